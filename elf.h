@@ -144,4 +144,88 @@ typedef struct {
 #define R_386_32   1
 #define R_386_PC32 2
 
+// ELF64 data types.
+typedef uint64_t Elf64_Addr;
+typedef uint64_t Elf64_Off;
+typedef uint64_t Elf64_Xword;
+typedef int64_t  Elf64_Sxword;
+typedef uint32_t Elf64_Word;
+typedef uint16_t Elf64_Half;
+
+// ELF64 header.
+typedef struct {
+  uint8_t     e_ident[EI_NIDENT];
+  Elf64_Half  e_type;
+  Elf64_Half  e_machine;
+  Elf64_Word  e_version;
+  Elf64_Addr  e_entry;
+  Elf64_Off   e_phoff;
+  Elf64_Off   e_shoff;
+  Elf64_Word  e_flags;
+  Elf64_Half  e_ehsize;
+  Elf64_Half  e_phentsize;
+  Elf64_Half  e_phnum;
+  Elf64_Half  e_shentsize;
+  Elf64_Half  e_shnum;
+  Elf64_Half  e_shstrndx;
+} Elf64_Header;
+
+// ELF64 program header.
+typedef struct {
+  Elf64_Word  p_type;
+  Elf64_Word  p_flags;
+  Elf64_Off   p_offset;
+  Elf64_Addr  p_vaddr;
+  Elf64_Addr  p_paddr;
+  Elf64_Xword p_filesz;
+  Elf64_Xword p_memsz;
+  Elf64_Xword p_align;
+} Elf64_Phdr;
+
+// ELF64 section header.
+typedef struct {
+  Elf64_Word  sh_name;
+  Elf64_Word  sh_type;
+  Elf64_Xword sh_flags;
+  Elf64_Addr  sh_addr;
+  Elf64_Off   sh_offset;
+  Elf64_Xword sh_size;
+  Elf64_Word  sh_link;
+  Elf64_Word  sh_info;
+  Elf64_Xword sh_addralign;
+  Elf64_Xword sh_entsize;
+} Elf64_Shdr;
+
+// ELF64 symbol
+typedef struct {
+  Elf64_Word    st_name;
+  unsigned char st_info;
+  unsigned char st_other;
+  Elf64_Half    st_shndx;
+  Elf64_Addr    st_value;
+  Elf64_Xword   st_size;
+} Elf64_Sym;
+
+// Macros to apply to st_info
+#define ELF64_ST_BIND(i)   ((i)>>4)
+#define ELF64_ST_TYPE(i)   ((i)&0xf)
+
+// ELF64 relocation entry with addend
+typedef struct {
+  Elf64_Addr   r_offset;
+  Elf64_Xword  r_info;
+  Elf64_Sxword r_addend;
+} Elf64_Rela;
+
+// Macros to apply to r_info
+#define ELF64_R_SYM(i)    ((i)>>32)
+#define ELF64_R_TYPE(i)   ((i)&0xffffffffL)
+
+// x86-64 R_TYPE values
+#define R_X86_64_64    1
+#define R_X86_64_PC32  2
+#define R_X86_64_PLT32 4
+#define R_X86_64_32    10
+#define R_X86_64_32S   11
+
 #endif /* _ELF_H_ */
@@ -1,13 +1,47 @@
 
+// for memfd_create
+#ifdef __linux__
+#define _GNU_SOURCE
+#endif
+
 #include <stdio.h>
 #include <stdlib.h>
 #include <stdint.h>
 #include <string.h>
 #include <ctype.h>
+#include <time.h>
 #include "elf.h"
 
+#ifdef __linux__
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+#endif
+
 FILE *input = NULL;
 
+// command line options
+uint8_t short_circuit = 0; // -fshort-circuit
+uint8_t peephole_enabled = 1; // -fno-peephole
+uint8_t peephole_stats = 0; // --peephole-stats
+uint8_t opt_level = 0; // -O<n>
+uint8_t emit_ir = 0; // --emit-ir
+uint8_t time_passes = 0; // --time-passes
+uint8_t unroll_loops = 0; // -funroll-loops
+uint8_t unroll_report = 0; // --unroll-report
+uint32_t inline_limit = 24; // -finline-limit=<n>
+uint8_t frame_report = 0; // --frame-report
+uint8_t reorder_functions = 1; // -fno-reorder-functions
+uint8_t function_order_report = 0; // --function-order-report
+uint8_t schedule_insns = 1; // -fno-schedule-insns
+uint8_t mtune = 0; // -mtune=<cpu>
+uint8_t target64 = 0; // -m64
+uint8_t run = 0; // --run, --run-batch
+uint8_t run_batch = 0; // --run-batch
+char *profile_generate = NULL; // -fprofile-generate[=<file>]
+char *profile_use = NULL; // -fprofile-use[=<file>]
+
 typedef enum {
   INT_LITERAL, SEMICOLON, EOF_, LPAREN, RPAREN, LCURLY, RCURLY,
   COMMA, LT, GT, LTE, GTE, EQ, EQUAL, NEQUAL, NOT, BIT_AND, BIT_OR,
@@ -246,6 +280,7 @@ typedef struct ast_node_s {
   ast_node_variant_t variant;
   int32_t i;
   char *s;
+  uint32_t *counts; // -fprofile-use counters of a function body, if or while
   struct ast_node_s *children;
   struct ast_node_s *next;
 } ast_node_t;
@@ -815,9 +850,12 @@ typedef struct symbol_s {
   struct symbol_s *parent;
 } symbol_t;
 
-// these numbers are completely arbitrary
-#define DATA_START 0x3000
-#define TEXT_START 0x4000
+// these numbers are completely arbitrary. programs built for --run are
+// moved up by RUN_BASE, since Linux maps nothing below vm.mmap_min_addr
+// (65536 by default)
+#define RUN_BASE 0x10000
+#define DATA_START (run ? RUN_BASE + 0x3000 : 0x3000)
+#define TEXT_START (run ? RUN_BASE + 0x4000 : 0x4000)
 
 uint8_t *text = NULL;
 uint32_t text_loc = 0;
@@ -887,6 +925,16 @@ symbol_type_t symbol_type_of_node_type(ast_node_t *v)
   return 0;
 }
 
+// pointers are 8 bytes in 64-bit code, and ints stay 4
+#define WORD_SIZE (target64 ? 8 : 4)
+
+uint32_t type_size(symbol_type_t type)
+{
+  if (type == tCHAR) return 1;
+  if (type == tINT || type == tVOID) return 4;
+  return WORD_SIZE;
+}
+
 uint32_t construct_symtab(
   ast_node_t *root, symbol_t *out, symbol_t *parent,
   uint32_t loc, uint32_t block_id
@@ -912,7 +960,8 @@ uint32_t construct_symtab(
 
     ast_node_t *argument_nodes = type_node->next;
     ast_node_t *current_arg = argument_nodes;
-    uint32_t arg_offset = 8; // 4 bytes for return address and 4 for old ebp
+    // a word for the return address and one for the old ebp
+    uint32_t arg_offset = 2 * WORD_SIZE;
     while (current_arg->type == nARGUMENT) {
       symbol_t arg_sym;
       arg_sym.name = current_arg->s;
@@ -922,24 +971,24 @@ uint32_t construct_symtab(
       arg_sym.child = NULL;
       arg_sym.parent = out;
       symtab_insert(sym.child, arg_sym);
-      arg_offset += 4;
+      arg_offset += WORD_SIZE;
       current_arg = current_arg->next;
     }
 
     if (current_arg->type == nSTMT && current_arg->variant == vEMPTY)
       sym.loc = -1;
 
+    // the frame is a whole number of words, so that %esp stays aligned
     uint32_t stack_size = construct_symtab(current_arg, sym.child, out, 0, 0);
     symtab_insert(out, sym);
-    return stack_size;
+    return (stack_size + WORD_SIZE - 1) & ~(WORD_SIZE - 1);
   }
 
   if (root->variant == vDECL) {
     symbol_t sym;
     sym.name = root->s;
     sym.type = symbol_type_of_node_type(root->children);
-    uint32_t size = 4;
-    if (sym.type == tCHAR) size = 1;
+    uint32_t size = type_size(sym.type);
     if (out == root_symtab) {
       sym.loc = data_loc;
       sym.loc_type = lDATA;
@@ -964,11 +1013,36 @@ uint32_t construct_symtab(
     sym.parent = parent;
     sym.loc_type = lSTACK;
 
-    ast_node_t *current_child = root->children;
+    // the variables declared in the block come first, largest first so that
+    // they stay aligned. the blocks nested in it are never live at the same
+    // time, so they all start after them and share the same slots
+    ast_node_t *current_child;
     uint32_t size = 0;
+    uint32_t sizes[3] = { 8, 4, 1 };
+    for (uint32_t pass = 0; pass < 3; ++pass) {
+      current_child = root->children;
+      while (current_child != NULL) {
+        ast_node_t *type = current_child->children;
+        if (
+          current_child->variant == vDECL
+          && type_size(symbol_type_of_node_type(type)) == sizes[pass]
+          )
+          size += construct_symtab(current_child, sym.child, out, loc + size, 0);
+        current_child = current_child->next;
+      }
+    }
+    size = (size + WORD_SIZE - 1) & ~(WORD_SIZE - 1);
+
+    uint32_t nested = 0;
     uint32_t bid = 0;
+    current_child = root->children;
     while (current_child != NULL) {
-      size += construct_symtab(current_child, sym.child, out, loc + size, bid);
+      if (current_child->variant != vDECL) {
+        uint32_t s = construct_symtab(
+          current_child, sym.child, out, loc + size, bid
+          );
+        if (s > nested) nested = s;
+      }
       if (current_child->variant == vBLOCK || current_child->variant == vWHILE)
         ++bid;
       if (current_child->variant == vIF) bid += 2;
@@ -977,22 +1051,357 @@ uint32_t construct_symtab(
 
     sym.loc = -(loc + size); // TODO make this the text offset of the block?
     symtab_insert(out, sym);
-    return size;
+    return size + nested;
   }
 
   if (root->variant == vWHILE)
     return construct_symtab(root->children->next, out, parent, loc, block_id);
 
+  // only one of the branches runs, so they share their slots
   if (root->variant == vIF) {
     uint32_t s = construct_symtab(root->children->next, out, parent, loc, block_id);
-    return s + construct_symtab(
-      root->children->next->next, out, parent, loc + s, block_id + 1
+    uint32_t e = construct_symtab(
+      root->children->next->next, out, parent, loc, block_id + 1
       );
+    return s > e ? s : e;
   }
 
   return 0;
 }
 
+// AST simplification, run between parse() and codegen(): folds operators whose
+// operands are constants, applies algebraic identities and prunes if/while
+// statements whose condition is constant. folding follows codegen's typing:
+// an operator on two chars produces a char, wrapping to 8 bits.
+
+// declared names visible at a point of the AST, innermost first
+typedef struct scope_s {
+  char *name;
+  symbol_type_t type;
+  uint8_t function;
+  struct scope_s *next;
+} scope_t;
+
+scope_t *scope_push(scope_t *scope, char *name, symbol_type_t type, uint8_t fn)
+{
+  scope_t *s = malloc(sizeof(scope_t));
+  *s = (scope_t) { .name = name, .type = type, .function = fn, .next = scope };
+  return s;
+}
+
+symbol_type_t pointer_to(symbol_type_t t)
+{
+  switch (t) {
+  case tINT: return tINT_PTR;
+  case tCHAR: return tCHAR_PTR;
+  case tVOID: return tVOID_PTR;
+  default: return tPTR_PTR;
+  }
+}
+
+// the type codegen_expr() returns for `expr`, if it can be known statically
+uint8_t static_type(ast_node_t *expr, scope_t *scope, symbol_type_t *out)
+{
+  symbol_type_t l, r;
+  switch (expr->variant) {
+  case vINT_LITERAL: *out = tINT; return 1;
+  case vCHAR_LITERAL: *out = tCHAR; return 1;
+  case vSTRING_LITERAL: *out = tCHAR_PTR; return 1;
+  case vNOT: *out = tCHAR; return 1;
+  case vLT: case vGT: case vEQUAL: case vAND: case vOR: case vASSIGN:
+    *out = tINT; return 1;
+  case vBIT_NOT: return static_type(expr->children, scope, out);
+
+  case vIDENT:
+    for (; scope != NULL; scope = scope->next) {
+      if (strcmp(scope->name, expr->s) != 0) continue;
+      *out = scope->type;
+      return 1;
+    }
+    return 0;
+
+  case vDEREF: case vINCREMENT: case vDECREMENT:
+    if (expr->variant != vDEREF && expr->children->variant == vIDENT)
+      return static_type(expr->children, scope, out);
+    if (expr->variant != vDEREF) expr = expr->children;
+    if (!static_type(expr->children, scope, &l)) return 0;
+    *out = l == tCHAR_PTR ? tCHAR : tINT;
+    return 1;
+
+  case vADDRESSOF:
+    if (expr->children->variant == vDEREF)
+      return static_type(expr->children->children, scope, out);
+    if (!static_type(expr->children, scope, &l)) return 0;
+    for (; scope != NULL; scope = scope->next)
+      if (strcmp(scope->name, expr->children->s) == 0) break;
+    *out = scope->function ? l : pointer_to(l);
+    return 1;
+
+  case vCALL: return static_type(expr->children, scope, out);
+
+  default:
+    if (!static_type(expr->children, scope, &l)) return 0;
+    if (!static_type(expr->children->next, scope, &r)) return 0;
+    *out = l == tCHAR ? r : l;
+    return 1;
+  }
+}
+
+// whether evaluating `expr` has no side effects
+uint8_t expr_pure(ast_node_t *expr)
+{
+  switch (expr->variant) {
+  case vCALL: case vASSIGN: case vINCREMENT: case vDECREMENT: return 0;
+  case vIDENT: case vINT_LITERAL: case vCHAR_LITERAL: case vSTRING_LITERAL:
+    return 1;
+  default: ;
+  }
+  for (ast_node_t *c = expr->children; c != NULL; c = c->next)
+    if (!expr_pure(c)) return 0;
+  return 1;
+}
+
+// whether `a` and `b` are the same expression
+uint8_t expr_equal(ast_node_t *a, ast_node_t *b)
+{
+  if (a->variant != b->variant || a->i != b->i) return 0;
+  if ((a->s == NULL) != (b->s == NULL)) return 0;
+  if (a->s != NULL && strcmp(a->s, b->s) != 0) return 0;
+  ast_node_t *ca = a->children, *cb = b->children;
+  for (; ca != NULL && cb != NULL; ca = ca->next, cb = cb->next)
+    if (!expr_equal(ca, cb)) return 0;
+  return ca == NULL && cb == NULL;
+}
+
+uint8_t is_literal(ast_node_t *expr)
+{
+  return expr->variant == vINT_LITERAL || expr->variant == vCHAR_LITERAL;
+}
+
+// overwrites `expr` with `with`, keeping its place in its sibling list
+void replace_expr(ast_node_t *expr, ast_node_t *with)
+{
+  ast_node_t *next = expr->next;
+  *expr = *with;
+  expr->next = next;
+}
+
+// turns `expr` into a literal of type `type` (tINT or tCHAR) with value `v`
+void make_literal(ast_node_t *expr, symbol_type_t type, int32_t v)
+{
+  expr->variant = type == tCHAR ? vCHAR_LITERAL : vINT_LITERAL;
+  expr->i = type == tCHAR ? (int8_t) v : v;
+  expr->s = NULL;
+  expr->children = NULL;
+}
+
+// computes `l <op> r` for constant operands. returns 0 if it cannot be done
+// at compile time (division by zero or overflow, which trap at runtime)
+uint8_t fold_binary(ast_node_variant_t op, int32_t l, int32_t r, int32_t *out)
+{
+  uint32_t ul = l, ur = r;
+  switch (op) {
+  case vADD: *out = ul + ur; return 1;
+  case vSUBTRACT: *out = ul - ur; return 1;
+  case vMULTIPLY: *out = ul * ur; return 1;
+  case vDIVIDE: case vMODULO:
+    if (r == 0 || (l == INT32_MIN && r == -1)) return 0;
+    *out = op == vDIVIDE ? l / r : l % r;
+    return 1;
+  case vBIT_AND: *out = l & r; return 1;
+  case vBIT_OR: *out = l | r; return 1;
+  case vBIT_XOR: *out = l ^ r; return 1;
+  case vLT: *out = l < r; return 1;
+  case vGT: *out = l > r; return 1;
+  case vEQUAL: *out = l == r; return 1;
+  case vAND: *out = l && r; return 1;
+  case vOR: *out = l || r; return 1;
+  default: return 0;
+  }
+}
+
+void simplify_expr(ast_node_t *expr, scope_t *scope)
+{
+  if (expr->type != nEXPR) return;
+  for (ast_node_t *c = expr->children; c != NULL; c = c->next)
+    simplify_expr(c, scope);
+
+  symbol_type_t type;
+  uint8_t typed = static_type(expr, scope, &type);
+  ast_node_t *left = expr->children;
+
+  if (expr->variant == vNOT || expr->variant == vBIT_NOT) {
+    if (!is_literal(left)) return;
+    if (expr->variant == vNOT) make_literal(expr, tCHAR, !left->i);
+    else make_literal(expr, type, ~left->i);
+    return;
+  }
+
+  switch (expr->variant) {
+  case vADD: case vSUBTRACT: case vMULTIPLY: case vDIVIDE: case vMODULO:
+  case vBIT_AND: case vBIT_OR: case vBIT_XOR:
+  case vLT: case vGT: case vEQUAL: case vAND: case vOR:
+    break;
+  default: return;
+  }
+
+  ast_node_t *right = left->next;
+  int32_t v;
+  if (is_literal(left) && is_literal(right)) {
+    if (fold_binary(expr->variant, left->i, right->i, &v))
+      make_literal(expr, type, v);
+    return;
+  }
+
+  // identities. the result has to keep the type of the original expression,
+  // which decides between byte and 32-bit operations further up
+  symbol_type_t t;
+  ast_node_t *x = NULL;
+  uint8_t zero = 0;
+  int32_t r = is_literal(right) ? right->i : 1 << 16;
+  int32_t l = is_literal(left) ? left->i : 1 << 16;
+  uint8_t same = expr_pure(left) && expr_equal(left, right);
+
+  switch (expr->variant) {
+  case vADD: case vBIT_OR: case vBIT_XOR:
+    if (r == 0) x = left;
+    else if (l == 0) x = right;
+    else if (expr->variant == vBIT_XOR && same) zero = 1;
+    else if (expr->variant == vBIT_OR && same) x = left;
+    break;
+  case vSUBTRACT:
+    if (r == 0) x = left;
+    else if (same) zero = 1;
+    break;
+  case vMULTIPLY:
+    if (r == 1) x = left;
+    else if (l == 1) x = right;
+    else if (r == 0 && expr_pure(left)) zero = 1;
+    else if (l == 0 && expr_pure(right)) zero = 1;
+    break;
+  case vDIVIDE:
+    if (r == 1) x = left;
+    break;
+  case vMODULO:
+    if ((r == 1 || r == -1) && expr_pure(left)) zero = 1;
+    break;
+  case vBIT_AND:
+    if (same) x = left;
+    else if (r == 0 && expr_pure(left)) zero = 1;
+    else if (l == 0 && expr_pure(right)) zero = 1;
+    break;
+  case vLT: case vGT: case vEQUAL:
+    if (same) make_literal(expr, tINT, expr->variant == vEQUAL);
+    return;
+  case vAND:
+    // with -fshort-circuit the right side of 0 && x is never evaluated
+    if (
+      (r == 0 && expr_pure(left))
+      || (l == 0 && (short_circuit || expr_pure(right)))
+      )
+      make_literal(expr, tINT, 0);
+    return;
+  case vOR:
+    if (
+      (is_literal(right) && r != 0 && expr_pure(left))
+      || (is_literal(left) && l != 0 && (short_circuit || expr_pure(right)))
+      )
+      make_literal(expr, tINT, 1);
+    return;
+  default: return;
+  }
+
+  if (!typed) return;
+  if (zero && (type == tINT || type == tCHAR)) make_literal(expr, type, 0);
+  else if (x != NULL && static_type(x, scope, &t) && t == type)
+    replace_expr(expr, x);
+}
+
+// simplifies a condition, where only whether the value is 0 matters
+void simplify_cond(ast_node_t *cond, scope_t *scope)
+{
+  simplify_expr(cond, scope);
+
+  // !!x -> x, unless x is a char: the upper bits of a char value are not
+  // meaningful, so its truth value has to be tested with a byte test
+  symbol_type_t t;
+  while (
+    cond->variant == vNOT && cond->children->variant == vNOT
+    && static_type(cond->children->children, scope, &t) && t != tCHAR
+    )
+    replace_expr(cond, cond->children->children);
+}
+
+// returns the scope after `stmt`, which includes any variable it declares
+scope_t *simplify_stmt(ast_node_t *stmt, scope_t *scope)
+{
+  if (stmt->variant == vDECL)
+    return scope_push(scope, stmt->s, symbol_type_of_node_type(stmt->children), 0);
+
+  if (stmt->variant == vEXPR || stmt->variant == vRETURN) {
+    if (stmt->children != NULL) simplify_expr(stmt->children, scope);
+    if (stmt->variant == vEXPR && is_literal(stmt->children)) {
+      stmt->variant = vEMPTY;
+      stmt->children = NULL;
+    }
+  }
+
+  if (stmt->variant == vBLOCK) {
+    scope_t *inner = scope;
+    for (ast_node_t *c = stmt->children; c != NULL; c = c->next)
+      inner = simplify_stmt(c, inner);
+  }
+
+  if (stmt->variant == vIF) {
+    ast_node_t *cond = stmt->children;
+    simplify_cond(cond, scope);
+    simplify_stmt(cond->next, scope);
+    simplify_stmt(cond->next->next, scope);
+
+    // keep only the branch that is taken
+    if (is_literal(cond)) {
+      ast_node_t *next = stmt->next;
+      *stmt = cond->i ? *(cond->next) : *(cond->next->next);
+      stmt->next = next;
+    }
+  }
+
+  if (stmt->variant == vWHILE) {
+    ast_node_t *cond = stmt->children;
+    simplify_cond(cond, scope);
+    simplify_stmt(cond->next, scope);
+
+    // a loop that never runs
+    if (is_literal(cond) && cond->i == 0) {
+      stmt->variant = vEMPTY;
+      stmt->children = NULL;
+    }
+  }
+
+  return scope;
+}
+
+void simplify(ast_node_t *ast)
+{
+  scope_t *globals = NULL;
+  for (ast_node_t *current = ast; current != NULL; current = current->next) {
+    ast_node_t *type_node = current->children;
+    globals = scope_push(
+      globals, current->s, symbol_type_of_node_type(type_node),
+      current->type == nFUNCTION
+      );
+    if (current->type != nFUNCTION) continue;
+
+    scope_t *scope = globals;
+    ast_node_t *child = type_node->next;
+    for (; child->type == nARGUMENT; child = child->next)
+      scope = scope_push(
+        scope, child->s, symbol_type_of_node_type(child->children), 0
+        );
+    simplify_stmt(child, scope);
+  }
+}
+
 void write_text(uint8_t *b, uint32_t n)
 {
   if (text == NULL || text_loc + n >= text_cap) {
@@ -1014,8 +1423,9 @@ void write_data(uint8_t *b, uint32_t n)
   data_loc += n;
 }
 
+// rIMM64 only comes from 64-bit object files
 typedef enum {
-  rMOV_EAX, rOFFSET, rIMM
+  rMOV_EAX, rOFFSET, rIMM, rIMM64
 } relocation_type_t;
 
 typedef struct relocation_s {
@@ -1023,6 +1433,8 @@ typedef struct relocation_s {
   char *name;
   symbol_t *symtab;
   relocation_type_t type;
+  int32_t addend; // -4 for the rel32 of nanoc's calls and jumps, or 0
+  uint32_t weight; // how often the call at `addr` ran, for ordering functions
   struct relocation_s *next;
 } relocation_t;
 
@@ -1032,862 +1444,9073 @@ void add_relocation(uint32_t addr, char *name, symbol_t *symtab, relocation_type
 {
   relocation_t *r = malloc(sizeof(relocation_t));
   *r = (relocation_t) {
-    .addr = addr, .name = name, .symtab = symtab, .type = t, .next = relocs
+    .addr = addr, .name = name, .symtab = symtab, .type = t,
+    .addend = t == rOFFSET ? -4 : 0, .weight = 1, .next = relocs
   };
   relocs = r;
 }
 
-uint32_t codegen_argument(ast_node_t *arg, symbol_t *symtab);
+// %r8 to %r15 only exist in 64-bit code
+typedef enum {
+  EAX, ECX, EDX, EBX, ESP, EBP, ESI, EDI, R8, R9, R10, R11, R12, R13, R14, R15
+} reg_t;
 
-symbol_type_t codegen_expr(ast_node_t *expr, symbol_t *symtab)
+typedef enum {
+  oREG, oIMM, oMEM, oABS
+} operand_type_t;
+
+// an instruction operand:
+//   oREG: register `reg`
+//   oIMM: immediate `val`
+//   oMEM: memory at `val`(%reg), or `val`(%reg,%index,scale) if `scale` is
+//         nonzero
+//   oABS: memory at absolute address `val`
+typedef struct operand_s {
+  operand_type_t type;
+  reg_t reg;
+  uint32_t val;
+  reg_t index;
+  uint8_t scale;
+} operand_t;
+
+// x86 encoder: every instruction nanoc emits goes through one of the emit_*
+// functions below, which pick the shortest valid encoding for their operands.
+// in 64-bit code (-m64) the instructions that are not byte-sized work on
+// whole 64-bit registers, unless `wide` is cleared for a 32-bit memory access
+// or a sequence that relies on 32-bit arithmetic
+uint8_t wide = 1;
+
+// REX prefix, when 64-bit code needs one: for a 64-bit operand size unless
+// `byte`, for %r8 to %r15 as `reg` or in `rm`, and for byte accesses to
+// %spl to %dil, which are %ah to %bh without one
+void write_rex(uint8_t byte, uint8_t reg, operand_t rm)
 {
-  if (expr->variant == vINT_LITERAL || expr->variant == vCHAR_LITERAL) {
-    // for int literal:
-    //   movl <imm>, %eax
-    // for char literal:
-    //   movb <imm>, %al
-
-    uint8_t tmp = 0xb0;
-    uint32_t size = 1;
-    if (expr->variant == vINT_LITERAL) { tmp = 0xb8; size = 4; }
-    write_text(&tmp, 1);
-    uint32_t imm = expr->i;
-    for (uint32_t i = 0; i < size; ++i) {
-      uint8_t tmp = imm & 0xff;
-      write_text(&tmp, 1);
-      imm >>= 8;
-    }
-    if (expr->variant == vINT_LITERAL) return tINT;
-    return tCHAR;
-  }
-
-  if (expr->variant == vIDENT) {
-    symbol_t *sym = symtab_get(symtab, expr->s);
-    if (sym == NULL) {
-      printf("Undefined symbol %s\n", expr->s);
-      exit(1);
-    }
-    if (sym->loc == (uint32_t) -1) {
-      add_relocation(text_loc, expr->s, symtab, rMOV_EAX);
-      text_loc += 5;
-      goto global_ident;
-    }
+  if (!target64) return;
+  uint8_t rex = 0x40;
+  if (!byte && wide) rex |= 8;
+  if (reg & 8) rex |= 4;
+  if ((rm.type == oREG || rm.type == oMEM) && (rm.reg & 8)) rex |= 1;
+  if (rm.type == oMEM && rm.scale && (rm.index & 8)) rex |= 2;
+  uint8_t high = byte && (
+    (reg >= ESP && reg <= EDI)
+    || (rm.type == oREG && rm.reg >= ESP && rm.reg <= EDI)
+    );
+  if (rex != 0x40 || high) write_text(&rex, 1);
+}
 
-    if (sym->loc_type == lSTACK) {
-      // movl x(%ebp), %eax
-      uint8_t tmp[2] = { 0x8b, 0x85 };
-      if (sym->type == tCHAR) tmp[0] = 0x8a;
-      write_text(tmp, 2);
-      uint32_t off = sym->loc;
-      for (uint32_t i = 0; i < 4; ++i) {
-        uint8_t tmp0 = off;
-        write_text(&tmp0, 1);
-        off >>= 8;
-      }
-      return sym->type;
-    }
+// REX prefix for an opcode that encodes register `r` in its low bits
+void write_rex_reg(uint8_t byte, reg_t r)
+{
+  write_rex(byte, 0, (operand_t) { .type = oREG, .reg = r });
+}
 
-    // movl addr, %eax
-    uint32_t addr = DATA_START + sym->loc;
-    if (sym->loc_type == lTEXT) addr = TEXT_START + sym->loc;
-    uint8_t tmp = 0xb8;
-    write_text(&tmp, 1);
-    for (uint32_t i = 0; i < 4; ++i) {
-      uint8_t tmp = addr & 0xff;
-      write_text(&tmp, 1);
-      addr >>= 8;
-    }
+uint8_t fits_imm8(uint32_t v)
+{
+  return (int32_t) v >= -128 && (int32_t) v <= 127;
+}
 
-  global_ident:
-    // assume all symbols in .text are function pointers
-    // so do not dereference
-    if (sym->loc_type == lTEXT) return sym->type;
+void write_imm8(uint32_t imm)
+{
+  uint8_t tmp = imm & 0xff;
+  write_text(&tmp, 1);
+}
 
-    // for int:
-    //   movl (%eax), %eax
-    // for char:
-    //   movb (%eax), %al
-    uint8_t tmp2[2] = { 0x8b, 0 };
-    if (sym->type == tCHAR) tmp2[0] = 0x8a;
-    write_text(tmp2, 2);
-    return sym->type;
+void write_imm32(uint32_t imm)
+{
+  for (uint32_t i = 0; i < 4; ++i) {
+    uint8_t tmp = imm & 0xff;
+    write_text(&tmp, 1);
+    imm >>= 8;
   }
+}
 
-  if (expr->variant == vSTRING_LITERAL) {
-    // write to data section
-    uint32_t addr = DATA_START + data_loc;
-    uint32_t len = strlen(expr->s);
-    write_data((uint8_t *)(expr->s), len + 1);
-
-    // movl addr, %eax
-    uint8_t tmp = 0xb8;
+// ModR/M byte (plus SIB and displacement) for `reg` and the r/m operand `rm`.
+// memory operands get no displacement, a disp8 or a disp32 depending on the
+// smallest one that holds the offset
+void write_modrm(uint8_t reg, operand_t rm)
+{
+  uint8_t tmp;
+  reg &= 7;
+  if (rm.type == oREG) {
+    tmp = 0xc0 | (reg << 3) | (rm.reg & 7);
     write_text(&tmp, 1);
-    for (uint32_t i = 0; i < 4; ++i) {
-      uint8_t tmp = addr & 0xff;
-      write_text(&tmp, 1);
-      addr >>= 8;
-    }
-
-    return tCHAR_PTR;
+    return;
   }
-
-  if (expr->variant == vDEREF) {
-    // for now, we do not bother returning the correct expression type
-    // for more than one level of indirection because nanoc treats all pointer
-    // arithmetic as being performed on char* / int
-
-    // for int:
-    //   movl (%eax), %eax
-    // for char:
-    //   movb (%eax), %al
-    symbol_type_t ptr_type = codegen_expr(expr->children, symtab);
-    uint8_t tmp2[2] = { 0x8b, 0 };
-    if (ptr_type == tCHAR_PTR) tmp2[0] = 0x8a;
-    write_text(tmp2, 2);
-    if (ptr_type == tCHAR_PTR) return tCHAR;
-    return tINT;
+  if (rm.type == oABS) {
+    // disp32 alone is relative to %rip in 64-bit code, so absolute addresses
+    // take a SIB byte with neither base nor index there
+    tmp = (target64 ? 0x04 : 0x05) | (reg << 3);
+    write_text(&tmp, 1);
+    if (target64) { tmp = 0x25; write_text(&tmp, 1); }
+    write_imm32(rm.val);
+    return;
   }
 
-  if (expr->variant == vADDRESSOF) {
-    ast_node_t *child = expr->children;
-    if (child->variant != vDEREF && child->variant != vIDENT) {
-      printf("Invalid operand for 'address of' operator\n");
-      exit(1);
-    }
-    if (child->variant == vDEREF)
-      return codegen_expr(child->children, symtab);
+  // (%ebp) has no disp-less encoding, and neither has (%r13)
+  uint8_t mod = 0x80;
+  if (rm.val == 0 && (rm.reg & 7) != EBP) mod = 0;
+  else if (fits_imm8(rm.val)) mod = 0x40;
+  if (rm.scale) {
+    tmp = mod | (reg << 3) | 0x04;
+    write_text(&tmp, 1);
+    uint8_t ss = rm.scale == 8 ? 3 : rm.scale == 4 ? 2 : rm.scale - 1;
+    tmp = (ss << 6) | ((rm.index & 7) << 3) | (rm.reg & 7);
+    write_text(&tmp, 1);
+  } else {
+    tmp = mod | (reg << 3) | (rm.reg & 7);
+    write_text(&tmp, 1);
+    if ((rm.reg & 7) == ESP) { tmp = 0x24; write_text(&tmp, 1); }
+  }
+  if (mod == 0x40) write_imm8(rm.val);
+  else if (mod == 0x80) write_imm32(rm.val);
+}
 
-    symbol_t *sym = symtab_get(symtab, child->s);
-    if (sym == NULL) {
-      printf("Undefined symbol %s\n", expr->s);
-      exit(1);
-    }
-    if (sym->loc == (uint32_t) -1) {
-      add_relocation(text_loc, child->s, symtab, rMOV_EAX);
-      text_loc += 5;
-      return sym->type;
-    }
+// ALU operations in the order of their x86 opcode extension (/digit)
+typedef enum {
+  aADD, aOR, aADC, aSBB, aAND, aSUB, aXOR, aCMP
+} alu_op_t;
 
-    if (sym->loc_type == lSTACK) {
-      // movl %ebp, %eax
-      uint8_t tmp[2] = { 0x89, 0xe8 };
-      write_text(tmp, 2);
-
-      // addl offset, %eax
-      tmp[0] = 0x05;
-      write_text(tmp, 1);
-      uint32_t off = sym->loc;
-      for (uint32_t i = 0; i < 4; ++i) {
-        uint8_t tmp = off & 0xff;
+// <op>l/<op>b src, %dst
+void emit_alu(alu_op_t op, reg_t dst, operand_t src, uint8_t byte)
+{
+  uint8_t tmp;
+  operand_t rd = { .type = oREG, .reg = dst };
+  if (src.type == oIMM) {
+    write_rex(byte, 0, rd);
+    if (byte || fits_imm8(src.val)) {
+      if (byte && dst == EAX) {
+        // <op>b $imm8, %al
+        tmp = (op << 3) | 0x04;
         write_text(&tmp, 1);
-        off >>= 8;
-      }
-      switch (sym->type) {
-      case tINT: return tINT_PTR;
-      case tCHAR: return tCHAR_PTR;
-      case tVOID: return tVOID_PTR;
-      default: return tPTR_PTR;
+      } else {
+        tmp = byte ? 0x80 : 0x83;
+        write_text(&tmp, 1);
+        write_modrm(op, (operand_t) { .type = oREG, .reg = dst });
       }
+      write_imm8(src.val);
+      return;
     }
-
-    // movl addr, %eax
-    uint32_t addr = DATA_START + sym->loc;
-    if (sym->loc_type == lTEXT) addr = TEXT_START + sym->loc;
-    uint8_t tmp = 0xb8;
-    write_text(&tmp, 1);
-    for (uint32_t i = 0; i < 4; ++i) {
-      uint8_t tmp = addr & 0xff;
+    if (dst == EAX) {
+      // <op>l $imm32, %eax
+      tmp = (op << 3) | 0x05;
+      write_text(&tmp, 1);
+    } else {
+      tmp = 0x81;
       write_text(&tmp, 1);
-      addr >>= 8;
+      write_modrm(op, (operand_t) { .type = oREG, .reg = dst });
     }
+    write_imm32(src.val);
+    return;
+  }
+  write_rex(byte, dst, src);
+  tmp = (op << 3) | (byte ? 0x02 : 0x03);
+  write_text(&tmp, 1);
+  write_modrm(dst, src);
+}
 
-    if (sym->loc_type == lTEXT) return sym->type;
-    switch (sym->type) {
-    case tINT: return tINT_PTR;
-    case tCHAR: return tCHAR_PTR;
-    case tVOID: return tVOID_PTR;
-    default: return tPTR_PTR;
+// movl/movb src, %dst
+// loading an immediate 0 clobbers the flags since it is done with
+// xorl %dst, %dst
+void emit_load(reg_t dst, operand_t src, uint8_t byte)
+{
+  uint8_t tmp;
+  if (src.type == oIMM) {
+    if (src.val == 0 || (byte && (src.val & 0xff) == 0)) {
+      emit_alu(aXOR, dst, (operand_t) { .type = oREG, .reg = dst }, 0);
+      return;
+    }
+    if (target64 && wide && !byte && (int32_t) src.val < 0) {
+      // movq $imm32, %dst            (sign-extended)
+      write_rex(0, 0, (operand_t) { .type = oREG, .reg = dst });
+      tmp = 0xc7;
+      write_text(&tmp, 1);
+      write_modrm(0, (operand_t) { .type = oREG, .reg = dst });
+      write_imm32(src.val);
+      return;
     }
+    // movl $imm32, %dst clears the upper half of 64-bit registers
+    uint8_t saved = wide;
+    wide = 0;
+    write_rex_reg(byte, dst);
+    wide = saved;
+    tmp = (byte ? 0xb0 : 0xb8) + (dst & 7);
+    write_text(&tmp, 1);
+    if (byte) write_imm8(src.val);
+    else write_imm32(src.val);
+    return;
   }
+  // the moffs forms take a 64-bit address in 64-bit code
+  if (src.type == oABS && dst == EAX && !target64) {
+    // movl/movb moffs32, %eax/%al
+    tmp = byte ? 0xa0 : 0xa1;
+    write_text(&tmp, 1);
+    write_imm32(src.val);
+    return;
+  }
+  write_rex(byte, dst, src);
+  tmp = byte ? 0x8a : 0x8b;
+  write_text(&tmp, 1);
+  write_modrm(dst, src);
+}
 
-  if (expr->variant == vINCREMENT || expr->variant == vDECREMENT) {
-    ast_node_t *lval = malloc(sizeof(ast_node_t));
-    memset(lval, 0, sizeof(ast_node_t));
-    lval->type = nEXPR;
-    lval->variant = vADDRESSOF;
-    lval->children = expr->children;
-    codegen_expr(lval, symtab);
-
-    // pushl %eax
-    uint8_t tmp0 = 0x50; write_text(&tmp0, 1);
+// movl/movb %src, dst
+void emit_store(operand_t dst, reg_t src, uint8_t byte)
+{
+  uint8_t tmp;
+  if (dst.type == oABS && src == EAX && !target64) {
+    // movl/movb %eax/%al, moffs32
+    tmp = byte ? 0xa2 : 0xa3;
+    write_text(&tmp, 1);
+    write_imm32(dst.val);
+    return;
+  }
+  write_rex(byte, src, dst);
+  tmp = byte ? 0x88 : 0x89;
+  write_text(&tmp, 1);
+  write_modrm(src, dst);
+}
 
-    symbol_type_t child_type = codegen_expr(expr->children, symtab);
-    uint8_t tmp[2] = { 0x40, 0 };
-    if (expr->variant == vINCREMENT && child_type != tCHAR)
-      write_text(tmp, 1);                               // incl %eax
-    else if (expr->variant == vDECREMENT && child_type != tCHAR) {
-      tmp[0] = 0x48; write_text(tmp, 1);                // decl %eax
-    } else if (expr->variant == vINCREMENT && child_type == tCHAR) {
-      tmp[0] = 0xfe; tmp[1] = 0xc0; write_text(tmp, 2); // incb %al
-    } else {
-      tmp[0] = 0xfe; tmp[1] = 0xc8; write_text(tmp, 2); // decb %al
-    }
+// leal src, %dst
+void emit_lea(reg_t dst, operand_t src)
+{
+  write_rex(0, dst, src);
+  uint8_t tmp = 0x8d;
+  write_text(&tmp, 1);
+  write_modrm(dst, src);
+}
 
-    // popl %ecx
-    // movl %eax, (%ecx)
-    tmp0 = 0x59; write_text(&tmp0, 1);
-    tmp[0] = 0x89; tmp[1] = 0x01;
-    write_text(tmp, 2);
-    return child_type;
+// xchgl %a, %b
+void emit_xchg(reg_t a, reg_t b)
+{
+  uint8_t tmp;
+  if (a == EAX || b == EAX) {
+    write_rex_reg(0, a == EAX ? b : a);
+    tmp = 0x90 + ((a == EAX ? b : a) & 7);
+    write_text(&tmp, 1);
+    return;
   }
+  write_rex(0, a, (operand_t) { .type = oREG, .reg = b });
+  tmp = 0x87;
+  write_text(&tmp, 1);
+  write_modrm(a, (operand_t) { .type = oREG, .reg = b });
+}
 
-  if (expr->variant == vNOT) {
-    symbol_type_t child_type = codegen_expr(expr->children, symtab);
+// testl/testb %a, %b
+void emit_test(reg_t a, reg_t b, uint8_t byte)
+{
+  write_rex(byte, a, (operand_t) { .type = oREG, .reg = b });
+  uint8_t tmp = byte ? 0x84 : 0x85;
+  write_text(&tmp, 1);
+  write_modrm(a, (operand_t) { .type = oREG, .reg = b });
+}
 
-    // xorl %ecx, %ecx
-    // test %eax, %eax
-    // sete %cl
-    // movl %ecx, %eax
-    uint8_t tmp[9] = { 0x31, 0xc9, 0x85, 0xc0, 0x0f, 0x94, 0xc1, 0x89, 0xc8 };
-    // testb %al, %al instead of test %eax, %eax
-    if (child_type == tCHAR) tmp[2] = 0x84;
-    write_text(tmp, 9);
-    return tCHAR;
+// group 3 unary operations, by opcode extension
+typedef enum {
+  uNOT = 2, uNEG, uMUL, uIMUL, uDIV, uIDIV
+} unary_op_t;
+
+// <op>l/<op>b o
+void emit_unary(unary_op_t op, operand_t o, uint8_t byte)
+{
+  write_rex(byte, 0, o);
+  uint8_t tmp = byte ? 0xf6 : 0xf7;
+  write_text(&tmp, 1);
+  write_modrm(op, o);
+}
+
+// incl/decl/incb/decb o
+void emit_incdec(uint8_t dec, operand_t o, uint8_t byte)
+{
+  uint8_t tmp;
+  // 0x40 to 0x4f are REX prefixes in 64-bit code
+  if (o.type == oREG && !byte && !target64) {
+    tmp = (dec ? 0x48 : 0x40) + o.reg;
+    write_text(&tmp, 1);
+    return;
   }
+  write_rex(byte, 0, o);
+  tmp = byte ? 0xfe : 0xff;
+  write_text(&tmp, 1);
+  write_modrm(dec, o);
+}
 
-  if (expr->variant == vBIT_NOT) {
-    symbol_type_t child_type = codegen_expr(expr->children, symtab);
-    // notl %eax
-    uint8_t tmp[2] = { 0xf7, 0xd0 };
-    write_text(tmp, 2);
-    return child_type;
+// imull src, %dst
+void emit_imul(reg_t dst, operand_t src)
+{
+  uint8_t tmp[2] = { 0x0f, 0xaf };
+  operand_t rd = { .type = oREG, .reg = dst };
+  write_rex(0, dst, src.type == oIMM ? rd : src);
+  if (src.type == oIMM) {
+    // imull $imm, %dst, %dst
+    tmp[0] = fits_imm8(src.val) ? 0x6b : 0x69;
+    write_text(tmp, 1);
+    write_modrm(dst, rd);
+    if (tmp[0] == 0x6b) write_imm8(src.val);
+    else write_imm32(src.val);
+    return;
   }
+  write_text(tmp, 2);
+  write_modrm(dst, src);
+}
 
-  if (
-    expr->variant == vADD || expr->variant == vSUBTRACT
-    || expr->variant == vMULTIPLY || expr->variant == vDIVIDE
-    || expr->variant == vMODULO || expr->variant == vBIT_AND
-    || expr->variant == vBIT_OR || expr->variant == vBIT_XOR
-    ) {
-    symbol_type_t right_type = codegen_expr(expr->children->next, symtab);
-    // pushl %eax
-    uint8_t tmp = 0x50; write_text(&tmp, 1);
-    symbol_type_t left_type = codegen_expr(expr->children, symtab);
-    // popl %ecx
-    // <op> %ecx, %eax
-    tmp = 0x59; write_text(&tmp, 1);
-    uint8_t tmp1[3] = { 0x01, 0xc8, 0 };
-    uint32_t len = 2;
-    if (expr->variant == vADD) {
-      if (left_type == tCHAR && right_type == tCHAR)
-        tmp1[0] = 0; // addb %cl, %al instead of addl %ecx, %eax
-    } else if (expr->variant == vSUBTRACT) {
-      tmp1[0] = 0x29; // subl/subb %ecx, %eax
-      if (left_type == tCHAR && right_type == tCHAR) tmp1[0] = 0x28;
-    } else if (expr->variant == vMULTIPLY) {
-      tmp1[0] = 0x0f; tmp1[1] = 0xaf; tmp1[2] = 0xc1; // imull %ecx, %eax
-      len = 3;
-      // TODO figure out how to multiply bytes
-    } else if (expr->variant == vDIVIDE) {
-      tmp1[0] = 0xf7; tmp1[1] = 0xf9; // idivl/idivb %ecx
-      if (left_type == tCHAR && right_type == tCHAR) tmp1[0] = 0xf6;
-    } else if (expr->variant == vMODULO) {
-      tmp1[0] = 0xf7; tmp1[1] = 0xf9; // idivl/idivb %ecx
-      if (left_type == tCHAR && right_type == tCHAR) tmp1[0] = 0xf6;
-      write_text(tmp1, 2);
-      tmp1[0] = 0x89; tmp1[1] = 0xd0; // movl/movb %edx, %eax
-      if (left_type == tCHAR && right_type == tCHAR) tmp1[0] = 0x88;
-    } else if (expr->variant == vBIT_AND) {
-      tmp1[0] = 0x21; tmp1[1] = 0xc8; // andl/andb %ecx, %eax
-      if (left_type == tCHAR && right_type == tCHAR) tmp1[0] = 0x20;
-    } else if (expr->variant == vBIT_OR) {
-      tmp1[0] = 0x09; tmp1[1] = 0xc8; // orl/orb %ecx, %eax
-      if (left_type == tCHAR && right_type == tCHAR) tmp1[0] = 0x08;
-    } else if (expr->variant == vBIT_XOR) {
-      tmp1[0] = 0x31; tmp1[1] = 0xc8; // orl/orb %ecx, %eax
-      if (left_type == tCHAR && right_type == tCHAR) tmp1[0] = 0x30;
-    }
-    write_text(tmp1, len);
-    if (left_type == tCHAR) return right_type;
-    return left_type;
+// group 2 shifts, by opcode extension
+typedef enum {
+  sSHL = 4, sSHR, sSAR = 7
+} shift_op_t;
+
+// <op>l $n, %r
+void emit_shift(shift_op_t op, reg_t r, uint8_t n)
+{
+  write_rex_reg(0, r);
+  uint8_t tmp = n == 1 ? 0xd1 : 0xc1;
+  write_text(&tmp, 1);
+  write_modrm(op, (operand_t) { .type = oREG, .reg = r });
+  if (n != 1) write_text(&n, 1);
+}
+
+// movl $<name>, %dst
+// for a symbol that is not defined yet: relocate() fills in its address
+void emit_load_symbol(reg_t dst, char *name, symbol_t *symtab)
+{
+  uint8_t tmp[5] = { 0xb8 + (dst & 7), 0, 0, 0, 0 };
+  if (dst & 8) {
+    uint8_t rex = 0x41;
+    write_text(&rex, 1);
   }
+  if (dst == EAX) add_relocation(text_loc, name, symtab, rMOV_EAX);
+  else add_relocation(text_loc + 1, name, symtab, rIMM);
+  write_text(tmp, 5);
+}
 
-  if (expr->variant == vLT || expr->variant == vGT || expr->variant == vEQUAL) {
-    symbol_type_t right_type = codegen_expr(expr->children->next, symtab);
-    // pushl %eax
-    uint8_t tmp = 0x50; write_text(&tmp, 1);
-    symbol_type_t left_type = codegen_expr(expr->children, symtab);
-    // popl %ecx
-    // cmpl/cmpb %ecx, %eax
-    // setl/setg/sete %al
-    // movzbl %al, %eax
-    uint8_t tmp1[9] = { 0x59, 0x39, 0xc8, 0x0f, 0x9c, 0xc0, 0x0f, 0xb6, 0xc0 };
-    if (left_type == tCHAR && right_type == tCHAR) tmp1[1] = 0x38;
-    if (expr->variant == vGT) tmp1[4] = 0x9f;
-    else if (expr->variant == vEQUAL) tmp1[4] = 0x94;
-    write_text(tmp1, 9);
-    return tINT;
+// movsbl src, %dst
+void emit_movsx(reg_t dst, operand_t src)
+{
+  // a REX prefix makes %spl to %dil byte registers, where there are none
+  // in 32-bit code
+  write_rex(0, dst, src);
+  uint8_t tmp[2] = { 0x0f, 0xbe };
+  write_text(tmp, 2);
+  write_modrm(dst, src);
+}
+
+// movslq src, %dst
+void emit_movsxd(reg_t dst, operand_t src)
+{
+  write_rex(0, dst, src);
+  uint8_t tmp = 0x63;
+  write_text(&tmp, 1);
+  write_modrm(dst, src);
+}
+
+// movl/movb $imm, dst
+void emit_store_imm(operand_t dst, uint32_t imm, uint8_t byte)
+{
+  write_rex(byte, 0, dst);
+  uint8_t tmp = byte ? 0xc6 : 0xc7;
+  write_text(&tmp, 1);
+  write_modrm(0, dst);
+  if (byte) write_imm8(imm);
+  else write_imm32(imm);
+}
+
+// cdq, or cqto in 64-bit code
+void emit_cdq()
+{
+  write_rex(0, 0, (operand_t) { .type = oIMM });
+  uint8_t tmp = 0x99;
+  write_text(&tmp, 1);
+}
+
+// pushl src
+void emit_push(operand_t src)
+{
+  // pushes and pops are 64-bit in 64-bit code without a REX.W
+  uint8_t tmp, saved = wide;
+  wide = 0;
+  write_rex(0, 0, src);
+  wide = saved;
+  if (src.type == oREG) {
+    tmp = 0x50 + (src.reg & 7);
+    write_text(&tmp, 1);
+  } else if (src.type == oIMM) {
+    tmp = fits_imm8(src.val) ? 0x6a : 0x68;
+    write_text(&tmp, 1);
+    if (tmp == 0x6a) write_imm8(src.val);
+    else write_imm32(src.val);
+  } else {
+    tmp = 0xff;
+    write_text(&tmp, 1);
+    write_modrm(6, src);
   }
+}
 
-  if (expr->variant == vAND) {
-    symbol_type_t right_type = codegen_expr(expr->children->next, symtab);
-    // pushl %eax
-    uint8_t tmp = 0x50; write_text(&tmp, 1);
-    symbol_type_t left_type = codegen_expr(expr->children, symtab);
-    // popl %ecx
-    // mull/mulb %ecx
-    // orl %edx, %eax
-    // xorl %ecx, %ecx
-    // cmpl/cmpb %ecx, %eax
-    // setne %al
-    // movzbl %al, %eax
-    uint8_t tmp1[15] = {
-      0x59, 0xf7, 0xe1, 0x09, 0xd0, 0x31, 0xc9, 0x39, 0xc8,
-      0x0f, 0x95, 0xc0, 0x0f, 0xb6, 0xc0
-    };
-    if (left_type == tCHAR && right_type == tCHAR) {
-      tmp1[1] = 0xf7; tmp1[7] = 0x38;
+// popl %dst
+void emit_pop(reg_t dst)
+{
+  if (dst & 8) {
+    uint8_t rex = 0x41;
+    write_text(&rex, 1);
+  }
+  uint8_t tmp = 0x58 + (dst & 7);
+  write_text(&tmp, 1);
+}
+
+// addl $n, %esp
+void emit_release(uint32_t n)
+{
+  if (n == 0) return;
+  emit_alu(aADD, ESP, (operand_t) { .type = oIMM, .val = n }, 0);
+}
+
+// calll *o
+void emit_call(operand_t o)
+{
+  uint8_t saved = wide;
+  wide = 0;
+  write_rex(0, 0, o);
+  wide = saved;
+  uint8_t tmp = 0xff;
+  write_text(&tmp, 1);
+  write_modrm(2, o);
+}
+
+// calll <name>
+// relocate() fills in the offset once every function has been placed
+void emit_call_symbol(char *name, symbol_t *symtab)
+{
+  uint8_t tmp[5] = { 0xe8, 0, 0, 0, 0 };
+  add_relocation(text_loc + 1, name, symtab, rOFFSET);
+  write_text(tmp, 5);
+}
+
+// x86 condition codes, and a pseudo condition for unconditional jumps
+#define ccE  0x4
+#define ccNE 0x5
+#define ccL  0xc
+#define ccGE 0xd
+#define ccLE 0xe
+#define ccG  0xf
+#define ccALWAYS 0xff
+
+// set<cc> %al
+// movzbl %al, %eax
+void emit_setcc(uint8_t cc)
+{
+  uint8_t tmp[6] = { 0x0f, 0x90 | cc, 0xc0, 0x0f, 0xb6, 0xc0 };
+  write_text(tmp, 6);
+}
+
+// jumps inside a function go to labels. they are emitted as rel32 and
+// recorded as fixups, and once the function is complete relax_jumps() shrinks
+// every jump whose target is in range to rel8 and closes up the gaps
+#define NO_LABEL ((uint32_t) -1)
+
+uint32_t *labels = NULL; // label -> text offset
+uint32_t label_count = 0;
+uint32_t label_cap = 0;
+
+typedef struct fixup_s {
+  uint32_t at;
+  uint8_t cc;
+  uint32_t label;
+  uint32_t size;
+} fixup_t;
+
+fixup_t *fixups = NULL;
+uint32_t fixup_count = 0;
+uint32_t fixup_cap = 0;
+
+uint32_t new_label()
+{
+  if (label_count == label_cap) {
+    label_cap = label_cap ? 2 * label_cap : 64;
+    labels = realloc(labels, label_cap * sizeof(uint32_t));
+  }
+  labels[label_count] = NO_LABEL;
+  return label_count++;
+}
+
+// binds `label` to the current end of the text
+void place_label(uint32_t label)
+{
+  labels[label] = text_loc;
+}
+
+// size of j<cc>/jmp with a rel8 or rel32 displacement
+uint32_t jump_size(uint8_t cc, uint8_t rel8)
+{
+  if (rel8) return 2;
+  return cc == ccALWAYS ? 5 : 6;
+}
+
+// writes j<cc>/jmp of `size` bytes with displacement `rel` to `p`
+void encode_jump(uint8_t *p, uint8_t cc, uint32_t size, int32_t rel)
+{
+  if (size == 2) {
+    p[0] = cc == ccALWAYS ? 0xeb : 0x70 | cc;
+    p[1] = rel;
+    return;
+  }
+
+  if (cc == ccALWAYS) p[0] = 0xe9;
+  else { p[0] = 0x0f; p[1] = 0x80 | cc; }
+  for (uint32_t i = size - 4; i < size; ++i) {
+    p[i] = rel & 0xff;
+    rel >>= 8;
+  }
+}
+
+// j<cc>/jmp to `label`
+void emit_jump(uint8_t cc, uint32_t label)
+{
+  if (fixup_count == fixup_cap) {
+    fixup_cap = fixup_cap ? 2 * fixup_cap : 64;
+    fixups = realloc(fixups, fixup_cap * sizeof(fixup_t));
+  }
+  uint32_t size = jump_size(cc, 0);
+  fixups[fixup_count++] = (fixup_t) {
+    .at = text_loc, .cc = cc, .label = label, .size = size
+  };
+  uint8_t tmp[6];
+  encode_jump(tmp, cc, size, 0);
+  write_text(tmp, size);
+}
+
+// the offset that `at` moves to when the jumps before it shrink, given the
+// total shrinkage `shift[i]` of the first i fixups
+uint32_t relaxed_offset(uint32_t at, uint32_t *shift)
+{
+  // number of fixups that start before `at`
+  uint32_t lo = 0, hi = fixup_count;
+  while (lo < hi) {
+    uint32_t mid = (lo + hi) / 2;
+    if (fixups[mid].at < at) lo = mid + 1;
+    else hi = mid;
+  }
+  return at - shift[lo];
+}
+
+// resolves the jumps of the function starting at `start`, which ends at the
+// current end of the text. every jump starts out as rel8 and is widened to
+// rel32 if its target is out of range; widening only ever moves targets
+// further away, so this settles after a few passes. the code is then moved
+// down over the unused bytes, along with the labels and relocations in it
+void relax_jumps(uint32_t start)
+{
+  uint32_t *shift = malloc((fixup_count + 1) * sizeof(uint32_t));
+  uint8_t *rel8 = malloc(fixup_count + 1);
+  memset(rel8, 1, fixup_count + 1);
+
+  for (uint32_t i = 0; i < fixup_count; ++i) {
+    if (labels[fixups[i].label] == NO_LABEL) {
+      printf("Jump to unplaced label\n");
+      exit(1);
     }
-    write_text(tmp1, 15);
-    return tINT;
   }
 
-  if (expr->variant == vOR) {
-    symbol_type_t right_type = codegen_expr(expr->children->next, symtab);
-    // pushl %eax
-    uint8_t tmp = 0x50; write_text(&tmp, 1);
-    symbol_type_t left_type = codegen_expr(expr->children, symtab);
-    // popl %ecx
-    // orl/orb %ecx, %eax
-    // xorl %ecx, %ecx
-    // cmpl/cmpb %ecx, %ax
-    // setne %al
-    // movzbl %al, %eax
-    uint8_t tmp1[13] = {
-      0x59, 0x09, 0xc8, 0x31, 0xc9, 0x39, 0xc8,
-      0x0f, 0x95, 0xc0, 0x0f, 0xb6, 0xc0
-    };
-    if (left_type == tCHAR && right_type == tCHAR) {
-      tmp1[1] = 0x08; tmp1[5] = 0x38;
+  uint8_t changed = 1;
+  while (changed) {
+    changed = 0;
+    shift[0] = 0;
+    for (uint32_t i = 0; i < fixup_count; ++i)
+      shift[i + 1] = shift[i] + fixups[i].size
+        - jump_size(fixups[i].cc, rel8[i]);
+
+    for (uint32_t i = 0; i < fixup_count; ++i) {
+      if (!rel8[i]) continue;
+      int32_t rel = relaxed_offset(labels[fixups[i].label], shift)
+        - (fixups[i].at - shift[i] + 2);
+      if (rel < -128 || rel > 127) { rel8[i] = 0; changed = 1; }
     }
-    write_text(tmp1, 13);
-    return tINT;
   }
 
-  if (expr->variant == vASSIGN) {
-    ast_node_t *lval = malloc(sizeof(ast_node_t));
-    memset(lval, 0, sizeof(ast_node_t));
-    lval->type = nEXPR;
-    lval->variant = vADDRESSOF;
-    lval->children = expr->children;
-    codegen_expr(lval, symtab);
+  uint32_t end = text_loc;
+  uint32_t src = start, dst = start;
+  for (uint32_t i = 0; i < fixup_count; ++i) {
+    fixup_t *f = fixups + i;
+    memmove(text + dst, text + src, f->at - src);
+    dst += f->at - src;
+    src = f->at + f->size;
+
+    uint32_t size = jump_size(f->cc, rel8[i]);
+    int32_t target = relaxed_offset(labels[f->label], shift);
+    encode_jump(text + dst, f->cc, size, target - (dst + size));
+    dst += size;
+  }
+  memmove(text + dst, text + src, end - src);
+  text_loc = dst + end - src;
+
+  for (relocation_t *r = relocs; r != NULL; r = r->next)
+    if (r->addr >= start && r->addr < end)
+      r->addr = relaxed_offset(r->addr, shift);
+  for (uint32_t i = 0; i < label_count; ++i)
+    labels[i] = relaxed_offset(labels[i], shift);
+
+  free(shift);
+  free(rel8);
+  fixup_count = 0;
+  label_count = 0;
+}
 
-    // pushl %eax
-    uint8_t tmp0 = 0x50; write_text(&tmp0, 1);
+// leave
+// retl
+void emit_epilogue()
+{
+  uint8_t tmp[2] = { 0xc9, 0xc3 };
+  write_text(tmp, 2);
+}
 
-    codegen_expr(expr->children->next, symtab);
+// leave
+// jmpl *%r
+void emit_tail_jump(reg_t r)
+{
+  uint8_t tmp[3] = { 0xc9, 0xff, 0xe0 | r };
+  write_text(tmp, 3);
+}
+
+// leave
+// jmp <name>
+// relocate() fills in the offset once every function has been placed
+void emit_tail_jump_symbol(char *name, symbol_t *symtab)
+{
+  uint8_t tmp[6] = { 0xc9, 0xe9, 0, 0, 0, 0 };
+  add_relocation(text_loc + 2, name, symtab, rOFFSET);
+  write_text(tmp, 6);
+}
+
+// retl
+void emit_ret()
+{
+  uint8_t tmp = 0xc3;
+  write_text(&tmp, 1);
+}
+
+// pushl %ebp
+// movl %esp, %ebp
+// subl <size>, %esp                (if it is not 0)
+void emit_frame_setup(uint32_t size)
+{
+  emit_push((operand_t) { .type = oREG, .reg = EBP });
+  emit_store((operand_t) { .type = oREG, .reg = EBP }, ESP, 0);
+  if (size == 0) return;
+  emit_alu(aSUB, ESP, (operand_t) { .type = oIMM, .val = size }, 0);
+}
 
-    // popl %ecx
-    // movl %eax, (%ecx)
-    uint8_t tmp[3] = { 0x59, 0x89, 0x01 };
-    write_text(tmp, 3);
+// peephole optimizer: the code of a function is decoded into a list of
+// instructions, the rules in peephole_rules rewrite that list until none of
+// them applies any more, and the surviving instructions are written back
+// before relax_jumps() runs. rules never look across an instruction that a
+// jump lands on
+typedef enum {
+  iOTHER, iPUSH, iPOP, iLOAD, iSTORE, iLEAVE, iRET, iJMP, iJCC
+} insn_kind_t;
+
+typedef struct insn_s {
+  uint32_t at;     // offset in the code before the pass
+  uint8_t len;
+  uint8_t *bytes;  // into text, or `rewritten` if the rule replaced it
+  uint8_t rewritten[16];
+  insn_kind_t kind;
+  reg_t reg;       // pushed, popped, loaded or stored register
+  operand_t mem;   // memory operand of a load or store
+  uint8_t byte;
+  uint32_t fixup;  // fixup of a jump
+  uint8_t target;  // a jump lands here
+  uint8_t dead;
+} insn_t;
+
+// decodes a ModR/M byte (and SIB and displacement) into the register field
+// and r/m operand. returns its length
+uint32_t decode_modrm(uint8_t *p, uint8_t *reg, operand_t *rm)
+{
+  uint8_t mod = p[0] >> 6, r = p[0] & 7;
+  uint32_t len = 1;
+  *reg = (p[0] >> 3) & 7;
+  *rm = (operand_t) { .type = oMEM, .reg = r };
+  if (mod == 3) {
+    rm->type = oREG;
+    return 1;
   }
+  if (r == 4) {
+    uint8_t sib = p[1];
+    ++len;
+    rm->reg = sib & 7;
+    if (((sib >> 3) & 7) != ESP) {
+      rm->index = (sib >> 3) & 7;
+      rm->scale = 1 << (sib >> 6);
+    }
+  }
+  if (mod == 0 && r == 5) {
+    rm->type = oABS;
+    mod = 2;
+  }
+  if (mod == 1) {
+    rm->val = (int8_t) p[len];
+    len += 1;
+  } else if (mod == 2) {
+    rm->val = p[len] | (p[len + 1] << 8) | (p[len + 2] << 16)
+      | ((uint32_t) p[len + 3] << 24);
+    len += 4;
+  }
+  return len;
+}
 
-  if (expr->variant == vCALL) {
-    uint32_t offset = codegen_argument(expr->children->next, symtab);
-    symbol_type_t callee_type = codegen_expr(expr->children, symtab);
-    // calll *%eax
-    uint8_t tmp[2] = { 0xff, 0xd0 };
-    write_text(tmp, 2);
-    // addl <offset>, %esp
-    tmp[0] = 0x81; tmp[1] = 0xc4;
-    write_text(tmp, 2);
-    for (uint32_t i = 0; i < 4; ++i) {
-      uint8_t tmp0 = offset & 0xff;
-      write_text(&tmp0, 1);
-      offset >>= 8;
+// decodes an instruction of the kinds that nanoc emits. returns its length,
+// or 0 if it is not one of them
+uint32_t decode_insn(uint8_t *p, insn_t *insn)
+{
+  uint8_t op = p[0], reg;
+  operand_t rm;
+  insn->kind = iOTHER;
+  insn->bytes = p;
+
+  if (op == 0x0f) {
+    if (p[1] >= 0x80 && p[1] <= 0x8f) { insn->kind = iJCC; return 6; }
+    if (
+      (p[1] >= 0x90 && p[1] <= 0x9f) || p[1] == 0xaf
+      || p[1] == 0xb6 || p[1] == 0xb7 || p[1] == 0xbe || p[1] == 0xbf
+      )
+      return 2 + decode_modrm(p + 2, &reg, &rm);
+    return 0;
+  }
+
+  if (op < 0x40 && (op & 7) < 6) {
+    if ((op & 7) == 4) return 2;
+    if ((op & 7) == 5) return 5;
+    return 1 + decode_modrm(p + 1, &reg, &rm);
+  }
+  if (op >= 0x40 && op <= 0x5f) {
+    if (op >= 0x50) {
+      insn->kind = op < 0x58 ? iPUSH : iPOP;
+      insn->reg = op & 7;
     }
-    return callee_type;
+    return 1;
+  }
+  if (op >= 0x70 && op <= 0x7f) return 2;
+  if (op >= 0x90 && op <= 0x97) return 1;
+  if (op >= 0xa0 && op <= 0xa3) {
+    insn->kind = op < 0xa2 ? iLOAD : iSTORE;
+    insn->reg = EAX;
+    insn->byte = !(op & 1);
+    insn->mem = (operand_t) {
+      .type = oABS,
+      .val = p[1] | (p[2] << 8) | (p[3] << 16) | ((uint32_t) p[4] << 24)
+    };
+    return 5;
+  }
+  if (op >= 0xb0 && op <= 0xbf) return op < 0xb8 ? 2 : 5;
+
+  uint32_t len;
+  switch (op) {
+  case 0x88: case 0x89: case 0x8a: case 0x8b:
+    len = 1 + decode_modrm(p + 1, &reg, &rm);
+    if (rm.type != oREG) {
+      insn->kind = op < 0x8a ? iSTORE : iLOAD;
+      insn->reg = reg;
+      insn->mem = rm;
+      insn->byte = !(op & 1);
+    }
+    return len;
+  case 0x84: case 0x85: case 0x87: case 0x8d: case 0xd1:
+  case 0xfe: case 0xff:
+    return 1 + decode_modrm(p + 1, &reg, &rm);
+  case 0x80: case 0x83: case 0xc1: case 0x6b: case 0xc6:
+    return 2 + decode_modrm(p + 1, &reg, &rm);
+  case 0x81: case 0x69: case 0xc7:
+    return 5 + decode_modrm(p + 1, &reg, &rm);
+  case 0xf6: case 0xf7:
+    len = 1 + decode_modrm(p + 1, &reg, &rm);
+    if (reg < 2) len += op == 0xf6 ? 1 : 4;
+    return len;
+  case 0x6a: case 0xeb: return 2;
+  case 0x68: case 0xe8: return 5;
+  case 0xe9: insn->kind = iJMP; return 5;
+  case 0x99: return 1;
+  case 0xc3: insn->kind = iRET; return 1;
+  case 0xc9: insn->kind = iLEAVE; return 1;
   }
+  return 0;
+}
 
-  return tINT;
+uint8_t same_operand(operand_t a, operand_t b)
+{
+  return a.type == b.type && a.reg == b.reg && a.val == b.val
+    && a.scale == b.scale && (a.scale == 0 || a.index == b.index);
 }
 
-uint32_t codegen_argument(ast_node_t *arg, symbol_t *symtab)
+// replaces `insn` with movl/movb %src, %dst
+void rewrite_mov(insn_t *insn, reg_t dst, reg_t src, uint8_t byte)
 {
-  if (arg == NULL) return 0;
-  uint32_t offset = codegen_argument(arg->next, symtab);
-  codegen_expr(arg, symtab);
+  insn->rewritten[0] = byte ? 0x8a : 0x8b;
+  insn->rewritten[1] = 0xc0 | (dst << 3) | src;
+  insn->bytes = insn->rewritten;
+  insn->len = 2;
+  insn->kind = iOTHER;
+}
 
-  // pushl %eax
-  uint8_t tmp = 0x50;
-  write_text(&tmp, 1);
+// index of the first live instruction after `i`, or `n`
+uint32_t next_insn(insn_t *insns, uint32_t i, uint32_t n)
+{
+  for (++i; i < n && insns[i].dead; ++i);
+  return i;
+}
 
-  return offset + 4;
+// index of the first live instruction at or after offset `at`, or `n`
+uint32_t insn_at(insn_t *insns, uint32_t n, uint32_t at)
+{
+  uint32_t lo = 0, hi = n;
+  while (lo < hi) {
+    uint32_t mid = (lo + hi) / 2;
+    if (insns[mid].at < at) lo = mid + 1;
+    else hi = mid;
+  }
+  if (lo < n && insns[lo].dead) lo = next_insn(insns, lo, n);
+  return lo;
 }
 
-void codegen_stmt(
-  ast_node_t *stmt, symbol_t *symtab,
-  uint32_t *block_id, uint32_t *continues, uint32_t *breaks
-  )
+// pushl %a
+// popl %b
+// -> movl %a, %b (or nothing if a == b)
+uint8_t peephole_push_pop(insn_t *insns, uint32_t i, uint32_t n)
 {
-  if (stmt->variant == vEMPTY || stmt->variant == vDECL) return;
-  if (stmt->variant == vEXPR) codegen_expr(stmt->children, symtab);
+  uint32_t j = next_insn(insns, i, n);
+  if (insns[i].kind != iPUSH || j == n) return 0;
+  if (insns[j].kind != iPOP || insns[j].target) return 0;
+  if (insns[i].reg == insns[j].reg) insns[i].dead = 1;
+  else rewrite_mov(insns + i, insns[j].reg, insns[i].reg, 0);
+  insns[j].dead = 1;
+  return 1;
+}
 
-  if (stmt->variant == vBLOCK) {
-    char symtab_key[2] = { (char) *block_id, 0 };
-    ++(*block_id);
-    symbol_t *child_symtab = symtab_get(symtab, symtab_key)->child;
-    ast_node_t *child = stmt->children;
-    uint32_t child_block_id = 0;
-    while (child != NULL) {
-      codegen_stmt(child, child_symtab, &child_block_id, continues, breaks);
-      child = child->next;
+// movl %a, <mem>
+// movl <mem>, %b
+// -> movl %a, <mem>
+//    movl %a, %b (or nothing if a == b)
+uint8_t peephole_store_reload(insn_t *insns, uint32_t i, uint32_t n)
+{
+  uint32_t j = next_insn(insns, i, n);
+  if (insns[i].kind != iSTORE || j == n) return 0;
+  insn_t *load = insns + j;
+  if (load->kind != iLOAD || load->target || load->byte != insns[i].byte)
+    return 0;
+  if (!same_operand(insns[i].mem, load->mem)) return 0;
+  if (load->reg == insns[i].reg) load->dead = 1;
+  else rewrite_mov(load, load->reg, insns[i].reg, load->byte);
+  return 1;
+}
+
+// movl <mem>, %a
+// movl <mem>, %a
+// -> movl <mem>, %a
+// unless <mem> is addressed through %a
+uint8_t peephole_reload(insn_t *insns, uint32_t i, uint32_t n)
+{
+  uint32_t j = next_insn(insns, i, n);
+  if (insns[i].kind != iLOAD || j == n) return 0;
+  insn_t *a = insns + i, *b = insns + j;
+  if (b->kind != iLOAD || b->target || b->byte != a->byte) return 0;
+  if (b->reg != a->reg || !same_operand(a->mem, b->mem)) return 0;
+  if (a->mem.type == oMEM && a->mem.reg == a->reg) return 0;
+  if (a->mem.scale && a->mem.index == a->reg) return 0;
+  b->dead = 1;
+  return 1;
+}
+
+// jmp/j<cc> next
+// next:
+// -> next:
+uint8_t peephole_jump_to_next(insn_t *insns, uint32_t i, uint32_t n)
+{
+  if (insns[i].kind != iJMP && insns[i].kind != iJCC) return 0;
+  uint32_t target = labels[fixups[insns[i].fixup].label];
+  if (insn_at(insns, n, target) != next_insn(insns, i, n)) return 0;
+  insns[i].dead = 1;
+  return 1;
+}
+
+// retl/jmp
+// <anything but a jump target>
+// -> retl/jmp
+// this also removes the leave/retl of the function epilogue after a return
+uint8_t peephole_unreachable(insn_t *insns, uint32_t i, uint32_t n)
+{
+  if (insns[i].kind != iRET && insns[i].kind != iJMP) return 0;
+  uint8_t hit = 0;
+  for (uint32_t j = i + 1; j < n && !insns[j].target; ++j) {
+    if (insns[j].dead) continue;
+    insns[j].dead = 1;
+    hit = 1;
+  }
+  return hit;
+}
+
+typedef struct peephole_rule_s {
+  char *name;
+  uint8_t (*apply)(insn_t *insns, uint32_t i, uint32_t n);
+  uint32_t hits;
+} peephole_rule_t;
+
+peephole_rule_t peephole_rules[] = {
+  { "push-pop", peephole_push_pop, 0 },
+  { "store-reload", peephole_store_reload, 0 },
+  { "reload", peephole_reload, 0 },
+  { "jump-to-next", peephole_jump_to_next, 0 },
+  { "unreachable", peephole_unreachable, 0 },
+};
+
+#define PEEPHOLE_RULE_COUNT \
+  (sizeof(peephole_rules) / sizeof(peephole_rules[0]))
+
+// marks the instructions that a live jump lands on. removing instructions
+// only ever removes targets, so the marks stay safe until this runs again
+void mark_targets(insn_t *insns, uint32_t n)
+{
+  for (uint32_t i = 0; i < n; ++i) insns[i].target = 0;
+  for (uint32_t i = 0; i < n; ++i) {
+    if (insns[i].dead || (insns[i].kind != iJMP && insns[i].kind != iJCC))
+      continue;
+    uint32_t t = insn_at(insns, n, labels[fixups[insns[i].fixup].label]);
+    if (t < n) insns[t].target = 1;
+  }
+}
+
+// runs the peephole rules over the function starting at `start`, which ends
+// at the current end of the text and has not had its jumps relaxed yet
+void peephole(uint32_t start)
+{
+  uint32_t end = text_loc;
+  uint32_t cap = 64, n = 0;
+  insn_t *insns = malloc(cap * sizeof(insn_t));
+
+  uint32_t next_fixup = 0;
+  for (uint32_t at = start; at < end; ) {
+    if (n == cap) {
+      cap *= 2;
+      insns = realloc(insns, cap * sizeof(insn_t));
+    }
+    insn_t *insn = insns + n;
+    memset(insn, 0, sizeof(insn_t));
+    insn->at = at;
+    insn->len = decode_insn(text + at, insn);
+    if (insn->len == 0) { free(insns); return; }
+    if (insn->kind == iJMP || insn->kind == iJCC) {
+      if (next_fixup == fixup_count || fixups[next_fixup].at != at) {
+        // jmp <function> leaves the function like retl
+        if (insn->kind == iJMP) {
+          insn->kind = iRET;
+          at += insn->len;
+          ++n;
+          continue;
+        }
+        free(insns);
+        return;
+      }
+      insn->fixup = next_fixup++;
     }
+    at += insn->len;
+    ++n;
   }
 
-  if (stmt->variant == vRETURN) {
-    if (stmt->children != NULL) codegen_expr(stmt->children, symtab);
-    // leave
-    // retl
-    uint8_t tmp[2] = { 0xc9, 0xc3 };
-    write_text(tmp, 2);
+  uint8_t changed = 1;
+  while (changed) {
+    changed = 0;
+    mark_targets(insns, n);
+    for (uint32_t i = 0; i < n; ++i) {
+      for (uint32_t r = 0; r < PEEPHOLE_RULE_COUNT && !insns[i].dead; ++r) {
+        if (!peephole_rules[r].apply(insns, i, n)) continue;
+        ++peephole_rules[r].hits;
+        changed = 1;
+      }
+    }
   }
 
-  if (stmt->variant == vCONTINUE || stmt->variant == vBREAK) {
-    if (
-      (stmt->variant == vCONTINUE && continues == NULL)
-      || (stmt->variant == vBREAK && breaks == NULL)
-      ) {
-      printf("Invalid '%s'\n", stmt->variant == vCONTINUE ? "continue" : "break");
-      exit(1);
+  // write back the live instructions, moving the labels, fixups and
+  // relocations along with them
+  uint32_t *new_at = malloc((n + 1) * sizeof(uint32_t));
+  uint8_t *out = malloc(end - start);
+  uint32_t out_len = 0, live_fixups = 0;
+  for (uint32_t i = 0; i < n; ++i) {
+    new_at[i] = start + out_len;
+    if (insns[i].dead) continue;
+    memcpy(out + out_len, insns[i].bytes, insns[i].len);
+    out_len += insns[i].len;
+    if (insns[i].kind == iJMP || insns[i].kind == iJCC) {
+      fixup_t f = fixups[insns[i].fixup];
+      f.at = new_at[i];
+      fixups[live_fixups++] = f;
+    }
+  }
+  new_at[n] = start + out_len;
+  memcpy(text + start, out, out_len);
+  text_loc = start + out_len;
+  fixup_count = live_fixups;
+
+  for (uint32_t i = 0; i < label_count; ++i)
+    if (labels[i] != NO_LABEL)
+      labels[i] = new_at[insn_at(insns, n, labels[i])];
+
+  relocation_t **r = &relocs;
+  while (*r != NULL) {
+    if ((*r)->addr < start || (*r)->addr >= end) { r = &(*r)->next; continue; }
+    // the instruction that holds the relocation
+    uint32_t lo = 0, hi = n;
+    while (lo < hi) {
+      uint32_t mid = (lo + hi) / 2;
+      if (insns[mid].at <= (*r)->addr) lo = mid + 1;
+      else hi = mid;
+    }
+    uint32_t i = lo - 1;
+    if (insns[i].dead) {
+      *r = (*r)->next;
+      continue;
     }
+    (*r)->addr = new_at[i] + (*r)->addr - insns[i].at;
+    r = &(*r)->next;
+  }
 
-    uint32_t *arr = stmt->variant == vCONTINUE ? continues : breaks;
-    uint32_t i = 0;
-    while (arr[i]) ++i;
-    arr[i] = text_loc;
-    text_loc += 5;
+  free(out);
+  free(new_at);
+  free(insns);
+}
+
+// instruction scheduler: after the peephole optimizer, the instructions
+// between two jump targets, calls, pushes, pops and jumps are reordered so
+// that a load or an imull is issued as long as possible before its result
+// is used. it decodes the machine code like the peephole optimizer does and
+// knows which registers, flags and memory each instruction reads and writes.
+// the latencies come from the core picked with -mtune
+typedef struct tune_s {
+  char *name;
+  uint8_t width; // instructions issued per cycle
+  uint8_t load;  // cycles from a load to a use of the loaded value
+  uint8_t imul;
+  uint8_t div;
+  uint8_t agi;   // extra cycles before a register can be used in an address
+} tune_t;
+
+tune_t tunes[] = {
+  { "generic", 3, 4, 3, 26, 0 },
+  { "atom", 2, 3, 5, 50, 3 },
+  { "quark", 1, 2, 10, 40, 1 },
+};
+#define TUNE_COUNT (sizeof(tunes) / sizeof(tune_t))
+
+// longest run of instructions that is scheduled at once
+#define SCHED_WINDOW 64
+
+typedef struct sched_insn_s {
+  uint32_t at;
+  uint8_t len;
+  uint8_t barrier;      // nothing moves across it
+  uint8_t uses, defs;   // registers, one bit each
+  uint8_t addr;         // registers that form a memory address
+  uint8_t reads_flags, writes_flags, live_flags;
+  uint8_t load, store;
+  operand_t mem;
+  uint8_t size;         // of the memory access
+  uint8_t reloc;        // holds a relocation
+  uint8_t latency;
+} sched_insn_t;
+
+// a register operand of `size` bytes. %ah..%bh belong to %eax..%ebx, and
+// writing a byte register keeps the rest of it
+void sched_reg(sched_insn_t *s, uint8_t r, uint8_t size, uint8_t use, uint8_t def)
+{
+  if (size == 1) r &= 3;
+  if (use || (def && size == 1)) s->uses |= 1 << r;
+  if (def) s->defs |= 1 << r;
+}
+
+void sched_rm(
+  sched_insn_t *s, operand_t rm, uint8_t size, uint8_t use, uint8_t def
+  )
+{
+  if (rm.type == oREG) {
+    sched_reg(s, rm.reg, size, use, def);
+    return;
+  }
+  if (rm.type == oMEM) {
+    s->addr |= 1 << rm.reg;
+    if (rm.scale) s->addr |= 1 << rm.index;
+    s->uses |= s->addr;
+  }
+  s->mem = rm;
+  s->size = size;
+  s->load |= use;
+  s->store |= def;
+}
+
+// fills in what the instruction at `p` reads and writes. returns 0 if the
+// scheduler does not know, or must not move anything across it
+uint8_t sched_decode(uint8_t *p, sched_insn_t *s)
+{
+  uint8_t op = p[0], reg, size = (op & 1) ? 4 : 1, alu;
+  operand_t rm = { 0 };
+  if (op == 0x0f) {
+    decode_modrm(p + 2, &reg, &rm);
+    if (p[1] >= 0x90 && p[1] <= 0x9f) {
+      // setcc r/m8
+      s->reads_flags = 1;
+      sched_rm(s, rm, 1, 0, 1);
+      s->latency = 1;
+    } else if (p[1] == 0xaf) {
+      // imull r/m, reg
+      sched_rm(s, rm, 4, 1, 0);
+      sched_reg(s, reg, 4, 1, 1);
+      s->writes_flags = 1;
+      s->latency = tunes[mtune].imul;
+    } else if (
+      p[1] == 0xb6 || p[1] == 0xb7 || p[1] == 0xbe || p[1] == 0xbf
+      ) {
+      // movzx/movsx r/m, reg
+      sched_rm(s, rm, (p[1] & 1) ? 2 : 1, 1, 0);
+      sched_reg(s, reg, 4, 0, 1);
+    } else return 0;
+    return 1;
   }
 
-  if (stmt->variant == vIF) {
-    codegen_expr(stmt->children, symtab);
+  if (op < 0x40 && (op & 7) < 6) {
+    // add, or, adc, sbb, and, sub, xor and cmp write their first operand,
+    // except for cmp
+    alu = op >> 3;
+    s->writes_flags = 1;
+    s->reads_flags = alu == 2 || alu == 3;
+    s->latency = 1;
+    if ((op & 7) >= 4) sched_reg(s, EAX, size, 1, alu != 7);
+    else {
+      decode_modrm(p + 1, &reg, &rm);
+      if (op & 2) {
+        sched_rm(s, rm, size, 1, 0);
+        sched_reg(s, reg, size, 1, alu != 7);
+      } else {
+        sched_reg(s, reg, size, 1, 0);
+        sched_rm(s, rm, size, 1, alu != 7);
+      }
+    }
+    return 1;
+  }
+  if (op >= 0x40 && op <= 0x4f) {
+    // incl/decl keep the carry flag
+    sched_reg(s, op & 7, 4, 1, 1);
+    s->reads_flags = s->writes_flags = 1;
+    s->latency = 1;
+    return 1;
+  }
+  if (op >= 0x90 && op <= 0x97) {
+    // xchgl %eax, reg
+    sched_reg(s, EAX, 4, 1, 1);
+    sched_reg(s, op & 7, 4, 1, 1);
+    s->latency = 1;
+    return 1;
+  }
+  if (op >= 0xa0 && op <= 0xa3) {
+    // movl <addr>, %eax / movl %eax, <addr>
+    rm = (operand_t) {
+      .type = oABS,
+      .val = p[1] | (p[2] << 8) | (p[3] << 16) | ((uint32_t) p[4] << 24)
+    };
+    sched_rm(s, rm, size, op < 0xa2, op >= 0xa2);
+    sched_reg(s, EAX, size, op >= 0xa2, op < 0xa2);
+    return 1;
+  }
+  if (op >= 0xb0 && op <= 0xbf) {
+    // movl $imm, reg
+    sched_reg(s, op & 7, op < 0xb8 ? 1 : 4, 0, 1);
+    return 1;
+  }
+
+  if (op == 0x99) {
+    // cltd
+    sched_reg(s, EAX, 4, 1, 0);
+    sched_reg(s, EDX, 4, 0, 1);
+    s->latency = 1;
+    return 1;
+  }
+
+  // pushes, pops, jumps, calls, leave and retl
+  if (
+    (op >= 0x50 && op <= 0x7f && op != 0x69 && op != 0x6b)
+    || op == 0xc3 || op == 0xc9 || (op >= 0xe8 && op <= 0xeb)
+    )
+    return 0;
+
+  uint32_t len = 1 + decode_modrm(p + 1, &reg, &rm);
+  switch (op) {
+  case 0x88: case 0x89:
+    sched_reg(s, reg, size, 1, 0);
+    sched_rm(s, rm, size, 0, 1);
+    return 1;
+  case 0x8a: case 0x8b:
+    sched_rm(s, rm, size, 1, 0);
+    sched_reg(s, reg, size, 0, 1);
+    return 1;
+  case 0x84: case 0x85:
+    // test
+    sched_rm(s, rm, size, 1, 0);
+    sched_reg(s, reg, size, 1, 0);
+    s->writes_flags = 1;
+    s->latency = 1;
+    return 1;
+  case 0x87:
+    sched_rm(s, rm, size, 1, 1);
+    sched_reg(s, reg, size, 1, 1);
+    s->latency = 1;
+    return 1;
+  case 0x8d:
+    // leal computes its address like a load would
+    if (rm.type != oMEM) return 0;
+    sched_rm(s, rm, 4, 0, 0);
+    s->mem = (operand_t) { 0 };
+    sched_reg(s, reg, 4, 0, 1);
+    s->latency = 1;
+    return 1;
+  case 0xc1: case 0xd1:
+    // shifts and rotates. a shift by 0 keeps the flags
+    if (reg == 6) return 0;
+    sched_rm(s, rm, 4, 1, 1);
+    s->writes_flags = 1;
+    s->reads_flags = reg == 2 || reg == 3
+      || (op == 0xc1 && (p[len] & 31) == 0);
+    s->latency = 1;
+    return 1;
+  case 0xfe: case 0xff:
+    if (reg > 1) return 0;
+    sched_rm(s, rm, size, 1, 1);
+    s->reads_flags = s->writes_flags = 1;
+    s->latency = 1;
+    return 1;
+  case 0x80: case 0x81: case 0x83:
+    sched_rm(s, rm, size, 1, reg != 7);
+    s->writes_flags = 1;
+    s->reads_flags = reg == 2 || reg == 3;
+    s->latency = 1;
+    return 1;
+  case 0x69: case 0x6b:
+    // imull $imm, r/m, reg
+    sched_rm(s, rm, 4, 1, 0);
+    sched_reg(s, reg, 4, 0, 1);
+    s->writes_flags = 1;
+    s->latency = tunes[mtune].imul;
+    return 1;
+  case 0xc6: case 0xc7:
+    sched_rm(s, rm, size, 0, 1);
+    return 1;
+  case 0xf6: case 0xf7:
+    if (reg == 1 || (op == 0xf6 && reg >= 4)) return 0;
+    s->latency = 1;
+    if (reg == 0) {
+      // testl $imm, r/m
+      sched_rm(s, rm, size, 1, 0);
+    } else if (reg < 4) {
+      // notl / negl
+      sched_rm(s, rm, size, 1, 1);
+      if (reg == 2) return 1;
+    } else {
+      // mull / imull / divl / idivl work on %edx:%eax
+      sched_rm(s, rm, 4, 1, 0);
+      sched_reg(s, EAX, 4, 1, 1);
+      sched_reg(s, EDX, 4, reg >= 6, 1);
+      s->latency = reg < 6 ? tunes[mtune].imul : tunes[mtune].div;
+    }
+    s->writes_flags = 1;
+    return 1;
+  }
+  return 0;
+}
+
+// whether two memory accesses can overlap. the frame and the data section
+// are disjoint, and so are two ranges off the same registers: if one of the
+// registers changed between the accesses they are ordered by that anyway
+uint8_t sched_may_alias(sched_insn_t *a, sched_insn_t *b)
+{
+  operand_t x = a->mem, y = b->mem;
+  uint8_t x_stack = x.type == oMEM && (x.reg == EBP || x.reg == ESP);
+  uint8_t y_stack = y.type == oMEM && (y.reg == EBP || y.reg == ESP);
+  if ((x_stack && y.type == oABS) || (y_stack && x.type == oABS)) return 0;
+  if (x.type == oABS && y.type == oABS && (a->reloc || b->reloc)) return 1;
+  if (
+    x.type != y.type || (x.type == oMEM && x.reg != y.reg)
+    || x.scale != y.scale || (x.scale && x.index != y.index)
+    )
+    return 1;
+  return (int32_t) (x.val - y.val) < b->size
+    && (int32_t) (y.val - x.val) < a->size;
+}
+
+// list-schedules `n` instructions that no jump lands between, writing their
+// new order to `order`. returns 1 if it differs from the old one
+uint8_t schedule_block(sched_insn_t *s, uint32_t n, uint32_t *order)
+{
+  static int16_t lat[SCHED_WINDOW][SCHED_WINDOW];
+  for (uint32_t i = 0; i < n; ++i)
+    for (uint32_t j = 0; j < n; ++j) lat[i][j] = -1;
+#define SCHED_EDGE(i, j, l) \
+  if (lat[i][j] < (int16_t) (l)) lat[i][j] = (l)
+
+  // flags that something reads before they are written again. the
+  // instruction after the block may read them
+  uint8_t live = 1;
+  for (uint32_t i = n; i-- > 0; ) {
+    s[i].live_flags = s[i].writes_flags && live;
+    if (s[i].writes_flags) live = 0;
+    if (s[i].reads_flags) live = 1;
+  }
+
+  int32_t last_def[8], last_flags = -1;
+  uint64_t readers[8] = { 0 }, flag_readers = 0, flag_writers = 0;
+  for (uint32_t r = 0; r < 8; ++r) last_def[r] = -1;
+  for (uint32_t j = 0; j < n; ++j) {
+    for (uint32_t r = 0; r < 8; ++r) {
+      if (!(s[j].uses & (1 << r)) || last_def[r] < 0) continue;
+      uint32_t i = last_def[r];
+      SCHED_EDGE(i, j, s[i].latency
+                 + ((s[j].addr & (1 << r)) ? tunes[mtune].agi : 0));
+    }
+    for (uint32_t r = 0; r < 8; ++r) {
+      if (!(s[j].defs & (1 << r))) continue;
+      for (uint32_t i = 0; i < j; ++i)
+        if (readers[r] & ((uint64_t) 1 << i)) SCHED_EDGE(i, j, 0);
+      if (last_def[r] >= 0) SCHED_EDGE(last_def[r], j, 0);
+      last_def[r] = j;
+      readers[r] = 0;
+    }
+    for (uint32_t r = 0; r < 8; ++r)
+      if ((s[j].uses & ~s[j].defs) & (1 << r)) readers[r] |= (uint64_t) 1 << j;
+
+    // an instruction whose flags nothing reads can move across other
+    // writers, but not between a writer and its readers
+    if (s[j].reads_flags) {
+      if (last_flags >= 0) SCHED_EDGE(last_flags, j, 1);
+      flag_readers |= (uint64_t) 1 << j;
+    }
+    if (s[j].writes_flags) {
+      for (uint32_t i = 0; i < j; ++i)
+        if (flag_readers & ((uint64_t) 1 << i)) SCHED_EDGE(i, j, 0);
+      if (s[j].live_flags) {
+        for (uint32_t i = 0; i < j; ++i)
+          if (flag_writers & ((uint64_t) 1 << i)) SCHED_EDGE(i, j, 0);
+        flag_readers = 0;
+        flag_writers = 0;
+      }
+      flag_writers |= (uint64_t) 1 << j;
+      last_flags = j;
+    }
+
+    if (!s[j].load && !s[j].store) continue;
+    for (uint32_t i = 0; i < j; ++i) {
+      if (!s[i].load && !s[i].store) continue;
+      if (!s[i].store && !s[j].store) continue;
+      if (sched_may_alias(s + i, s + j))
+        SCHED_EDGE(i, j, s[i].store && s[j].load);
+    }
+  }
+#undef SCHED_EDGE
+
+  // priority: the longest path from an instruction to the end of the block
+  uint32_t height[SCHED_WINDOW], ready_at[SCHED_WINDOW], preds[SCHED_WINDOW];
+  for (uint32_t i = n; i-- > 0; ) {
+    height[i] = s[i].latency;
+    for (uint32_t j = i + 1; j < n; ++j)
+      if (lat[i][j] >= 0 && lat[i][j] + height[j] > height[i])
+        height[i] = lat[i][j] + height[j];
+  }
+  for (uint32_t j = 0; j < n; ++j) {
+    ready_at[j] = 0;
+    preds[j] = 0;
+    for (uint32_t i = 0; i < j; ++i) preds[j] += lat[i][j] >= 0;
+  }
+
+  uint32_t cycle = 0, issued = 0, done = 0;
+  uint64_t scheduled = 0;
+  uint8_t moved = 0;
+  while (done < n) {
+    int32_t best = -1;
+    if (issued < tunes[mtune].width) {
+      for (uint32_t i = 0; i < n; ++i) {
+        if ((scheduled & ((uint64_t) 1 << i)) || preds[i] || ready_at[i] > cycle)
+          continue;
+        if (best < 0 || height[i] > height[best]) best = i;
+      }
+    }
+    if (best < 0) {
+      ++cycle;
+      issued = 0;
+      continue;
+    }
+    moved |= (uint32_t) best != done;
+    order[done++] = best;
+    scheduled |= (uint64_t) 1 << best;
+    ++issued;
+    for (uint32_t j = best + 1; j < n; ++j) {
+      if (lat[best][j] < 0) continue;
+      --preds[j];
+      if (cycle + lat[best][j] > ready_at[j]) ready_at[j] = cycle + lat[best][j];
+    }
+  }
+  return moved;
+}
+
+// schedules the function starting at `start`, which ends at the current end
+// of the text and has not had its jumps relaxed yet
+void schedule(uint32_t start)
+{
+  uint32_t end = text_loc;
+  uint32_t cap = 64, n = 0;
+  sched_insn_t *s = malloc(cap * sizeof(sched_insn_t));
+
+  // instructions that a jump lands on start a block
+  uint8_t *target = malloc(end - start + 1);
+  memset(target, 0, end - start + 1);
+  for (uint32_t i = 0; i < label_count; ++i)
+    if (labels[i] != NO_LABEL && labels[i] >= start && labels[i] <= end)
+      target[labels[i] - start] = 1;
+  uint8_t *reloc = malloc(end - start);
+  memset(reloc, 0, end - start);
+  for (relocation_t *r = relocs; r != NULL; r = r->next)
+    if (r->addr >= start && r->addr < end) reloc[r->addr - start] = 1;
+
+  for (uint32_t at = start; at < end; ) {
+    if (n == cap) {
+      cap *= 2;
+      s = realloc(s, cap * sizeof(sched_insn_t));
+    }
+    insn_t insn;
+    memset(s + n, 0, sizeof(sched_insn_t));
+    s[n].at = at;
+    s[n].len = decode_insn(text + at, &insn);
+    if (s[n].len == 0) {
+      free(s);
+      free(target);
+      free(reloc);
+      return;
+    }
+    s[n].barrier = !sched_decode(text + at, s + n);
+    if (s[n].load) s[n].latency += tunes[mtune].load;
+    if (s[n].latency == 0) s[n].latency = 1;
+    for (uint32_t k = 0; k < s[n].len; ++k) s[n].reloc |= reloc[at - start + k];
+    at += s[n].len;
+    ++n;
+  }
+
+  uint32_t *new_at = malloc((n + 1) * sizeof(uint32_t));
+  uint32_t order[SCHED_WINDOW];
+  uint8_t *out = malloc(end - start);
+  for (uint32_t i = 0; i < n; ++i) new_at[i] = s[i].at;
+  for (uint32_t first = 0; first < n; ) {
+    uint32_t last = first + 1;
+    if (!s[first].barrier) {
+      while (
+        last < n && last - first < SCHED_WINDOW && !s[last].barrier
+        && !target[s[last].at - start]
+        )
+        ++last;
+    }
+    if (last - first > 1 && schedule_block(s + first, last - first, order)) {
+      uint32_t at = s[first].at, len = 0;
+      for (uint32_t k = 0; k < last - first; ++k) {
+        sched_insn_t *insn = s + first + order[k];
+        new_at[first + order[k]] = at + len;
+        memcpy(out + len, text + insn->at, insn->len);
+        len += insn->len;
+      }
+      memcpy(text + at, out, len);
+    }
+    first = last;
+  }
+
+  for (relocation_t *r = relocs; r != NULL; r = r->next) {
+    if (r->addr < start || r->addr >= end) continue;
+    uint32_t lo = 0, hi = n;
+    while (lo < hi) {
+      uint32_t mid = (lo + hi) / 2;
+      if (s[mid].at <= r->addr) lo = mid + 1;
+      else hi = mid;
+    }
+    r->addr = new_at[lo - 1] + r->addr - s[lo - 1].at;
+  }
+
+  free(out);
+  free(new_at);
+  free(reloc);
+  free(target);
+  free(s);
+}
+
+// scratch registers that hold intermediate values while the other operand of
+// a binary operator is evaluated into %eax. both are caller-saved, so the
+// function prologue does not need to preserve them, but a call made while
+// they are live has to
+#define POOL_SIZE 2
+reg_t reg_pool[POOL_SIZE] = { ECX, EDX };
+uint8_t reg_busy = 0;
+
+// returns a free scratch register and marks it busy, or ESP if there is none
+reg_t alloc_reg()
+{
+  for (uint32_t i = 0; i < POOL_SIZE; ++i) {
+    if (reg_busy & (1 << reg_pool[i])) continue;
+    reg_busy |= 1 << reg_pool[i];
+    return reg_pool[i];
+  }
+  return ESP;
+}
+
+void free_reg(reg_t r)
+{
+  reg_busy &= ~(1 << r);
+}
+
+// returns k if n is 2^k, or -1
+int32_t log2_exact(uint32_t n)
+{
+  if (n == 0 || (n & (n - 1))) return -1;
+  int32_t k = 0;
+  while (n >>= 1) ++k;
+  return k;
+}
+
+// leal (%eax,%eax,scale - 1), %eax
+void emit_lea_scaled(uint32_t factor)
+{
+  operand_t o = {
+    .type = oMEM, .reg = EAX, .index = EAX, .scale = factor - 1
+  };
+  emit_lea(EAX, o);
+}
+
+// multiplies %eax by the constant `c` with shifts and leas when that takes
+// at most two of them, since each is a single cycle where imull is three.
+// returns 0 if `c` needs a real imull
+uint8_t emit_mul_const(int32_t c)
+{
+  uint32_t a = c < 0 ? -(uint32_t) c : (uint32_t) c;
+  operand_t eax = { .type = oREG, .reg = EAX };
+  static const uint32_t lea_factors[] = { 3, 5, 9 };
+
+  if (c == 0) {
+    // xorl %eax, %eax
+    emit_load(EAX, (operand_t) { .type = oIMM, .val = 0 }, 0);
+    return 1;
+  }
+
+  int32_t k = log2_exact(a);
+  uint32_t first = 0, second = 0;
+  if (k < 0) {
+    // a = f * 2^k or a = f * g with f, g in {3, 5, 9}
+    for (uint32_t i = 0; i < 3 && first == 0; ++i) {
+      uint32_t f = lea_factors[i];
+      if (a % f) continue;
+      k = log2_exact(a / f);
+      if (k >= 0) { first = f; break; }
+      for (uint32_t j = 0; j < 3; ++j)
+        if (a / f == lea_factors[j]) { first = f; second = a / f; break; }
+    }
+    if (first == 0) return 0;
+  }
+  if ((first != 0) + (second != 0) + (k > 0) + (c < 0) > 2) return 0;
+
+  // leal (%eax,%eax,<f - 1>), %eax
+  // leal (%eax,%eax,<g - 1>), %eax / shll $k, %eax
+  // negl %eax (if c < 0)
+  if (first) emit_lea_scaled(first);
+  if (second) emit_lea_scaled(second);
+  else if (k > 0) emit_shift(sSHL, EAX, k);
+  if (c < 0) emit_unary(uNEG, eax, 0);
+  return 1;
+}
+
+// computes the magic multiplier and shift for signed division by `d`
+// (2 <= |d| < 2^31), as in Hacker's Delight, chapter 10
+void signed_magic(int32_t d, int32_t *m, uint32_t *s)
+{
+  const uint32_t two31 = 0x80000000;
+  uint32_t ad = d < 0 ? -(uint32_t) d : (uint32_t) d;
+  uint32_t t = two31 + ((uint32_t) d >> 31);
+  uint32_t anc = t - 1 - t % ad;
+  uint32_t q1 = two31 / anc, r1 = two31 - q1 * anc;
+  uint32_t q2 = two31 / ad, r2 = two31 - q2 * ad;
+  uint32_t p = 31, delta;
+  do {
+    ++p;
+    q1 <<= 1; r1 <<= 1;
+    if (r1 >= anc) { ++q1; r1 -= anc; }
+    q2 <<= 1; r2 <<= 1;
+    if (r2 >= ad) { ++q2; r2 -= ad; }
+    delta = ad - r2;
+  } while (q1 < delta || (q1 == delta && r1 == 0));
+  *m = q2 + 1;
+  if (d < 0) *m = -*m;
+  *s = p - 32;
+}
+
+// divides %eax by the constant `d` (or takes the remainder if `modulo` is
+// set) without idivl: powers of two become a rounding adjustment and a shift,
+// everything else a multiply by the reciprocal. %ecx and %edx are used as
+// temporaries and saved around the sequence if they are live. returns 0 for
+// divisors that need a real idivl
+uint8_t emit_div_const(int32_t d, uint8_t modulo)
+{
+  if (d == 0 || d == INT32_MIN) return 0;
+  // the magic numbers are for 32-bit multiplies, so 64-bit code does the
+  // same and leaves sign-extending the result to the caller
+  uint8_t saved_wide = wide;
+  wide = 0;
+  operand_t eax = { .type = oREG, .reg = EAX };
+  operand_t ecx = { .type = oREG, .reg = ECX };
+  operand_t edx = { .type = oREG, .reg = EDX };
+
+  if (d == 1 || d == -1) {
+    // x % 1 == 0, x / 1 == x, x / -1 == -x
+    if (modulo) emit_load(EAX, (operand_t) { .type = oIMM, .val = 0 }, 0);
+    else if (d == -1) emit_unary(uNEG, eax, 0);
+    wide = saved_wide;
+    return 1;
+  }
+
+  uint8_t save_ecx = (reg_busy >> ECX) & 1;
+  uint8_t save_edx = (reg_busy >> EDX) & 1;
+  if (save_ecx) emit_push(ecx);
+  if (save_edx) emit_push(edx);
+
+  uint32_t a = d < 0 ? -(uint32_t) d : (uint32_t) d;
+  int32_t k = log2_exact(a);
+  if (k > 0) {
+    // cdq
+    // shrl $<32 - k>, %edx         (2^k - 1 if negative, rounds toward 0)
+    // addl %edx, %eax
+    // sarl $k, %eax                (quotient)
+    // negl %eax                    (if d < 0)
+    // -- or for the remainder --
+    // andl $<2^k - 1>, %eax
+    // subl %edx, %eax
+    emit_cdq();
+    emit_shift(sSHR, EDX, 32 - k);
+    emit_alu(aADD, EAX, edx, 0);
+    if (modulo) {
+      emit_alu(aAND, EAX, (operand_t) { .type = oIMM, .val = a - 1 }, 0);
+      emit_alu(aSUB, EAX, edx, 0);
+    } else {
+      emit_shift(sSAR, EAX, k);
+      if (d < 0) emit_unary(uNEG, eax, 0);
+    }
+  } else {
+    int32_t m;
+    uint32_t s;
+    signed_magic(d, &m, &s);
+    // movl %eax, %ecx
+    // movl $m, %edx
+    // imull %edx                   (%edx = high half of x * m)
+    // addl/subl %ecx, %edx         (if m and d have different signs)
+    // sarl $s, %edx
+    // movl %edx, %eax
+    // shrl $31, %eax
+    // addl %edx, %eax              (quotient, +1 if negative)
+    // -- and for the remainder --
+    // imull $d, %eax, %eax
+    // subl %eax, %ecx
+    // movl %ecx, %eax
+    emit_load(ECX, eax, 0);
+    emit_load(EDX, (operand_t) { .type = oIMM, .val = m }, 0);
+    emit_unary(uIMUL, edx, 0);
+    if (d > 0 && m < 0) emit_alu(aADD, EDX, ecx, 0);
+    else if (d < 0 && m > 0) emit_alu(aSUB, EDX, ecx, 0);
+    if (s) emit_shift(sSAR, EDX, s);
+    emit_load(EAX, edx, 0);
+    emit_shift(sSHR, EAX, 31);
+    emit_alu(aADD, EAX, edx, 0);
+    if (modulo) {
+      emit_imul(EAX, (operand_t) { .type = oIMM, .val = d });
+      emit_alu(aSUB, ECX, eax, 0);
+      emit_load(EAX, ecx, 0);
+    }
+  }
+
+  if (save_edx) emit_pop(EDX);
+  if (save_ecx) emit_pop(ECX);
+  wide = saved_wide;
+  return 1;
+}
+
+uint8_t is_pointer(symbol_type_t type)
+{
+  return type == tINT_PTR || type == tCHAR_PTR || type == tVOID_PTR
+    || type == tPTR_PTR;
+}
+
+// the type of what a pointer of type `ptr` points to. nanoc treats all
+// pointer arithmetic as being performed on char* / int, so that is an int
+// unless it is a char, or a whole pointer in 64-bit code
+symbol_type_t deref_type(symbol_type_t ptr)
+{
+  if (ptr == tCHAR_PTR) return tCHAR;
+  if (ptr == tPTR_PTR && target64) return tVOID_PTR;
+  return tINT;
+}
+
+// loads a value of type `type` from `src`, sign-extended to the whole
+// register:
+//   movsbl/movl src, %dst
+// or in 64-bit code:
+//   movsbq/movslq/movq src, %dst
+void emit_load_typed(reg_t dst, operand_t src, symbol_type_t type)
+{
+  if (type == tCHAR) emit_movsx(dst, src);
+  else if (type_size(type) < WORD_SIZE) emit_movsxd(dst, src);
+  else emit_load(dst, src, 0);
+}
+
+// movb/movl/movq %src, dst
+void emit_store_typed(operand_t dst, reg_t src, symbol_type_t type)
+{
+  uint8_t saved = wide;
+  wide = type_size(type) == 8;
+  emit_store(dst, src, type == tCHAR);
+  wide = saved;
+}
+
+// if `expr` is a variable that lives at a fixed location (a local or a
+// defined global), writes its memory operand to `out` and returns 1
+uint8_t ident_operand(
+  ast_node_t *expr, symbol_t *symtab, operand_t *out, symbol_type_t *type
+  )
+{
+  if (expr->variant != vIDENT) return 0;
+  symbol_t *sym = symtab_get(symtab, expr->s);
+  if (sym == NULL || sym->loc_type == lTEXT) return 0;
+
+  *type = sym->type;
+  if (sym->loc_type == lSTACK)
+    *out = (operand_t) { .type = oMEM, .reg = EBP, .val = sym->loc };
+  else
+    *out = (operand_t) { .type = oABS, .val = DATA_START + sym->loc };
+  return 1;
+}
+
+// if the value of `expr` can be used directly as an instruction operand
+// (a literal, a function address or an int/pointer variable), writes it to
+// `out` and returns 1. char variables are not operands since they have to be
+// sign-extended with movsbl first, and neither are ints in 64-bit code
+uint8_t leaf_operand(
+  ast_node_t *expr, symbol_t *symtab, operand_t *out, symbol_type_t *type
+  )
+{
+  if (expr->variant == vINT_LITERAL) {
+    *out = (operand_t) { .type = oIMM, .val = expr->i };
+    *type = tINT;
+    return 1;
+  }
+  if (expr->variant == vCHAR_LITERAL) {
+    *out = (operand_t) { .type = oIMM, .val = (int8_t) expr->i };
+    *type = tCHAR;
+    return 1;
+  }
+
+  if (ident_operand(expr, symtab, out, type))
+    return type_size(*type) == WORD_SIZE;
+
+  if (expr->variant != vIDENT) return 0;
+  symbol_t *sym = symtab_get(symtab, expr->s);
+  if (sym == NULL || (sym->loc == (uint32_t) -1 && sym->loc_type == lTEXT))
+    return 0;
+  *out = (operand_t) { .type = oIMM, .val = TEXT_START + sym->loc };
+  *type = sym->type;
+  return 1;
+}
+
+// Sethi-Ullman number: the number of registers needed to evaluate `expr`
+// without spilling. calls are given the maximum, since every live scratch
+// register has to be saved around them
+uint32_t expr_need(ast_node_t *expr, symbol_t *symtab)
+{
+  operand_t o;
+  symbol_type_t t;
+
+  switch (expr->variant) {
+  case vCALL: return POOL_SIZE + 1;
+  case vDEREF: case vADDRESSOF: case vINCREMENT: case vDECREMENT:
+  case vNOT: case vBIT_NOT:
+    return expr_need(expr->children, symtab);
+  case vADD: case vSUBTRACT: case vMULTIPLY: case vDIVIDE: case vMODULO:
+  case vLT: case vGT: case vEQUAL: case vAND: case vOR:
+  case vBIT_AND: case vBIT_OR: case vBIT_XOR: case vASSIGN:
+    break;
+  default: return 1;
+  }
+
+  ast_node_t *left = expr->children, *right = left->next;
+  if (expr->variant == vASSIGN) {
+    if (left->variant == vIDENT) return expr_need(right, symtab);
+    left = right; right = expr->children->children;
+  }
+
+  uint32_t l = expr_need(left, symtab);
+  if (leaf_operand(right, symtab, &o, &t)) return l;
+  uint32_t r = expr_need(right, symtab);
+  if (leaf_operand(left, symtab, &o, &t)) return r;
+  if (l == r) return l + 1;
+  return l > r ? l : r;
+}
+
+symbol_type_t codegen_expr(ast_node_t *expr, symbol_t *symtab);
+
+// evaluates the operands of a binary operator, leaving one of them in %eax and
+// the other in `rhs`. operands are evaluated left to right, like the IR does,
+// so that side effects happen in the same order at every -O level. only when
+// neither operand has side effects is a variable on the left used in place,
+// or the operand needing more registers evaluated first. the operand that
+// goes first is held in a scratch register while the other one is computed,
+// or spilled to the stack when no scratch register is free.
+//
+// if `commutative` is 0 %eax always holds the left operand, otherwise
+// `swapped` is set when it holds the right one instead.
+// returns the number of bytes pushed onto the stack, to be released once
+// `rhs` has been used
+uint32_t codegen_operands(
+  ast_node_t *left, ast_node_t *right, symbol_t *symtab, uint8_t commutative,
+  operand_t *rhs, symbol_type_t *left_type, symbol_type_t *right_type,
+  uint8_t *swapped
+  )
+{
+  *swapped = 0;
+  uint8_t reorder = expr_pure(left) && expr_pure(right);
+
+  if (leaf_operand(right, symtab, rhs, right_type)) {
+    *left_type = codegen_expr(left, symtab);
+    return 0;
+  }
+
+  if (
+    commutative && leaf_operand(left, symtab, rhs, left_type)
+    && (reorder || rhs->type == oIMM)
+    ) {
+    *right_type = codegen_expr(right, symtab);
+    *swapped = 1;
+    return 0;
+  }
+
+  reg_t r = alloc_reg();
+  if (r == ESP && reorder) {
+    // <right operand>
+    // pushl %eax
+    // <left operand>
+    // <op> (%esp), %eax
+    *right_type = codegen_expr(right, symtab);
+    emit_push((operand_t) { .type = oREG, .reg = EAX });
+    *left_type = codegen_expr(left, symtab);
+    *rhs = (operand_t) { .type = oMEM, .reg = ESP, .val = 0 };
+    return WORD_SIZE;
+  }
+  if (r == ESP) {
+    // <left operand>
+    // pushl %eax
+    // <right operand>
+    // <op> (%esp), %eax        (commutative)
+    // or
+    // pushl %eax
+    // movl 4(%esp), %eax
+    // <op> (%esp), %eax
+    *left_type = codegen_expr(left, symtab);
+    emit_push((operand_t) { .type = oREG, .reg = EAX });
+    *right_type = codegen_expr(right, symtab);
+    *rhs = (operand_t) { .type = oMEM, .reg = ESP, .val = 0 };
+    if (commutative) {
+      *swapped = 1;
+      return WORD_SIZE;
+    }
+    emit_push((operand_t) { .type = oREG, .reg = EAX });
+    emit_load(
+      EAX, (operand_t) { .type = oMEM, .reg = ESP, .val = WORD_SIZE }, 0
+      );
+    return 2 * WORD_SIZE;
+  }
+
+  *rhs = (operand_t) { .type = oREG, .reg = r };
+  if (!reorder || expr_need(left, symtab) > expr_need(right, symtab)) {
+    // movl %eax, %r
+    *left_type = codegen_expr(left, symtab);
+    emit_store(*rhs, EAX, 0);
+    *right_type = codegen_expr(right, symtab);
+    if (commutative) *swapped = 1;
+    else {
+      // xchgl %eax, %r
+      emit_xchg(EAX, r);
+    }
+  } else {
+    *right_type = codegen_expr(right, symtab);
+    emit_store(*rhs, EAX, 0);
+    *left_type = codegen_expr(left, symtab);
+  }
+
+  return 0;
+}
+
+// frees the scratch register or stack slot holding an operand
+void release_operand(operand_t o, uint32_t pushed)
+{
+  if (o.type == oREG) free_reg(o.reg);
+  emit_release(pushed);
+}
+
+// if `expr` is a comparison, generates it leaving only the flags set, and
+// returns the condition code that holds when `expr` is true. returns
+// ccALWAYS otherwise
+uint8_t codegen_compare(ast_node_t *expr, symbol_t *symtab)
+{
+  if (expr->variant != vLT && expr->variant != vGT && expr->variant != vEQUAL)
+    return ccALWAYS;
+
+  operand_t rhs;
+  symbol_type_t left_type, right_type;
+  uint8_t swapped;
+  uint32_t pushed = codegen_operands(
+    expr->children, expr->children->next, symtab, 1,
+    &rhs, &left_type, &right_type, &swapped
+    );
+
+  // cmpl <rhs>, %eax
+  // leal <pushed>(%esp), %esp     (if the rhs was spilled, keeps the flags)
+  emit_alu(aCMP, EAX, rhs, 0);
+  if (rhs.type == oREG) free_reg(rhs.reg);
+  if (pushed)
+    emit_lea(ESP, (operand_t) { .type = oMEM, .reg = ESP, .val = pushed });
+
+  if (expr->variant == vLT) return swapped ? ccG : ccL;
+  if (expr->variant == vGT) return swapped ? ccL : ccG;
+  return ccE;
+}
+
+uint32_t codegen_argument(ast_node_t *arg, symbol_t *symtab);
+symbol_type_t codegen_call64(ast_node_t *expr, symbol_t *symtab);
+
+// values are always computed in all of %eax: chars are sign-extended when
+// they are loaded and only narrowed by the movb that stores them, so nothing
+// reads %eax after writing just %al. in 64-bit code they fill all of %rax,
+// and ints are sign-extended again after arithmetic that can carry into the
+// upper half
+symbol_type_t codegen_expr(ast_node_t *expr, symbol_t *symtab)
+{
+  if (expr->variant == vINT_LITERAL || expr->variant == vCHAR_LITERAL) {
+    // movl <imm>, %eax
+    if (expr->variant == vINT_LITERAL) {
+      emit_load(EAX, (operand_t) { .type = oIMM, .val = expr->i }, 0);
+      return tINT;
+    }
+    emit_load(EAX, (operand_t) { .type = oIMM, .val = (int8_t) expr->i }, 0);
+    return tCHAR;
+  }
+
+  if (expr->variant == vIDENT) {
+    symbol_t *sym = symtab_get(symtab, expr->s);
+    if (sym == NULL) {
+      printf("Undefined symbol %s\n", expr->s);
+      exit(1);
+    }
+    if (sym->loc == (uint32_t) -1 && sym->loc_type == lTEXT) {
+      emit_load_symbol(EAX, expr->s, symtab);
+
+      // assume all symbols in .text are function pointers
+      // so do not dereference
+      if (sym->loc_type == lTEXT) return sym->type;
+
+      // for int:
+      //   movl (%eax), %eax
+      // for char:
+      //   movsbl (%eax), %eax
+      operand_t mem = { .type = oMEM, .reg = EAX, .val = 0 };
+      if (sym->type == tCHAR) emit_movsx(EAX, mem);
+      else emit_load(EAX, mem, 0);
+      return sym->type;
+    }
+
+    // for int:
+    //   movl x(%ebp)/addr, %eax
+    // for char:
+    //   movsbl x(%ebp)/addr, %eax
+    // for functions:
+    //   movl <addr>, %eax
+    operand_t o;
+    symbol_type_t type;
+    if (!ident_operand(expr, symtab, &o, &type)) {
+      o = (operand_t) { .type = oIMM, .val = TEXT_START + sym->loc };
+      emit_load(EAX, o, 0);
+    } else emit_load_typed(EAX, o, type);
+    return sym->type;
+  }
+
+  if (expr->variant == vSTRING_LITERAL) {
+    // write to data section
+    uint32_t addr = DATA_START + data_loc;
+    uint32_t len = strlen(expr->s);
+    write_data((uint8_t *)(expr->s), len + 1);
+
+    // movl addr, %eax
+    emit_load(EAX, (operand_t) { .type = oIMM, .val = addr }, 0);
+    return tCHAR_PTR;
+  }
+
+  if (expr->variant == vDEREF) {
+    // for now, we do not bother returning the correct expression type
+    // for more than one level of indirection because nanoc treats all pointer
+    // arithmetic as being performed on char* / int
+
+    // for int:
+    //   movl (%eax), %eax
+    // for char:
+    //   movsbl (%eax), %eax
+    symbol_type_t ptr_type = codegen_expr(expr->children, symtab);
+    operand_t mem = { .type = oMEM, .reg = EAX, .val = 0 };
+    symbol_type_t type = deref_type(ptr_type);
+    emit_load_typed(EAX, mem, type);
+    return type;
+  }
+
+  if (expr->variant == vADDRESSOF) {
+    ast_node_t *child = expr->children;
+    if (child->variant != vDEREF && child->variant != vIDENT) {
+      printf("Invalid operand for 'address of' operator\n");
+      exit(1);
+    }
+    if (child->variant == vDEREF)
+      return codegen_expr(child->children, symtab);
+
+    symbol_t *sym = symtab_get(symtab, child->s);
+    if (sym == NULL) {
+      printf("Undefined symbol %s\n", expr->s);
+      exit(1);
+    }
+    if (sym->loc == (uint32_t) -1 && sym->loc_type == lTEXT) {
+      emit_load_symbol(EAX, child->s, symtab);
+      return sym->type;
+    }
+
+    if (sym->loc_type == lSTACK) {
+      // leal offset(%ebp), %eax
+      emit_lea(EAX, (operand_t) { .type = oMEM, .reg = EBP, .val = sym->loc });
+      switch (sym->type) {
+      case tINT: return tINT_PTR;
+      case tCHAR: return tCHAR_PTR;
+      case tVOID: return tVOID_PTR;
+      default: return tPTR_PTR;
+      }
+    }
+
+    // movl addr, %eax
+    uint32_t addr = DATA_START + sym->loc;
+    if (sym->loc_type == lTEXT) addr = TEXT_START + sym->loc;
+    emit_load(EAX, (operand_t) { .type = oIMM, .val = addr }, 0);
+
+    if (sym->loc_type == lTEXT) return sym->type;
+    switch (sym->type) {
+    case tINT: return tINT_PTR;
+    case tCHAR: return tCHAR_PTR;
+    case tVOID: return tVOID_PTR;
+    default: return tPTR_PTR;
+    }
+  }
+
+  if (expr->variant == vINCREMENT || expr->variant == vDECREMENT) {
+    // incl/decl/incb/decb <lval>
+    // movl/movsbl <lval>, %eax
+    operand_t lval;
+    symbol_type_t child_type;
+    if (!ident_operand(expr->children, symtab, &lval, &child_type)) {
+      ast_node_t *addr = malloc(sizeof(ast_node_t));
+      memset(addr, 0, sizeof(ast_node_t));
+      addr->type = nEXPR;
+      addr->variant = vADDRESSOF;
+      addr->children = expr->children;
+      child_type = deref_type(codegen_expr(addr, symtab));
+      lval = (operand_t) { .type = oMEM, .reg = EAX, .val = 0 };
+    }
+
+    uint8_t saved = wide;
+    wide = type_size(child_type) == 8;
+    emit_incdec(expr->variant == vDECREMENT, lval, child_type == tCHAR);
+    wide = saved;
+    emit_load_typed(EAX, lval, child_type);
+    return child_type;
+  }
+
+  if (expr->variant == vNOT) {
+    // !(a < b) is a comparison with the opposite condition:
+    // cmpl <b>, %eax
+    // set<!cc> %al
+    // movzbl %al, %eax
+    uint8_t cc = codegen_compare(expr->children, symtab);
+    if (cc != ccALWAYS) {
+      emit_setcc(cc ^ 1);
+      return tCHAR;
+    }
+
+    codegen_expr(expr->children, symtab);
+
+    // test %eax, %eax
+    // sete %al
+    // movzbl %al, %eax
+    emit_test(EAX, EAX, 0);
+    emit_setcc(ccE);
+    return tCHAR;
+  }
+
+  if (expr->variant == vBIT_NOT) {
+    symbol_type_t child_type = codegen_expr(expr->children, symtab);
+    // notl %eax
+    emit_unary(uNOT, (operand_t) { .type = oREG, .reg = EAX }, 0);
+    return child_type;
+  }
+
+  if (
+    expr->variant == vADD || expr->variant == vSUBTRACT
+    || expr->variant == vMULTIPLY || expr->variant == vDIVIDE
+    || expr->variant == vMODULO || expr->variant == vBIT_AND
+    || expr->variant == vBIT_OR || expr->variant == vBIT_XOR
+    ) {
+    uint8_t commutative = expr->variant != vSUBTRACT
+      && expr->variant != vDIVIDE && expr->variant != vMODULO;
+    operand_t rhs;
+    symbol_type_t left_type, right_type;
+    uint8_t swapped;
+    uint32_t pushed = codegen_operands(
+      expr->children, expr->children->next, symtab, commutative,
+      &rhs, &left_type, &right_type, &swapped
+      );
+    uint8_t byte = left_type == tCHAR && right_type == tCHAR;
+
+    if (expr->variant == vMULTIPLY) {
+      // imull <rhs>, %eax
+      if (rhs.type != oIMM || !emit_mul_const(rhs.val)) emit_imul(EAX, rhs);
+    } else if (
+      (expr->variant == vDIVIDE || expr->variant == vMODULO)
+      && rhs.type == oIMM
+      && emit_div_const(rhs.val, expr->variant == vMODULO)
+      ) {
+      // strength reduced
+    } else if (expr->variant == vDIVIDE || expr->variant == vMODULO) {
+      // the divisor has to be a register or memory operand, and cannot live
+      // in %edx which holds the high half of the dividend
+      if (rhs.type == oIMM || (rhs.type == oREG && rhs.reg == EDX)) {
+        emit_push(rhs);
+        release_operand(rhs, 0);
+        rhs = (operand_t) { .type = oMEM, .reg = ESP, .val = 0 };
+        pushed += WORD_SIZE;
+      }
+
+      // pushl %edx (if live)
+      // cdq
+      // idivl <rhs>
+      // movl %edx, %eax (for modulo)
+      // popl %edx (if live)
+      uint8_t save_edx = (reg_busy >> EDX) & 1;
+      if (save_edx) {
+        emit_push((operand_t) { .type = oREG, .reg = EDX });
+        if (rhs.type == oMEM && rhs.reg == ESP) rhs.val += WORD_SIZE;
+      }
+      emit_cdq();
+      emit_unary(uIDIV, rhs, 0);
+      if (expr->variant == vMODULO)
+        emit_store((operand_t) { .type = oREG, .reg = EAX }, EDX, 0);
+      if (save_edx) emit_pop(EDX);
+    } else {
+      alu_op_t op = aADD;
+      if (expr->variant == vSUBTRACT) op = aSUB;
+      else if (expr->variant == vBIT_AND) op = aAND;
+      else if (expr->variant == vBIT_OR) op = aOR;
+      else if (expr->variant == vBIT_XOR) op = aXOR;
+      // <op>l <rhs>, %eax
+      emit_alu(op, EAX, rhs, 0);
+    }
+
+    // the result of adding, subtracting or multiplying two chars is a char:
+    // movsbl %al, %eax
+    // and/or/xor of sign-extended bytes are sign-extended already
+    if (
+      byte && (expr->variant == vADD || expr->variant == vSUBTRACT
+      || expr->variant == vMULTIPLY)
+      )
+      emit_movsx(EAX, (operand_t) { .type = oREG, .reg = EAX });
+
+    // in 64-bit code, arithmetic on ints is done on the whole register and
+    // wraps to 32 bits afterwards, unless it is on a pointer:
+    // movslq %eax, %rax
+    uint8_t arith = expr->variant != vBIT_AND && expr->variant != vBIT_OR
+      && expr->variant != vBIT_XOR;
+    if (
+      target64 && arith && !byte && !is_pointer(left_type)
+      && !is_pointer(right_type)
+      ) {
+      emit_movsxd(EAX, (operand_t) { .type = oREG, .reg = EAX });
+    }
+
+    release_operand(rhs, pushed);
+    if (target64 && is_pointer(right_type) && !is_pointer(left_type))
+      return right_type;
+    if (left_type == tCHAR) return right_type;
+    return left_type;
+  }
+
+  if (expr->variant == vLT || expr->variant == vGT || expr->variant == vEQUAL) {
+    // <comparison>
+    // setl/setg/sete %al
+    // movzbl %al, %eax
+    emit_setcc(codegen_compare(expr, symtab));
+    return tINT;
+  }
+
+  if ((expr->variant == vAND || expr->variant == vOR) && short_circuit) {
+    // <left>
+    // testl %eax, %eax
+    // je/jne done                  (je for &&, jne for ||)
+    // <right>
+    // testl %eax, %eax
+    // done:
+    // setne %al
+    // movzbl %al, %eax
+    // the flags at `done` are those of whichever test decided the result
+    uint32_t done = new_label();
+    codegen_expr(expr->children, symtab);
+    emit_test(EAX, EAX, 0);
+    emit_jump(expr->variant == vAND ? ccE : ccNE, done);
+    codegen_expr(expr->children->next, symtab);
+    emit_test(EAX, EAX, 0);
+    place_label(done);
+    emit_setcc(ccNE);
+    return tINT;
+  }
+
+  if (expr->variant == vAND || expr->variant == vOR) {
+    operand_t rhs;
+    symbol_type_t left_type, right_type;
+    uint8_t swapped;
+    uint32_t pushed = codegen_operands(
+      expr->children, expr->children->next, symtab, 1,
+      &rhs, &left_type, &right_type, &swapped
+      );
+
+    if (expr->variant == vAND) {
+      // negl %eax
+      // sbbl %eax, %eax
+      // andl <rhs>, %eax
+      operand_t eax = { .type = oREG, .reg = EAX };
+      emit_unary(uNEG, eax, 0);
+      emit_alu(aSBB, EAX, eax, 0);
+      emit_alu(aAND, EAX, rhs, 0);
+    } else {
+      // orl <rhs>, %eax
+      emit_alu(aOR, EAX, rhs, 0);
+    }
+
+    // setne %al
+    // movzbl %al, %eax
+    emit_setcc(ccNE);
+    release_operand(rhs, pushed);
+    return tINT;
+  }
+
+  if (expr->variant == vASSIGN) {
+    ast_node_t *lhs = expr->children;
+    operand_t dst;
+    symbol_type_t dst_type;
+    if (ident_operand(lhs, symtab, &dst, &dst_type)) {
+      // <value>
+      // movl/movb %eax, <lval>
+      codegen_expr(lhs->next, symtab);
+      emit_store_typed(dst, EAX, dst_type);
+      return tINT;
+    }
+
+    ast_node_t *addr = lhs->children;
+    if (lhs->variant != vDEREF) {
+      addr = malloc(sizeof(ast_node_t));
+      memset(addr, 0, sizeof(ast_node_t));
+      addr->type = nEXPR;
+      addr->variant = vADDRESSOF;
+      addr->children = lhs;
+    }
+
+    operand_t rhs;
+    symbol_type_t value_type, ptr_type;
+    uint8_t swapped;
+    uint32_t pushed = codegen_operands(
+      lhs->next, addr, symtab, 0, &rhs, &value_type, &ptr_type, &swapped
+      );
+    symbol_type_t type = deref_type(ptr_type);
+
+    // movl/movb %eax, (<address>)
+    if (rhs.type == oIMM) {
+      dst = (operand_t) { .type = oABS, .val = rhs.val };
+      emit_store_typed(dst, EAX, type);
+    } else if (rhs.type == oREG) {
+      dst = (operand_t) { .type = oMEM, .reg = rhs.reg, .val = 0 };
+      emit_store_typed(dst, EAX, type);
+    } else {
+      // the address is in memory: load it into a scratch register first,
+      // borrowing %ecx if none is free
+      reg_t r = alloc_reg();
+      if (r == ESP) {
+        r = ECX;
+        emit_push((operand_t) { .type = oREG, .reg = ECX });
+        if (rhs.reg == ESP) rhs.val += WORD_SIZE;
+      }
+      emit_load(r, rhs, 0);
+      dst = (operand_t) { .type = oMEM, .reg = r, .val = 0 };
+      emit_store_typed(dst, EAX, type);
+      if (reg_busy & (1 << r)) free_reg(r);
+      else emit_pop(ECX);
+    }
+
+    release_operand(rhs, pushed);
+    return tINT;
+  }
+
+  if (expr->variant == vCALL && target64) return codegen_call64(expr, symtab);
+  if (expr->variant == vCALL) {
+    // scratch registers are caller-saved:
+    //   pushl %ecx/%edx (if live)
+    //   <arguments>
+    //   calll <function>
+    // or through a pointer:
+    //   <callee>
+    //   calll *%eax
+    //   addl <offset>, %esp
+    //   popl %edx/%ecx (if live)
+    uint8_t live = reg_busy;
+    for (uint32_t i = 0; i < POOL_SIZE; ++i)
+      if (live & (1 << reg_pool[i]))
+        emit_push((operand_t) { .type = oREG, .reg = reg_pool[i] });
+    reg_busy = 0;
+
+    uint32_t offset = codegen_argument(expr->children->next, symtab);
+    symbol_type_t callee_type;
+    symbol_t *sym = NULL;
+    if (expr->children->variant == vIDENT)
+      sym = symtab_get(symtab, expr->children->s);
+    if (sym != NULL && sym->loc_type == lTEXT) {
+      callee_type = sym->type;
+      emit_call_symbol(expr->children->s, symtab);
+    } else {
+      callee_type = codegen_expr(expr->children, symtab);
+      emit_call((operand_t) { .type = oREG, .reg = EAX });
+    }
+    emit_release(offset);
+    // movsbl %al, %eax             (for functions returning char)
+    if (callee_type == tCHAR)
+      emit_movsx(EAX, (operand_t) { .type = oREG, .reg = EAX });
+
+    reg_busy = live;
+    for (uint32_t i = POOL_SIZE; i > 0; --i)
+      if (live & (1 << reg_pool[i - 1])) emit_pop(reg_pool[i - 1]);
+    return callee_type;
+  }
+
+  return tINT;
+}
+
+uint32_t codegen_argument(ast_node_t *arg, symbol_t *symtab)
+{
+  if (arg == NULL) return 0;
+  uint32_t offset = codegen_argument(arg->next, symtab);
+
+  // pushl <arg>
+  operand_t o;
+  symbol_type_t t;
+  if (!leaf_operand(arg, symtab, &o, &t)) {
+    codegen_expr(arg, symtab);
+    o = (operand_t) { .type = oREG, .reg = EAX };
+  }
+  emit_push(o);
+
+  return offset + WORD_SIZE;
+}
+
+// 64-bit code calls functions as the System V ABI says: the first six
+// arguments go in registers and the rest on the stack, which is 16-byte
+// aligned at the call. the arguments are pushed like in 32-bit code and the
+// first ones popped into their registers:
+//   pushq %rcx/%rdx                (if live)
+//   pushq %rsp
+//   pushq (%rsp)
+//   andq $-16, %rsp                (8(%rsp) is the old %rsp either way)
+//   subq $8, %rsp                  (if an odd number of arguments is left
+//                                   on the stack)
+//   <arguments>
+//   popq %rdi/%rsi/%rdx/%rcx/%r8/%r9
+//   xorl %eax, %eax                (no vector registers, for varargs)
+//   callq <function>
+// or through a pointer, evaluated before the arguments are popped:
+//   <callee>
+//   movq %rax, %r11
+//   popq %rdi/...
+//   xorl %eax, %eax
+//   callq *%r11
+// and then:
+//   movq <offset>(%rsp), %rsp
+//   movslq %eax, %rax / movsbq %al, %rax
+//                                  (for functions returning int or char)
+//   popq %rdx/%rcx                 (if live)
+#define ARG_REGS64 6
+
+reg_t arg_regs64[ARG_REGS64] = { EDI, ESI, EDX, ECX, R8, R9 };
+
+symbol_type_t codegen_call64(ast_node_t *expr, symbol_t *symtab)
+{
+  uint8_t live = reg_busy;
+  for (uint32_t i = 0; i < POOL_SIZE; ++i)
+    if (live & (1 << reg_pool[i]))
+      emit_push((operand_t) { .type = oREG, .reg = reg_pool[i] });
+  reg_busy = 0;
+
+  uint32_t args = 0;
+  for (ast_node_t *arg = expr->children->next; arg != NULL; arg = arg->next)
+    ++args;
+  uint32_t on_stack = args > ARG_REGS64 ? args - ARG_REGS64 : 0;
+  uint32_t pad = 8 * (on_stack & 1);
+  emit_push((operand_t) { .type = oREG, .reg = ESP });
+  emit_push((operand_t) { .type = oMEM, .reg = ESP, .val = 0 });
+  emit_alu(aAND, ESP, (operand_t) { .type = oIMM, .val = -16 }, 0);
+  if (pad) emit_alu(aSUB, ESP, (operand_t) { .type = oIMM, .val = pad }, 0);
+  codegen_argument(expr->children->next, symtab);
+
+  symbol_type_t callee_type;
+  symbol_t *sym = NULL;
+  if (expr->children->variant == vIDENT)
+    sym = symtab_get(symtab, expr->children->s);
+  uint8_t direct = sym != NULL && sym->loc_type == lTEXT;
+  if (direct) callee_type = sym->type;
+  else {
+    callee_type = codegen_expr(expr->children, symtab);
+    emit_load(R11, (operand_t) { .type = oREG, .reg = EAX }, 0);
+  }
+  for (uint32_t i = 0; i < args && i < ARG_REGS64; ++i)
+    emit_pop(arg_regs64[i]);
+  wide = 0;
+  emit_load(EAX, (operand_t) { .type = oIMM, .val = 0 }, 0);
+  wide = 1;
+  if (direct) emit_call_symbol(expr->children->s, symtab);
+  else emit_call((operand_t) { .type = oREG, .reg = R11 });
+
+  operand_t old = { .type = oMEM, .reg = ESP, .val = 8 * on_stack + pad + 8 };
+  emit_load(ESP, old, 0);
+  operand_t eax = { .type = oREG, .reg = EAX };
+  if (callee_type == tINT) emit_movsxd(EAX, eax);
+  else if (callee_type == tCHAR) emit_movsx(EAX, eax);
+
+  reg_busy = live;
+  for (uint32_t i = POOL_SIZE; i > 0; --i)
+    if (live & (1 << reg_pool[i - 1])) emit_pop(reg_pool[i - 1]);
+  return callee_type;
+}
+
+// generates code that jumps to `label` if the truth value of `cond` is
+// `when` and falls through otherwise. comparisons jump on their own flags
+// instead of producing a 0/1 value, and with -fshort-circuit, && and || jump
+// as soon as one operand decides the result
+void codegen_branch(
+  ast_node_t *cond, symbol_t *symtab, uint8_t when, uint32_t label
+  )
+{
+  if (short_circuit && (cond->variant == vAND || cond->variant == vOR)) {
+    ast_node_t *left = cond->children;
+    if (when != (cond->variant == vAND)) {
+      // a && b is false if a is false or b is false,
+      // a || b is true if a is true or b is true
+      codegen_branch(left, symtab, when, label);
+      codegen_branch(left->next, symtab, when, label);
+    } else {
+      // a && b is true if a is true and b is true,
+      // a || b is false if a is false and b is false
+      uint32_t skip = new_label();
+      codegen_branch(left, symtab, !when, skip);
+      codegen_branch(left->next, symtab, when, label);
+      place_label(skip);
+    }
+    return;
+  }
+
+  // !x jumps where x does not
+  if (cond->variant == vNOT) {
+    codegen_branch(cond->children, symtab, !when, label);
+    return;
+  }
+
+  // a condition that is always or never true is either an unconditional
+  // jump or nothing
+  if (cond->variant == vINT_LITERAL || cond->variant == vCHAR_LITERAL) {
+    if ((cond->i != 0) == when) emit_jump(ccALWAYS, label);
+    return;
+  }
+
+  // <comparison>
+  // j<cc>/j<!cc> <label>
+  uint8_t cc = codegen_compare(cond, symtab);
+  if (cc != ccALWAYS) {
+    emit_jump(when ? cc : cc ^ 1, label);
+    return;
+  }
+
+  // <cond>
+  // testl %eax, %eax
+  // jne/je <label>
+  codegen_expr(cond, symtab);
+  emit_test(EAX, EAX, 0);
+  emit_jump(when ? ccNE : ccE, label);
+}
+
+void codegen_stmt(
+  ast_node_t *stmt, symbol_t *symtab,
+  uint32_t *block_id, uint32_t continue_label, uint32_t break_label
+  )
+{
+  if (stmt->variant == vEMPTY || stmt->variant == vDECL) return;
+  if (stmt->variant == vEXPR) codegen_expr(stmt->children, symtab);
+
+  if (stmt->variant == vBLOCK) {
+    char symtab_key[2] = { (char) *block_id, 0 };
+    ++(*block_id);
+    symbol_t *child_symtab = symtab_get(symtab, symtab_key)->child;
+    ast_node_t *child = stmt->children;
+    uint32_t child_block_id = 0;
+    while (child != NULL) {
+      codegen_stmt(
+        child, child_symtab, &child_block_id, continue_label, break_label
+        );
+      child = child->next;
+    }
+  }
+
+  if (stmt->variant == vRETURN) {
+    if (stmt->children != NULL) codegen_expr(stmt->children, symtab);
+    emit_epilogue();
+  }
+
+  if (stmt->variant == vCONTINUE || stmt->variant == vBREAK) {
+    uint32_t label = stmt->variant == vCONTINUE ? continue_label : break_label;
+    if (label == NO_LABEL) {
+      printf("Invalid '%s'\n", stmt->variant == vCONTINUE ? "continue" : "break");
+      exit(1);
+    }
+
+    // jmp cond_start/while_end
+    emit_jump(ccALWAYS, label);
+  }
+
+  if (stmt->variant == vIF) {
+    // <condition, jumping to else_start if false>
+    // <if block>
+    // jmp else_end
+    // else_start:
+    // <else block>
+    // else_end:
+    uint32_t else_start = new_label();
+    uint32_t else_end = new_label();
+    codegen_branch(stmt->children, symtab, 0, else_start);
+    codegen_stmt(
+      stmt->children->next, symtab, block_id, continue_label, break_label
+      );
+    emit_jump(ccALWAYS, else_end);
+    place_label(else_start);
+    codegen_stmt(
+      stmt->children->next->next, symtab, block_id, continue_label, break_label
+      );
+    place_label(else_end);
+  }
+
+  if (stmt->variant == vWHILE) {
+    // cond_start:
+    // <condition, jumping to while_end if false>
+    // <while block>
+    // jmp cond_start
+    // while_end:
+    // a constant condition (always true, since simplify() removes loops
+    // that never run) needs no test
+    uint32_t cond_start = new_label();
+    uint32_t while_end = new_label();
+    place_label(cond_start);
+    uint8_t tested = stmt->children->variant != vINT_LITERAL
+      && stmt->children->variant != vCHAR_LITERAL;
+    if (tested) codegen_branch(stmt->children, symtab, 0, while_end);
+
+    codegen_stmt(stmt->children->next, symtab, block_id, cond_start, while_end);
+
+    emit_jump(ccALWAYS, cond_start);
+    place_label(while_end);
+  }
+}
+
+// IR: from -O1 up, functions are lowered from the AST into a linear
+// three-address IR instead of going straight to machine code. a function is
+// a list of basic blocks, each a list of instructions ending in a jump, a
+// branch or a return. instructions compute virtual registers (vregs) from
+// vregs and immediates, and only loads and stores touch memory. char values
+// are kept sign-extended to 32 bits: an instruction of width 1 wraps its
+// result to 8 bits, a load of width 1 sign-extends and a store of width 1
+// stores the low byte.
+//
+// the IR is in SSA form until the out-of-ssa pass: every vreg is defined
+// once, by an instruction that dominates its uses, and values that depend
+// on the path taken are merged by phis at the start of a block.
+
+typedef enum {
+  irCOPY, irADD, irSUB, irMUL, irDIV, irMOD, irAND, irOR, irXOR, irNOT,
+  irEQ, irNE, irLT, irLE, irGT, irGE,
+  irLOAD, irSTORE, irADDR, irSYM, irPARAM, irCALL, irPHI,
+  irJMP, irBR, irRET
+} ir_op_t;
+
+char *ir_op_names[] = {
+  "copy", "add", "sub", "mul", "div", "mod", "and", "or", "xor", "not",
+  "eq", "ne", "lt", "le", "gt", "ge",
+  "load", "store", "addr", "sym", "param", "call", "phi",
+  "jmp", "br", "ret"
+};
+
+typedef enum {
+  kNONE, kVREG, kIMM
+} ir_val_kind_t;
+
+// an instruction operand: vreg `v` or the immediate `v`
+typedef struct ir_val_s {
+  ir_val_kind_t kind;
+  int32_t v;
+} ir_val_t;
+
+// memory operand of loads, stores and irADDR:
+//   mFRAME: `disp`(%ebp)
+//   mABS: absolute address `disp`
+//   mPTR: `disp` bytes past the pointer `a`
+typedef enum {
+  mFRAME, mABS, mPTR
+} ir_mem_t;
+
+struct ir_block_s;
+
+typedef struct ir_insn_s {
+  ir_op_t op;
+  uint8_t width;
+  uint32_t dst; // result vreg, 0 if there is none
+  ir_val_t a, b; // stores store `b`, branches test `a`, returns return `a`
+  ir_mem_t mem;
+  int32_t disp; // also the index of the parameter of an irPARAM
+  char *name; // irSYM, and irCALL of a function by name
+  symbol_t *symtab;
+  ir_val_t *args; // irCALL arguments (`a` is the callee), irPHI inputs
+  struct ir_block_s **from; // irPHI: the predecessor of each input
+  uint32_t nargs;
+  struct ir_block_s *target, *target2; // jmp target, branch true/false
+  uint32_t aux; // scratch for passes
+  struct ir_insn_s *prev, *next;
+} ir_insn_t;
+
+// the count of a block that the profile says nothing about
+#define IR_NO_COUNT ((uint32_t) -1)
+
+typedef struct ir_block_s {
+  uint32_t id;
+  uint32_t count; // how often it ran in the profile run
+  ir_insn_t *first, *last;
+  struct ir_block_s *next; // layout order
+  struct ir_block_s **preds;
+  uint32_t pred_count;
+  uint32_t label;
+  uint32_t index; // scratch for passes
+  uint8_t mark;
+  struct ir_block_s *idom; // immediate dominator
+  struct ir_block_s **children; // dominator tree
+  uint32_t child_count;
+} ir_block_t;
+
+// internal functions: from -O1 up, a function that is only ever called by
+// name from the source takes its first parameters in %eax, %edx and %ecx,
+// like gcc's regparm(3), and the rest on the stack as usual. functions
+// whose address is taken, _start and functions that the archive refers to
+// take all of them on the stack. a parameter passed in a register is moved
+// to a slot in the frame by an irPARAM at the start of the function
+#define IR_REGPARM 3
+
+reg_t ir_regparm_regs[IR_REGPARM] = { EAX, EDX, ECX };
+
+typedef struct regparm_func_s {
+  char *name;
+  uint32_t regparm;
+} regparm_func_t;
+
+regparm_func_t *regparm_funcs = NULL;
+uint32_t regparm_func_count = 0;
+
+// the number of parameters that the function `name` takes in registers
+uint32_t regparm_of(char *name)
+{
+  for (uint32_t i = 0; i < regparm_func_count; ++i)
+    if (strcmp(regparm_funcs[i].name, name) == 0)
+      return regparm_funcs[i].regparm;
+  return 0;
+}
+
+// a function being compiled. every pass takes one of these: the AST passes
+// use `body` and `symtab`, the IR passes `blocks`, and the machine code
+// passes the code from `start` to the end of the text
+typedef struct ir_func_s {
+  char *name;
+  ast_node_t *body;
+  symbol_t *symtab;
+  uint32_t start;
+  ir_block_t *blocks; // the entry block comes first
+  uint32_t block_count;
+  uint32_t vreg_count; // vregs are numbered from 1
+  uint32_t frame_size;
+  uint32_t uncompacted_size; // the frame size before frame compaction
+  uint32_t params; // the number of parameters
+  uint32_t count; // how often it was called in the profile run
+  uint32_t regparm; // how many of them are passed in registers
+  // the frame slots of those, and of the System V register parameters in
+  // 64-bit code
+  int32_t param_slots[6];
+  uint8_t param_widths[6];
+  operand_t *locs; // vreg -> register or stack slot, from regalloc
+  uint8_t *folded; // vreg -> whether its load is folded into its use
+  uint8_t saved_regs; // callee-saved registers that regalloc used
+} ir_func_t;
+
+ir_val_t ir_vreg(uint32_t v) { return (ir_val_t) { .kind = kVREG, .v = v }; }
+ir_val_t ir_imm(int32_t v) { return (ir_val_t) { .kind = kIMM, .v = v }; }
+
+uint8_t ir_is_vreg(ir_val_t v, uint32_t x)
+{
+  return v.kind == kVREG && (uint32_t) v.v == x;
+}
+
+uint8_t ir_is_terminator(ir_op_t op)
+{
+  return op == irJMP || op == irBR || op == irRET;
+}
+
+// whether the instruction has an effect besides computing `dst`
+uint8_t ir_has_side_effects(ir_insn_t *insn)
+{
+  switch (insn->op) {
+  case irSTORE: case irCALL: case irJMP: case irBR: case irRET: return 1;
+  // division by zero traps
+  case irDIV: case irMOD: return insn->b.kind != kIMM || insn->b.v == 0;
+  default: return 0;
+  }
+}
+
+// the successors of `b`, returns how many there are
+uint32_t ir_successors(ir_block_t *b, ir_block_t **out)
+{
+  if (b->last == NULL) return 0;
+  if (b->last->op == irJMP) { out[0] = b->last->target; return 1; }
+  if (b->last->op == irBR) {
+    out[0] = b->last->target;
+    out[1] = b->last->target2;
+    return out[0] == out[1] ? 1 : 2;
+  }
+  return 0;
+}
+
+// the operands of an instruction: `a`, `b` and then the arguments
+uint32_t ir_operand_count(ir_insn_t *insn)
+{
+  return 2 + insn->nargs;
+}
+
+ir_val_t *ir_operand(ir_insn_t *insn, uint32_t i)
+{
+  if (i == 0) return &insn->a;
+  if (i == 1) return &insn->b;
+  return insn->args + i - 2;
+}
+
+void ir_remove_insn(ir_block_t *b, ir_insn_t *insn)
+{
+  if (insn->prev) insn->prev->next = insn->next;
+  else b->first = insn->next;
+  if (insn->next) insn->next->prev = insn->prev;
+  else b->last = insn->prev;
+}
+
+// inserts `insn` into `b` before `before`, or at the end if it is NULL
+void ir_insert_insn(ir_block_t *b, ir_insn_t *insn, ir_insn_t *before)
+{
+  insn->next = before;
+  insn->prev = before ? before->prev : b->last;
+  if (insn->prev) insn->prev->next = insn;
+  else b->first = insn;
+  if (before) before->prev = insn;
+  else b->last = insn;
+}
+
+ir_insn_t *ir_new_insn(ir_op_t op)
+{
+  ir_insn_t *insn = malloc(sizeof(ir_insn_t));
+  memset(insn, 0, sizeof(ir_insn_t));
+  insn->op = op;
+  insn->width = 4;
+  return insn;
+}
+
+void ir_make_copy(ir_insn_t *insn, ir_val_t v)
+{
+  insn->op = irCOPY;
+  insn->a = v;
+  insn->b.kind = kNONE;
+  insn->width = 4;
+}
+
+ir_block_t *ir_new_block(ir_func_t *f)
+{
+  ir_block_t *b = malloc(sizeof(ir_block_t));
+  memset(b, 0, sizeof(ir_block_t));
+  b->id = f->block_count++;
+  b->count = IR_NO_COUNT;
+  return b;
+}
+
+// recomputes the predecessor lists of every block
+void ir_compute_preds(ir_func_t *f)
+{
+  for (ir_block_t *b = f->blocks; b != NULL; b = b->next) {
+    free(b->preds);
+    b->preds = NULL;
+    b->pred_count = 0;
+  }
+  for (ir_block_t *b = f->blocks; b != NULL; b = b->next) {
+    ir_block_t *succ[2];
+    uint32_t n = ir_successors(b, succ);
+    for (uint32_t i = 0; i < n; ++i) {
+      ir_block_t *s = succ[i];
+      s->preds = realloc(s->preds, (s->pred_count + 1) * sizeof(ir_block_t *));
+      s->preds[s->pred_count++] = b;
+    }
+  }
+}
+
+void ir_print_val(ir_val_t v)
+{
+  if (v.kind == kVREG) printf("v%d", v.v);
+  else printf("%d", v.v);
+}
+
+void ir_print_mem(ir_insn_t *insn)
+{
+  if (insn->mem == mFRAME) printf("[%%ebp%+d]", insn->disp);
+  else if (insn->mem == mABS) printf("[0x%x]", insn->disp);
+  else {
+    printf("[");
+    ir_print_val(insn->a);
+    if (insn->disp) printf("%+d", insn->disp);
+    printf("]");
+  }
+}
+
+void ir_print_func(ir_func_t *f)
+{
+  printf("function %s (frame %u):\n", f->name, f->frame_size);
+  for (ir_block_t *b = f->blocks; b != NULL; b = b->next) {
+    printf("b%u:", b->id);
+    if (b->pred_count) {
+      printf("  ; preds");
+      for (uint32_t i = 0; i < b->pred_count; ++i) printf(" b%u", b->preds[i]->id);
+    }
+    printf("\n");
+    for (ir_insn_t *insn = b->first; insn != NULL; insn = insn->next) {
+      printf("  ");
+      if (insn->dst) printf("v%u = ", insn->dst);
+      printf("%s", ir_op_names[insn->op]);
+      if (insn->width == 1) printf(".8");
+      switch (insn->op) {
+      case irLOAD: case irADDR:
+        printf(" ");
+        ir_print_mem(insn);
+        break;
+      case irSTORE:
+        printf(" ");
+        ir_print_mem(insn);
+        printf(", ");
+        ir_print_val(insn->b);
+        break;
+      case irSYM:
+        printf(" %s", insn->name);
+        break;
+      case irPARAM:
+        printf(" %d", insn->disp);
+        break;
+      case irCALL:
+        if (insn->name != NULL) printf(" %s(", insn->name);
+        else {
+          printf(" ");
+          ir_print_val(insn->a);
+          printf("(");
+        }
+        for (uint32_t i = 0; i < insn->nargs; ++i) {
+          if (i) printf(", ");
+          ir_print_val(insn->args[i]);
+        }
+        printf(")");
+        break;
+      case irPHI:
+        for (uint32_t i = 0; i < insn->nargs; ++i) {
+          printf("%s [b%u: ", i ? "," : "", insn->from[i]->id);
+          ir_print_val(insn->args[i]);
+          printf("]");
+        }
+        break;
+      case irJMP:
+        printf(" b%u", insn->target->id);
+        break;
+      case irBR:
+        printf(" ");
+        ir_print_val(insn->a);
+        printf(", b%u, b%u", insn->target->id, insn->target2->id);
+        break;
+      default:
+        if (insn->a.kind != kNONE) { printf(" "); ir_print_val(insn->a); }
+        if (insn->b.kind != kNONE) { printf(", "); ir_print_val(insn->b); }
+      }
+      printf("\n");
+    }
+  }
+}
+
+// lowering from the AST. the state of the function being lowered:
+ir_func_t *ir_func = NULL;
+ir_block_t *ir_block = NULL; // block that instructions are appended to
+ir_block_t *ir_layout_end = NULL;
+
+// appends `b` to the block layout and makes it the current block
+void ir_place_block(ir_block_t *b)
+{
+  if (ir_layout_end == NULL) ir_func->blocks = b;
+  else ir_layout_end->next = b;
+  ir_layout_end = b;
+  ir_block = b;
+}
+
+uint32_t ir_new_vreg()
+{
+  return ir_func->vreg_count++;
+}
+
+// appends an instruction to the current block. code after a jump or return
+// goes into a new block, which is unreachable unless something jumps to it
+ir_insn_t *ir_emit(ir_op_t op)
+{
+  if (ir_block->last != NULL && ir_is_terminator(ir_block->last->op))
+    ir_place_block(ir_new_block(ir_func));
+  ir_insn_t *insn = ir_new_insn(op);
+  ir_insert_insn(ir_block, insn, NULL);
+  return insn;
+}
+
+// dst = a <op> b
+ir_val_t ir_emit_binary(ir_op_t op, ir_val_t a, ir_val_t b, uint8_t width)
+{
+  ir_insn_t *insn = ir_emit(op);
+  insn->a = a;
+  insn->b = b;
+  insn->width = width;
+  insn->dst = ir_new_vreg();
+  return ir_vreg(insn->dst);
+}
+
+void ir_emit_jump(ir_block_t *target)
+{
+  ir_emit(irJMP)->target = target;
+}
+
+void ir_emit_branch(ir_val_t cond, ir_block_t *t, ir_block_t *f)
+{
+  ir_insn_t *insn = ir_emit(irBR);
+  insn->a = cond;
+  insn->target = t;
+  insn->target2 = f;
+}
+
+ir_val_t ir_emit_load(ir_mem_t mem, ir_val_t ptr, int32_t disp, uint8_t width)
+{
+  ir_insn_t *insn = ir_emit(irLOAD);
+  insn->mem = mem;
+  insn->a = ptr;
+  insn->disp = disp;
+  insn->width = width;
+  insn->dst = ir_new_vreg();
+  return ir_vreg(insn->dst);
+}
+
+void ir_emit_store(
+  ir_mem_t mem, ir_val_t ptr, int32_t disp, ir_val_t value, uint8_t width
+  )
+{
+  ir_insn_t *insn = ir_emit(irSTORE);
+  insn->mem = mem;
+  insn->a = ptr;
+  insn->disp = disp;
+  insn->b = value;
+  insn->width = width;
+}
+
+symbol_t *ir_lookup(symbol_t *symtab, char *name)
+{
+  symbol_t *sym = symtab_get(symtab, name);
+  if (sym == NULL) {
+    printf("Undefined symbol %s\n", name);
+    exit(1);
+  }
+  return sym;
+}
+
+// the memory operand of a variable that lives at a fixed location, as in
+// ident_operand()
+uint8_t ir_ident_mem(
+  ast_node_t *expr, symbol_t *symtab, ir_mem_t *mem, int32_t *disp,
+  symbol_type_t *type
+  )
+{
+  if (expr->variant != vIDENT) return 0;
+  symbol_t *sym = ir_lookup(symtab, expr->s);
+  if (sym->loc_type == lTEXT) return 0;
+  *type = sym->type;
+  if (sym->loc_type == lSTACK) { *mem = mFRAME; *disp = sym->loc; }
+  else { *mem = mABS; *disp = DATA_START + sym->loc; }
+  return 1;
+}
+
+ir_val_t ir_lower_expr(ast_node_t *expr, symbol_t *symtab, symbol_type_t *type);
+void ir_lower_cond(
+  ast_node_t *cond, symbol_t *symtab, ir_block_t *t, ir_block_t *f
+  );
+
+// the address of an lvalue, and the type it points to
+ir_val_t ir_lower_address(
+  ast_node_t *lval, symbol_t *symtab, symbol_type_t *type
+  )
+{
+  if (lval->variant == vDEREF)
+    return ir_lower_expr(lval->children, symtab, type);
+  if (lval->variant != vIDENT) {
+    printf("Invalid operand for 'address of' operator\n");
+    exit(1);
+  }
+
+  // functions are always addressed by name, so that they can be moved once
+  // they have been placed
+  symbol_t *sym = ir_lookup(symtab, lval->s);
+  if (sym->loc_type == lTEXT) {
+    ir_insn_t *insn = ir_emit(irSYM);
+    insn->name = lval->s;
+    insn->symtab = symtab;
+    insn->dst = ir_new_vreg();
+    *type = sym->type;
+    return ir_vreg(insn->dst);
+  }
+  if (sym->loc_type == lSTACK) {
+    ir_insn_t *insn = ir_emit(irADDR);
+    insn->mem = mFRAME;
+    insn->disp = sym->loc;
+    insn->dst = ir_new_vreg();
+    *type = pointer_to(sym->type);
+    return ir_vreg(insn->dst);
+  }
+  *type = pointer_to(sym->type);
+  return ir_imm(DATA_START + sym->loc);
+}
+
+// lowers `expr` and returns its value, writing its type to `type`. the
+// typing follows codegen_expr()
+ir_val_t ir_lower_expr(ast_node_t *expr, symbol_t *symtab, symbol_type_t *type)
+{
+  symbol_type_t t;
+  ir_mem_t mem;
+  int32_t disp;
+
+  switch (expr->variant) {
+  case vINT_LITERAL:
+    *type = tINT;
+    return ir_imm(expr->i);
+  case vCHAR_LITERAL:
+    *type = tCHAR;
+    return ir_imm((int8_t) expr->i);
+
+  case vIDENT: {
+    if (ir_ident_mem(expr, symtab, &mem, &disp, type))
+      return ir_emit_load(mem, ir_imm(0), disp, *type == tCHAR ? 1 : 4);
+    symbol_t *sym = ir_lookup(symtab, expr->s);
+    *type = sym->type;
+    // assume all symbols in .text are function pointers. they are addressed
+    // by name like in ir_lower_addr()
+    ir_insn_t *insn = ir_emit(irSYM);
+    insn->name = expr->s;
+    insn->symtab = symtab;
+    insn->dst = ir_new_vreg();
+    return ir_vreg(insn->dst);
+  }
+
+  case vSTRING_LITERAL: {
+    uint32_t addr = DATA_START + data_loc;
+    write_data((uint8_t *) expr->s, strlen(expr->s) + 1);
+    *type = tCHAR_PTR;
+    return ir_imm(addr);
+  }
+
+  case vDEREF: {
+    ir_val_t ptr = ir_lower_expr(expr->children, symtab, &t);
+    *type = t == tCHAR_PTR ? tCHAR : tINT;
+    return ir_emit_load(mPTR, ptr, 0, t == tCHAR_PTR ? 1 : 4);
+  }
+
+  case vADDRESSOF:
+    return ir_lower_address(expr->children, symtab, type);
+
+  case vINCREMENT: case vDECREMENT: {
+    ir_val_t ptr = ir_imm(0);
+    if (!ir_ident_mem(expr->children, symtab, &mem, &disp, type)) {
+      ptr = ir_lower_address(expr->children, symtab, &t);
+      *type = t == tCHAR_PTR ? tCHAR : tINT;
+      mem = mPTR;
+      disp = 0;
+    }
+    uint8_t width = *type == tCHAR ? 1 : 4;
+    ir_val_t v = ir_emit_load(mem, ptr, disp, width);
+    v = ir_emit_binary(
+      expr->variant == vINCREMENT ? irADD : irSUB, v, ir_imm(1), width
+      );
+    ir_emit_store(mem, ptr, disp, v, width);
+    return v;
+  }
+
+  case vNOT: {
+    ast_node_t *child = expr->children;
+    *type = tCHAR;
+    if (
+      child->variant == vLT || child->variant == vGT
+      || child->variant == vEQUAL
+      ) {
+      symbol_type_t lt, rt;
+      ir_val_t l = ir_lower_expr(child->children, symtab, &lt);
+      ir_val_t r = ir_lower_expr(child->children->next, symtab, &rt);
+      ir_op_t op = child->variant == vLT ? irGE
+        : child->variant == vGT ? irLE : irNE;
+      return ir_emit_binary(op, l, r, 4);
+    }
+    ir_val_t v = ir_lower_expr(child, symtab, &t);
+    return ir_emit_binary(irEQ, v, ir_imm(0), 4);
+  }
+
+  case vBIT_NOT: {
+    ir_val_t v = ir_lower_expr(expr->children, symtab, type);
+    ir_insn_t *insn = ir_emit(irNOT);
+    insn->a = v;
+    insn->width = *type == tCHAR ? 1 : 4;
+    insn->dst = ir_new_vreg();
+    return ir_vreg(insn->dst);
+  }
+
+  case vADD: case vSUBTRACT: case vMULTIPLY: case vDIVIDE: case vMODULO:
+  case vBIT_AND: case vBIT_OR: case vBIT_XOR: {
+    symbol_type_t lt, rt;
+    ir_val_t l = ir_lower_expr(expr->children, symtab, &lt);
+    ir_val_t r = ir_lower_expr(expr->children->next, symtab, &rt);
+    ir_op_t op = irADD;
+    switch (expr->variant) {
+    case vSUBTRACT: op = irSUB; break;
+    case vMULTIPLY: op = irMUL; break;
+    case vDIVIDE: op = irDIV; break;
+    case vMODULO: op = irMOD; break;
+    case vBIT_AND: op = irAND; break;
+    case vBIT_OR: op = irOR; break;
+    case vBIT_XOR: op = irXOR; break;
+    default: ;
+    }
+    *type = lt == tCHAR ? rt : lt;
+    return ir_emit_binary(op, l, r, lt == tCHAR && rt == tCHAR ? 1 : 4);
+  }
+
+  case vLT: case vGT: case vEQUAL: {
+    symbol_type_t lt, rt;
+    ir_val_t l = ir_lower_expr(expr->children, symtab, &lt);
+    ir_val_t r = ir_lower_expr(expr->children->next, symtab, &rt);
+    ir_op_t op = expr->variant == vLT ? irLT
+      : expr->variant == vGT ? irGT : irEQ;
+    *type = tINT;
+    return ir_emit_binary(op, l, r, 4);
+  }
+
+  case vAND: case vOR: {
+    *type = tINT;
+    if (!short_circuit) {
+      // both operands are evaluated:
+      // v = (l != 0) & (r != 0) / v = (l | r) != 0
+      symbol_type_t lt, rt;
+      ir_val_t l = ir_lower_expr(expr->children, symtab, &lt);
+      ir_val_t r = ir_lower_expr(expr->children->next, symtab, &rt);
+      if (expr->variant == vOR)
+        return ir_emit_binary(irNE, ir_emit_binary(irOR, l, r, 4), ir_imm(0), 4);
+      l = ir_emit_binary(irNE, l, ir_imm(0), 4);
+      r = ir_emit_binary(irNE, r, ir_imm(0), 4);
+      return ir_emit_binary(irAND, l, r, 4);
+    }
+
+    // v = phi [t_block: 1], [f_block: 0]
+    ir_block_t *t_block = ir_new_block(ir_func);
+    ir_block_t *f_block = ir_new_block(ir_func);
+    ir_block_t *done = ir_new_block(ir_func);
+    ir_lower_cond(expr, symtab, t_block, f_block);
+    ir_place_block(t_block);
+    ir_emit_jump(done);
+    ir_place_block(f_block);
+    ir_emit_jump(done);
+    ir_place_block(done);
+    ir_insn_t *phi = ir_emit(irPHI);
+    phi->nargs = 2;
+    phi->args = malloc(2 * sizeof(ir_val_t));
+    phi->from = malloc(2 * sizeof(ir_block_t *));
+    phi->args[0] = ir_imm(1);
+    phi->from[0] = t_block;
+    phi->args[1] = ir_imm(0);
+    phi->from[1] = f_block;
+    phi->dst = ir_new_vreg();
+    return ir_vreg(phi->dst);
+  }
+
+  case vASSIGN: {
+    ast_node_t *lhs = expr->children;
+    *type = tINT;
+    if (ir_ident_mem(lhs, symtab, &mem, &disp, &t)) {
+      ir_val_t v = ir_lower_expr(lhs->next, symtab, type);
+      ir_emit_store(mem, ir_imm(0), disp, v, t == tCHAR ? 1 : 4);
+      *type = tINT;
+      return v;
+    }
+    ir_val_t v = ir_lower_expr(lhs->next, symtab, &t);
+    ir_val_t ptr = ir_lower_address(lhs, symtab, &t);
+    ir_emit_store(mPTR, ptr, 0, v, t == tCHAR_PTR ? 1 : 4);
+    return v;
+  }
+
+  case vCALL: {
+    // arguments are evaluated last to first, then the callee
+    uint32_t n = 0;
+    for (ast_node_t *arg = expr->children->next; arg != NULL; arg = arg->next)
+      ++n;
+    ir_val_t *args = malloc((n + 1) * sizeof(ir_val_t));
+    ast_node_t **nodes = malloc((n + 1) * sizeof(ast_node_t *));
+    uint32_t i = 0;
+    for (ast_node_t *arg = expr->children->next; arg != NULL; arg = arg->next)
+      nodes[i++] = arg;
+    for (i = n; i > 0; --i) args[i - 1] = ir_lower_expr(nodes[i - 1], symtab, &t);
+    free(nodes);
+
+    // functions are called by name. the callee is left out for those that
+    // have not been placed yet, and kept for the passes that look for
+    // calls to particular functions otherwise
+    ast_node_t *callee = expr->children;
+    symbol_t *sym = NULL;
+    if (callee->variant == vIDENT) sym = ir_lookup(symtab, callee->s);
+    ir_val_t a = { .kind = kNONE };
+    if (sym != NULL && sym->loc_type == lTEXT) {
+      *type = sym->type;
+      if (sym->loc != (uint32_t) -1) a = ir_imm(TEXT_START + sym->loc);
+    } else a = ir_lower_expr(callee, symtab, type);
+    ir_insn_t *insn = ir_emit(irCALL);
+    insn->a = a;
+    if (sym != NULL && sym->loc_type == lTEXT) {
+      insn->name = callee->s;
+      insn->symtab = symtab;
+    }
+    insn->args = args;
+    insn->nargs = n;
+    insn->width = *type == tCHAR ? 1 : 4;
+    insn->dst = ir_new_vreg();
+    return ir_vreg(insn->dst);
+  }
+
+  default: ;
+  }
+
+  *type = tINT;
+  return ir_imm(0);
+}
+
+// lowers a condition into branches to `t` if it is true and `f` otherwise
+void ir_lower_cond(
+  ast_node_t *cond, symbol_t *symtab, ir_block_t *t, ir_block_t *f
+  )
+{
+  symbol_type_t type;
+
+  if (short_circuit && (cond->variant == vAND || cond->variant == vOR)) {
+    ir_block_t *right = ir_new_block(ir_func);
+    if (cond->variant == vAND) ir_lower_cond(cond->children, symtab, right, f);
+    else ir_lower_cond(cond->children, symtab, t, right);
+    ir_place_block(right);
+    ir_lower_cond(cond->children->next, symtab, t, f);
+    return;
+  }
+
+  if (cond->variant == vNOT) {
+    ir_lower_cond(cond->children, symtab, f, t);
+    return;
+  }
+
+  if (cond->variant == vINT_LITERAL || cond->variant == vCHAR_LITERAL) {
+    ir_emit_jump(cond->i != 0 ? t : f);
+    return;
+  }
+
+  ir_val_t v = ir_lower_expr(cond, symtab, &type);
+  ir_emit_branch(v, t, f);
+}
+
+// break and continue targets of the innermost loop
+typedef struct ir_loop_s {
+  ir_block_t *continue_block, *break_block;
+} ir_loop_t;
+
+void ir_lower_stmt(
+  ast_node_t *stmt, symbol_t *symtab, uint32_t *block_id, ir_loop_t *loop
+  )
+{
+  symbol_type_t type;
+
+  switch (stmt->variant) {
+  case vEXPR:
+    ir_lower_expr(stmt->children, symtab, &type);
+    return;
+
+  case vBLOCK: {
+    char symtab_key[2] = { (char) *block_id, 0 };
+    ++(*block_id);
+    symbol_t *child_symtab = symtab_get(symtab, symtab_key)->child;
+    uint32_t child_block_id = 0;
+    for (ast_node_t *child = stmt->children; child != NULL; child = child->next)
+      ir_lower_stmt(child, child_symtab, &child_block_id, loop);
+    return;
+  }
+
+  case vRETURN: {
+    ir_val_t v = { .kind = kNONE };
+    if (stmt->children != NULL) v = ir_lower_expr(stmt->children, symtab, &type);
+    ir_emit(irRET)->a = v;
+    return;
+  }
+
+  case vCONTINUE: case vBREAK:
+    if (loop == NULL) {
+      printf("Invalid '%s'\n", stmt->variant == vCONTINUE ? "continue" : "break");
+      exit(1);
+    }
+    ir_emit_jump(
+      stmt->variant == vCONTINUE ? loop->continue_block : loop->break_block
+      );
+    return;
+
+  case vIF: {
+    ir_block_t *then_block = ir_new_block(ir_func);
+    ir_block_t *else_block = ir_new_block(ir_func);
+    ir_block_t *end = ir_new_block(ir_func);
+    if (stmt->counts != NULL) {
+      then_block->count = stmt->counts[0];
+      else_block->count = stmt->counts[1];
+      end->count = stmt->counts[0] + stmt->counts[1];
+    }
+    ir_lower_cond(stmt->children, symtab, then_block, else_block);
+    ir_place_block(then_block);
+    ir_lower_stmt(stmt->children->next, symtab, block_id, loop);
+    ir_emit_jump(end);
+    ir_place_block(else_block);
+    ir_lower_stmt(stmt->children->next->next, symtab, block_id, loop);
+    ir_emit_jump(end);
+    ir_place_block(end);
+    return;
+  }
+
+  case vWHILE: {
+    ir_block_t *cond = ir_new_block(ir_func);
+    ir_block_t *body = ir_new_block(ir_func);
+    ir_block_t *end = ir_new_block(ir_func);
+    ir_loop_t inner = { .continue_block = cond, .break_block = end };
+    if (stmt->counts != NULL) {
+      cond->count = stmt->counts[0] + stmt->counts[1];
+      body->count = stmt->counts[1];
+      end->count = stmt->counts[0];
+    }
+    ir_emit_jump(cond);
+    ir_place_block(cond);
+    ir_lower_cond(stmt->children, symtab, body, end);
+    ir_place_block(body);
+    ir_lower_stmt(stmt->children->next, symtab, block_id, &inner);
+    ir_emit_jump(cond);
+    ir_place_block(end);
+    return;
+  }
+
+  default: ;
+  }
+}
+
+// lowers the body of `f` into IR
+void ir_lower(ir_func_t *f)
+{
+  ir_func = f;
+  f->vreg_count = 1;
+  ir_layout_end = NULL;
+  ir_place_block(ir_new_block(f));
+  f->count = IR_NO_COUNT;
+  if (f->body->counts != NULL) f->count = f->blocks->count = f->body->counts[0];
+
+  // v = param i
+  // store [%ebp+<slot>], v
+  for (uint32_t i = 0; i < f->regparm; ++i) {
+    ir_insn_t *param = ir_emit(irPARAM);
+    param->disp = i;
+    param->dst = ir_new_vreg();
+    ir_emit_store(
+      mFRAME, ir_imm(0), f->param_slots[i], ir_vreg(param->dst),
+      f->param_widths[i]
+      );
+  }
+
+  uint32_t block_id = 0;
+  ir_lower_stmt(f->body, f->symtab, &block_id, NULL);
+  ir_emit(irRET)->a = (ir_val_t) { .kind = kNONE };
+  ir_compute_preds(f);
+}
+
+// IR passes. each one takes the function and rewrites its blocks in place
+
+// simplify-cfg: removes unreachable blocks, turns branches whose outcome is
+// known into jumps, threads jumps through blocks that only jump, and merges
+// blocks into their only predecessor when it jumps straight to them
+void ir_mark_reachable(ir_block_t *b)
+{
+  if (b->mark) return;
+  b->mark = 1;
+  ir_block_t *succ[2];
+  uint32_t n = ir_successors(b, succ);
+  for (uint32_t i = 0; i < n; ++i) ir_mark_reachable(succ[i]);
+}
+
+uint8_t ir_has_phis(ir_block_t *b)
+{
+  return b->first != NULL && b->first->op == irPHI;
+}
+
+// the block that a jump to `b` ends up at, skipping blocks that only jump.
+// a block with phis has to keep its predecessors, so jumps to it stay
+ir_block_t *ir_jump_target(ir_block_t *b)
+{
+  for (uint32_t hops = 0; hops < 8; ++hops) {
+    if (b->first != b->last || b->first->op != irJMP) break;
+    if (b->first->target == b || ir_has_phis(b->first->target)) break;
+    b = b->first->target;
+  }
+  return b;
+}
+
+uint8_t ir_is_pred(ir_block_t *b, ir_block_t *p)
+{
+  for (uint32_t i = 0; i < b->pred_count; ++i)
+    if (b->preds[i] == p) return 1;
+  return 0;
+}
+
+ir_val_t ir_phi_input(ir_insn_t *phi, ir_block_t *from)
+{
+  for (uint32_t i = 0; i < phi->nargs; ++i)
+    if (phi->from[i] == from) return phi->args[i];
+  return (ir_val_t) { .kind = kNONE };
+}
+
+// drops the phi inputs that come from blocks which are no longer
+// predecessors, and turns phis that are left with one input into copies
+void ir_prune_phis(ir_func_t *f)
+{
+  for (ir_block_t *b = f->blocks; b != NULL; b = b->next) {
+    for (ir_insn_t *insn = b->first; insn != NULL; insn = insn->next) {
+      if (insn->op != irPHI) break;
+      uint32_t n = 0;
+      for (uint32_t i = 0; i < insn->nargs; ++i) {
+        if (!ir_is_pred(b, insn->from[i])) continue;
+        insn->args[n] = insn->args[i];
+        insn->from[n++] = insn->from[i];
+      }
+      insn->nargs = n;
+      if (n == 1) {
+        ir_val_t v = insn->args[0];
+        insn->nargs = 0;
+        ir_make_copy(insn, v);
+      }
+    }
+  }
+}
+
+void ir_simplify_cfg(ir_func_t *f)
+{
+  uint8_t changed = 1;
+  while (changed) {
+    changed = 0;
+
+    for (ir_block_t *b = f->blocks; b != NULL; b = b->next) {
+      ir_insn_t *last = b->last;
+      if (last->op == irBR && last->a.kind == kIMM) {
+        last->op = irJMP;
+        if (last->a.v == 0) last->target = last->target2;
+        last->a.kind = kNONE;
+        changed = 1;
+      }
+      if (last->op == irBR && last->target == last->target2) {
+        last->op = irJMP;
+        last->a.kind = kNONE;
+        changed = 1;
+      }
+      if (last->op == irJMP || last->op == irBR) {
+        ir_block_t *t = ir_jump_target(last->target);
+        if (t != last->target) { last->target = t; changed = 1; }
+      }
+      if (last->op == irBR) {
+        ir_block_t *t = ir_jump_target(last->target2);
+        if (t != last->target2) { last->target2 = t; changed = 1; }
+      }
+    }
+
+    // a call whose result is returned through a jump to a return returns
+    // it itself, so that isel can see that it is a tail call
+    for (ir_block_t *b = f->blocks; b != NULL; b = b->next) {
+      ir_insn_t *last = b->last, *call = last->prev;
+      if (last->op != irJMP || call == NULL || call->op != irCALL) continue;
+      ir_insn_t *ret = last->target->first;
+      while (ret->op == irPHI) ret = ret->next;
+      if (ret->op != irRET) continue;
+      ir_val_t v = ret->a;
+      for (ir_insn_t *phi = last->target->first; phi != ret; phi = phi->next)
+        if (ir_is_vreg(v, phi->dst)) { v = ir_phi_input(phi, b); break; }
+      if (v.kind != kNONE && !ir_is_vreg(v, call->dst)) continue;
+      last->op = irRET;
+      last->a = v;
+      changed = 1;
+    }
+
+    for (ir_block_t *b = f->blocks; b != NULL; b = b->next) b->mark = 0;
+    ir_mark_reachable(f->blocks);
+    for (ir_block_t *b = f->blocks; b->next != NULL; ) {
+      if (b->next->mark) { b = b->next; continue; }
+      b->next = b->next->next;
+      changed = 1;
+    }
+    ir_compute_preds(f);
+    ir_prune_phis(f);
+
+    for (ir_block_t *b = f->blocks; b != NULL; b = b->next) {
+      if (b->last->op != irJMP) continue;
+      ir_block_t *t = b->last->target;
+      if (t == b || t == f->blocks || t->pred_count != 1) continue;
+
+      // append t to b and drop it from the layout. phis in t have one
+      // input, and phis in the successors of t now come from b
+      ir_remove_insn(b, b->last);
+      for (ir_insn_t *insn = t->first, *next; insn != NULL; insn = next) {
+        next = insn->next;
+        if (insn->op == irPHI) {
+          ir_val_t v = insn->args[0];
+          insn->nargs = 0;
+          ir_make_copy(insn, v);
+        }
+        ir_insert_insn(b, insn, NULL);
+      }
+      ir_block_t *succ[2];
+      uint32_t ns = ir_successors(b, succ);
+      for (uint32_t i = 0; i < ns; ++i) {
+        for (ir_insn_t *phi = succ[i]->first; phi != NULL; phi = phi->next) {
+          if (phi->op != irPHI) break;
+          for (uint32_t j = 0; j < phi->nargs; ++j)
+            if (phi->from[j] == t) phi->from[j] = b;
+        }
+      }
+      t->first = t->last = NULL;
+      for (ir_block_t *p = f->blocks; p != NULL; p = p->next)
+        if (p->next == t) { p->next = t->next; break; }
+      ir_compute_preds(f);
+      changed = 1;
+    }
+  }
+}
+
+// computes `op` on constants as the generated code would, wrapping to 8 bits
+// for width 1. returns 0 if the operation would trap
+uint8_t ir_eval(ir_op_t op, int32_t a, int32_t b, uint8_t width, int32_t *out)
+{
+  uint32_t ua = a, ub = b;
+  switch (op) {
+  case irCOPY: *out = a; break;
+  case irADD: *out = ua + ub; break;
+  case irSUB: *out = ua - ub; break;
+  case irMUL: *out = ua * ub; break;
+  case irDIV: case irMOD:
+    if (b == 0 || (a == INT32_MIN && b == -1)) return 0;
+    *out = op == irDIV ? a / b : a % b;
+    break;
+  case irAND: *out = a & b; break;
+  case irOR: *out = a | b; break;
+  case irXOR: *out = a ^ b; break;
+  case irNOT: *out = ~a; break;
+  case irEQ: *out = a == b; break;
+  case irNE: *out = a != b; break;
+  case irLT: *out = a < b; break;
+  case irLE: *out = a <= b; break;
+  case irGT: *out = a > b; break;
+  case irGE: *out = a >= b; break;
+  default: return 0;
+  }
+  if (width == 1) *out = (int8_t) *out;
+  return 1;
+}
+
+uint8_t ir_is_binary(ir_op_t op)
+{
+  return op >= irADD && op <= irGE && op != irNOT;
+}
+
+uint8_t ir_is_compare(ir_op_t op)
+{
+  return op >= irEQ && op <= irGE;
+}
+
+uint8_t ir_commutative(ir_op_t op)
+{
+  return op == irADD || op == irMUL || op == irAND || op == irOR
+    || op == irXOR || op == irEQ || op == irNE;
+}
+
+// a < b is b > a, and so on
+ir_op_t ir_swap_compare(ir_op_t op)
+{
+  switch (op) {
+  case irLT: return irGT;
+  case irLE: return irGE;
+  case irGT: return irLT;
+  case irGE: return irLE;
+  default: return op;
+  }
+}
+
+// a < b is !(a >= b), and so on
+ir_op_t ir_negate_compare(ir_op_t op)
+{
+  switch (op) {
+  case irEQ: return irNE;
+  case irNE: return irEQ;
+  case irLT: return irGE;
+  case irLE: return irGT;
+  case irGT: return irLE;
+  case irGE: return irLT;
+  default: return op;
+  }
+}
+
+// vreg -> the number of instructions that define it, and the last of them
+void ir_count_defs(ir_func_t *f, uint32_t *count, ir_insn_t **def)
+{
+  memset(count, 0, f->vreg_count * sizeof(uint32_t));
+  for (ir_block_t *b = f->blocks; b != NULL; b = b->next)
+    for (ir_insn_t *insn = b->first; insn != NULL; insn = insn->next)
+      if (insn->dst) { ++count[insn->dst]; def[insn->dst] = insn; }
+}
+
+// vreg -> the number of times it is used
+void ir_count_uses(ir_func_t *f, uint32_t *count)
+{
+  memset(count, 0, f->vreg_count * sizeof(uint32_t));
+  for (ir_block_t *b = f->blocks; b != NULL; b = b->next)
+    for (ir_insn_t *insn = b->first; insn != NULL; insn = insn->next)
+      for (uint32_t i = 0; i < ir_operand_count(insn); ++i)
+        if (ir_operand(insn, i)->kind == kVREG) ++count[ir_operand(insn, i)->v];
+}
+
+// replaces the uses of copies with what they copy. returns whether
+// anything changed
+uint8_t ir_propagate_copies(ir_func_t *f, uint32_t *defs, ir_insn_t **def)
+{
+  uint8_t changed = 0;
+  for (ir_block_t *b = f->blocks; b != NULL; b = b->next) {
+    for (ir_insn_t *insn = b->first; insn != NULL; insn = insn->next) {
+      for (uint32_t i = 0; i < ir_operand_count(insn); ++i) {
+        ir_val_t *v = ir_operand(insn, i);
+        if (v->kind != kVREG || defs[v->v] != 1) continue;
+        ir_insn_t *d = def[v->v];
+        if (d->op != irCOPY || d->width != 4 || d == insn) continue;
+        if (d->a.kind == kVREG && defs[d->a.v] != 1) continue;
+        *v = d->a;
+        changed = 1;
+      }
+    }
+  }
+  return changed;
+}
+
+// whether the value of `v` is a sign-extended byte already
+uint8_t ir_is_byte(ir_val_t v, uint32_t *defs, ir_insn_t **def)
+{
+  if (v.kind == kIMM) return v.v == (int8_t) v.v;
+  if (defs[v.v] != 1) return 0;
+  ir_insn_t *d = def[v.v];
+  return d->width == 1 || ir_is_compare(d->op);
+}
+
+// copy-prop: propagates copies, and turns phis whose inputs are all the same
+// value (or the phi itself) and byte copies of values that are bytes already
+// into plain copies
+void ir_copy_prop(ir_func_t *f)
+{
+  uint32_t *defs = malloc(f->vreg_count * sizeof(uint32_t));
+  ir_insn_t **def = malloc(f->vreg_count * sizeof(ir_insn_t *));
+  ir_count_defs(f, defs, def);
+
+  uint8_t changed = 1;
+  while (changed) {
+    changed = ir_propagate_copies(f, defs, def);
+    for (ir_block_t *b = f->blocks; b != NULL; b = b->next) {
+      for (ir_insn_t *insn = b->first; insn != NULL; insn = insn->next) {
+        if (
+          insn->op == irCOPY && insn->width == 1
+          && ir_is_byte(insn->a, defs, def)
+          ) {
+          insn->width = 4;
+          changed = 1;
+        }
+        if (insn->op != irPHI) continue;
+
+        ir_val_t same = { .kind = kNONE };
+        uint8_t trivial = 1;
+        for (uint32_t i = 0; i < insn->nargs && trivial; ++i) {
+          ir_val_t v = insn->args[i];
+          if (v.kind == kVREG && (uint32_t) v.v == insn->dst) continue;
+          if (same.kind == kNONE) same = v;
+          else if (same.kind != v.kind || same.v != v.v) trivial = 0;
+        }
+        if (!trivial || same.kind == kNONE) continue;
+        insn->nargs = 0;
+        ir_make_copy(insn, same);
+        changed = 1;
+      }
+    }
+  }
+
+  free(defs);
+  free(def);
+}
+
+// fold: constant folding, algebraic identities and propagation of copies
+// and constants. addresses computed with irADDR or by adding a constant are
+// folded into the memory operands of loads and stores
+void ir_fold(ir_func_t *f)
+{
+  uint32_t *defs = malloc(f->vreg_count * sizeof(uint32_t));
+  ir_insn_t **def = malloc(f->vreg_count * sizeof(ir_insn_t *));
+  ir_count_defs(f, defs, def);
+
+  uint8_t changed = 1;
+  while (changed) {
+    changed = ir_propagate_copies(f, defs, def);
+    for (ir_block_t *b = f->blocks; b != NULL; b = b->next) {
+      for (ir_insn_t *insn = b->first; insn != NULL; insn = insn->next) {
+        if (insn->op == irLOAD || insn->op == irSTORE) {
+          if (insn->mem == mPTR && insn->a.kind == kIMM) {
+            insn->mem = mABS;
+            insn->disp += insn->a.v;
+            insn->a = ir_imm(0);
+            changed = 1;
+          }
+          ir_insn_t *d = NULL;
+          if (insn->mem == mPTR && insn->a.kind == kVREG && defs[insn->a.v] == 1)
+            d = def[insn->a.v];
+          if (d && d->op == irADDR) {
+            // [addr(x) + disp] -> [%ebp + x + disp]
+            insn->mem = mFRAME;
+            insn->disp += d->disp;
+            insn->a = ir_imm(0);
+            changed = 1;
+          } else if (
+            d && d->op == irADD && d->width == 4 && d->b.kind == kIMM
+            && d->a.kind == kVREG && defs[d->a.v] == 1
+            ) {
+            // [(p + c) + disp] -> [p + c + disp]
+            insn->a = d->a;
+            insn->disp += d->b.v;
+            changed = 1;
+          }
+          continue;
+        }
+
+        uint8_t unary = insn->op == irNOT
+          || (insn->op == irCOPY && insn->width == 1);
+        if (!ir_is_binary(insn->op) && !unary) continue;
+        int32_t r;
+        if (
+          insn->a.kind == kIMM && (unary || insn->b.kind == kIMM)
+          && ir_eval(insn->op, insn->a.v, insn->b.v, insn->width, &r)
+          ) {
+          ir_make_copy(insn, ir_imm(r));
+          changed = 1;
+          continue;
+        }
+        if (unary) continue;
+
+        // x - x, x ^ x -> 0
+        if (
+          (insn->op == irSUB || insn->op == irXOR)
+          && insn->a.kind == kVREG && insn->b.kind == kVREG
+          && insn->a.v == insn->b.v
+          ) {
+          ir_make_copy(insn, ir_imm(0));
+          changed = 1;
+          continue;
+        }
+
+        // immediates go on the right
+        if (insn->a.kind == kIMM && insn->b.kind == kVREG) {
+          if (!ir_commutative(insn->op) && !ir_is_compare(insn->op)) continue;
+          ir_val_t tmp = insn->a;
+          insn->a = insn->b;
+          insn->b = tmp;
+          insn->op = ir_swap_compare(insn->op);
+          changed = 1;
+        }
+        if (insn->b.kind != kIMM) continue;
+
+        // x - c -> x + -c, so that counting down is an induction variable
+        if (
+          insn->op == irSUB && insn->width == 4 && insn->b.v != 0
+          && insn->b.v != INT32_MIN
+          ) {
+          insn->op = irADD;
+          insn->b.v = -insn->b.v;
+          changed = 1;
+        }
+        // (x + c1) + c2 -> x + (c1 + c2)
+        ir_insn_t *d = NULL;
+        if (insn->op == irADD && insn->a.kind == kVREG && defs[insn->a.v] == 1)
+          d = def[insn->a.v];
+        if (
+          d && d->op == irADD && d->width == 4 && d->b.kind == kIMM
+          && d->a.kind == kVREG && defs[d->a.v] == 1 && insn->width == 4
+          ) {
+          insn->a = d->a;
+          ir_eval(irADD, insn->b.v, d->b.v, 4, &insn->b.v);
+          changed = 1;
+        }
+
+        // x + 0, x - 0, x | 0, x ^ 0, x * 1, x / 1, x & -1 -> x
+        // x * 0, x & 0, x % 1 -> 0
+        int32_t c = insn->b.v;
+        ir_op_t op = insn->op;
+        if (
+          (c == 0 && (op == irADD || op == irSUB || op == irOR || op == irXOR))
+          || (c == 1 && (op == irMUL || op == irDIV))
+          || (c == -1 && op == irAND)
+          ) {
+          ir_make_copy(insn, insn->a);
+          changed = 1;
+        } else if (
+          (c == 0 && (op == irMUL || op == irAND)) || (c == 1 && op == irMOD)
+          ) {
+          ir_make_copy(insn, ir_imm(0));
+          changed = 1;
+        }
+      }
+    }
+  }
+
+  free(defs);
+  free(def);
+}
+
+// dce: removes instructions whose results are never used
+void ir_dce(ir_func_t *f)
+{
+  uint32_t *uses = malloc(f->vreg_count * sizeof(uint32_t));
+  ir_count_uses(f, uses);
+
+  uint8_t changed = 1;
+  while (changed) {
+    changed = 0;
+    for (ir_block_t *b = f->blocks; b != NULL; b = b->next) {
+      for (ir_insn_t *insn = b->last, *prev; insn != NULL; insn = prev) {
+        prev = insn->prev;
+        uint8_t self_copy = insn->op == irCOPY && insn->a.kind == kVREG
+          && (uint32_t) insn->a.v == insn->dst;
+        if (!self_copy && (insn->dst == 0 || uses[insn->dst] != 0)) continue;
+        if (!self_copy && ir_has_side_effects(insn)) continue;
+        for (uint32_t i = 0; i < ir_operand_count(insn); ++i)
+          if (ir_operand(insn, i)->kind == kVREG) --uses[ir_operand(insn, i)->v];
+        ir_remove_insn(b, insn);
+        changed = 1;
+      }
+    }
+  }
+
+  free(uses);
+}
+
+// dominators, with the iterative algorithm of Cooper, Harvey and Kennedy.
+// blocks are numbered in postorder into `index`, and every block gets its
+// immediate dominator and its children in the dominator tree
+void ir_postorder(ir_block_t *b, ir_block_t **order, uint32_t *n)
+{
+  b->mark = 1;
+  ir_block_t *succ[2];
+  uint32_t ns = ir_successors(b, succ);
+  for (uint32_t i = 0; i < ns; ++i)
+    if (!succ[i]->mark) ir_postorder(succ[i], order, n);
+  b->index = *n;
+  order[(*n)++] = b;
+}
+
+ir_block_t *ir_intersect(ir_block_t *a, ir_block_t *b)
+{
+  while (a != b) {
+    while (a->index < b->index) a = a->idom;
+    while (b->index < a->index) b = b->idom;
+  }
+  return a;
+}
+
+// returns the blocks in postorder, writing their number to `count`
+ir_block_t **ir_compute_dominators(ir_func_t *f, uint32_t *count)
+{
+  ir_compute_preds(f);
+  ir_block_t **order = malloc(f->block_count * sizeof(ir_block_t *));
+  uint32_t n = 0;
+  for (ir_block_t *b = f->blocks; b != NULL; b = b->next) {
+    b->mark = 0;
+    b->idom = NULL;
+    b->child_count = 0;
+  }
+  ir_postorder(f->blocks, order, &n);
+
+  f->blocks->idom = f->blocks;
+  uint8_t changed = 1;
+  while (changed) {
+    changed = 0;
+    for (uint32_t i = n - 1; i-- > 0; ) {
+      ir_block_t *b = order[i], *idom = NULL;
+      for (uint32_t j = 0; j < b->pred_count; ++j) {
+        ir_block_t *p = b->preds[j];
+        if (p->idom == NULL) continue;
+        idom = idom == NULL ? p : ir_intersect(p, idom);
+      }
+      if (idom != b->idom) { b->idom = idom; changed = 1; }
+    }
+  }
+  f->blocks->idom = NULL;
+
+  for (uint32_t i = 0; i < n; ++i) {
+    ir_block_t *b = order[i];
+    free(b->children);
+    b->children = NULL;
+  }
+  for (uint32_t i = n; i-- > 0; ) {
+    ir_block_t *b = order[i], *d = b->idom;
+    if (d == NULL) continue;
+    d->children = realloc(d->children, (d->child_count + 1) * sizeof(ir_block_t *));
+    d->children[d->child_count++] = b;
+  }
+
+  *count = n;
+  return order;
+}
+
+ir_insn_t *ir_new_phi(ir_func_t *f, ir_block_t *b)
+{
+  ir_insn_t *phi = ir_new_insn(irPHI);
+  phi->dst = f->vreg_count++;
+  phi->nargs = b->pred_count;
+  phi->args = malloc(b->pred_count * sizeof(ir_val_t));
+  phi->from = malloc(b->pred_count * sizeof(ir_block_t *));
+  for (uint32_t i = 0; i < b->pred_count; ++i) {
+    phi->args[i] = (ir_val_t) { .kind = kNONE };
+    phi->from[i] = b->preds[i];
+  }
+  ir_insert_insn(b, phi, b->first);
+  return phi;
+}
+
+// ssa: promotes the stack slots of locals and arguments whose address is
+// never taken to vregs, placing phis on the iterated dominance frontiers of
+// their stores (Cytron et al.) and then renaming along the dominator tree
+typedef struct ir_slot_s {
+  int32_t disp;
+  uint8_t width;
+  uint8_t promoted;
+  ir_val_t *stack; // the values of the slot on the current dominator path
+  uint32_t depth;
+} ir_slot_t;
+
+ir_slot_t *ir_slots = NULL;
+uint32_t ir_slot_count = 0;
+
+ir_slot_t *ir_find_slot(int32_t disp)
+{
+  for (uint32_t i = 0; i < ir_slot_count; ++i)
+    if (ir_slots[i].disp == disp) return ir_slots + i;
+  return NULL;
+}
+
+// the promoted slot that a load or store accesses, or NULL
+ir_slot_t *ir_access_slot(ir_insn_t *insn)
+{
+  if (insn->op != irLOAD && insn->op != irSTORE) return NULL;
+  if (insn->mem != mFRAME) return NULL;
+  ir_slot_t *s = ir_find_slot(insn->disp);
+  return s && s->promoted ? s : NULL;
+}
+
+void ir_push_slot(ir_slot_t *s, ir_val_t v)
+{
+  s->stack = realloc(s->stack, (s->depth + 1) * sizeof(ir_val_t));
+  s->stack[s->depth++] = v;
+}
+
+void ir_rename(ir_func_t *f, ir_block_t *b)
+{
+  uint32_t *depth = malloc(ir_slot_count * sizeof(uint32_t));
+  for (uint32_t i = 0; i < ir_slot_count; ++i) depth[i] = ir_slots[i].depth;
+
+  for (ir_insn_t *insn = b->first, *next; insn != NULL; insn = next) {
+    next = insn->next;
+    if (insn->op == irPHI && insn->aux) {
+      ir_push_slot(ir_slots + insn->aux - 1, ir_vreg(insn->dst));
+      continue;
+    }
+    ir_slot_t *s = ir_access_slot(insn);
+    if (s == NULL || insn->aux) continue;
+    if (insn->op == irLOAD) {
+      ir_make_copy(insn, s->stack[s->depth - 1]);
+      continue;
+    }
+
+    // a byte store keeps the low byte, which a later load sign-extends
+    ir_val_t v = insn->b;
+    if (s->width == 1) {
+      ir_insn_t *copy = ir_new_insn(irCOPY);
+      copy->a = v;
+      copy->width = 1;
+      copy->dst = f->vreg_count++;
+      ir_insert_insn(b, copy, insn);
+      v = ir_vreg(copy->dst);
+    }
+    ir_push_slot(s, v);
+    ir_remove_insn(b, insn);
+  }
+
+  ir_block_t *succ[2];
+  uint32_t ns = ir_successors(b, succ);
+  for (uint32_t i = 0; i < ns; ++i) {
+    for (ir_insn_t *phi = succ[i]->first; phi != NULL; phi = phi->next) {
+      if (phi->op != irPHI) break;
+      if (!phi->aux) continue;
+      ir_slot_t *s = ir_slots + phi->aux - 1;
+      for (uint32_t j = 0; j < phi->nargs; ++j)
+        if (phi->from[j] == b) phi->args[j] = s->stack[s->depth - 1];
+    }
+  }
+
+  for (uint32_t i = 0; i < b->child_count; ++i) ir_rename(f, b->children[i]);
+  for (uint32_t i = 0; i < ir_slot_count; ++i) ir_slots[i].depth = depth[i];
+  free(depth);
+}
+
+void ir_build_ssa(ir_func_t *f)
+{
+  ir_slot_count = 0;
+  uint32_t cap = 0;
+  for (ir_block_t *b = f->blocks; b != NULL; b = b->next) {
+    for (ir_insn_t *insn = b->first; insn != NULL; insn = insn->next) {
+      if (insn->op != irLOAD && insn->op != irSTORE && insn->op != irADDR)
+        continue;
+      if (insn->mem != mFRAME) continue;
+      ir_slot_t *s = ir_find_slot(insn->disp);
+      if (s == NULL) {
+        if (ir_slot_count == cap) {
+          cap = cap ? 2 * cap : 16;
+          ir_slots = realloc(ir_slots, cap * sizeof(ir_slot_t));
+        }
+        s = ir_slots + ir_slot_count++;
+        *s = (ir_slot_t) {
+          .disp = insn->disp, .width = insn->width, .promoted = 1
+        };
+      }
+      if (insn->op == irADDR || insn->width != s->width) s->promoted = 0;
+    }
+  }
+
+  // slots that overlap are accessed in some way other than as a variable
+  for (uint32_t i = 0; i < ir_slot_count; ++i) {
+    for (uint32_t j = 0; j < ir_slot_count; ++j) {
+      ir_slot_t *a = ir_slots + i, *b = ir_slots + j;
+      if (i != j && a->disp < b->disp && a->disp + a->width > b->disp)
+        a->promoted = b->promoted = 0;
+    }
+  }
+
+  uint32_t n;
+  ir_block_t **order = ir_compute_dominators(f, &n);
+
+  // dominance frontiers
+  ir_block_t ***df = malloc(n * sizeof(ir_block_t **));
+  uint32_t *df_count = malloc(n * sizeof(uint32_t));
+  memset(df, 0, n * sizeof(ir_block_t **));
+  memset(df_count, 0, n * sizeof(uint32_t));
+  for (uint32_t i = 0; i < n; ++i) {
+    ir_block_t *b = order[i];
+    if (b->pred_count < 2) continue;
+    for (uint32_t j = 0; j < b->pred_count; ++j) {
+      if (!b->preds[j]->mark) continue;
+      for (ir_block_t *r = b->preds[j]; r != b->idom; r = r->idom) {
+        uint32_t k = 0;
+        while (k < df_count[r->index] && df[r->index][k] != b) ++k;
+        if (k < df_count[r->index]) continue;
+        df[r->index] = realloc(
+          df[r->index], (df_count[r->index] + 1) * sizeof(ir_block_t *)
+          );
+        df[r->index][df_count[r->index]++] = b;
+      }
+    }
+  }
+
+  ir_block_t **work = malloc(n * sizeof(ir_block_t *));
+  uint8_t *has_phi = malloc(n);
+  uint8_t *queued = malloc(n);
+  uint8_t *stores = malloc(n);
+  uint8_t *live = malloc(n);
+  for (uint32_t si = 0; si < ir_slot_count; ++si) {
+    ir_slot_t *s = ir_slots + si;
+    s->depth = 0;
+    if (!s->promoted) continue;
+
+    // arguments start out with the value they were passed, locals with 0
+    ir_val_t initial = ir_imm(0);
+    if (s->disp > 0) {
+      ir_insn_t *load = ir_new_insn(irLOAD);
+      load->mem = mFRAME;
+      load->disp = s->disp;
+      load->width = s->width;
+      load->dst = f->vreg_count++;
+      load->aux = 1;
+      ir_insert_insn(f->blocks, load, f->blocks->first);
+      initial = ir_vreg(load->dst);
+    }
+    ir_push_slot(s, initial);
+
+    // the blocks that store to the slot, and those that load it before
+    // storing to it
+    uint32_t nwork = 0;
+    memset(stores, 0, n);
+    memset(live, 0, n);
+    for (uint32_t i = 0; i < n; ++i) {
+      for (ir_insn_t *insn = order[i]->first; insn != NULL; insn = insn->next) {
+        if (ir_access_slot(insn) != s || insn->aux) continue;
+        if (insn->op == irSTORE) stores[i] = 1;
+        else if (!stores[i] && !live[i]) {
+          live[i] = 1;
+          work[nwork++] = order[i];
+        }
+      }
+    }
+
+    // the slot is live into the blocks from which a load can be reached
+    // without passing a store. phis only go where it is live
+    while (nwork > 0) {
+      ir_block_t *b = work[--nwork];
+      for (uint32_t k = 0; k < b->pred_count; ++k) {
+        ir_block_t *p = b->preds[k];
+        if (!p->mark || live[p->index] || stores[p->index]) continue;
+        live[p->index] = 1;
+        work[nwork++] = p;
+      }
+    }
+
+    memset(has_phi, 0, n);
+    memset(queued, 0, n);
+    for (uint32_t i = 0; i < n; ++i) {
+      if (!stores[i]) continue;
+      work[nwork++] = order[i];
+      queued[i] = 1;
+    }
+    while (nwork > 0) {
+      ir_block_t *b = work[--nwork];
+      for (uint32_t k = 0; k < df_count[b->index]; ++k) {
+        ir_block_t *d = df[b->index][k];
+        if (has_phi[d->index] || !live[d->index]) continue;
+        has_phi[d->index] = 1;
+        ir_new_phi(f, d)->aux = si + 1;
+        if (!queued[d->index]) {
+          queued[d->index] = 1;
+          work[nwork++] = d;
+        }
+      }
+    }
+  }
+
+  ir_rename(f, f->blocks);
+
+  for (uint32_t i = 0; i < n; ++i) free(df[i]);
+  for (uint32_t i = 0; i < ir_slot_count; ++i) {
+    free(ir_slots[i].stack);
+    ir_slots[i].stack = NULL;
+  }
+  for (ir_block_t *b = f->blocks; b != NULL; b = b->next)
+    for (ir_insn_t *insn = b->first; insn != NULL; insn = insn->next)
+      insn->aux = 0;
+  free(df);
+  free(df_count);
+  free(work);
+  free(has_phi);
+  free(queued);
+  free(stores);
+  free(live);
+  free(order);
+}
+
+// sccp: sparse conditional constant propagation (Wegman and Zadeck). every
+// vreg starts out unknown and is lowered to a constant or to varying while
+// only the blocks and edges found to be executable are evaluated. vregs that
+// end up constant are replaced by their value and branches on them become
+// jumps, which leaves the blocks that never run unreachable
+typedef enum {
+  lUNKNOWN, lCONST, lVARYING
+} ir_lattice_kind_t;
+
+typedef struct ir_lattice_s {
+  ir_lattice_kind_t kind;
+  int32_t v;
+} ir_lattice_t;
+
+ir_lattice_t ir_meet(ir_lattice_t a, ir_lattice_t b)
+{
+  if (a.kind == lUNKNOWN) return b;
+  if (b.kind == lUNKNOWN) return a;
+  if (a.kind == lCONST && b.kind == lCONST && a.v == b.v) return a;
+  return (ir_lattice_t) { .kind = lVARYING };
+}
+
+ir_lattice_t ir_lattice_of(ir_val_t v, ir_lattice_t *values)
+{
+  if (v.kind == kIMM) return (ir_lattice_t) { .kind = lCONST, .v = v.v };
+  if (v.kind == kVREG) return values[v.v];
+  return (ir_lattice_t) { .kind = lVARYING };
+}
+
+// whether the edge from `p` to `b` has been found executable. the
+// terminator of `p` records its executable edges in `aux`: bit 0 for
+// `target` and bit 1 for `target2`
+uint8_t ir_edge_executable(ir_block_t *p, ir_block_t *b)
+{
+  ir_insn_t *t = p->last;
+  if (!p->mark) return 0;
+  if (t->target == b && (t->aux & 1)) return 1;
+  return t->op == irBR && t->target2 == b && (t->aux & 2);
+}
+
+ir_lattice_t ir_sccp_eval(ir_insn_t *insn, ir_block_t *b, ir_lattice_t *values)
+{
+  ir_lattice_t varying = { .kind = lVARYING };
+  ir_lattice_t r = { .kind = lUNKNOWN };
+
+  if (insn->op == irPHI) {
+    for (uint32_t i = 0; i < insn->nargs; ++i)
+      if (ir_edge_executable(insn->from[i], b))
+        r = ir_meet(r, ir_lattice_of(insn->args[i], values));
+    return r;
+  }
+
+  uint8_t unary = insn->op == irCOPY || insn->op == irNOT;
+  if (!unary && !ir_is_binary(insn->op)) return varying;
+  ir_lattice_t a = ir_lattice_of(insn->a, values);
+  ir_lattice_t c = unary ? a : ir_lattice_of(insn->b, values);
+  if (a.kind == lVARYING || c.kind == lVARYING) return varying;
+  if (a.kind == lUNKNOWN || c.kind == lUNKNOWN) return r;
+  if (!ir_eval(insn->op, a.v, c.v, insn->width, &r.v)) return varying;
+  r.kind = lCONST;
+  return r;
+}
+
+void ir_sccp(ir_func_t *f)
+{
+  ir_lattice_t *values = malloc(f->vreg_count * sizeof(ir_lattice_t));
+  memset(values, 0, f->vreg_count * sizeof(ir_lattice_t));
+  ir_compute_preds(f);
+  for (ir_block_t *b = f->blocks; b != NULL; b = b->next) {
+    b->mark = 0;
+    b->last->aux = 0;
+  }
+  f->blocks->mark = 1;
+
+  uint8_t changed = 1;
+  while (changed) {
+    changed = 0;
+    for (ir_block_t *b = f->blocks; b != NULL; b = b->next) {
+      if (!b->mark) continue;
+      for (ir_insn_t *insn = b->first; insn != NULL; insn = insn->next) {
+        if (insn->dst) {
+          ir_lattice_t old = values[insn->dst];
+          ir_lattice_t v = ir_meet(old, ir_sccp_eval(insn, b, values));
+          if (v.kind != old.kind || v.v != old.v) {
+            values[insn->dst] = v;
+            changed = 1;
+          }
+        }
+
+        uint32_t edges = 0;
+        if (insn->op == irJMP) edges = 1;
+        if (insn->op == irBR) {
+          ir_lattice_t c = ir_lattice_of(insn->a, values);
+          if (c.kind == lVARYING) edges = 3;
+          else if (c.kind == lCONST) edges = c.v ? 1 : 2;
+        }
+        if ((insn->aux | edges) == insn->aux) continue;
+        insn->aux |= edges;
+        if (edges & 1) insn->target->mark = 1;
+        if (edges & 2) insn->target2->mark = 1;
+        changed = 1;
+      }
+    }
+  }
+
+  for (ir_block_t *b = f->blocks; b != NULL; b = b->next) {
+    if (!b->mark) continue;
+    for (ir_insn_t *insn = b->first; insn != NULL; insn = insn->next) {
+      for (uint32_t i = 0; i < ir_operand_count(insn); ++i) {
+        ir_val_t *v = ir_operand(insn, i);
+        if (v->kind == kVREG && values[v->v].kind == lCONST)
+          *v = ir_imm(values[v->v].v);
+      }
+      if (insn->dst && values[insn->dst].kind == lCONST && insn->op != irCALL) {
+        insn->nargs = 0;
+        ir_make_copy(insn, ir_imm(values[insn->dst].v));
+      }
+    }
+    // a branch that only ever goes one way is a jump
+    ir_insn_t *t = b->last;
+    if (t->op == irBR && (t->aux == 1 || t->aux == 2)) {
+      t->op = irJMP;
+      if (t->aux == 2) t->target = t->target2;
+      t->a.kind = kNONE;
+    }
+  }
+
+  for (ir_block_t *b = f->blocks; b != NULL; b = b->next) b->last->aux = 0;
+  free(values);
+}
+
+// gvn: global value numbering over the dominator tree. an instruction that
+// computes the same operation on the same operands as one that dominates it
+// is replaced by a copy of that one's result. loads are numbered too, but
+// only within a block and until the next store or call, and a store makes
+// the value it stores available to later loads of the same address.
+//
+// compares are cheaper to redo than to keep in a register for the branches
+// they feed, so a repeated compare is only replaced when a branch above
+// decided it: below the true edge of `br v, ...` the value number of v is
+// 1, and below the false edge it is 0. a compare whose negation was
+// decided gets the opposite value
+typedef struct ir_expr_s {
+  ir_insn_t *insn; // the operation and operands
+  ir_val_t value;
+} ir_expr_t;
+
+ir_expr_t *ir_exprs = NULL;
+uint32_t ir_expr_count = 0;
+uint32_t ir_expr_cap = 0;
+
+// the value numbers of the branch conditions known on the current dominator
+// path
+ir_val_t *ir_known = NULL;
+uint32_t ir_known_count = 0;
+
+// vreg -> its value number, the vreg of the first compare that computed the
+// same value
+uint32_t *ir_vn = NULL;
+
+uint8_t ir_same_val(ir_val_t a, ir_val_t b)
+{
+  return a.kind == b.kind && (a.kind == kNONE || a.v == b.v);
+}
+
+uint8_t ir_same_expr(ir_insn_t *x, ir_insn_t *y)
+{
+  uint8_t memory = x->op == irLOAD || x->op == irSTORE;
+  if (memory != (y->op == irLOAD || y->op == irSTORE)) return 0;
+  if (memory) {
+    return x->mem == y->mem && x->disp == y->disp && x->width == y->width
+      && (x->mem != mPTR || ir_same_val(x->a, y->a));
+  }
+  if (x->op != y->op || x->width != y->width) return 0;
+  if (x->op == irSYM) return strcmp(x->name, y->name) == 0;
+  if (x->op == irADDR) return x->disp == y->disp;
+  if (ir_same_val(x->a, y->a) && ir_same_val(x->b, y->b)) return 1;
+  return ir_commutative(x->op)
+    && ir_same_val(x->a, y->b) && ir_same_val(x->b, y->a);
+}
+
+void ir_add_expr(ir_insn_t *insn, ir_val_t value)
+{
+  if (ir_expr_count == ir_expr_cap) {
+    ir_expr_cap = ir_expr_cap ? 2 * ir_expr_cap : 64;
+    ir_exprs = realloc(ir_exprs, ir_expr_cap * sizeof(ir_expr_t));
+  }
+  ir_exprs[ir_expr_count++] = (ir_expr_t) { .insn = insn, .value = value };
+}
+
+ir_expr_t *ir_find_expr(ir_insn_t *insn, uint32_t from)
+{
+  for (uint32_t i = ir_expr_count; i-- > from; )
+    if (ir_same_expr(ir_exprs[i].insn, insn)) return ir_exprs + i;
+  return NULL;
+}
+
+// the value of the compare `insn` if a branch above decided it or its
+// negation
+uint8_t ir_known_compare(ir_insn_t *insn, ir_val_t *out)
+{
+  for (uint8_t negate = 0; negate < 2; ++negate) {
+    ir_insn_t tmp = *insn;
+    if (negate) tmp.op = ir_negate_compare(insn->op);
+    ir_expr_t *e = ir_find_expr(&tmp, 0);
+    if (e == NULL) continue;
+    for (uint32_t i = 0; i < ir_known_count; i += 2) {
+      if (ir_same_val(ir_known[i], e->value)) {
+        *out = ir_imm(ir_known[i + 1].v ^ negate);
+        return 1;
+      }
+    }
+  }
+  return 0;
+}
+
+void ir_gvn_block(ir_block_t *b)
+{
+  uint32_t scope = ir_expr_count;
+  uint32_t known_scope = ir_known_count;
+  ir_block_t *p = b->pred_count == 1 ? b->preds[0] : NULL;
+  if (
+    p && p->last->op == irBR && p->last->a.kind == kVREG
+    && p->last->target != p->last->target2
+    ) {
+    // pairs of the vreg and its value
+    ir_known = realloc(ir_known, (ir_known_count + 2) * sizeof(ir_val_t));
+    ir_known[ir_known_count++] = ir_vreg(ir_vn[p->last->a.v]);
+    ir_known[ir_known_count++] = ir_imm(p->last->target == b);
+  }
+
+  // loads and stores are numbered after the other expressions of the block,
+  // from `memory` on
+  uint32_t memory = ir_expr_count;
+  for (ir_insn_t *insn = b->first; insn != NULL; insn = insn->next) {
+    if (insn->op == irCALL || insn->op == irSTORE) {
+      // forget the loads. the pure expressions numbered since `memory`
+      // are kept, moved to the front
+      uint32_t n = 0;
+      for (uint32_t i = memory; i < ir_expr_count; ++i) {
+        ir_op_t op = ir_exprs[i].insn->op;
+        if (op != irLOAD && op != irSTORE) ir_exprs[memory + n++] = ir_exprs[i];
+      }
+      ir_expr_count = memory + n;
+      if (insn->op == irSTORE && insn->width == 4)
+        ir_add_expr(insn, insn->b);
+      continue;
+    }
+
+    uint8_t pure = insn->op == irLOAD || insn->op == irADDR
+      || insn->op == irSYM || insn->op == irNOT || ir_is_binary(insn->op)
+      || (insn->op == irCOPY && insn->width == 1);
+    if (!pure) continue;
+    ir_expr_t *e = ir_find_expr(insn, insn->op == irLOAD ? memory : 0);
+    if (ir_is_compare(insn->op)) {
+      ir_val_t known;
+      if (e != NULL) ir_vn[insn->dst] = e->value.v;
+      if (ir_known_compare(insn, &known)) ir_make_copy(insn, known);
+      else if (e == NULL) ir_add_expr(insn, ir_vreg(insn->dst));
+      continue;
+    }
+    if (e == NULL) {
+      ir_add_expr(insn, ir_vreg(insn->dst));
+      continue;
+    }
+    ir_make_copy(insn, e->value);
+  }
+
+  // loads do not carry over into the blocks that this one dominates
+  uint32_t n = scope;
+  for (uint32_t i = scope; i < ir_expr_count; ++i) {
+    ir_op_t op = ir_exprs[i].insn->op;
+    if (op != irLOAD && op != irSTORE) ir_exprs[n++] = ir_exprs[i];
+  }
+  ir_expr_count = n;
+
+  for (uint32_t i = 0; i < b->child_count; ++i) ir_gvn_block(b->children[i]);
+  ir_expr_count = scope;
+  ir_known_count = known_scope;
+}
+
+void ir_gvn(ir_func_t *f)
+{
+  uint32_t n;
+  free(ir_compute_dominators(f, &n));
+  ir_expr_count = 0;
+  ir_known_count = 0;
+  ir_vn = malloc(f->vreg_count * sizeof(uint32_t));
+  for (uint32_t v = 0; v < f->vreg_count; ++v) ir_vn[v] = v;
+  ir_gvn_block(f->blocks);
+  free(ir_vn);
+}
+
+// adce: aggressive dead code elimination. only stores, calls, returns and
+// divisions that may trap are assumed to be needed; everything else is
+// needed only if a needed instruction uses its value, or for a branch, if a
+// needed instruction is control dependent on it. branches that nothing
+// depends on jump straight to their immediate postdominator
+void ir_postdom_order(
+  ir_block_t *b, ir_block_t **order, uint32_t *n, uint8_t *seen
+  )
+{
+  seen[b->index] = 1;
+  for (uint32_t i = 0; i < b->pred_count; ++i)
+    if (!seen[b->preds[i]->index])
+      ir_postdom_order(b->preds[i], order, n, seen);
+  order[(*n)++] = b;
+}
+
+void ir_adce(ir_func_t *f)
+{
+  ir_compute_preds(f);
+  uint32_t nb = 0;
+  for (ir_block_t *b = f->blocks; b != NULL; b = b->next) b->index = nb++;
+
+  // postorder of the reverse CFG from a virtual exit after every return,
+  // numbered in `rank`; the exit has rank nb
+  ir_block_t **order = malloc(nb * sizeof(ir_block_t *));
+  uint8_t *seen = malloc(nb);
+  memset(seen, 0, nb);
+  uint32_t n = 0;
+  for (ir_block_t *b = f->blocks; b != NULL; b = b->next)
+    if (b->last->op == irRET && !seen[b->index])
+      ir_postdom_order(b, order, &n, seen);
+  uint32_t *rank = malloc(nb * sizeof(uint32_t));
+  for (uint32_t i = 0; i < n; ++i) rank[order[i]->index] = i;
+
+  // ipdom[b] is the index of the immediate postdominator, nb for the exit
+  uint32_t *ipdom = malloc(nb * sizeof(uint32_t));
+  for (uint32_t i = 0; i < nb; ++i) ipdom[i] = (uint32_t) -1;
+  uint8_t all_reach_exit = n == nb;
+  uint8_t changed = all_reach_exit;
+  while (changed) {
+    changed = 0;
+    for (uint32_t i = n; i-- > 0; ) {
+      ir_block_t *b = order[i];
+      uint32_t new_ipdom = (uint32_t) -1;
+      ir_block_t *succ[2];
+      uint32_t ns = ir_successors(b, succ);
+      if (b->last->op == irRET) new_ipdom = nb;
+      for (uint32_t j = 0; j < ns; ++j) {
+        uint32_t s = succ[j]->index;
+        if (ipdom[s] == (uint32_t) -1) continue;
+        if (new_ipdom == (uint32_t) -1) { new_ipdom = s; continue; }
+        // intersect by rank, the exit ranking above everything
+        uint32_t x = s, y = new_ipdom;
+        while (x != y) {
+          while (x != nb && (y == nb || rank[x] < rank[y])) x = ipdom[x];
+          while (y != nb && (x == nb || rank[y] < rank[x])) y = ipdom[y];
+        }
+        new_ipdom = x;
+      }
+      if (new_ipdom != ipdom[b->index]) {
+        ipdom[b->index] = new_ipdom;
+        changed = 1;
+      }
+    }
+  }
+
+  // postdominance frontiers: the branches that each block depends on
+  ir_block_t ***pdf = malloc(nb * sizeof(ir_block_t **));
+  uint32_t *pdf_count = malloc(nb * sizeof(uint32_t));
+  memset(pdf, 0, nb * sizeof(ir_block_t **));
+  memset(pdf_count, 0, nb * sizeof(uint32_t));
+  ir_block_t **blocks = malloc(nb * sizeof(ir_block_t *));
+  for (ir_block_t *b = f->blocks; b != NULL; b = b->next) blocks[b->index] = b;
+  for (uint32_t i = 0; i < nb && all_reach_exit; ++i) {
+    ir_block_t *b = blocks[i];
+    ir_block_t *succ[2];
+    uint32_t ns = ir_successors(b, succ);
+    if (ns < 2) continue;
+    for (uint32_t j = 0; j < ns; ++j) {
+      for (uint32_t r = succ[j]->index; r != ipdom[i]; r = ipdom[r]) {
+        pdf[r] = realloc(pdf[r], (pdf_count[r] + 1) * sizeof(ir_block_t *));
+        pdf[r][pdf_count[r]++] = b;
+      }
+    }
+  }
+
+  uint32_t *defs = malloc(f->vreg_count * sizeof(uint32_t));
+  ir_insn_t **def = malloc(f->vreg_count * sizeof(ir_insn_t *));
+  ir_count_defs(f, defs, def);
+
+  // `aux` marks needed instructions, `mark` blocks with one in them
+  uint32_t cap = 64, nwork = 0;
+  ir_insn_t **work = malloc(cap * sizeof(ir_insn_t *));
+  ir_block_t **work_block = malloc(cap * sizeof(ir_block_t *));
+  for (ir_block_t *b = f->blocks; b != NULL; b = b->next) {
+    b->mark = 0;
+    for (ir_insn_t *insn = b->first; insn != NULL; insn = insn->next) {
+      insn->aux = 0;
+      uint8_t needed = insn->op == irRET
+        || (insn->op == irBR && !all_reach_exit)
+        || (ir_has_side_effects(insn) && insn->op != irJMP && insn->op != irBR);
+      if (!needed) continue;
+      if (nwork == cap) {
+        cap *= 2;
+        work = realloc(work, cap * sizeof(ir_insn_t *));
+        work_block = realloc(work_block, cap * sizeof(ir_block_t *));
+      }
+      insn->aux = 1;
+      work[nwork] = insn;
+      work_block[nwork++] = b;
+    }
+  }
+
+  // the def of every vreg is in the block found by scanning, so record it
+  ir_block_t **def_block = malloc(f->vreg_count * sizeof(ir_block_t *));
+  for (ir_block_t *b = f->blocks; b != NULL; b = b->next)
+    for (ir_insn_t *insn = b->first; insn != NULL; insn = insn->next)
+      if (insn->dst) def_block[insn->dst] = b;
+
+  while (nwork > 0) {
+    --nwork;
+    ir_insn_t *insn = work[nwork];
+    ir_block_t *b = work_block[nwork];
+
+    // what it uses, the branches its block depends on and, for a phi, the
+    // branches that decide which input it takes
+    ir_insn_t **more = NULL;
+    ir_block_t **more_block = NULL;
+    uint32_t nmore = 0;
+    for (uint32_t i = 0; i < ir_operand_count(insn); ++i) {
+      ir_val_t *v = ir_operand(insn, i);
+      if (v->kind != kVREG || defs[v->v] == 0) continue;
+      more = realloc(more, (nmore + 1) * sizeof(ir_insn_t *));
+      more_block = realloc(more_block, (nmore + 1) * sizeof(ir_block_t *));
+      more[nmore] = def[v->v];
+      more_block[nmore++] = def_block[v->v];
+    }
+    if (!b->mark) {
+      b->mark = 1;
+      for (uint32_t i = 0; i < pdf_count[b->index]; ++i) {
+        more = realloc(more, (nmore + 1) * sizeof(ir_insn_t *));
+        more_block = realloc(more_block, (nmore + 1) * sizeof(ir_block_t *));
+        more[nmore] = pdf[b->index][i]->last;
+        more_block[nmore++] = pdf[b->index][i];
+      }
+    }
+    for (uint32_t i = 0; insn->op == irPHI && i < insn->nargs; ++i) {
+      more = realloc(more, (nmore + 1) * sizeof(ir_insn_t *));
+      more_block = realloc(more_block, (nmore + 1) * sizeof(ir_block_t *));
+      more[nmore] = insn->from[i]->last;
+      more_block[nmore++] = insn->from[i];
+    }
+
+    for (uint32_t i = 0; i < nmore; ++i) {
+      if (more[i]->aux) continue;
+      more[i]->aux = 1;
+      if (nwork == cap) {
+        cap *= 2;
+        work = realloc(work, cap * sizeof(ir_insn_t *));
+        work_block = realloc(work_block, cap * sizeof(ir_block_t *));
+      }
+      work[nwork] = more[i];
+      work_block[nwork++] = more_block[i];
+    }
+    free(more);
+    free(more_block);
+  }
+
+  for (ir_block_t *b = f->blocks; b != NULL; b = b->next) {
+    for (ir_insn_t *insn = b->first, *next; insn != NULL; insn = next) {
+      next = insn->next;
+      if (insn->aux || insn->op == irJMP) continue;
+      if (insn->op == irBR) {
+        if (ipdom[b->index] >= nb) continue;
+        insn->op = irJMP;
+        insn->a.kind = kNONE;
+        insn->target = blocks[ipdom[b->index]];
+        continue;
+      }
+      ir_remove_insn(b, insn);
+    }
+  }
+
+  for (ir_block_t *b = f->blocks; b != NULL; b = b->next)
+    for (ir_insn_t *insn = b->first; insn != NULL; insn = insn->next)
+      insn->aux = 0;
+  for (uint32_t i = 0; i < nb; ++i) free(pdf[i]);
+  free(pdf);
+  free(pdf_count);
+  free(blocks);
+  free(order);
+  free(seen);
+  free(rank);
+  free(ipdom);
+  free(defs);
+  free(def);
+  free(def_block);
+  free(work);
+  free(work_block);
+  ir_compute_preds(f);
+}
+
+// loops: a natural loop is a header and the blocks that reach one of its
+// latches, the predecessors that the header dominates, without passing
+// through the header. after ir_compute_dominators, ir_mark_loop sets `mark`
+// on the blocks of the loop and clears it everywhere else
+uint8_t ir_dominates(ir_block_t *a, ir_block_t *b)
+{
+  for (; b != NULL; b = b->idom)
+    if (b == a) return 1;
+  return 0;
+}
+
+uint8_t ir_is_reachable(ir_func_t *f, ir_block_t *b)
+{
+  return b == f->blocks || b->idom != NULL;
+}
+
+// returns the number of latches, 0 if `h` is not a loop header
+uint32_t ir_mark_loop(ir_func_t *f, ir_block_t *h)
+{
+  for (ir_block_t *b = f->blocks; b != NULL; b = b->next) b->mark = 0;
+  ir_block_t **work = malloc(f->block_count * sizeof(ir_block_t *));
+  uint32_t nwork = 0, latches = 0;
+  h->mark = 1;
+  for (uint32_t i = 0; i < h->pred_count; ++i) {
+    ir_block_t *p = h->preds[i];
+    if (!ir_is_reachable(f, p) || !ir_dominates(h, p)) continue;
+    ++latches;
+    if (!p->mark) { p->mark = 1; work[nwork++] = p; }
+  }
+  while (nwork > 0) {
+    ir_block_t *b = work[--nwork];
+    for (uint32_t i = 0; i < b->pred_count; ++i) {
+      ir_block_t *p = b->preds[i];
+      if (p->mark || !ir_is_reachable(f, p)) continue;
+      p->mark = 1;
+      work[nwork++] = p;
+    }
+  }
+  free(work);
+  if (latches == 0) h->mark = 0;
+  return latches;
+}
+
+// the loop headers of `f` in reverse postorder, so outer loops come before
+// the loops nested in them. returns how many there are
+uint32_t ir_find_headers(ir_func_t *f, ir_block_t ***out)
+{
+  uint32_t n, count = 0;
+  ir_block_t **order = ir_compute_dominators(f, &n);
+  ir_block_t **headers = malloc(n * sizeof(ir_block_t *));
+  for (uint32_t i = n; i-- > 0; ) {
+    ir_block_t *h = order[i];
+    for (uint32_t j = 0; j < h->pred_count; ++j) {
+      if (!ir_is_reachable(f, h->preds[j])) continue;
+      if (ir_dominates(h, h->preds[j])) { headers[count++] = h; break; }
+    }
+  }
+  free(order);
+  *out = headers;
+  return count;
+}
+
+// points the jumps of `b` that go to `from` at `to`
+void ir_retarget(ir_block_t *b, ir_block_t *from, ir_block_t *to)
+{
+  if (b->last->op != irJMP && b->last->op != irBR) return;
+  if (b->last->target == from) b->last->target = to;
+  if (b->last->op == irBR && b->last->target2 == from) b->last->target2 = to;
+}
+
+void ir_place_after(ir_block_t *p, ir_block_t *b)
+{
+  b->next = p->next;
+  p->next = b;
+}
+
+// a block that jumps into the loop marked from `h` and is the only way into
+// it, made if the loop has one entering edge that is not such a block.
+// NULL if the loop is entered from more than one block
+ir_block_t *ir_preheader(ir_func_t *f, ir_block_t *h)
+{
+  ir_block_t *outside = NULL;
+  for (uint32_t i = 0; i < h->pred_count; ++i) {
+    ir_block_t *p = h->preds[i];
+    if (p->mark || !ir_is_reachable(f, p)) continue;
+    if (outside != NULL && outside != p) return NULL;
+    outside = p;
+  }
+  if (outside == NULL) return NULL;
+  if (outside->last->op == irJMP) return outside;
+
+  ir_block_t *pre = ir_new_block(f);
+  ir_insn_t *jmp = ir_new_insn(irJMP);
+  jmp->target = h;
+  ir_insert_insn(pre, jmp, NULL);
+  ir_retarget(outside, h, pre);
+  for (ir_insn_t *phi = h->first; phi && phi->op == irPHI; phi = phi->next)
+    for (uint32_t i = 0; i < phi->nargs; ++i)
+      if (phi->from[i] == outside) phi->from[i] = pre;
+  ir_place_after(outside, pre);
+  ir_compute_preds(f);
+  return pre;
+}
+
+// loop-rotate: turns a loop that tests its condition at the top into one
+// that tests it at the bottom. the header is copied into a block after the
+// last latch, which the latches jump to instead, and the header is left to
+// guard the first iteration:
+//   cond: br c, body, end        cond: br c, body, end
+//   body: ...; jmp cond    =>    body: ...; jmp test
+//                                test: br c', body, end
+// so that every iteration takes one branch instead of a branch and a jump.
+// only small headers without stores or calls whose values do not leave
+// them are copied
+#define IR_ROTATE_LIMIT 8
+
+uint8_t ir_rotate_loop(ir_func_t *f, ir_block_t *h)
+{
+  ir_insn_t *br = h->last;
+  if (br->op != irBR || br->target == br->target2) return 0;
+  ir_block_t *inside = br->target->mark ? br->target : br->target2;
+  ir_block_t *exit = br->target->mark ? br->target2 : br->target;
+  if (exit->mark || !inside->mark || inside == h) return 0;
+  if (ir_has_phis(h) || ir_has_phis(inside) || ir_has_phis(exit)) return 0;
+
+  uint32_t size = 0;
+  uint8_t *local = malloc(f->vreg_count);
+  memset(local, 0, f->vreg_count);
+  for (ir_insn_t *insn = h->first; insn != NULL; insn = insn->next) {
+    if (insn->op == irSTORE || insn->op == irCALL || ++size > IR_ROTATE_LIMIT) {
+      free(local);
+      return 0;
+    }
+    if (insn->dst) local[insn->dst] = 1;
+  }
+  for (ir_block_t *b = f->blocks; b != NULL; b = b->next) {
+    if (b == h) continue;
+    for (ir_insn_t *insn = b->first; insn != NULL; insn = insn->next) {
+      for (uint32_t i = 0; i < ir_operand_count(insn); ++i) {
+        ir_val_t *v = ir_operand(insn, i);
+        if (v->kind == kVREG && local[v->v]) { free(local); return 0; }
+      }
+    }
+  }
+  free(local);
+
+  uint32_t *rename = malloc(f->vreg_count * sizeof(uint32_t));
+  memset(rename, 0, f->vreg_count * sizeof(uint32_t));
+  ir_block_t *test = ir_new_block(f);
+  for (ir_insn_t *insn = h->first; insn != NULL; insn = insn->next) {
+    ir_insn_t *copy = ir_new_insn(insn->op);
+    *copy = *insn;
+    if (insn->dst) copy->dst = rename[insn->dst] = f->vreg_count++;
+    for (uint32_t i = 0; i < 2; ++i) {
+      ir_val_t *v = ir_operand(copy, i);
+      if (v->kind == kVREG && rename[v->v]) v->v = rename[v->v];
+    }
+    ir_insert_insn(test, copy, NULL);
+  }
+  free(rename);
+
+  // the latches jump to the test instead. it goes after the last of them
+  ir_block_t *last_latch = NULL;
+  for (ir_block_t *b = f->blocks; b != NULL; b = b->next) {
+    if (!b->mark || b == h || !ir_is_pred(h, b)) continue;
+    ir_retarget(b, h, test);
+    last_latch = b;
+  }
+  ir_place_after(last_latch, test);
+  return 1;
+}
+
+void ir_rotate_loops(ir_func_t *f)
+{
+  ir_block_t **headers;
+  uint32_t count = ir_find_headers(f, &headers);
+  for (uint32_t i = 0; i < count; ++i) {
+    uint32_t n;
+    free(ir_compute_dominators(f, &n));
+    if (!ir_is_reachable(f, headers[i])) continue;
+    if (ir_mark_loop(f, headers[i]) == 0) continue;
+    if (ir_rotate_loop(f, headers[i])) ir_compute_preds(f);
+  }
+  free(headers);
+}
+
+// licm: moves the computations of a loop whose operands do not change in
+// it, and loads that nothing in it can store to, into its preheader.
+// globals that the loop stores to and that it accesses only directly are
+// kept in a new stack slot while it runs: the preheader loads the slot from
+// the global, every exit stores it back, and building SSA again turns the
+// slot into vregs
+typedef struct ir_loop_info_s {
+  uint8_t has_call;
+  uint8_t has_ptr; // loads or stores through pointers
+  ir_insn_t **stores;
+  uint32_t store_count;
+} ir_loop_info_t;
+
+void ir_scan_loop(ir_func_t *f, ir_loop_info_t *info)
+{
+  info->has_call = info->has_ptr = 0;
+  info->store_count = 0;
+  for (ir_block_t *b = f->blocks; b != NULL; b = b->next) {
+    if (!b->mark) continue;
+    for (ir_insn_t *insn = b->first; insn != NULL; insn = insn->next) {
+      if (insn->op == irCALL) info->has_call = 1;
+      if (insn->op != irLOAD && insn->op != irSTORE) continue;
+      if (insn->mem == mPTR) info->has_ptr = 1;
+      if (insn->op != irSTORE) continue;
+      info->stores = realloc(
+        info->stores, (info->store_count + 1) * sizeof(ir_insn_t *)
+        );
+      info->stores[info->store_count++] = insn;
+    }
+  }
+}
+
+uint8_t ir_overlaps(ir_insn_t *x, ir_insn_t *y)
+{
+  return x->mem == y->mem && x->disp < y->disp + y->width
+    && y->disp < x->disp + x->width;
+}
+
+// whether `insn` computes the same value wherever it is in the loop.
+// `in_loop` tells which vregs are defined in the loop
+uint8_t ir_is_invariant(ir_insn_t *insn, uint8_t *in_loop, ir_loop_info_t *info)
+{
+  switch (insn->op) {
+  case irADD: case irSUB: case irMUL: case irDIV: case irMOD:
+  case irAND: case irOR: case irXOR: case irNOT:
+    if (ir_has_side_effects(insn)) return 0;
+    break;
+  // copies of constants are cheaper to redo than to keep in a register
+  case irCOPY:
+    if (insn->a.kind == kIMM) return 0;
+    break;
+  // loads of the frame and of globals cannot fault
+  case irLOAD:
+    if (insn->mem == mPTR || info->has_call) return 0;
+    for (uint32_t i = 0; i < info->store_count; ++i) {
+      ir_insn_t *s = info->stores[i];
+      if (s->mem == mPTR || ir_overlaps(s, insn)) return 0;
+    }
+    break;
+  default: return 0;
+  }
+  for (uint32_t i = 0; i < 2; ++i) {
+    ir_val_t *v = ir_operand(insn, i);
+    if (v->kind == kVREG && in_loop[v->v]) return 0;
+  }
+  return 1;
+}
+
+void ir_hoist(ir_func_t *f, ir_block_t *pre, ir_loop_info_t *info)
+{
+  uint8_t *in_loop = malloc(f->vreg_count);
+  memset(in_loop, 0, f->vreg_count);
+  for (ir_block_t *b = f->blocks; b != NULL; b = b->next) {
+    if (!b->mark) continue;
+    for (ir_insn_t *insn = b->first; insn != NULL; insn = insn->next)
+      if (insn->dst) in_loop[insn->dst] = 1;
+  }
+
+  uint8_t changed = 1;
+  while (changed) {
+    changed = 0;
+    for (ir_block_t *b = f->blocks; b != NULL; b = b->next) {
+      if (!b->mark) continue;
+      for (ir_insn_t *insn = b->first, *next; insn != NULL; insn = next) {
+        next = insn->next;
+        if (!ir_is_invariant(insn, in_loop, info)) continue;
+        ir_remove_insn(b, insn);
+        ir_insert_insn(pre, insn, pre->last);
+        in_loop[insn->dst] = 0;
+        changed = 1;
+      }
+    }
+  }
+  free(in_loop);
+}
+
+// splits every edge that leaves the loop with a block that jumps to where
+// the edge went, and returns the new blocks
+uint32_t ir_split_exits(ir_func_t *f, ir_block_t ***out)
+{
+  ir_block_t **exits = NULL;
+  uint32_t count = 0;
+  for (ir_block_t *b = f->blocks; b != NULL; b = b->next) {
+    if (!b->mark || b->last->op == irRET) continue;
+    ir_block_t *succ[2];
+    uint32_t ns = ir_successors(b, succ);
+    for (uint32_t i = 0; i < ns; ++i) {
+      ir_block_t *y = succ[i];
+      if (y->mark) continue;
+      ir_block_t *e = ir_new_block(f);
+      ir_insn_t *jmp = ir_new_insn(irJMP);
+      jmp->target = y;
+      ir_insert_insn(e, jmp, NULL);
+      ir_retarget(b, y, e);
+      for (ir_insn_t *phi = y->first; phi && phi->op == irPHI; phi = phi->next)
+        for (uint32_t j = 0; j < phi->nargs; ++j)
+          if (phi->from[j] == b) phi->from[j] = e;
+      ir_place_after(b, e);
+      exits = realloc(exits, (count + 1) * sizeof(ir_block_t *));
+      exits[count++] = e;
+    }
+  }
+  ir_compute_preds(f);
+  *out = exits;
+  return count;
+}
+
+ir_insn_t *ir_new_access(ir_op_t op, ir_mem_t mem, int32_t disp, uint8_t width)
+{
+  ir_insn_t *insn = ir_new_insn(op);
+  insn->mem = mem;
+  insn->a = ir_imm(0);
+  insn->disp = disp;
+  insn->width = width;
+  return insn;
+}
+
+// returns whether any global was promoted
+uint8_t ir_promote_globals(ir_func_t *f, ir_block_t *pre, ir_loop_info_t *info)
+{
+  if (info->has_call || info->has_ptr) return 0;
+  ir_block_t **exits = NULL;
+  uint32_t exit_count = 0;
+  uint8_t promoted = 0;
+
+  for (uint32_t i = 0; i < info->store_count; ++i) {
+    ir_insn_t *s = info->stores[i];
+    if (s->mem != mABS) continue;
+    int32_t disp = s->disp;
+    uint8_t width = s->width, ok = 1;
+    for (uint32_t j = 0; j < i; ++j)
+      if (info->stores[j]->mem == mABS && info->stores[j]->disp == disp) ok = 0;
+    for (ir_block_t *b = f->blocks; b != NULL && ok; b = b->next) {
+      if (!b->mark) continue;
+      for (ir_insn_t *insn = b->first; insn != NULL; insn = insn->next) {
+        if (insn->op != irLOAD && insn->op != irSTORE && insn->op != irADDR)
+          continue;
+        if (!ir_overlaps(insn, s)) continue;
+        if (insn->op == irADDR || insn->disp != disp || insn->width != width)
+          ok = 0;
+      }
+    }
+    if (!ok) continue;
+
+    if (!promoted) exit_count = ir_split_exits(f, &exits);
+    promoted = 1;
+    f->frame_size = ((f->frame_size + 3) & ~3) + 4;
+    int32_t slot = -(int32_t) f->frame_size;
+
+    // pre:  v = load [disp]; store [slot], v
+    ir_insn_t *load = ir_new_access(irLOAD, mABS, disp, width);
+    load->dst = f->vreg_count++;
+    ir_insert_insn(pre, load, pre->last);
+    ir_insn_t *store = ir_new_access(irSTORE, mFRAME, slot, width);
+    store->b = ir_vreg(load->dst);
+    ir_insert_insn(pre, store, pre->last);
+
+    for (ir_block_t *b = f->blocks; b != NULL; b = b->next) {
+      if (!b->mark) continue;
+      for (ir_insn_t *insn = b->first; insn != NULL; insn = insn->next) {
+        if (insn->op != irLOAD && insn->op != irSTORE) continue;
+        if (insn->mem != mABS || insn->disp != disp) continue;
+        insn->mem = mFRAME;
+        insn->disp = slot;
+      }
+    }
+
+    // exits:  v = load [slot]; store [disp], v
+    for (uint32_t j = 0; j < exit_count; ++j) {
+      load = ir_new_access(irLOAD, mFRAME, slot, width);
+      load->dst = f->vreg_count++;
+      ir_insert_insn(exits[j], load, exits[j]->last);
+      store = ir_new_access(irSTORE, mABS, disp, width);
+      store->b = ir_vreg(load->dst);
+      ir_insert_insn(exits[j], store, exits[j]->last);
+    }
+  }
+
+  free(exits);
+  return promoted;
+}
+
+void ir_licm(ir_func_t *f)
+{
+  ir_block_t **headers;
+  uint32_t count = ir_find_headers(f, &headers);
+  ir_loop_info_t info = { 0 };
+  uint8_t promoted = 0;
+  for (uint32_t i = 0; i < count; ++i) {
+    uint32_t n;
+    free(ir_compute_dominators(f, &n));
+    if (!ir_is_reachable(f, headers[i])) continue;
+    if (ir_mark_loop(f, headers[i]) == 0) continue;
+    ir_block_t *pre = ir_preheader(f, headers[i]);
+    if (pre == NULL) continue;
+    ir_scan_loop(f, &info);
+    ir_hoist(f, pre, &info);
+    if (ir_promote_globals(f, pre, &info)) promoted = 1;
+  }
+  free(info.stores);
+  free(headers);
+
+  if (promoted) {
+    for (ir_block_t *b = f->blocks; b != NULL; b = b->next)
+      for (ir_insn_t *insn = b->first; insn != NULL; insn = insn->next)
+        insn->aux = 0;
+    ir_build_ssa(f);
+  }
+  ir_compute_preds(f);
+}
+
+// iv-reduce: strength-reduces the addresses of loads and stores of the form
+// base + i * k, where base does not change in the loop and i is a basic
+// induction variable (a header phi that every latch adds the same constant
+// to), into a pointer that starts at base + i0 * k and is advanced along
+// with i:
+//   v = mul i, 4; p = add base, v; load [p]   =>   load [q]
+//   i' = add i, 1                                  i' = add i, 1
+//                                                  q' = add q, 4
+// an unscaled index is only replaced when the loop uses it for nothing
+// else, since otherwise the pointer is an extra register for no gain.
+// the loop test is left alone: comparing pointers instead of the index
+// would compare unsigned where the program compared signed
+#define IR_IV_LIMIT 2
+
+// the increment of the header phi `phi` if it is a basic induction
+// variable, NULL otherwise. `pre` is the preheader
+ir_insn_t *ir_basic_iv(ir_insn_t *phi, ir_block_t *pre, ir_insn_t **def)
+{
+  ir_val_t next = { .kind = kNONE };
+  for (uint32_t i = 0; i < phi->nargs; ++i) {
+    if (phi->from[i] == pre) continue;
+    if (phi->args[i].kind != kVREG) return NULL;
+    if (next.kind != kNONE && next.v != phi->args[i].v) return NULL;
+    next = phi->args[i];
+  }
+  if (next.kind == kNONE) return NULL;
+  ir_insn_t *d = def[next.v];
+  if (d == NULL || d->op != irADD || d->width != 4) return NULL;
+  if (d->a.kind == kVREG && (uint32_t) d->a.v == phi->dst && d->b.kind == kIMM)
+    return d;
+  if (d->b.kind == kVREG && (uint32_t) d->b.v == phi->dst && d->a.kind == kIMM)
+    return d;
+  return NULL;
+}
+
+// splits the address of the load or store `insn` into base + iv * scale,
+// where base is defined outside the loop. returns the vreg that is scaled,
+// or 0. vregs from `count` on are new and have no definitions in `def`
+uint32_t ir_split_address(
+  ir_insn_t *insn, uint32_t count, ir_insn_t **def, uint8_t *in_loop,
+  ir_val_t *base, int32_t *scale
+  )
+{
+  if (insn->op != irLOAD && insn->op != irSTORE) return 0;
+  if (insn->mem != mPTR || insn->a.kind != kVREG) return 0;
+  if ((uint32_t) insn->a.v >= count || !in_loop[insn->a.v]) return 0;
+  ir_insn_t *d = def[insn->a.v];
+  if (d == NULL || d->op != irADD || d->width != 4) return 0;
+  for (uint32_t i = 0; i < 2; ++i) {
+    ir_val_t b = i ? d->a : d->b, idx = i ? d->b : d->a;
+    if (b.kind == kVREG && in_loop[b.v]) continue;
+    if (idx.kind != kVREG) continue;
+    *base = b;
+    *scale = 1;
+    ir_insn_t *m = def[idx.v];
+    if (m == NULL || m->op != irMUL || m->width != 4) return idx.v;
+    if (m->a.kind == kVREG && m->b.kind == kIMM) {
+      *scale = m->b.v;
+      return m->a.v;
+    }
+    if (m->b.kind == kVREG && m->a.kind == kIMM) {
+      *scale = m->a.v;
+      return m->b.v;
+    }
+    return idx.v;
+  }
+  return 0;
+}
+
+// whether the iv is used for anything but its increment, its phi and the
+// addresses that `group` is about to stop using
+uint8_t ir_iv_escapes(
+  ir_insn_t *phi, ir_insn_t *next, ir_insn_t **group, uint32_t n,
+  uint32_t *uses, ir_insn_t **def
+  )
+{
+  uint32_t phi_uses = 1, next_uses = 0;
+  for (uint32_t i = 0; i < phi->nargs; ++i)
+    if (phi->args[i].kind == kVREG && (uint32_t) phi->args[i].v == next->dst)
+      ++next_uses;
+
+  for (uint32_t i = 0; i < n; ++i) {
+    uint32_t x = group[i]->a.v, replaced = 0, seen = 0;
+    for (uint32_t j = 0; j < n; ++j) {
+      if ((uint32_t) group[j]->a.v != x) continue;
+      if (j < i) seen = 1;
+      ++replaced;
+    }
+    if (seen || replaced != uses[x]) continue;
+    ir_insn_t *d = def[x];
+    for (uint32_t k = 0; k < 2; ++k) {
+      ir_val_t v = *ir_operand(d, k);
+      if (v.kind != kVREG) continue;
+      if ((uint32_t) v.v == phi->dst) ++phi_uses;
+      else if ((uint32_t) v.v == next->dst) ++next_uses;
+    }
+  }
+  return uses[phi->dst] != phi_uses || uses[next->dst] != next_uses;
+}
+
+// gives the accesses in `group`, whose addresses are base + iv * scale, a
+// pointer of their own that moves with the iv
+void ir_reduce_group(
+  ir_func_t *f, ir_block_t *h, ir_block_t *pre, ir_insn_t *phi,
+  ir_insn_t *next, ir_block_t *next_block, ir_val_t base, int32_t scale,
+  ir_insn_t **group, uint32_t n, uint32_t *ivs
+  )
+{
+  // pre: s = mul i0, scale; q0 = add base, s
+  ir_val_t init = { .kind = kNONE };
+  for (uint32_t i = 0; i < phi->nargs; ++i)
+    if (phi->from[i] == pre) init = phi->args[i];
+  if (scale != 1) {
+    ir_insn_t *mul = ir_new_insn(irMUL);
+    mul->a = init;
+    mul->b = ir_imm(scale);
+    mul->dst = f->vreg_count++;
+    ir_insert_insn(pre, mul, pre->last);
+    init = ir_vreg(mul->dst);
+  }
+  ir_insn_t *start = ir_new_insn(irADD);
+  start->a = base;
+  start->b = init;
+  start->dst = f->vreg_count++;
+  ir_insert_insn(pre, start, pre->last);
+
+  // h: q = phi [pre: q0, latches: q']
+  // after i' = add i, step: q' = add q, step * scale
+  ir_insn_t *q = ir_new_phi(f, h);
+  ir_insn_t *step = ir_new_insn(irADD);
+  step->a = ir_vreg(q->dst);
+  step->b = ir_imm((next->a.kind == kIMM ? next->a.v : next->b.v) * scale);
+  step->dst = f->vreg_count++;
+  ir_insert_insn(next_block, step, next->next);
+  for (uint32_t i = 0; i < q->nargs; ++i)
+    q->args[i] = ir_vreg(q->from[i] == pre ? start->dst : step->dst);
+
+  for (uint32_t i = 0; i < n; ++i)
+    group[i]->a = ir_vreg(ivs[i] == phi->dst ? q->dst : step->dst);
+}
+
+void ir_reduce_loop(ir_func_t *f, ir_block_t *h, ir_block_t *pre)
+{
+  uint32_t count = f->vreg_count;
+  uint32_t *defs = malloc(count * sizeof(uint32_t));
+  uint32_t *uses = malloc(count * sizeof(uint32_t));
+  ir_insn_t **def = malloc(count * sizeof(ir_insn_t *));
+  ir_block_t **def_block = malloc(count * sizeof(ir_block_t *));
+  uint8_t *in_loop = malloc(count);
+  memset(def, 0, count * sizeof(ir_insn_t *));
+  memset(in_loop, 0, count);
+  ir_count_defs(f, defs, def);
+  ir_count_uses(f, uses);
+  for (ir_block_t *b = f->blocks; b != NULL; b = b->next) {
+    if (!b->mark) continue;
+    for (ir_insn_t *insn = b->first; insn != NULL; insn = insn->next) {
+      if (insn->dst == 0) continue;
+      in_loop[insn->dst] = 1;
+      def_block[insn->dst] = b;
+    }
+  }
+
+  ir_insn_t **all = NULL, **group = NULL;
+  uint32_t *all_ivs = NULL, *ivs = NULL, reduced = 0;
+  ir_val_t *bases = NULL;
+  int32_t *scales = NULL;
+  for (ir_insn_t *phi = h->first; phi && phi->op == irPHI; phi = phi->next) {
+    if (phi->dst >= count) continue;
+    ir_insn_t *next = ir_basic_iv(phi, pre, def);
+    if (next == NULL || !in_loop[next->dst]) continue;
+
+    // the accesses through this iv. the unscaled ones are only worth it
+    // if all of them are replaced and the iv dies
+    uint32_t n = 0, unscaled = 0;
+    for (ir_block_t *b = f->blocks; b != NULL; b = b->next) {
+      if (!b->mark) continue;
+      for (ir_insn_t *insn = b->first; insn != NULL; insn = insn->next) {
+        ir_val_t base;
+        int32_t scale;
+        uint32_t iv =
+          ir_split_address(insn, count, def, in_loop, &base, &scale);
+        if (iv == 0 || (iv != phi->dst && iv != next->dst)) continue;
+        all = realloc(all, (n + 1) * sizeof(ir_insn_t *));
+        all_ivs = realloc(all_ivs, (n + 1) * sizeof(uint32_t));
+        bases = realloc(bases, (n + 1) * sizeof(ir_val_t));
+        scales = realloc(scales, (n + 1) * sizeof(int32_t));
+        all[n] = insn;
+        all_ivs[n] = iv;
+        bases[n] = base;
+        scales[n++] = scale;
+      }
+    }
+    for (uint32_t i = 0; i < n; ++i) {
+      if (scales[i] != 1) continue;
+      group = realloc(group, (unscaled + 1) * sizeof(ir_insn_t *));
+      group[unscaled++] = all[i];
+    }
+    uint8_t keep_unscaled = unscaled == 0
+      || ir_iv_escapes(phi, next, group, unscaled, uses, def);
+
+    // one pointer for each base and scale
+    for (uint32_t i = 0; i < n && reduced < IR_IV_LIMIT; ++i) {
+      if (all[i] == NULL || (scales[i] == 1 && keep_unscaled)) continue;
+      uint32_t m = 0;
+      for (uint32_t j = i; j < n; ++j) {
+        if (all[j] == NULL || scales[j] != scales[i]) continue;
+        if (!ir_same_val(bases[j], bases[i])) continue;
+        group = realloc(group, (m + 1) * sizeof(ir_insn_t *));
+        ivs = realloc(ivs, (m + 1) * sizeof(uint32_t));
+        group[m] = all[j];
+        ivs[m++] = all_ivs[j];
+        all[j] = NULL;
+      }
+      ir_reduce_group(
+        f, h, pre, phi, next, def_block[next->dst], bases[i], scales[i],
+        group, m, ivs
+        );
+      ++reduced;
+    }
+  }
+
+  free(all);
+  free(all_ivs);
+  free(bases);
+  free(scales);
+  free(group);
+  free(ivs);
+  free(defs);
+  free(uses);
+  free(def);
+  free(def_block);
+  free(in_loop);
+}
+
+void ir_iv_reduce(ir_func_t *f)
+{
+  ir_block_t **headers;
+  uint32_t count = ir_find_headers(f, &headers);
+  for (uint32_t i = 0; i < count; ++i) {
+    uint32_t n;
+    free(ir_compute_dominators(f, &n));
+    if (!ir_is_reachable(f, headers[i])) continue;
+    if (ir_mark_loop(f, headers[i]) == 0) continue;
+    ir_block_t *pre = ir_preheader(f, headers[i]);
+    if (pre != NULL) ir_reduce_loop(f, headers[i], pre);
+  }
+  free(headers);
+  ir_compute_preds(f);
+}
+
+// unroll: with -funroll-loops, unrolls counted loops whose body is one
+// block: a loop that steps a basic induction variable by a constant and
+// tests it against a bound that does not change in it. a loop with a small
+// constant trip count is replaced by that many copies of its body. other
+// loops that count up with < or down with > get a copy that runs the body
+// `factor` times per test while at least that many iterations are left,
+// falling back to the original loop for the rest:
+//   pre:  lim = sub n, d; br n >= INT_MIN + d, chk, loop
+//   chk:  br i0 < lim, main, loop
+//   main: <body> x factor; br i < lim, main, rest
+//   rest: br <test of the last copy>, loop, exit
+// where d is how far past the start of an iteration its test looks, in
+// factor - 1 steps. the factor is the largest that keeps the copies within
+// IR_UNROLL_BUDGET instructions. with a profile, loops that never ran are
+// left alone, and without -funroll-loops only the loops that ran more
+// often than their function was called are unrolled
+#define IR_UNROLL_BUDGET 48
+#define IR_UNROLL_FULL 16
+
+typedef struct ir_counted_loop_s {
+  ir_insn_t *phi; // the induction variable i
+  ir_insn_t *next; // i' = add i, step
+  ir_insn_t *test; // the compare that the latch branches on
+  int32_t step;
+  ir_op_t op; // the loop goes on while `v op bound`
+  uint8_t tests_next; // v is i' rather than i
+  ir_val_t init, bound;
+} ir_counted_loop_t;
+
+void ir_add_phi_input(ir_insn_t *phi, ir_block_t *from, ir_val_t v)
+{
+  phi->args = realloc(phi->args, (phi->nargs + 1) * sizeof(ir_val_t));
+  phi->from = realloc(phi->from, (phi->nargs + 1) * sizeof(ir_block_t *));
+  phi->args[phi->nargs] = v;
+  phi->from[phi->nargs++] = from;
+}
+
+uint8_t ir_defines(ir_block_t *b, uint32_t v)
+{
+  for (ir_insn_t *insn = b->first; insn != NULL; insn = insn->next)
+    if (insn->dst == v) return 1;
+  return 0;
+}
+
+// recognizes the counted loop `b`, which jumps to itself. returns a reason
+// it is not one, or NULL
+char *ir_match_counted(
+  ir_block_t *b, ir_block_t *pre, ir_insn_t **def, ir_counted_loop_t *loop
+  )
+{
+  ir_insn_t *br = b->last;
+  if (br->op != irBR || br->a.kind != kVREG) return "not a counted loop";
+  ir_insn_t *test = def[br->a.v];
+  if (test == NULL || !ir_is_compare(test->op)) return "not a counted loop";
+  loop->test = test;
+  loop->op = br->target == b ? test->op : ir_negate_compare(test->op);
+
+  for (ir_insn_t *phi = b->first; phi && phi->op == irPHI; phi = phi->next) {
+    ir_insn_t *next = ir_basic_iv(phi, pre, def);
+    if (next == NULL) continue;
+    for (uint32_t i = 0; i < 2; ++i) {
+      ir_val_t v = i ? test->b : test->a, bound = i ? test->a : test->b;
+      if (!ir_is_vreg(v, phi->dst) && !ir_is_vreg(v, next->dst)) continue;
+      if (bound.kind == kVREG && ir_defines(b, bound.v)) continue;
+      loop->phi = phi;
+      loop->next = next;
+      loop->step = next->a.kind == kIMM ? next->a.v : next->b.v;
+      loop->tests_next = ir_is_vreg(v, next->dst);
+      loop->init = ir_phi_input(phi, pre);
+      loop->bound = bound;
+      if (i) loop->op = ir_swap_compare(loop->op);
+      return NULL;
+    }
+  }
+  return "no induction variable in the test";
+}
+
+// the number of times the body runs, or 0 if it is not a constant of at
+// most IR_UNROLL_FULL
+uint32_t ir_trip_count(ir_counted_loop_t *loop)
+{
+  if (loop->init.kind != kIMM || loop->bound.kind != kIMM) return 0;
+  int32_t i = loop->init.v, v, go;
+  for (uint32_t trips = 1; trips <= IR_UNROLL_FULL; ++trips) {
+    ir_eval(irADD, i, loop->tests_next ? loop->step : 0, 4, &v);
+    ir_eval(loop->op, v, loop->bound.v, 4, &go);
+    if (!go) return trips;
+    ir_eval(irADD, i, loop->step, 4, &i);
+  }
+  return 0;
+}
+
+ir_val_t ir_lookup_env(ir_val_t v, ir_val_t *env, uint32_t count)
+{
+  if (v.kind == kVREG && (uint32_t) v.v < count && env[v.v].kind != kNONE)
+    return env[v.v];
+  return v;
+}
+
+// appends a copy of the body of `b`, between its phis and its terminator,
+// to `to`. the copy reads `env` for the vregs of `b` and records the new
+// vregs of its definitions there
+void ir_clone_body(
+  ir_func_t *f, ir_block_t *b, ir_block_t *to, ir_val_t *env, uint32_t count
+  )
+{
+  for (ir_insn_t *insn = b->first; insn != b->last; insn = insn->next) {
+    if (insn->op == irPHI) continue;
+    ir_insn_t *copy = ir_new_insn(insn->op);
+    *copy = *insn;
+    if (insn->nargs) {
+      copy->args = malloc(insn->nargs * sizeof(ir_val_t));
+      memcpy(copy->args, insn->args, insn->nargs * sizeof(ir_val_t));
+    }
+    for (uint32_t i = 0; i < ir_operand_count(copy); ++i)
+      *ir_operand(copy, i) = ir_lookup_env(*ir_operand(copy, i), env, count);
+    if (insn->dst) {
+      copy->dst = f->vreg_count++;
+      env[insn->dst] = ir_vreg(copy->dst);
+    }
+    ir_insert_insn(to, copy, NULL);
+  }
+}
+
+// moves `env` on to the next iteration: the phis of `b` take the values
+// that the copy just made feeds back to them
+void ir_next_iteration(ir_block_t *b, ir_val_t *env, uint32_t count)
+{
+  uint32_t nphis = 0;
+  for (ir_insn_t *phi = b->first; phi && phi->op == irPHI; phi = phi->next)
+    ++nphis;
+  ir_val_t *next = malloc(nphis * sizeof(ir_val_t));
+  uint32_t i = 0;
+  for (ir_insn_t *phi = b->first; phi && phi->op == irPHI; phi = phi->next)
+    next[i++] = ir_lookup_env(ir_phi_input(phi, b), env, count);
+  i = 0;
+  for (ir_insn_t *phi = b->first; phi && phi->op == irPHI; phi = phi->next)
+    env[phi->dst] = next[i++];
+  free(next);
+}
+
+// replaces the loop `b` with `trips` copies of its body. the last copy is
+// the original body, so values that are used after the loop keep their vregs
+void ir_unroll_fully(ir_func_t *f, ir_block_t *b, ir_block_t *pre, uint32_t trips)
+{
+  uint32_t count = f->vreg_count;
+  ir_val_t *env = malloc(count * sizeof(ir_val_t));
+  memset(env, 0, count * sizeof(ir_val_t));
+  for (ir_insn_t *phi = b->first; phi && phi->op == irPHI; phi = phi->next)
+    env[phi->dst] = ir_phi_input(phi, pre);
+
+  ir_block_t *copies = ir_new_block(f);
+  for (uint32_t t = 1; t < trips; ++t) {
+    ir_clone_body(f, b, copies, env, count);
+    ir_next_iteration(b, env, count);
+  }
+
+  // the phis become copies of the values they have in the last iteration
+  ir_insn_t *br = b->last;
+  for (ir_insn_t *insn = b->first; insn != NULL; insn = insn->next)
+    if (insn->op == irPHI) {
+      insn->nargs = 0;
+      ir_make_copy(insn, env[insn->dst]);
+    }
+  br->op = irJMP;
+  br->a.kind = kNONE;
+  if (br->target == b) br->target = br->target2;
+  if (copies->first != NULL) {
+    copies->last->next = b->first;
+    b->first->prev = copies->last;
+    b->first = copies->first;
+  }
+  free(env);
+}
+
+// gives the values of `b` that are used after the loop a phi in its exit
+// `exit`, if the loop is the only way there
+void ir_close_loop(ir_func_t *f, ir_block_t *b, ir_block_t *exit)
+{
+  if (exit->pred_count != 1) return;
+  for (ir_insn_t *insn = b->first; insn != NULL; insn = insn->next) {
+    if (insn->dst == 0) continue;
+    ir_insn_t *phi = NULL;
+    for (ir_block_t *u = f->blocks; u != NULL; u = u->next) {
+      if (u == b) continue;
+      for (ir_insn_t *user = u->first; user != NULL; user = user->next) {
+        if (user == phi) continue;
+        for (uint32_t i = 0; i < ir_operand_count(user); ++i) {
+          if (!ir_is_vreg(*ir_operand(user, i), insn->dst)) continue;
+          if (phi == NULL) {
+            phi = ir_new_phi(f, exit);
+            phi->args[0] = ir_vreg(insn->dst);
+          }
+          *ir_operand(user, i) = ir_vreg(phi->dst);
+        }
+      }
+    }
+  }
+}
+
+void ir_unroll_partially(
+  ir_func_t *f, ir_block_t *b, ir_block_t *pre, ir_counted_loop_t *loop,
+  uint32_t factor
+  )
+{
+  ir_block_t *exit = b->last->target == b ? b->last->target2 : b->last->target;
+  ir_close_loop(f, b, exit);
+
+  // pre: lim = sub n, d; g = ge n, INT_MIN + d (le n, INT_MAX + d counting
+  // down), so that lim does not wrap around
+  ir_op_t less = loop->step > 0 ? irLT : irGT;
+  int32_t d = (loop->tests_next ? loop->step : 0)
+    + (int32_t) (factor - 2) * loop->step;
+  ir_insn_t *jmp = pre->last;
+  ir_insn_t *lim = ir_new_insn(irSUB);
+  lim->a = loop->bound;
+  lim->b = ir_imm(d);
+  lim->dst = f->vreg_count++;
+  ir_insert_insn(pre, lim, jmp);
+  ir_block_t *chk = ir_new_block(f), *main = ir_new_block(f);
+  ir_block_t *rest = ir_new_block(f);
+  uint8_t guard = loop->step > 0 ? d > 0 : d < 0;
+  if (guard) {
+    ir_insn_t *g = ir_new_insn(loop->step > 0 ? irGE : irLE);
+    g->a = loop->bound;
+    g->b = ir_imm(loop->step > 0 ? INT32_MIN + d : INT32_MAX + d);
+    g->dst = f->vreg_count++;
+    ir_insert_insn(pre, g, jmp);
+    jmp->op = irBR;
+    jmp->a = ir_vreg(g->dst);
+    jmp->target2 = b;
+  }
+  jmp->target = chk;
+
+  // chk: e = lt i0, lim; br e, main, b
+  ir_insn_t *e = ir_new_insn(less);
+  e->a = loop->init;
+  e->b = ir_vreg(lim->dst);
+  e->dst = f->vreg_count++;
+  ir_insert_insn(chk, e, NULL);
+  ir_insn_t *br = ir_new_insn(irBR);
+  br->a = ir_vreg(e->dst);
+  br->target = main;
+  br->target2 = b;
+  ir_insert_insn(chk, br, NULL);
+
+  // main: a phi for each phi of b, then the copies of the body
+  uint32_t count = f->vreg_count;
+  ir_val_t *env = malloc(count * sizeof(ir_val_t));
+  memset(env, 0, count * sizeof(ir_val_t));
+  for (ir_insn_t *phi = b->first; phi && phi->op == irPHI; phi = phi->next) {
+    ir_insn_t *q = ir_new_insn(irPHI);
+    q->dst = f->vreg_count++;
+    ir_add_phi_input(q, chk, ir_phi_input(phi, pre));
+    ir_insert_insn(main, q, NULL);
+    env[phi->dst] = ir_vreg(q->dst);
+  }
+  for (uint32_t t = 1; t < factor; ++t) {
+    ir_clone_body(f, b, main, env, count);
+    ir_next_iteration(b, env, count);
+  }
+  ir_clone_body(f, b, main, env, count);
+
+  // rest: br <test of the last copy>, b, exit. the values that leave
+  // through it are those of the last copy
+  br = ir_new_insn(irBR);
+  *br = *b->last;
+  br->a = ir_lookup_env(br->a, env, count);
+  ir_insert_insn(rest, br, NULL);
+  for (ir_insn_t *phi = exit->first; phi && phi->op == irPHI; phi = phi->next)
+    ir_add_phi_input(phi, rest, ir_lookup_env(ir_phi_input(phi, b), env, count));
+  ir_next_iteration(b, env, count);
+
+  // main goes on while i < lim, with i as it is after the last copy
+  ir_insn_t *q = main->first;
+  for (ir_insn_t *phi = b->first; phi && phi->op == irPHI; phi = phi->next) {
+    ir_add_phi_input(q, main, env[phi->dst]);
+    ir_val_t init = ir_phi_input(phi, pre);
+    if (guard) ir_add_phi_input(phi, chk, init);
+    else
+      for (uint32_t i = 0; i < phi->nargs; ++i)
+        if (phi->from[i] == pre) phi->from[i] = chk;
+    ir_add_phi_input(phi, rest, env[phi->dst]);
+    q = q->next;
+  }
+  ir_insn_t *again = ir_new_insn(less);
+  again->a = env[loop->phi->dst];
+  again->b = ir_vreg(lim->dst);
+  again->dst = f->vreg_count++;
+  ir_insert_insn(main, again, NULL);
+  br = ir_new_insn(irBR);
+  br->a = ir_vreg(again->dst);
+  br->target = main;
+  br->target2 = rest;
+  ir_insert_insn(main, br, NULL);
+
+  ir_place_after(pre, chk);
+  ir_place_after(chk, main);
+  ir_place_after(main, rest);
+  free(env);
+}
+
+void ir_unroll_loop(ir_func_t *f, ir_block_t *h)
+{
+  char *why = NULL;
+  uint32_t size = 0, trips = 0, factor = 0;
+  ir_block_t *pre = NULL;
+  ir_counted_loop_t loop;
+
+  if (h->last->op != irBR || !ir_is_pred(h, h)) why = "body has control flow";
+  for (uint32_t i = 0; i < h->pred_count && why == NULL; ++i)
+    if (h->preds[i] != h && h->preds[i]->mark) why = "body has control flow";
+  if (why == NULL && (pre = ir_preheader(f, h)) == NULL)
+    why = "more than one entry";
+  if (why == NULL && h->count == 0) why = "never ran in the profile";
+  if (
+    why == NULL && !unroll_loops
+    && (h->count == IR_NO_COUNT || h->count <= f->count)
+    )
+    why = "not hot in the profile";
+  for (ir_insn_t *insn = h->first; insn != h->last; insn = insn->next)
+    if (insn->op != irPHI) ++size;
+
+  uint32_t *defs = malloc(f->vreg_count * sizeof(uint32_t));
+  ir_insn_t **def = malloc(f->vreg_count * sizeof(ir_insn_t *));
+  memset(def, 0, f->vreg_count * sizeof(ir_insn_t *));
+  ir_count_defs(f, defs, def);
+  if (why == NULL) why = ir_match_counted(h, pre, def, &loop);
+  free(defs);
+  free(def);
+
+  if (why == NULL) {
+    trips = ir_trip_count(&loop);
+    if (trips > 0 && trips * size > IR_UNROLL_BUDGET) trips = 0;
+  }
+  if (why == NULL && trips == 0) {
+    if (loop.step == 0 || loop.step > 0x10000 || loop.step < -0x10000)
+      why = "unsupported step";
+    else if (loop.op != (loop.step > 0 ? irLT : irGT)) why = "unsupported test";
+    for (factor = 8; factor > 1 && factor * size > IR_UNROLL_BUDGET; )
+      factor /= 2;
+    if (why == NULL && factor < 2) why = "body too large";
+  }
+
+  if (why == NULL && trips > 0) ir_unroll_fully(f, h, pre, trips);
+  else if (why == NULL) ir_unroll_partially(f, h, pre, &loop, factor);
+  ir_compute_preds(f);
+
+  if (!unroll_report) return;
+  printf(
+    "%s: loop at b%u (%u instruction%s): ", f->name, h->id, size,
+    size == 1 ? "" : "s"
+    );
+  if (why != NULL) printf("not unrolled, %s\n", why);
+  else if (trips > 0) printf("unrolled fully, %u iterations\n", trips);
+  else printf("unrolled %u times\n", factor);
+}
+
+void ir_unroll(ir_func_t *f)
+{
+  if (!unroll_loops && f->count == IR_NO_COUNT) return;
+  ir_block_t **headers;
+  uint32_t count = ir_find_headers(f, &headers);
+  for (uint32_t i = 0; i < count; ++i) {
+    uint32_t n;
+    free(ir_compute_dominators(f, &n));
+    if (!ir_is_reachable(f, headers[i])) continue;
+    if (ir_mark_loop(f, headers[i]) == 0) continue;
+    ir_unroll_loop(f, headers[i]);
+  }
+  free(headers);
+}
+
+// whether `call` is in tail position: the return right after it returns
+// what it returns, or nothing. a call that returns a char is not, since
+// its result is sign-extended after it returns
+uint8_t ir_is_tail_call(ir_insn_t *call)
+{
+  ir_insn_t *ret = call->next;
+  if (call->op != irCALL || ret == NULL || ret->op != irRET) return 0;
+  if (ret->a.kind == kNONE) return 1;
+  return ir_is_vreg(ret->a, call->dst) && call->width == 4;
+}
+
+// whether the address of anything in the frame of `f` is taken, so that
+// it may not be reused while the function runs
+uint8_t ir_frame_escapes(ir_func_t *f)
+{
+  for (ir_block_t *b = f->blocks; b != NULL; b = b->next)
+    for (ir_insn_t *insn = b->first; insn != NULL; insn = insn->next)
+      if (insn->op == irADDR) return 1;
+  return 0;
+}
+
+// the frame slot of parameter `i` of `f`
+int32_t ir_param_disp(ir_func_t *f, uint32_t i)
+{
+  if (i < f->regparm) return f->param_slots[i];
+  return 8 + 4 * (i - f->regparm);
+}
+
+// tail-recursion: a function that returns the result of calling itself
+// stores the arguments over its own and jumps back to its start instead,
+// unless the address of anything in its frame is taken:
+//   v = call f(a, b)          store [%ebp+8], a
+//   ret v                =>   store [%ebp+12], b
+//                             jmp b1
+// the entry block becomes a new one that only jumps to the old one, so the
+// loop that this makes has a header. the irPARAMs that the function starts
+// with and their stores move there too. this runs before ssa, which turns
+// the parameters into phis. calls to other functions in tail position are
+// left to isel
+void ir_tail_recursion(ir_func_t *f)
+{
+  if (ir_frame_escapes(f)) return;
+  ir_block_t *start = f->blocks, *entry = NULL;
+  for (ir_block_t *b = f->blocks; b != NULL; b = b->next) {
+    ir_insn_t *call = b->last ? b->last->prev : NULL;
+    if (call == NULL || !ir_is_tail_call(call)) continue;
+    if (call->a.kind != kIMM || call->nargs != f->params) continue;
+    if ((uint32_t) call->a.v != TEXT_START + f->start) continue;
+
+    if (entry == NULL) {
+      entry = ir_new_block(f);
+      ir_insn_t *jmp = ir_new_insn(irJMP);
+      jmp->target = start;
+      ir_insert_insn(entry, jmp, NULL);
+      entry->next = start;
+      f->blocks = entry;
+      // v = param i; store [%ebp+<slot>], v
+      while (start->first->op == irPARAM) {
+        for (uint32_t i = 0; i < 2; ++i) {
+          ir_insn_t *insn = start->first;
+          ir_remove_insn(start, insn);
+          ir_insert_insn(entry, insn, jmp);
+        }
+      }
+    }
+
+    // a parameter is stored with the width that it is loaded with
+    for (uint32_t i = 0; i < call->nargs; ++i) {
+      int32_t disp = ir_param_disp(f, i);
+      ir_insn_t *store = ir_new_access(irSTORE, mFRAME, disp, 4);
+      store->b = call->args[i];
+      for (ir_block_t *u = start; u != NULL; u = u->next)
+        for (ir_insn_t *insn = u->first; insn != NULL; insn = insn->next)
+          if (insn->op == irLOAD && insn->mem == mFRAME)
+            if (insn->disp == store->disp) store->width = insn->width;
+      ir_insert_insn(b, store, call);
+    }
+    ir_remove_insn(b, b->last);
+    call->op = irJMP;
+    call->a.kind = kNONE;
+    call->nargs = 0;
+    call->dst = 0;
+    call->target = start;
+  }
+  ir_compute_preds(f);
+}
+
+// inline: at -O2, replaces calls to functions defined earlier in the file
+// with copies of their bodies. every function leaves a copy of its IR here,
+// as it is once its own calls have been inlined, for the functions after
+// it. the copy gets vregs after those of the caller and frame slots below
+// its frame, so its locals cannot clash with the caller's:
+//   v = call f(a, b)            jmp b1
+//   <rest>                 =>   b1: <body of f, loading a for its first
+//                               parameter and b for its second>
+//                               jmp b3                (for every return)
+//                               b3: v = phi <returned values>
+//                               <rest>
+// parameters that are only ever loaded become the arguments themselves.
+// if the callee stores to one or takes its address, all of them get slots
+// in the caller's frame that the arguments are stored to. a call is
+// inlined if the callee has at most inline_limit instructions, twice that
+// in a loop, and the caller has not grown by IR_INLINE_GROWTH times that
+// already. functions that call themselves are never inlined. with a
+// profile, calls that never ran are not inlined, and calls that ran more
+// often than the caller was called count as in a loop
+#define IR_INLINE_GROWTH 8
+
+typedef struct ir_inline_body_s {
+  ir_func_t *f; // the copy, whose `start` is where the function is
+  uint32_t size;
+  uint8_t recursive;
+  uint8_t params_in_memory;
+  uint32_t params; // the number of parameters it reads from the stack
+} ir_inline_body_t;
+
+ir_inline_body_t *inline_bodies = NULL;
+uint32_t inline_body_count = 0;
+
+// copies the blocks of `from`, whose predecessors are up to date, into
+// `to`, adding `offset` to every vreg. returns the first copy; the copies
+// are linked in the same order
+ir_block_t *ir_copy_blocks(ir_func_t *from, ir_func_t *to, uint32_t offset)
+{
+  ir_block_t **map = malloc(from->block_count * sizeof(ir_block_t *));
+  ir_block_t *first = NULL, *last = NULL;
+  for (ir_block_t *b = from->blocks; b != NULL; b = b->next) {
+    ir_block_t *copy = ir_new_block(to);
+    copy->count = b->count;
+    map[b->id] = copy;
+    if (last == NULL) first = copy;
+    else last->next = copy;
+    last = copy;
+  }
+
+  for (ir_block_t *b = from->blocks; b != NULL; b = b->next) {
+    for (ir_insn_t *insn = b->first; insn != NULL; insn = insn->next) {
+      ir_insn_t *copy = ir_new_insn(insn->op);
+      *copy = *insn;
+      copy->aux = 0;
+      if (insn->nargs) {
+        copy->args = malloc(insn->nargs * sizeof(ir_val_t));
+        memcpy(copy->args, insn->args, insn->nargs * sizeof(ir_val_t));
+      }
+      if (insn->op == irPHI) {
+        // inputs from blocks that are no longer predecessors are dropped
+        copy->from = malloc(insn->nargs * sizeof(ir_block_t *));
+        copy->nargs = 0;
+        for (uint32_t i = 0; i < insn->nargs; ++i) {
+          if (!ir_is_pred(b, insn->from[i])) continue;
+          copy->args[copy->nargs] = insn->args[i];
+          copy->from[copy->nargs++] = map[insn->from[i]->id];
+        }
+      }
+      if (insn->op == irJMP || insn->op == irBR)
+        copy->target = map[insn->target->id];
+      if (insn->op == irBR) copy->target2 = map[insn->target2->id];
+      if (copy->dst) copy->dst += offset;
+      for (uint32_t i = 0; i < ir_operand_count(copy); ++i) {
+        ir_val_t *v = ir_operand(copy, i);
+        if (v->kind == kVREG) v->v += offset;
+      }
+      ir_insert_insn(map[b->id], copy, NULL);
+    }
+  }
+  free(map);
+  return first;
+}
+
+// instructions other than phis and jumps
+uint32_t ir_func_size(ir_func_t *f)
+{
+  uint32_t size = 0;
+  for (ir_block_t *b = f->blocks; b != NULL; b = b->next)
+    for (ir_insn_t *insn = b->first; insn != NULL; insn = insn->next)
+      if (insn->op != irPHI && insn->op != irJMP) ++size;
+  return size;
+}
+
+ir_inline_body_t *ir_inline_body(ir_val_t callee)
+{
+  if (callee.kind != kIMM) return NULL;
+  for (uint32_t i = 0; i < inline_body_count; ++i)
+    if ((uint32_t) callee.v == TEXT_START + inline_bodies[i].f->start)
+      return inline_bodies + i;
+  return NULL;
+}
+
+// keeps a copy of `f` for inlining into the functions after it
+void ir_save_body(ir_func_t *f)
+{
+  ir_inline_body_t body = { 0 };
+  body.f = malloc(sizeof(ir_func_t));
+  memset(body.f, 0, sizeof(ir_func_t));
+  body.f->name = f->name;
+  body.f->start = f->start;
+  body.f->frame_size = f->frame_size;
+  body.f->vreg_count = f->vreg_count;
+  body.f->regparm = f->regparm;
+  body.f->count = f->count;
+  ir_compute_preds(f);
+  body.f->blocks = ir_copy_blocks(f, body.f, 0);
+  ir_compute_preds(body.f);
+  body.size = ir_func_size(f);
+
+  for (ir_block_t *b = f->blocks; b != NULL; b = b->next) {
+    for (ir_insn_t *insn = b->first; insn != NULL; insn = insn->next) {
+      if (insn->op == irCALL && insn->a.kind == kIMM)
+        if ((uint32_t) insn->a.v == TEXT_START + f->start) body.recursive = 1;
+      uint8_t access = insn->op == irLOAD || insn->op == irSTORE
+        || insn->op == irADDR;
+      if (!access || insn->mem != mFRAME || insn->disp < 8) continue;
+      uint32_t param = (insn->disp - 8) / 4;
+      if (param + 1 > body.params) body.params = param + 1;
+      if (insn->op != irLOAD || (insn->disp - 8) % 4 != 0)
+        body.params_in_memory = 1;
+    }
+  }
+
+  inline_bodies = realloc(
+    inline_bodies, (inline_body_count + 1) * sizeof(ir_inline_body_t)
+    );
+  inline_bodies[inline_body_count++] = body;
+}
+
+// argument `i` of `call`, or 0 if it passes fewer
+ir_val_t ir_call_arg(ir_insn_t *call, uint32_t i)
+{
+  return i < call->nargs ? call->args[i] : ir_imm(0);
+}
+
+// replaces `call`, the last instruction of `b` before `rest`, with a copy
+// of `body`. `rest` is the block that the instructions after it move to
+void ir_inline_call(
+  ir_func_t *f, ir_block_t *b, ir_insn_t *call, ir_inline_body_t *body,
+  ir_block_t *rest
+  )
+{
+  // the instructions after the call go to `rest`, and the edges out of `b`
+  // now leave from there
+  rest->first = call->next;
+  rest->last = b->last;
+  if (rest->first) rest->first->prev = NULL;
+  b->last = call;
+  call->next = NULL;
+  for (ir_block_t *s = f->blocks; s != NULL; s = s->next)
+    for (ir_insn_t *phi = s->first; phi && phi->op == irPHI; phi = phi->next)
+      for (uint32_t i = 0; i < phi->nargs; ++i)
+        if (phi->from[i] == b) phi->from[i] = rest;
+
+  // the callee's frame goes below the caller's, after its parameters if
+  // they need slots
+  uint32_t base = (f->frame_size + 3) & ~3;
+  uint32_t regparm = body->f->regparm;
+  int32_t params = 0;
+  if (body->params_in_memory) {
+    params = -(int32_t) (base + 4 * body->params);
+    base += 4 * body->params;
+    for (uint32_t i = 0; i < body->params; ++i) {
+      ir_insn_t *store = ir_new_access(irSTORE, mFRAME, params + 4 * i, 4);
+      store->b = ir_call_arg(call, regparm + i);
+      ir_insert_insn(b, store, call);
+    }
+  }
+  f->frame_size = base + body->f->frame_size;
+
+  uint32_t offset = f->vreg_count - 1;
+  ir_block_t *first = ir_copy_blocks(body->f, f, offset);
+  f->vreg_count += body->f->vreg_count - 1;
+  ir_insn_t *phi = ir_new_insn(irPHI);
+  phi->dst = f->vreg_count++;
+
+  // the profile of the callee, scaled to how often this call ran
+  rest->count = b->count;
+  ir_block_t *last = first;
+  for (ir_block_t *c = first; c != NULL; c = c->next) {
+    last = c;
+    if (
+      c->count != IR_NO_COUNT && b->count != IR_NO_COUNT
+      && body->f->count != IR_NO_COUNT && body->f->count != 0
+      )
+      c->count = (uint64_t) c->count * b->count / body->f->count;
+    else c->count = IR_NO_COUNT;
+    for (ir_insn_t *insn = c->first; insn != NULL; insn = insn->next) {
+      if (insn->op == irRET) {
+        ir_val_t v = insn->a.kind == kNONE ? ir_imm(0) : insn->a;
+        ir_add_phi_input(phi, c, v);
+        insn->op = irJMP;
+        insn->a.kind = kNONE;
+        insn->target = rest;
+        continue;
+      }
+      if (insn->op == irPARAM) {
+        ir_make_copy(insn, ir_call_arg(call, insn->disp));
+        continue;
+      }
+      uint8_t access = insn->op == irLOAD || insn->op == irSTORE
+        || insn->op == irADDR;
+      if (!access || insn->mem != mFRAME) continue;
+      if (insn->disp < 0) insn->disp -= base;
+      else if (body->params_in_memory) insn->disp += params - 8;
+      else {
+        // v = load.8 [%ebp+8] => v = copy.8 <argument>
+        uint8_t width = insn->width;
+        uint32_t i = regparm + (insn->disp - 8) / 4;
+        ir_make_copy(insn, ir_call_arg(call, i));
+        insn->width = width;
+      }
+    }
+  }
+
+  call->op = irJMP;
+  call->a.kind = kNONE;
+  call->nargs = 0;
+  call->target = first;
+  if (call->dst) {
+    // v = copy.8 <phi> if the callee returns a char
+    ir_insn_t *copy = ir_new_insn(irCOPY);
+    copy->dst = call->dst;
+    copy->a = ir_vreg(phi->dst);
+    copy->width = call->width;
+    ir_insert_insn(rest, copy, rest->first);
+    ir_insert_insn(rest, phi, rest->first);
+  }
+  call->dst = 0;
+  if (phi->nargs == 0) ir_make_copy(phi, ir_imm(0));
+
+  last->next = b->next;
+  b->next = first;
+  ir_place_after(last, rest);
+}
+
+void ir_inline(ir_func_t *f)
+{
+  if (inline_limit == 0) return;
+
+  // which blocks are in loops
+  ir_block_t **headers;
+  uint32_t count = ir_find_headers(f, &headers);
+  uint8_t *in_loop = malloc(f->block_count);
+  memset(in_loop, 0, f->block_count);
+  for (uint32_t i = 0; i < count; ++i) {
+    ir_mark_loop(f, headers[i]);
+    for (ir_block_t *b = f->blocks; b != NULL; b = b->next)
+      if (b->mark) in_loop[b->id] = 1;
+  }
+  free(headers);
+
+  uint32_t growth = 0;
+  for (ir_block_t *b = f->blocks, *next; b != NULL; b = next) {
+    next = b->next;
+    for (ir_insn_t *insn = b->first; insn != NULL; insn = insn->next) {
+      if (insn->op != irCALL) continue;
+      ir_inline_body_t *body = ir_inline_body(insn->a);
+      if (body == NULL || body->recursive || body->params > insn->nargs)
+        continue;
+      if (b->count == 0) continue;
+      uint8_t hot = in_loop[b->id]
+        || (b->count != IR_NO_COUNT && f->count != IR_NO_COUNT
+            && b->count > f->count);
+      uint32_t limit = inline_limit * (hot ? 2 : 1);
+      if (body->size > limit) continue;
+      if (growth + body->size > IR_INLINE_GROWTH * inline_limit) continue;
+      growth += body->size;
+
+      // the rest of `b` is scanned next, as part of `rest`
+      ir_block_t *rest = ir_new_block(f);
+      in_loop = realloc(in_loop, f->block_count);
+      in_loop[rest->id] = in_loop[b->id];
+      ir_inline_call(f, b, insn, body, rest);
+      next = rest;
+      break;
+    }
+  }
+  free(in_loop);
+  ir_save_body(f);
+}
+
+// out-of-ssa: replaces the phis of a block with copies at the end of each
+// predecessor. an edge from a block that branches is split first, so the
+// copies only run on that edge. the copies into one block happen at once,
+// so they are ordered to read every value before it is overwritten, with a
+// temporary to break cycles. first, a phi and an input computed in the
+// block it comes from share a vreg when the phi is dead from that point on,
+// which leaves nothing to copy for the update of a loop variable
+void ir_emit_parallel_copies(
+  ir_func_t *f, ir_block_t *b, uint32_t *dst, ir_val_t *src, uint32_t n
+  )
+{
+  while (n > 0) {
+    uint32_t i = 0;
+    for (; i < n; ++i) {
+      uint8_t read = 0;
+      for (uint32_t j = 0; j < n && !read; ++j)
+        read = j != i && src[j].kind == kVREG && (uint32_t) src[j].v == dst[i];
+      if (!read) break;
+    }
+
+    if (i == n) {
+      // every destination is still to be read: save one of them
+      ir_insn_t *save = ir_new_insn(irCOPY);
+      save->a = ir_vreg(dst[0]);
+      save->dst = f->vreg_count++;
+      ir_insert_insn(b, save, b->last);
+      for (uint32_t j = 0; j < n; ++j)
+        if (src[j].kind == kVREG && (uint32_t) src[j].v == dst[0])
+          src[j] = ir_vreg(save->dst);
+      i = 0;
+    }
+
+    if (src[i].kind != kVREG || (uint32_t) src[i].v != dst[i]) {
+      ir_insn_t *copy = ir_new_insn(irCOPY);
+      copy->a = src[i];
+      copy->dst = dst[i];
+      ir_insert_insn(b, copy, b->last);
+    }
+    dst[i] = dst[n - 1];
+    src[i] = src[n - 1];
+    --n;
+  }
+}
+
+// whether `v` is used after `insn` in its block `b`
+uint8_t ir_used_after(ir_block_t *b, ir_insn_t *insn, uint32_t v)
+{
+  for (insn = insn ? insn->next : b->first; insn != NULL; insn = insn->next) {
+    for (uint32_t i = 0; i < ir_operand_count(insn); ++i) {
+      ir_val_t *o = ir_operand(insn, i);
+      if (o->kind == kVREG && (uint32_t) o->v == v) return 1;
+    }
+  }
+  return 0;
+}
+
+// whether a phi in `s` reads `v` on the edge from `p`, other than `except`
+uint8_t ir_phi_reads(
+  ir_block_t *s, ir_block_t *p, uint32_t v, ir_insn_t *except
+  )
+{
+  for (ir_insn_t *phi = s->first; phi && phi->op == irPHI; phi = phi->next) {
+    if (phi == except) continue;
+    for (uint32_t j = 0; j < phi->nargs; ++j)
+      if (phi->from[j] == p && ir_is_vreg(phi->args[j], v)) return 1;
+  }
+  return 0;
+}
+
+void ir_coalesce_phis(ir_func_t *f)
+{
+  uint32_t n = f->vreg_count, words = (n + 31) / 32, nblocks = 0;
+  for (ir_block_t *b = f->blocks; b != NULL; b = b->next) b->index = nblocks++;
+
+  // live-in sets. a phi reads its input at the end of the predecessor
+  uint32_t *sets = malloc(3 * nblocks * words * sizeof(uint32_t));
+  memset(sets, 0, 3 * nblocks * words * sizeof(uint32_t));
+#define IR_SET(kind, b) (sets + ((kind) * nblocks + (b)->index) * words)
+#define IR_HAS(set, v) (((set)[(v) / 32] >> ((v) % 32)) & 1)
+#define IR_ADD(set, v) ((set)[(v) / 32] |= 1u << ((v) % 32))
+  for (ir_block_t *b = f->blocks; b != NULL; b = b->next) {
+    uint32_t *gen = IR_SET(0, b), *kill = IR_SET(1, b);
+    for (ir_insn_t *insn = b->first; insn != NULL; insn = insn->next) {
+      for (uint32_t i = 0; i < ir_operand_count(insn); ++i) {
+        ir_val_t *v = ir_operand(insn, i);
+        if (insn->op == irPHI || v->kind != kVREG) continue;
+        if (!IR_HAS(kill, v->v)) IR_ADD(gen, v->v);
+      }
+      if (insn->dst) IR_ADD(kill, insn->dst);
+    }
+  }
+  uint32_t *out = malloc(words * sizeof(uint32_t));
+  uint8_t changed = 1;
+  while (changed) {
+    changed = 0;
+    for (ir_block_t *b = f->blocks; b != NULL; b = b->next) {
+      memset(out, 0, words * sizeof(uint32_t));
+      ir_block_t *succ[2];
+      uint32_t ns = ir_successors(b, succ);
+      for (uint32_t i = 0; i < ns; ++i) {
+        for (uint32_t w = 0; w < words; ++w) out[w] |= IR_SET(2, succ[i])[w];
+        ir_insn_t *phi = succ[i]->first;
+        for (; phi && phi->op == irPHI; phi = phi->next)
+          for (uint32_t j = 0; j < phi->nargs; ++j)
+            if (phi->from[j] == b && phi->args[j].kind == kVREG)
+              IR_ADD(out, phi->args[j].v);
+      }
+      uint32_t *in = IR_SET(2, b);
+      for (uint32_t w = 0; w < words; ++w) {
+        uint32_t x = IR_SET(0, b)[w] | (out[w] & ~IR_SET(1, b)[w]);
+        if (x != in[w]) { in[w] = x; changed = 1; }
+      }
+    }
+  }
+
+  uint32_t *defs = malloc(n * sizeof(uint32_t));
+  uint32_t *uses = malloc(n * sizeof(uint32_t));
+  ir_insn_t **def = malloc(n * sizeof(ir_insn_t *));
+  ir_count_defs(f, defs, def);
+  ir_count_uses(f, uses);
+
+  for (ir_block_t *h = f->blocks; h != NULL; h = h->next) {
+    for (ir_insn_t *phi = h->first; phi && phi->op == irPHI; phi = phi->next) {
+      for (uint32_t j = 0; j < phi->nargs; ++j) {
+        ir_block_t *p = phi->from[j];
+        ir_val_t x = phi->args[j];
+        if (x.kind != kVREG || defs[x.v] != 1) continue;
+        if (def[x.v]->op == irPHI) continue;
+        ir_insn_t *d = p->first;
+        while (d != NULL && d != def[x.v]) d = d->next;
+        if (d == NULL || ir_used_after(p, d, phi->dst)) continue;
+
+        // x may only be read after d in p, and by phis on edges from p,
+        // and the phi must be dead on every edge out of p
+        uint32_t reads = 0;
+        for (ir_insn_t *insn = d->next; insn != NULL; insn = insn->next)
+          for (uint32_t i = 0; i < ir_operand_count(insn); ++i)
+            if (ir_is_vreg(*ir_operand(insn, i), x.v)) ++reads;
+        ir_block_t *succ[2];
+        uint32_t ns = ir_successors(p, succ);
+        uint8_t ok = 1;
+        for (uint32_t i = 0; i < ns; ++i) {
+          for (ir_insn_t *q = succ[i]->first; q && q->op == irPHI; q = q->next)
+            for (uint32_t k = 0; k < q->nargs; ++k)
+              if (q->from[k] == p && ir_is_vreg(q->args[k], x.v)) ++reads;
+          if (ir_phi_reads(succ[i], p, phi->dst, phi)) ok = 0;
+          if (succ[i] != h && IR_HAS(IR_SET(2, succ[i]), phi->dst)) ok = 0;
+        }
+        if (!ok || reads != uses[x.v]) continue;
+
+        d->dst = phi->dst;
+        ++defs[phi->dst];
+        for (ir_insn_t *insn = d->next; insn != NULL; insn = insn->next)
+          for (uint32_t i = 0; i < ir_operand_count(insn); ++i)
+            if (ir_is_vreg(*ir_operand(insn, i), x.v))
+              ir_operand(insn, i)->v = phi->dst;
+        for (uint32_t i = 0; i < ns; ++i)
+          for (ir_insn_t *q = succ[i]->first; q && q->op == irPHI; q = q->next)
+            for (uint32_t k = 0; k < q->nargs; ++k)
+              if (q->from[k] == p && ir_is_vreg(q->args[k], x.v))
+                q->args[k].v = phi->dst;
+      }
+    }
+  }
+#undef IR_ADD
+#undef IR_HAS
+#undef IR_SET
+
+  free(sets);
+  free(out);
+  free(defs);
+  free(uses);
+  free(def);
+}
+
+void ir_destruct_ssa(ir_func_t *f)
+{
+  ir_compute_preds(f);
+  ir_coalesce_phis(f);
+  for (ir_block_t *b = f->blocks; b != NULL; b = b->next) {
+    if (!ir_has_phis(b)) continue;
+    uint32_t nphis = 0;
+    for (ir_insn_t *phi = b->first; phi && phi->op == irPHI; phi = phi->next)
+      ++nphis;
+    uint32_t *dst = malloc(nphis * sizeof(uint32_t));
+    ir_val_t *src = malloc(nphis * sizeof(ir_val_t));
+
+    for (uint32_t i = 0; i < b->first->nargs; ++i) {
+      ir_block_t *p = b->first->from[i], *at = p;
+      uint32_t n = 0;
+      for (ir_insn_t *phi = b->first; phi && phi->op == irPHI; phi = phi->next) {
+        for (uint32_t j = 0; j < phi->nargs; ++j) {
+          if (phi->from[j] != p || ir_is_vreg(phi->args[j], phi->dst)) continue;
+          dst[n] = phi->dst;
+          src[n++] = phi->args[j];
+        }
+      }
+      if (n == 0) continue;
+
+      if (p->last->op == irBR) {
+        at = ir_new_block(f);
+        ir_insn_t *jmp = ir_new_insn(irJMP);
+        jmp->target = b;
+        ir_insert_insn(at, jmp, NULL);
+        if (p->last->target == b) p->last->target = at;
+        if (p->last->target2 == b) p->last->target2 = at;
+        at->next = p->next;
+        p->next = at;
+      }
+      ir_emit_parallel_copies(f, at, dst, src, n);
+    }
+
+    while (ir_has_phis(b)) ir_remove_insn(b, b->first);
+    free(dst);
+    free(src);
+  }
+  ir_compute_preds(f);
+}
+
+// frame compaction: promotion to SSA values, inlining and passing parameters
+// in registers leave slots in the frame that nothing accesses any more. the
+// words of the frame that are still accessed are moved up towards %ebp in
+// the same order, so that every access keeps its alignment and variables
+// that share words keep sharing them
+void ir_compact_frame(ir_func_t *f)
+{
+  f->uncompacted_size = f->frame_size;
+  uint32_t words = (f->frame_size + 3) / 4;
+  for (ir_block_t *b = f->blocks; b != NULL; b = b->next)
+    for (ir_insn_t *insn = b->first; insn != NULL; insn = insn->next)
+      if (
+        (insn->op == irLOAD || insn->op == irSTORE || insn->op == irADDR)
+        && insn->mem == mFRAME && insn->disp < 0
+        && (uint32_t) (-insn->disp + 3) / 4 > words
+        )
+        words = (-insn->disp + 3) / 4;
+  if (words == 0) return;
+
+  // word `w` holds the bytes from -4(w + 1)(%ebp) up to -4w(%ebp). the
+  // address of a slot may be used for a word-sized access
+  uint32_t *moved = malloc(words * sizeof(uint32_t));
+  memset(moved, 0, words * sizeof(uint32_t));
+  for (ir_block_t *b = f->blocks; b != NULL; b = b->next) {
+    for (ir_insn_t *insn = b->first; insn != NULL; insn = insn->next) {
+      if (insn->op != irLOAD && insn->op != irSTORE && insn->op != irADDR)
+        continue;
+      if (insn->mem != mFRAME || insn->disp >= 0) continue;
+      int32_t end = insn->disp + (insn->op == irADDR ? 4 : insn->width);
+      for (int32_t d = insn->disp; d < end && d < 0; ++d)
+        moved[(-d - 1) / 4] = 1;
+    }
+  }
+
+  uint32_t kept = 0;
+  for (uint32_t w = 0; w < words; ++w)
+    if (moved[w]) moved[w] = kept++;
+    else moved[w] = (uint32_t) -1;
+
+  for (ir_block_t *b = f->blocks; b != NULL; b = b->next) {
+    for (ir_insn_t *insn = b->first; insn != NULL; insn = insn->next) {
+      if (insn->op != irLOAD && insn->op != irSTORE && insn->op != irADDR)
+        continue;
+      if (insn->mem != mFRAME || insn->disp >= 0) continue;
+      uint32_t w = (-insn->disp - 1) / 4;
+      insn->disp += 4 * (w - moved[w]);
+    }
+  }
+  f->frame_size = 4 * kept;
+  free(moved);
+}
+
+// register allocation: linear scan over live intervals. instructions are
+// numbered in layout order, and the interval of a vreg runs from the first
+// to the last position at which it is defined, used or live across a block
+// boundary. %ebx, %esi and %edi are callee-saved and saved in the prologue
+// when they are used; %ecx is only given to intervals that no call or
+// division lies strictly inside of, since those clobber it. %eax and %edx
+// are left as scratch registers for instruction selection. intervals that
+// get no register live in stack slots, which intervals that do not overlap
+// share
+typedef struct ir_interval_s {
+  uint32_t vreg;
+  uint32_t start, end;
+  uint8_t spans_call;
+} ir_interval_t;
+
+#define IR_ALLOCATABLE 4
+reg_t ir_allocatable[IR_ALLOCATABLE] = { ECX, EBX, ESI, EDI };
+
+// a load from a fixed address whose only use follows it in the same block,
+// with no store or call in between, does not need a register: its use reads
+// the memory directly
+void ir_fold_loads(ir_func_t *f, uint32_t *uses)
+{
+  for (ir_block_t *b = f->blocks; b != NULL; b = b->next) {
+    for (ir_insn_t *insn = b->first; insn != NULL; insn = insn->next) {
+      if (insn->op != irLOAD || insn->width != 4 || uses[insn->dst] != 1)
+        continue;
+      if (insn->mem == mPTR) continue;
+
+      // the first later instruction that uses it, or that may write memory
+      uint8_t found = 0;
+      ir_insn_t *user = insn->next;
+      for (; user != NULL && !found; user = user->next) {
+        for (uint32_t i = 0; i < ir_operand_count(user); ++i) {
+          ir_val_t *v = ir_operand(user, i);
+          if (v->kind == kVREG && (uint32_t) v->v == insn->dst) found = 1;
+        }
+        if (user->op == irSTORE || user->op == irCALL) break;
+      }
+      if (!found) continue;
+
+      f->folded[insn->dst] = 1;
+      if (insn->mem == mFRAME)
+        f->locs[insn->dst] = (operand_t) {
+          .type = oMEM, .reg = EBP, .val = insn->disp
+        };
+      else f->locs[insn->dst] = (operand_t) { .type = oABS, .val = insn->disp };
+    }
+  }
+}
+
+int ir_interval_cmp(const void *a, const void *b)
+{
+  const ir_interval_t *x = a, *y = b;
+  if (x->start != y->start) return x->start < y->start ? -1 : 1;
+  return x->vreg < y->vreg ? -1 : x->vreg > y->vreg;
+}
+
+void ir_regalloc(ir_func_t *f)
+{
+  // isel copies the parameters out of %eax, %edx and %ecx before anything
+  // else, so their vregs are defined first
+  ir_block_t *entry = f->blocks;
+  for (ir_insn_t *insn = entry->first, *next; insn != NULL; insn = next) {
+    next = insn->next;
+    if (insn->op != irPARAM) continue;
+    ir_remove_insn(entry, insn);
+    ir_insert_insn(entry, insn, entry->first);
+  }
+
+  uint32_t n = f->vreg_count;
+  f->locs = malloc(n * sizeof(operand_t));
+  memset(f->locs, 0, n * sizeof(operand_t));
+  f->folded = malloc(n);
+  memset(f->folded, 0, n);
+  uint32_t *uses = malloc(n * sizeof(uint32_t));
+  ir_count_uses(f, uses);
+  ir_fold_loads(f, uses);
+  free(uses);
+
+  uint32_t words = (n + 31) / 32;
+  uint32_t nblocks = 0;
+  for (ir_block_t *b = f->blocks; b != NULL; b = b->next) b->index = nblocks++;
+
+  // per-block use, def, live-in and live-out sets
+  uint32_t *sets = malloc(4 * nblocks * words * sizeof(uint32_t));
+  memset(sets, 0, 4 * nblocks * words * sizeof(uint32_t));
+  uint32_t *start = malloc(nblocks * sizeof(uint32_t));
+  uint32_t *end = malloc(nblocks * sizeof(uint32_t));
+#define IR_SET(kind, b) (sets + ((kind) * nblocks + (b)->index) * words)
+#define IR_HAS(set, v) (((set)[(v) / 32] >> ((v) % 32)) & 1)
+#define IR_ADD(set, v) ((set)[(v) / 32] |= 1u << ((v) % 32))
+
+  uint32_t pos = 0, calls = 0;
+  uint32_t *call_pos = NULL;
+  for (ir_block_t *b = f->blocks; b != NULL; b = b->next) {
+    uint32_t *use = IR_SET(0, b), *def = IR_SET(1, b);
+    start[b->index] = pos;
+    for (ir_insn_t *insn = b->first; insn != NULL; insn = insn->next, pos += 2) {
+      for (uint32_t i = 0; i < ir_operand_count(insn); ++i) {
+        ir_val_t *v = ir_operand(insn, i);
+        if (v->kind == kVREG && !IR_HAS(def, v->v)) IR_ADD(use, v->v);
+      }
+      if (insn->dst) IR_ADD(def, insn->dst);
+      if (insn->op == irCALL || insn->op == irDIV || insn->op == irMOD) {
+        call_pos = realloc(call_pos, (calls + 1) * sizeof(uint32_t));
+        call_pos[calls++] = pos;
+      }
+    }
+    end[b->index] = pos - 2;
+  }
+
+  uint8_t changed = 1;
+  while (changed) {
+    changed = 0;
+    for (ir_block_t *b = f->blocks; b != NULL; b = b->next) {
+      uint32_t *in = IR_SET(2, b), *out = IR_SET(3, b);
+      ir_block_t *succ[2];
+      uint32_t ns = ir_successors(b, succ);
+      for (uint32_t w = 0; w < words; ++w) {
+        uint32_t o = 0;
+        for (uint32_t i = 0; i < ns; ++i) o |= IR_SET(2, succ[i])[w];
+        uint32_t x = IR_SET(0, b)[w] | (o & ~IR_SET(1, b)[w]);
+        if (o != out[w] || x != in[w]) changed = 1;
+        out[w] = o;
+        in[w] = x;
+      }
+    }
+  }
+
+  ir_interval_t *iv = malloc(n * sizeof(ir_interval_t));
+  for (uint32_t v = 0; v < n; ++v)
+    iv[v] = (ir_interval_t) { .vreg = v, .start = (uint32_t) -1, .end = 0 };
+#define IR_EXTEND(v, p) do { \
+    if ((p) < iv[v].start) iv[v].start = (p); \
+    if ((p) > iv[v].end) iv[v].end = (p); \
+  } while (0)
+
+  pos = 0;
+  for (ir_block_t *b = f->blocks; b != NULL; b = b->next) {
+    for (uint32_t v = 1; v < n; ++v) {
+      if (IR_HAS(IR_SET(2, b), v)) IR_EXTEND(v, start[b->index]);
+      if (IR_HAS(IR_SET(3, b), v)) IR_EXTEND(v, end[b->index]);
+    }
+    for (ir_insn_t *insn = b->first; insn != NULL; insn = insn->next, pos += 2) {
+      for (uint32_t i = 0; i < ir_operand_count(insn); ++i) {
+        ir_val_t *v = ir_operand(insn, i);
+        if (v->kind == kVREG) IR_EXTEND(v->v, pos);
+      }
+      if (insn->dst) IR_EXTEND(insn->dst, pos);
+    }
+  }
+#undef IR_EXTEND
+#undef IR_ADD
+#undef IR_HAS
+#undef IR_SET
+
+  for (uint32_t v = 1; v < n; ++v)
+    for (uint32_t i = 0; i < calls; ++i)
+      if (iv[v].start < call_pos[i] && call_pos[i] < iv[v].end)
+        iv[v].spans_call = 1;
+
+  qsort(iv + 1, n - 1, sizeof(ir_interval_t), ir_interval_cmp);
+
+  f->saved_regs = 0;
+  ir_interval_t *active[IR_ALLOCATABLE];
+  uint32_t nactive = 0;
+  // the last interval spilled to each stack slot
+  ir_interval_t **spilled = malloc(n * sizeof(ir_interval_t *));
+  uint32_t nspilled = 0;
+  for (uint32_t i = 1; i < n && iv[i].start != (uint32_t) -1; ++i) {
+    ir_interval_t *cur = iv + i;
+    if (f->folded[cur->vreg]) continue;
+
+    // an interval that ends where this one starts is only read there, before
+    // this one is written, so the register can be shared
+    uint8_t busy = 0;
+    for (uint32_t j = 0; j < nactive; ) {
+      if (active[j]->end <= cur->start) { active[j] = active[--nactive]; continue; }
+      busy |= 1 << f->locs[active[j]->vreg].reg;
+      ++j;
+    }
+
+    reg_t r = ESP;
+    for (uint32_t k = 0; k < IR_ALLOCATABLE && r == ESP; ++k) {
+      reg_t c = ir_allocatable[k];
+      if (busy & (1 << c)) continue;
+      if (c == ECX && cur->spans_call) continue;
+      r = c;
+    }
+
+    ir_interval_t *spill = cur;
+    if (r == ESP) {
+      // spill whichever interval ends last
+      for (uint32_t j = 0; j < nactive; ++j) {
+        reg_t c = f->locs[active[j]->vreg].reg;
+        if (c == ECX && cur->spans_call) continue;
+        if (active[j]->end > spill->end) spill = active[j];
+      }
+      if (spill != cur) {
+        r = f->locs[spill->vreg].reg;
+        for (uint32_t j = 0; j < nactive; ++j)
+          if (active[j] == spill) active[j] = active[--nactive];
+      }
+      uint32_t j = 0;
+      while (j < nspilled && spilled[j]->end >= spill->start) ++j;
+      int32_t slot;
+      if (j < nspilled) slot = f->locs[spilled[j]->vreg].val;
+      else {
+        f->frame_size = ((f->frame_size + 3) & ~3) + 4;
+        slot = -(int32_t) f->frame_size;
+        ++nspilled;
+      }
+      spilled[j] = spill;
+      f->locs[spill->vreg] = (operand_t) {
+        .type = oMEM, .reg = EBP, .val = slot
+      };
+    }
+    if (r == ESP) continue;
+
+    f->locs[cur->vreg] = (operand_t) { .type = oREG, .reg = r };
+    if (r != ECX) f->saved_regs |= 1 << r;
+    active[nactive++] = cur;
+  }
+
+  free(iv);
+  free(spilled);
+  free(sets);
+  free(start);
+  free(end);
+  free(call_pos);
+}
+
+// layout: with a profile, orders the blocks so that the code that runs is
+// laid out in one piece. starting from the entry, a block is followed by
+// its successor that ran most often, or the one it was followed by before
+// if they have no counts, so that the branch to the other one is the
+// rarely taken one. once the successors are placed, the next block in the
+// old order that ran comes next. blocks that never ran go to the end of
+// the function, out of the way of the code that does
+void ir_layout(ir_func_t *f)
+{
+  if (f->count == IR_NO_COUNT || f->count == 0) return;
+  uint32_t n = 0;
+  for (ir_block_t *b = f->blocks; b != NULL; b = b->next) {
+    b->mark = 0;
+    ++n;
+  }
+
+  ir_block_t **order = malloc(n * sizeof(ir_block_t *));
+  uint32_t placed = 0;
+  for (ir_block_t *b = f->blocks; b != NULL; ) {
+    b->mark = 1;
+    order[placed++] = b;
+
+    ir_block_t *succ[2], *next = NULL;
+    uint32_t k = ir_successors(b, succ);
+    for (uint32_t i = 0; i < k; ++i) {
+      ir_block_t *s = succ[i];
+      if (s->mark || s->count == 0) continue;
+      if (next == NULL) { next = s; continue; }
+      if (next->count != IR_NO_COUNT && s->count != IR_NO_COUNT) {
+        if (s->count > next->count || (s->count == next->count && s == b->next))
+          next = s;
+      } else if (s == b->next) next = s;
+    }
+    for (ir_block_t *c = f->blocks; c != NULL && next == NULL; c = c->next)
+      if (!c->mark && c->count != 0) next = c;
+    b = next;
+  }
+  for (ir_block_t *b = f->blocks; b != NULL; b = b->next)
+    if (!b->mark) order[placed++] = b;
+
+  for (uint32_t i = 0; i + 1 < n; ++i) order[i]->next = order[i + 1];
+  order[n - 1]->next = NULL;
+  f->blocks = order[0];
+  free(order);
+}
+
+// instruction selection: every instruction becomes a short x86 sequence
+// over the locations chosen by regalloc, with %eax and %edx as scratch
+ir_func_t *isel_func = NULL;
+uint8_t isel_frame_escapes = 0;
+uint8_t isel_frameless = 0; // see isel_needs_frame
+uint32_t isel_out_area = 0; // bytes below the saved registers for arguments
+
+// whether the function needs %ebp set up: it makes calls or uses a stack
+// slot below %ebp. functions that do not address their arguments through
+// %esp instead, past the return address and the saved registers
+uint8_t isel_needs_frame(ir_func_t *f)
+{
+  for (ir_block_t *b = f->blocks; b != NULL; b = b->next)
+    for (ir_insn_t *insn = b->first; insn != NULL; insn = insn->next) {
+      if (insn->op == irCALL || insn->op == irADDR) return 1;
+      uint8_t access = insn->op == irLOAD || insn->op == irSTORE;
+      if (access && insn->mem == mFRAME && insn->disp < 0) return 1;
+    }
+  for (uint32_t v = 1; v < f->vreg_count; ++v) {
+    operand_t o = f->locs[v];
+    if (o.type == oMEM && o.reg == EBP && (int32_t) o.val < 0) return 1;
+  }
+  return 0;
+}
+
+// the operand for `disp`(%ebp), which is
+//   <disp - 4 + 4 * saved registers>(%esp)
+// in a function without a frame
+operand_t isel_frame_slot(int32_t disp)
+{
+  if (!isel_frameless)
+    return (operand_t) { .type = oMEM, .reg = EBP, .val = disp };
+  for (uint32_t i = 0; i < IR_ALLOCATABLE; ++i)
+    if (isel_func->saved_regs & (1 << ir_allocatable[i])) disp += 4;
+  return (operand_t) { .type = oMEM, .reg = ESP, .val = disp - 4 };
+}
+
+// the x86 operand for `v`
+operand_t isel_operand(ir_val_t v)
+{
+  if (v.kind == kIMM) return (operand_t) { .type = oIMM, .val = v.v };
+  return isel_func->locs[v.v];
+}
+
+uint8_t isel_in_reg(ir_val_t v, reg_t r)
+{
+  operand_t o = isel_operand(v);
+  return v.kind == kVREG && o.type == oREG && o.reg == r;
+}
+
+// movl <v>, %r
+void isel_load(reg_t r, ir_val_t v)
+{
+  if (!isel_in_reg(v, r)) emit_load(r, isel_operand(v), 0);
+}
+
+// the register that the result of an instruction is computed in: the one
+// allocated to `dst`, or %eax if it lives on the stack
+reg_t isel_result_reg(uint32_t dst)
+{
+  operand_t o = isel_func->locs[dst];
+  return o.type == oREG ? o.reg : EAX;
+}
+
+// moves a result computed in %r to the location of `dst`
+void isel_finish(uint32_t dst, reg_t r)
+{
+  operand_t o = isel_func->locs[dst];
+  if (o.type == oREG && o.reg == r) return;
+  if (o.type == oREG) emit_load(o.reg, (operand_t) { .type = oREG, .reg = r }, 0);
+  else emit_store(o, r, 0);
+}
+
+// sign-extends the low byte of %r:
+//   movsbl %rl, %r
+// or for %esi and %edi, which have no byte register:
+//   shll $24, %r
+//   sarl $24, %r
+void isel_sext(reg_t r)
+{
+  if (r < ESP) {
+    emit_movsx(r, (operand_t) { .type = oREG, .reg = r });
+    return;
+  }
+  emit_shift(sSHL, r, 24);
+  emit_shift(sSAR, r, 24);
+}
+
+// the memory operand of a load or store. a pointer that lives on the stack
+// is loaded into `scratch` first
+operand_t isel_address(ir_insn_t *insn, reg_t scratch)
+{
+  if (insn->mem == mFRAME) return isel_frame_slot(insn->disp);
+  if (insn->mem == mABS || insn->a.kind == kIMM)
+    return (operand_t) { .type = oABS, .val = insn->disp + insn->a.v };
+  operand_t p = isel_operand(insn->a);
+  if (p.type != oREG) {
+    emit_load(scratch, p, 0);
+    p = (operand_t) { .type = oREG, .reg = scratch };
+  }
+  return (operand_t) { .type = oMEM, .reg = p.reg, .val = insn->disp };
+}
+
+// cmpl <b>, <a>, returning the condition code that holds when `insn` is true
+uint8_t isel_compare(ir_insn_t *insn)
+{
+  ir_op_t op = insn->op;
+  ir_val_t a = insn->a, b = insn->b;
+  if (a.kind == kIMM) {
+    ir_val_t tmp = a; a = b; b = tmp;
+    op = ir_swap_compare(op);
+  }
+  operand_t l = isel_operand(a);
+  if (l.type != oREG) {
+    emit_load(EAX, l, 0);
+    l = (operand_t) { .type = oREG, .reg = EAX };
+  }
+  emit_alu(aCMP, l.reg, isel_operand(b), 0);
+
+  switch (op) {
+  case irEQ: return ccE;
+  case irNE: return ccNE;
+  case irLT: return ccL;
+  case irLE: return ccLE;
+  case irGT: return ccG;
+  default: return ccGE;
+  }
+}
+
+// j<cc> to `t`, otherwise to `f`, falling through to `next` if possible
+void isel_branch(uint8_t cc, ir_block_t *t, ir_block_t *f, ir_block_t *next)
+{
+  if (t == next) emit_jump(cc ^ 1, f->label);
+  else {
+    emit_jump(cc, t->label);
+    if (f != next) emit_jump(ccALWAYS, f->label);
+  }
+}
+
+// addl <outgoing argument area>, %esp   (if registers were saved)
+// popl <saved registers>
+void isel_restore_regs()
+{
+  if (isel_func->saved_regs) emit_release(isel_out_area);
+  for (uint32_t i = IR_ALLOCATABLE; i > 0; --i)
+    if (isel_func->saved_regs & (1 << ir_allocatable[i - 1]))
+      emit_pop(ir_allocatable[i - 1]);
+}
+
+// how many of the arguments of `call` are passed in registers
+uint32_t isel_call_regs(ir_insn_t *call)
+{
+  if (call->name == NULL) return 0;
+  uint32_t n = regparm_of(call->name);
+  return n < call->nargs ? n : call->nargs;
+}
+
+// whether `call` can jump to its callee with the frame of the function
+// torn down, leaving the callee to return to its caller: it is in tail
+// position, its arguments fit where the function's own were passed, and
+// nothing points into the frame
+uint8_t isel_sibling_call(ir_insn_t *call)
+{
+  uint32_t stack_args = call->nargs - isel_call_regs(call);
+  return ir_is_tail_call(call) && !isel_frame_escapes
+    && stack_args <= isel_func->params - isel_func->regparm;
+}
+
+void isel_insn(ir_insn_t *insn, ir_block_t *b, uint32_t *uses)
+{
+  operand_t eax = { .type = oREG, .reg = EAX };
+  reg_t r = insn->dst ? isel_result_reg(insn->dst) : EAX;
+
+  switch (insn->op) {
+  case irCOPY: {
+    if (insn->width == 1) {
+      // the low byte, sign-extended
+      if (insn->a.kind == kIMM) insn->a.v = (int8_t) insn->a.v;
+      isel_load(r, insn->a);
+      if (insn->a.kind == kVREG) isel_sext(r);
+      isel_finish(insn->dst, r);
+      return;
+    }
+    operand_t dst = isel_func->locs[insn->dst];
+    operand_t src = isel_operand(insn->a);
+    if (dst.type == oREG) isel_load(dst.reg, insn->a);
+    else if (src.type == oIMM) emit_store_imm(dst, src.val, 0);
+    else if (src.type == oREG) emit_store(dst, src.reg, 0);
+    else if (!same_operand(dst, src)) {
+      emit_load(EAX, src, 0);
+      emit_store(dst, EAX, 0);
+    }
+    return;
+  }
+
+  case irADD: case irSUB: case irAND: case irOR: case irXOR: case irMUL: {
+    ir_val_t a = insn->a, bv = insn->b;
+    if (bv.kind == kVREG && isel_in_reg(bv, r) && !isel_in_reg(a, r)) {
+      if (ir_commutative(insn->op)) { a = insn->b; bv = insn->a; }
+      else r = EAX;
+    }
+    operand_t src = isel_operand(bv);
+    operand_t l = isel_operand(a);
+
+    if (
+      (insn->op == irADD || insn->op == irSUB) && insn->width == 4
+      && src.type == oIMM && a.kind == kVREG && l.type == oREG && l.reg != r
+      ) {
+      // leal <±imm>(%a), %r
+      int32_t c = insn->op == irADD ? (int32_t) src.val : -(int32_t) src.val;
+      emit_lea(r, (operand_t) { .type = oMEM, .reg = l.reg, .val = c });
+      isel_finish(insn->dst, r);
+      return;
+    }
+
+    isel_load(r, a);
+    if (insn->op == irMUL) {
+      // imull <b>, %r, or shifts and leas for constants
+      int32_t k = src.type == oIMM ? log2_exact(src.val) : -1;
+      if (k > 0) emit_shift(sSHL, r, k);
+      else if (src.type != oIMM || r != EAX || !emit_mul_const(src.val))
+        emit_imul(r, src);
+    } else {
+      alu_op_t op = aADD;
+      if (insn->op == irSUB) op = aSUB;
+      else if (insn->op == irAND) op = aAND;
+      else if (insn->op == irOR) op = aOR;
+      else if (insn->op == irXOR) op = aXOR;
+      emit_alu(op, r, src, 0);
+    }
+    // and/or/xor of sign-extended bytes are sign-extended already
+    if (
+      insn->width == 1
+      && (insn->op == irADD || insn->op == irSUB || insn->op == irMUL)
+      )
+      isel_sext(r);
+    isel_finish(insn->dst, r);
+    return;
+  }
+
+  case irDIV: case irMOD: {
+    // <a> -> %eax
+    // cdq
+    // idivl <b>                    (or a constant division sequence)
+    // quotient in %eax, remainder in %edx
+    uint8_t modulo = insn->op == irMOD;
+    operand_t src = isel_operand(insn->b);
+    isel_load(EAX, insn->a);
+    if (src.type == oIMM && emit_div_const(src.val, modulo)) {
+      isel_finish(insn->dst, EAX);
+      return;
+    }
+    uint32_t pushed = 0;
+    if (src.type == oIMM) {
+      emit_push(src);
+      src = (operand_t) { .type = oMEM, .reg = ESP, .val = 0 };
+      pushed = 4;
+    }
+    emit_cdq();
+    emit_unary(uIDIV, src, 0);
+    emit_release(pushed);
+    isel_finish(insn->dst, modulo ? EDX : EAX);
+    return;
+  }
+
+  case irNOT:
+    // notl %r
+    isel_load(r, insn->a);
+    emit_unary(uNOT, (operand_t) { .type = oREG, .reg = r }, 0);
+    isel_finish(insn->dst, r);
+    return;
+
+  case irEQ: case irNE: case irLT: case irLE: case irGT: case irGE: {
+    // a compare that only feeds the branch after it is done by the branch
+    ir_insn_t *next = insn->next;
+    if (
+      next->op == irBR && next->a.kind == kVREG
+      && (uint32_t) next->a.v == insn->dst && uses[insn->dst] == 1
+      )
+      return;
+    // cmpl <b>, <a>
+    // set<cc> %al
+    // movzbl %al, %eax
+    emit_setcc(isel_compare(insn));
+    isel_finish(insn->dst, EAX);
+    return;
+  }
+
+  case irLOAD: {
+    // movl/movsbl <mem>, %r
+    if (isel_func->folded[insn->dst]) return;
+    operand_t src = isel_address(insn, EAX);
+    if (insn->width == 1) emit_movsx(r, src);
+    else emit_load(r, src, 0);
+    isel_finish(insn->dst, r);
+    return;
+  }
+
+  case irSTORE: {
+    // movl/movb <b>, <mem>
+    operand_t dst = isel_address(insn, EDX);
+    operand_t src = isel_operand(insn->b);
+    uint8_t byte = insn->width == 1;
+    if (src.type == oIMM) {
+      emit_store_imm(dst, src.val, byte);
+      return;
+    }
+    if (src.type != oREG || (byte && src.reg >= ESP)) {
+      emit_load(EAX, src, 0);
+      src = eax;
+    }
+    emit_store(dst, src.reg, byte);
+    return;
+  }
+
+  case irADDR:
+    // leal disp(%ebp), %r
+    emit_lea(r, (operand_t) { .type = oMEM, .reg = EBP, .val = insn->disp });
+    isel_finish(insn->dst, r);
+    return;
+
+  case irSYM:
+    // movl $<name>, %r
+    emit_load_symbol(r, insn->name, insn->symtab);
+    isel_finish(insn->dst, r);
+    return;
+
+  case irPARAM:
+    // copied out of its register in the prologue
+    return;
+
+  case irCALL: {
+    uint32_t regs = isel_call_regs(insn);
+    if (isel_sibling_call(insn)) {
+      // pushl <argument>           (those passed in registers, then the
+      //                             others, each last to first)
+      // movl <callee>, %edx        (for a call through a pointer)
+      // popl %eax                  (the ones on the stack, first to last)
+      // movl %eax, <8 + 4i>(%ebp)
+      // popl %eax/%edx/%ecx        (the ones passed in registers)
+      // popl <saved registers>
+      // leave
+      // jmp <function>             (or jmpl *%edx)
+      // the arguments and the callee are read before the slots that they
+      // may be read from are overwritten
+      for (uint32_t i = regs; i > 0; --i)
+        emit_push(isel_operand(insn->args[i - 1]));
+      for (uint32_t i = insn->nargs; i > regs; --i)
+        emit_push(isel_operand(insn->args[i - 1]));
+      if (insn->name == NULL) isel_load(EDX, insn->a);
+      for (uint32_t i = 0; i < insn->nargs - regs; ++i) {
+        emit_pop(EAX);
+        emit_store(
+          (operand_t) { .type = oMEM, .reg = EBP, .val = 8 + 4 * i }, EAX, 0
+          );
+      }
+      for (uint32_t i = 0; i < regs; ++i) emit_pop(ir_regparm_regs[i]);
+      isel_restore_regs();
+      if (insn->name != NULL) {
+        emit_tail_jump_symbol(insn->name, insn->symtab);
+        if (b->count != IR_NO_COUNT) relocs->weight = b->count;
+      } else emit_tail_jump(EDX);
+      return;
+    }
+
+    // movl <argument>, <4i>(%esp)  (those passed on the stack, into the
+    //                               outgoing argument area)
+    // movl <argument>, %eax/%edx/%ecx (the first ones, for functions that
+    //                               take them in registers)
+    // calll <function>             (or calll *<callee> for pointers)
+    // movsbl %al, %eax             (if it returns a char)
+    for (uint32_t i = regs; i < insn->nargs; ++i) {
+      operand_t slot = { .type = oMEM, .reg = ESP, .val = 4 * (i - regs) };
+      operand_t src = isel_operand(insn->args[i]);
+      if (src.type == oIMM) emit_store_imm(slot, src.val, 0);
+      else {
+        if (src.type != oREG) {
+          emit_load(EAX, src, 0);
+          src = eax;
+        }
+        emit_store(slot, src.reg, 0);
+      }
+    }
+    // %ecx last, as it may hold one of the others
+    for (uint32_t i = 0; i < regs; ++i)
+      isel_load(ir_regparm_regs[i], insn->args[i]);
+    if (insn->name != NULL) {
+      emit_call_symbol(insn->name, insn->symtab);
+      if (b->count != IR_NO_COUNT) relocs->weight = b->count;
+    } else {
+      operand_t callee = isel_operand(insn->a);
+      if (callee.type == oIMM) {
+        emit_load(EAX, callee, 0);
+        callee = eax;
+      }
+      emit_call(callee);
+    }
+    if (uses[insn->dst] == 0) return;
+    if (insn->width == 1) emit_movsx(EAX, eax);
+    isel_finish(insn->dst, EAX);
+    return;
+  }
+
+  case irJMP:
+    if (insn->target != b->next) emit_jump(ccALWAYS, insn->target->label);
+    return;
+
+  case irBR: {
+    ir_insn_t *prev = insn->prev;
+    if (
+      prev && ir_is_compare(prev->op) && insn->a.kind == kVREG
+      && (uint32_t) insn->a.v == prev->dst && uses[prev->dst] == 1
+      ) {
+      // cmpl <b>, <a>
+      // j<cc> <target>
+      isel_branch(isel_compare(prev), insn->target, insn->target2, b->next);
+      return;
+    }
+    // testl %r, %r
+    // jne <target>
+    operand_t c = isel_operand(insn->a);
+    if (c.type != oREG) {
+      emit_load(EAX, c, 0);
+      c = eax;
+    }
+    emit_test(c.reg, c.reg, 0);
+    isel_branch(ccNE, insn->target, insn->target2, b->next);
+    return;
+  }
+
+  case irRET:
+    // popl <saved registers>
+    // leave                        (if the function has a frame)
+    // retl
+    if (insn->prev && isel_sibling_call(insn->prev)) return;
+    if (insn->a.kind != kNONE) isel_load(EAX, insn->a);
+    isel_restore_regs();
+    if (isel_frameless) emit_ret();
+    else emit_epilogue();
+    return;
+
+  default: ;
+  }
+}
+
+void ir_isel(ir_func_t *f)
+{
+  isel_func = f;
+  isel_frame_escapes = ir_frame_escapes(f);
+  isel_frameless = !isel_needs_frame(f);
+  isel_out_area = 0;
+  for (ir_block_t *b = f->blocks; b != NULL; b = b->next)
+    for (ir_insn_t *insn = b->first; insn != NULL; insn = insn->next)
+      if (insn->op == irCALL && !isel_sibling_call(insn)) {
+        uint32_t size = 4 * (insn->nargs - isel_call_regs(insn));
+        if (size > isel_out_area) isel_out_area = size;
+      }
+  uint32_t *uses = malloc(f->vreg_count * sizeof(uint32_t));
+  ir_count_uses(f, uses);
+
+  // loads folded into their uses read arguments through the frame as well
+  for (uint32_t v = 1; v < f->vreg_count; ++v)
+    if (f->locs[v].type == oMEM && f->locs[v].reg == EBP)
+      f->locs[v] = isel_frame_slot(f->locs[v].val);
+
+  // pushl %ebp                     (if the function needs a frame)
+  // movl %esp, %ebp
+  // subl <frame size>, %esp        (if it is not 0)
+  // pushl <saved registers>
+  // subl <outgoing argument area>, %esp
+  if (!isel_frameless) emit_frame_setup(f->frame_size);
+  for (uint32_t i = 0; i < IR_ALLOCATABLE; ++i)
+    if (f->saved_regs & (1 << ir_allocatable[i]))
+      emit_push((operand_t) { .type = oREG, .reg = ir_allocatable[i] });
+  if (isel_out_area)
+    emit_alu(aSUB, ESP, (operand_t) { .type = oIMM, .val = isel_out_area }, 0);
+
+  // movl %ecx, <third parameter>   (first, as regalloc may have put one of
+  // movl %eax, <first parameter>    the others in %ecx)
+  // movl %edx, <second parameter>
+  for (uint32_t k = 0; k < IR_REGPARM; ++k) {
+    uint32_t i = (k + 2) % IR_REGPARM;
+    for (ir_insn_t *insn = f->blocks->first; insn != NULL; insn = insn->next)
+      if (insn->op == irPARAM && insn->disp == (int32_t) i && uses[insn->dst])
+        isel_finish(insn->dst, ir_regparm_regs[i]);
+  }
+
+  for (ir_block_t *b = f->blocks; b != NULL; b = b->next) b->label = new_label();
+  for (ir_block_t *b = f->blocks; b != NULL; b = b->next) {
+    place_label(b->label);
+    for (ir_insn_t *insn = b->first; insn != NULL; insn = insn->next)
+      isel_insn(insn, b, uses);
+  }
+
+  free(uses);
+}
+
+// codegen: the direct translation from the AST used at -O0
+void codegen_function(ir_func_t *f)
+{
+  // function preamble:
+  //   pushl %ebp
+  //   movl %esp, %ebp
+  //   subl <stacksize>, %esp       (if it is not 0)
+  emit_frame_setup(f->frame_size);
+
+  // in 64-bit code the parameters passed in registers go to their slots:
+  //   movq %rdi/%rsi/%rdx/%rcx/%r8/%r9, <slot>(%rbp)
+  for (uint32_t i = 0; target64 && i < f->params && i < f->regparm; ++i) {
+    operand_t slot = { .type = oMEM, .reg = EBP, .val = f->param_slots[i] };
+    emit_store(slot, arg_regs64[i], 0);
+  }
+
+  uint32_t block_id = 0;
+  codegen_stmt(f->body, f->symtab, &block_id, NO_LABEL, NO_LABEL);
+
+  // function epilogue:
+  //   leave
+  //   retl
+  emit_epilogue();
+}
+
+void run_peephole(ir_func_t *f)
+{
+  if (peephole_enabled) peephole(f->start);
+}
+
+void run_schedule(ir_func_t *f)
+{
+  if (schedule_insns) schedule(f->start);
+}
+
+void run_relax(ir_func_t *f)
+{
+  relax_jumps(f->start);
+}
+
+// pass manager: every function goes through the pipeline of its -O level,
+// one pass at a time
+typedef enum {
+  pLOWER, pSIMPLIFY_CFG, pFOLD, pDCE, pTAIL_RECURSION, pLOOP_ROTATE, pSSA,
+  pSCCP, pCOPY_PROP, pGVN, pADCE, pINLINE, pLICM, pIV_REDUCE, pUNROLL,
+  pOUT_OF_SSA, pFRAME, pREGALLOC, pLAYOUT, pISEL, pCODEGEN, pPEEPHOLE,
+  pSCHEDULE, pRELAX, pEND
+} pass_id_t;
+
+typedef struct pass_s {
+  char *name;
+  void (*run)(ir_func_t *f);
+  clock_t time;
+  uint32_t runs;
+} pass_t;
+
+pass_t passes[] = {
+  [pLOWER] = { "lower", ir_lower, 0, 0 },
+  [pSIMPLIFY_CFG] = { "simplify-cfg", ir_simplify_cfg, 0, 0 },
+  [pFOLD] = { "fold", ir_fold, 0, 0 },
+  [pDCE] = { "dce", ir_dce, 0, 0 },
+  [pTAIL_RECURSION] = { "tail-recursion", ir_tail_recursion, 0, 0 },
+  [pLOOP_ROTATE] = { "loop-rotate", ir_rotate_loops, 0, 0 },
+  [pSSA] = { "ssa", ir_build_ssa, 0, 0 },
+  [pSCCP] = { "sccp", ir_sccp, 0, 0 },
+  [pCOPY_PROP] = { "copy-prop", ir_copy_prop, 0, 0 },
+  [pGVN] = { "gvn", ir_gvn, 0, 0 },
+  [pADCE] = { "adce", ir_adce, 0, 0 },
+  [pINLINE] = { "inline", ir_inline, 0, 0 },
+  [pLICM] = { "licm", ir_licm, 0, 0 },
+  [pIV_REDUCE] = { "iv-reduce", ir_iv_reduce, 0, 0 },
+  [pUNROLL] = { "unroll", ir_unroll, 0, 0 },
+  [pOUT_OF_SSA] = { "out-of-ssa", ir_destruct_ssa, 0, 0 },
+  [pFRAME] = { "frame", ir_compact_frame, 0, 0 },
+  [pREGALLOC] = { "regalloc", ir_regalloc, 0, 0 },
+  [pLAYOUT] = { "layout", ir_layout, 0, 0 },
+  [pISEL] = { "isel", ir_isel, 0, 0 },
+  [pCODEGEN] = { "codegen", codegen_function, 0, 0 },
+  [pPEEPHOLE] = { "peephole", run_peephole, 0, 0 },
+  [pSCHEDULE] = { "schedule", run_schedule, 0, 0 },
+  [pRELAX] = { "relax", run_relax, 0, 0 },
+};
+
+pass_id_t pipeline_o0[] = { pCODEGEN, pPEEPHOLE, pRELAX, pEND };
+pass_id_t pipeline_o1[] = {
+  pLOWER, pSIMPLIFY_CFG, pFOLD, pDCE, pTAIL_RECURSION, pLOOP_ROTATE, pSSA,
+  pCOPY_PROP, pFOLD, pDCE, pSIMPLIFY_CFG, pUNROLL, pCOPY_PROP, pFOLD, pDCE,
+  pSIMPLIFY_CFG, pOUT_OF_SSA, pFRAME, pREGALLOC, pLAYOUT, pISEL, pPEEPHOLE,
+  pSCHEDULE, pRELAX, pEND
+};
+pass_id_t pipeline_o2[] = {
+  pLOWER, pSIMPLIFY_CFG, pFOLD, pDCE, pTAIL_RECURSION, pLOOP_ROTATE, pSSA,
+  pSCCP, pCOPY_PROP, pGVN, pCOPY_PROP, pFOLD, pADCE, pSIMPLIFY_CFG, pINLINE,
+  pSCCP, pCOPY_PROP, pFOLD, pADCE, pSIMPLIFY_CFG, pLICM, pIV_REDUCE, pUNROLL,
+  pCOPY_PROP, pFOLD, pSCCP, pGVN, pCOPY_PROP, pFOLD, pADCE, pSIMPLIFY_CFG,
+  pOUT_OF_SSA, pFRAME, pREGALLOC, pLAYOUT, pISEL, pPEEPHOLE, pSCHEDULE, pRELAX,
+  pEND
+};
+
+void run_pass(pass_id_t id, ir_func_t *f)
+{
+  clock_t t = clock();
+  passes[id].run(f);
+  passes[id].time += clock() - t;
+  ++passes[id].runs;
+}
+
+void run_pipeline(ir_func_t *f)
+{
+  pass_id_t *pipeline = pipeline_o0;
+  if (opt_level == 1) pipeline = pipeline_o1;
+  else if (opt_level >= 2) pipeline = pipeline_o2;
+
+  if (emit_ir && pipeline[0] != pLOWER) {
+    // lower just for the dump. string literals are written to the data
+    // section again by codegen, so their first copies are dropped
+    uint32_t saved_data_loc = data_loc;
+    run_pass(pLOWER, f);
+    ir_print_func(f);
+    data_loc = saved_data_loc;
+  }
+
+  for (pass_id_t *p = pipeline; *p != pEND; ++p) {
+    if (emit_ir && *p == pOUT_OF_SSA) ir_print_func(f);
+    run_pass(*p, f);
+  }
+
+  if (!frame_report) return;
+  printf("%s: frame %u bytes", f->name, f->frame_size);
+  if (pipeline[0] == pLOWER)
+    printf(", %u before compaction", f->uncompacted_size);
+  printf("\n");
+}
+
+// function ordering: at -O2 the functions and the object files of the
+// archive are laid out so that callers end up next to the functions they
+// call most, which keeps the code that runs together on few pages
+// (Pettis and Hansen's greedy clustering). every call and every address of
+// a function is a relocation, so the code can be moved before relocate()
+// runs. object files move as a whole, as their code may call itself without
+// relocations
+
+typedef struct order_unit_s {
+  uint32_t start; // where the code is in text
+  uint32_t end;
+  uint32_t to; // where it goes
+  char *name;
+} order_unit_t;
+
+order_unit_t *order_units = NULL;
+uint32_t order_unit_count = 0;
+
+// a call or a reference from `at` in unit `from` to `target` in unit `to`
+typedef struct order_edge_s {
+  uint32_t from, at;
+  uint32_t to, target;
+  uint32_t weight;
+} order_edge_t;
+
+// records that the code from `start` to text_loc is one unit
+void order_add_unit(uint32_t start, char *name)
+{
+  if (start == text_loc) return;
+  order_units = realloc(
+    order_units, (order_unit_count + 1) * sizeof(order_unit_t)
+    );
+  order_units[order_unit_count++] = (order_unit_t) {
+    .start = start, .end = text_loc, .to = start, .name = name
+  };
+}
+
+// the unit that `loc` is in, or the one that ends at `loc`
+uint32_t order_unit_of(uint32_t loc)
+{
+  uint32_t lo = 0, hi = order_unit_count;
+  while (hi - lo > 1) {
+    uint32_t mid = (lo + hi) / 2;
+    if (order_units[mid].start <= loc) lo = mid;
+    else hi = mid;
+  }
+  return lo;
+}
+
+// the number of pages that the units in `reached` cover, and how often a
+// call crosses from one page to another, before or after they are moved
+void order_spread(
+  order_edge_t *edges, uint32_t n, uint8_t *reached, uint8_t after,
+  uint32_t *pages, uint32_t *crossing
+  )
+{
+  uint32_t npages = (text_loc >> 12) + 1;
+  uint8_t *used = malloc(npages);
+  memset(used, 0, npages);
+  for (uint32_t i = 0; i < order_unit_count; ++i) {
+    if (!reached[i]) continue;
+    order_unit_t *u = order_units + i;
+    uint32_t start = after ? u->to : u->start;
+    uint32_t last = (start + u->end - u->start - 1) >> 12;
+    for (uint32_t p = start >> 12; p <= last; ++p) used[p] = 1;
+  }
+  *pages = 0;
+  for (uint32_t p = 0; p < npages; ++p) *pages += used[p];
+  free(used);
+
+  *crossing = 0;
+  for (uint32_t i = 0; i < n; ++i) {
+    order_unit_t *from = order_units + edges[i].from;
+    order_unit_t *to = order_units + edges[i].to;
+    uint32_t at = (after ? from->to : from->start) + edges[i].at;
+    uint32_t target = (after ? to->to : to->start) + edges[i].target;
+    if (at >> 12 != target >> 12) *crossing += edges[i].weight;
+  }
+}
+
+int order_compare_pairs(const void *a, const void *b)
+{
+  const order_edge_t *x = a, *y = b;
+  if (x->from != y->from) return x->from < y->from ? -1 : 1;
+  if (x->to != y->to) return x->to < y->to ? -1 : 1;
+  return 0;
+}
+
+int order_compare_weights(const void *a, const void *b)
+{
+  const order_edge_t *x = a, *y = b;
+  if (x->weight != y->weight) return x->weight > y->weight ? -1 : 1;
+  return order_compare_pairs(a, b);
+}
+
+// the chains that units are merged into
+uint32_t **order_chains = NULL;
+uint32_t *order_chain_len = NULL;
+uint32_t *order_chain_weight = NULL;
+uint32_t *order_chain_of = NULL;
+
+void order_reverse_chain(uint32_t c)
+{
+  uint32_t *m = order_chains[c], len = order_chain_len[c];
+  for (uint32_t i = 0; i < len / 2; ++i) {
+    uint32_t t = m[i];
+    m[i] = m[len - 1 - i];
+    m[len - 1 - i] = t;
+  }
+}
+
+uint32_t order_position(uint32_t c, uint32_t unit)
+{
+  uint32_t i = 0;
+  while (order_chains[c][i] != unit) ++i;
+  return i;
+}
+
+// joins the chains of units a and b, turning them so that a and b end up as
+// close together as they can
+void order_merge(uint32_t a, uint32_t b, uint32_t weight)
+{
+  uint32_t ca = order_chain_of[a], cb = order_chain_of[b];
+  if (ca == cb) {
+    order_chain_weight[ca] += weight;
+    return;
+  }
+  if (order_position(ca, a) < order_chain_len[ca] / 2) order_reverse_chain(ca);
+  if (order_position(cb, b) >= (order_chain_len[cb] + 1) / 2)
+    order_reverse_chain(cb);
+
+  uint32_t len = order_chain_len[ca] + order_chain_len[cb];
+  order_chains[ca] = realloc(order_chains[ca], len * sizeof(uint32_t));
+  for (uint32_t i = 0; i < order_chain_len[cb]; ++i) {
+    uint32_t unit = order_chains[cb][i];
+    order_chains[ca][order_chain_len[ca] + i] = unit;
+    order_chain_of[unit] = ca;
+  }
+  order_chain_len[ca] = len;
+  order_chain_weight[ca] += order_chain_weight[cb] + weight;
+  free(order_chains[cb]);
+  order_chains[cb] = NULL;
+}
+
+// hotter chains first, and those that were not merged in their old order
+int order_compare_chains(const void *a, const void *b)
+{
+  uint32_t x = *(const uint32_t *) a, y = *(const uint32_t *) b;
+  if (order_chain_weight[x] != order_chain_weight[y])
+    return order_chain_weight[x] > order_chain_weight[y] ? -1 : 1;
+  return x < y ? -1 : x > y;
+}
+
+void order_functions()
+{
+  uint32_t n = order_unit_count;
+  if (n < 2) return;
+  // only code that is all in units can be moved
+  for (uint32_t i = 0; i < n; ++i)
+    if (order_units[i].start != (i == 0 ? 0 : order_units[i - 1].end)) return;
+  if (order_units[n - 1].end != text_loc) return;
+
+  uint32_t nedges = 0;
+  order_edge_t *edges = NULL;
+  for (relocation_t *r = relocs; r != NULL; r = r->next) {
+    symbol_t *sym = symtab_get(r->symtab, r->name);
+    if (
+      sym == NULL || sym->loc_type != lTEXT || sym->loc == (uint32_t) -1
+      || r->addr >= text_loc
+      ) {
+      continue;
+    }
+    uint32_t from = order_unit_of(r->addr), to = order_unit_of(sym->loc);
+    edges = realloc(edges, (nedges + 1) * sizeof(order_edge_t));
+    edges[nedges++] = (order_edge_t) {
+      .from = from, .at = r->addr - order_units[from].start,
+      .to = to, .target = sym->loc - order_units[to].start,
+      .weight = r->weight
+    };
+  }
+
+  // the units that _start reaches
+  uint8_t *reached = malloc(n);
+  uint32_t *work = malloc(n * sizeof(uint32_t)), nwork = 0;
+  memset(reached, 0, n);
+  symbol_t *start = symtab_get(root_symtab, "_start");
+  if (start == NULL || start->loc_type != lTEXT) memset(reached, 1, n);
+  else {
+    work[nwork++] = order_unit_of(start->loc);
+    reached[work[0]] = 1;
+  }
+  while (nwork > 0) {
+    uint32_t u = work[--nwork];
+    for (uint32_t i = 0; i < nedges; ++i) {
+      if (edges[i].from != u || reached[edges[i].to]) continue;
+      reached[edges[i].to] = 1;
+      work[nwork++] = edges[i].to;
+    }
+  }
+
+  // the weight of every pair of units, heaviest first
+  order_edge_t *pairs = malloc((nedges + 1) * sizeof(order_edge_t));
+  uint32_t npairs = 0;
+  for (uint32_t i = 0; i < nedges; ++i) {
+    if (edges[i].from == edges[i].to || edges[i].weight == 0) continue;
+    pairs[npairs] = edges[i];
+    if (pairs[npairs].from > pairs[npairs].to) {
+      pairs[npairs].from = edges[i].to;
+      pairs[npairs].to = edges[i].from;
+    }
+    ++npairs;
+  }
+  qsort(pairs, npairs, sizeof(order_edge_t), order_compare_pairs);
+  uint32_t merged = 0;
+  for (uint32_t i = 0; i < npairs; ++i) {
+    if (
+      merged > 0 && pairs[merged - 1].from == pairs[i].from
+      && pairs[merged - 1].to == pairs[i].to
+      ) {
+      pairs[merged - 1].weight += pairs[i].weight;
+      continue;
+    }
+    pairs[merged++] = pairs[i];
+  }
+  npairs = merged;
+  qsort(pairs, npairs, sizeof(order_edge_t), order_compare_weights);
+
+  order_chains = malloc(n * sizeof(uint32_t *));
+  order_chain_len = malloc(n * sizeof(uint32_t));
+  order_chain_weight = malloc(n * sizeof(uint32_t));
+  order_chain_of = malloc(n * sizeof(uint32_t));
+  for (uint32_t i = 0; i < n; ++i) {
+    order_chains[i] = malloc(sizeof(uint32_t));
+    order_chains[i][0] = i;
+    order_chain_len[i] = 1;
+    order_chain_weight[i] = 0;
+    order_chain_of[i] = i;
+  }
+  for (uint32_t i = 0; i < npairs; ++i)
+    order_merge(pairs[i].from, pairs[i].to, pairs[i].weight);
+
+  // a chain is named after the first unit it had
+  uint32_t nchains = 0;
+  for (uint32_t i = 0; i < n; ++i)
+    if (order_chains[i] != NULL) work[nchains++] = i;
+  qsort(work, nchains, sizeof(uint32_t), order_compare_chains);
+
+  uint8_t *moved = malloc(text_cap);
+  uint32_t to = 0;
+  for (uint32_t i = 0; i < nchains; ++i) {
+    for (uint32_t j = 0; j < order_chain_len[work[i]]; ++j) {
+      order_unit_t *u = order_units + order_chains[work[i]][j];
+      u->to = to;
+      memcpy(moved + to, text + u->start, u->end - u->start);
+      to += u->end - u->start;
+    }
+  }
+  free(text);
+  text = moved;
+
+  for (relocation_t *r = relocs; r != NULL; r = r->next) {
+    if (r->addr >= text_loc) continue;
+    order_unit_t *u = order_units + order_unit_of(r->addr);
+    r->addr = u->to + r->addr - u->start;
+  }
+  for (uint32_t i = 0; i < SYMTAB_SIZE; ++i) {
+    symbol_t *sym = root_symtab + i;
+    if (
+      sym->name == NULL || sym->loc_type != lTEXT
+      || sym->loc == (uint32_t) -1
+      ) {
+      continue;
+    }
+    order_unit_t *u = order_units + order_unit_of(sym->loc);
+    sym->loc = u->to + sym->loc - u->start;
+  }
+
+  if (function_order_report) {
+    for (uint32_t i = 0; i < nchains; ++i) {
+      for (uint32_t j = 0; j < order_chain_len[work[i]]; ++j) {
+        order_unit_t *u = order_units + order_chains[work[i]][j];
+        printf(
+          "%#x %s (%u bytes)\n", TEXT_START + u->to,
+          u->name == NULL ? "<archive>" : u->name, u->end - u->start
+          );
+      }
+    }
+    uint32_t pages[2], crossing[2];
+    order_spread(edges, nedges, reached, 0, pages, crossing);
+    order_spread(edges, nedges, reached, 1, pages + 1, crossing + 1);
+    printf(
+      "reachable code: %u pages, %u before; "
+      "calls across pages: %u, %u before\n",
+      pages[1], pages[0], crossing[1], crossing[0]
+      );
+  }
+
+  for (uint32_t i = 0; i < nchains; ++i) free(order_chains[work[i]]);
+  free(edges);
+  free(pairs);
+  free(reached);
+  free(work);
+  free(order_chains);
+  free(order_chain_len);
+  free(order_chain_weight);
+  free(order_chain_of);
+}
+
+void codegen(ast_node_t *ast)
+{
+  ast_node_t *current = ast;
+  while (current != NULL) {
+    uint32_t size = construct_symtab(current, root_symtab, NULL, 0, 0);
+
+    if (current->type == nSTMT) {
+      if (data_loc + size > DATA_CAP) {
+        printf("Too much data.\n");
+        exit(1);
+      }
+      data_loc += size;
+      current = current->next;
+      continue;
+    }
+
+    ast_node_t *current_child = current->children;
+    while (current_child->type != nSTMT) current_child = current_child->next;
+    if (current_child->variant != vBLOCK) {
+      current = current->next; continue;
+    }
+
+    ir_func_t f;
+    memset(&f, 0, sizeof(f));
+    f.name = current->s;
+    f.body = current_child;
+    f.symtab = symtab_get(root_symtab, current->s)->child;
+    f.start = text_loc;
+    f.frame_size = size;
+    f.regparm = target64 ? ARG_REGS64 : regparm_of(f.name);
+    // parameters passed in registers get slots at the bottom of the frame,
+    // and the others move up to where the first would have been
+    for (ast_node_t *arg = current->children->next; arg->type == nARGUMENT; ) {
+      symbol_t *sym = symtab_get(f.symtab, arg->s);
+      if (f.params < f.regparm) {
+        f.frame_size = (f.frame_size + WORD_SIZE - 1) & ~(WORD_SIZE - 1);
+        f.frame_size += WORD_SIZE;
+        sym->loc = -f.frame_size;
+        f.param_slots[f.params] = sym->loc;
+        f.param_widths[f.params] = sym->type == tCHAR ? 1 : 4;
+      } else sym->loc -= WORD_SIZE * f.regparm;
+      ++f.params;
+      arg = arg->next;
+    }
+    // the System V ABI keeps %rsp 16-byte aligned
+    if (target64) f.frame_size = (f.frame_size + 15) & ~15;
+    run_pipeline(&f);
+    order_add_unit(f.start, f.name);
+
+    current = current->next;
+  }
+}
+
+void relocate()
+{
+  relocation_t *current = relocs;
+  while (current != NULL) {
+    symbol_t *sym = symtab_get(current->symtab, current->name);
+    if (sym == NULL || (sym->loc == (uint32_t) -1 && sym->loc_type == lTEXT)) {
+      printf("Undefined symbol %s\n", current->name);
+      exit(1);
+    }
+
+    uint32_t addr = DATA_START + sym->loc;
+    if (sym->loc_type == lTEXT) addr = TEXT_START + sym->loc;
+
+    if (current->type == rMOV_EAX) {
+      uint8_t tmp[5];
+      tmp[0] = 0xb8;
+      for (uint32_t i = 1; i < 5; ++i) {
+        tmp[i] = addr & 0xff;
+        addr >>= 8;
+      }
+      memcpy(text + current->addr, tmp, sizeof(tmp));
+    }
+
+    if (current->type != rMOV_EAX) {
+      uint64_t offset = (int64_t) (addr + current->addend);
+      if (current->type == rOFFSET) offset -= current->addr + TEXT_START;
+      uint8_t tmp[8];
+      for (uint32_t i = 0; i < 8; ++i) {
+        tmp[i] = offset & 0xff;
+        offset >>= 8;
+      }
+      memcpy(text + current->addr, tmp, current->type == rIMM64 ? 8 : 4);
+    }
+
+    current = current->next;
+  }
+}
+
+// writes the ELF header in the class of the target
+void write_elf_header(FILE *out, Elf64_Header *hdr)
+{
+  if (target64) {
+    fwrite(hdr, sizeof(*hdr), 1, out);
+    return;
+  }
+  Elf32_Header hdr32;
+  memcpy(hdr32.e_ident, hdr->e_ident, EI_NIDENT);
+  hdr32.e_type = hdr->e_type;
+  hdr32.e_machine = hdr->e_machine;
+  hdr32.e_version = hdr->e_version;
+  hdr32.e_entry = hdr->e_entry;
+  hdr32.e_phoff = hdr->e_phoff;
+  hdr32.e_shoff = hdr->e_shoff;
+  hdr32.e_flags = hdr->e_flags;
+  hdr32.e_ehsize = hdr->e_ehsize;
+  hdr32.e_phentsize = hdr->e_phentsize;
+  hdr32.e_phnum = hdr->e_phnum;
+  hdr32.e_shentsize = hdr->e_shentsize;
+  hdr32.e_shnum = hdr->e_shnum;
+  hdr32.e_shstrndx = hdr->e_shstrndx;
+  fwrite(&hdr32, sizeof(hdr32), 1, out);
+}
+
+// writes a program header in the class of the target
+void write_elf_phdr(FILE *out, Elf64_Phdr *phdr)
+{
+  if (target64) {
+    fwrite(phdr, sizeof(*phdr), 1, out);
+    return;
+  }
+  Elf32_Phdr phdr32;
+  phdr32.p_type = phdr->p_type;
+  phdr32.p_offset = phdr->p_offset;
+  phdr32.p_vaddr = phdr->p_vaddr;
+  phdr32.p_paddr = phdr->p_paddr;
+  phdr32.p_filesz = phdr->p_filesz;
+  phdr32.p_memsz = phdr->p_memsz;
+  phdr32.p_flags = phdr->p_flags;
+  phdr32.p_align = phdr->p_align;
+  fwrite(&phdr32, sizeof(phdr32), 1, out);
+}
+
+// the headers are built in their 64-bit form and narrowed when written for
+// i386
+void write_elf(FILE *out)
+{
+  uint32_t entry = TEXT_START;
+  symbol_t *start = symtab_get(root_symtab, "_start");
+  if (start != NULL) entry = TEXT_START + start->loc;
+  else printf("Cannot find entry symbol _start; defaulting to %#x\n", entry);
+
+  uint32_t ehsize = target64 ? sizeof(Elf64_Header) : sizeof(Elf32_Header);
+  uint32_t phsize = target64 ? sizeof(Elf64_Phdr) : sizeof(Elf32_Phdr);
+
+  Elf64_Header ehdr;
+  memset(&ehdr, 0, sizeof(ehdr));
+  ehdr.e_ident[0] = ELFMAG0; ehdr.e_ident[1] = ELFMAG1;
+  ehdr.e_ident[2] = ELFMAG2; ehdr.e_ident[3] = ELFMAG3;
+  ehdr.e_ident[4] = target64 ? 2 : 1; ehdr.e_ident[5] = 1; ehdr.e_ident[6] = 1;
+  ehdr.e_type = ET_EXEC;
+  ehdr.e_machine = target64 ? 62 : 3;
+  ehdr.e_version = 1;
+  ehdr.e_phnum = 2;
+  ehdr.e_phentsize = phsize;
+  ehdr.e_phoff = ehsize;
+  ehdr.e_ehsize = ehsize;
+  ehdr.e_entry = entry;
+
+  Elf64_Phdr text_hdr;
+  memset(&text_hdr, 0, sizeof(text_hdr));
+  text_hdr.p_type = PT_LOAD;
+  text_hdr.p_offset = ehsize + (2*phsize) + data_loc;
+  text_hdr.p_vaddr = TEXT_START;
+  text_hdr.p_memsz = text_loc;
+  text_hdr.p_filesz = text_loc;
+  text_hdr.p_flags |= PF_X;
+
+  Elf64_Phdr data_hdr;
+  memset(&data_hdr, 0, sizeof(data_hdr));
+  data_hdr.p_type = PT_LOAD;
+  data_hdr.p_offset = ehsize + (2*phsize);
+  data_hdr.p_vaddr = DATA_START;
+  data_hdr.p_memsz = data_loc;
+  data_hdr.p_filesz = data_loc;
+
+  // to run it here, the segments are placed at page-aligned file offsets
+  // that match their addresses modulo the page size, so that Linux can map
+  // them with mmap
+  if (run) {
+    data_hdr.p_offset = DATA_START - RUN_BASE;
+    data_hdr.p_flags = PF_R | PF_W;
+    data_hdr.p_align = 0x1000;
+    text_hdr.p_offset = TEXT_START - RUN_BASE;
+    text_hdr.p_flags = PF_R | PF_X;
+    text_hdr.p_align = 0x1000;
+  }
+
+  write_elf_header(out, &ehdr);
+  write_elf_phdr(out, &data_hdr);
+  write_elf_phdr(out, &text_hdr);
+  fseek(out, data_hdr.p_offset, SEEK_SET);
+  fwrite(data, data_loc, 1, out);
+  fseek(out, text_hdr.p_offset, SEEK_SET);
+  fwrite(text, text_loc, 1, out);
+
+#ifdef NANOC_DEBUG
+  printf("text offset for objdumping: %#x\n", (uint32_t) text_hdr.p_offset);
+#endif
+}
+
+struct archive_header_s {
+  char ident[16];
+  char mod_time[12];
+  char owner_id[6];
+  char group_id[6];
+  char file_mode[8];
+  char file_len[10];
+  char end[2];
+} __attribute__((packed));
+typedef struct archive_header_s archive_header_t;
+
+// object files are read in the class of the target. their headers, symbols
+// and relocations are read into the 64-bit forms, widening them for i386.
+// fields are copied out since archive members are only 2-byte aligned
+Elf64_Shdr elf_section(uint8_t *buffer, Elf64_Header *hdr, uint32_t i)
+{
+  Elf64_Shdr shdr;
+  uint8_t *at = buffer + hdr->e_shoff + (hdr->e_shentsize * i);
+  if (target64) {
+    memcpy(&shdr, at, sizeof(shdr));
+    return shdr;
+  }
+  Elf32_Shdr shdr32;
+  memcpy(&shdr32, at, sizeof(shdr32));
+  shdr.sh_name = shdr32.sh_name;
+  shdr.sh_type = shdr32.sh_type;
+  shdr.sh_flags = shdr32.sh_flags;
+  shdr.sh_addr = shdr32.sh_addr;
+  shdr.sh_offset = shdr32.sh_offset;
+  shdr.sh_size = shdr32.sh_size;
+  shdr.sh_link = shdr32.sh_link;
+  shdr.sh_info = shdr32.sh_info;
+  shdr.sh_addralign = shdr32.sh_addralign;
+  shdr.sh_entsize = shdr32.sh_entsize;
+  return shdr;
+}
+
+Elf64_Sym elf_symbol(uint8_t *buffer, Elf64_Shdr *symtab_hdr, uint32_t i)
+{
+  Elf64_Sym sym;
+  if (target64) {
+    memcpy(&sym, buffer + symtab_hdr->sh_offset + i * sizeof(sym), sizeof(sym));
+    return sym;
+  }
+  Elf32_Sym sym32;
+  memcpy(
+    &sym32, buffer + symtab_hdr->sh_offset + i * sizeof(sym32), sizeof(sym32)
+    );
+  sym.st_name = sym32.st_name;
+  sym.st_info = sym32.st_info;
+  sym.st_other = sym32.st_other;
+  sym.st_shndx = sym32.st_shndx;
+  sym.st_value = sym32.st_value;
+  sym.st_size = sym32.st_size;
+  return sym;
+}
+
+// .rel.text entries of i386 get an addend of 0; theirs is in the code
+Elf64_Rela elf_relocation(uint8_t *buffer, Elf64_Shdr *rel_hdr, uint32_t i)
+{
+  Elf64_Rela rela;
+  if (target64) {
+    memcpy(&rela, buffer + rel_hdr->sh_offset + i * sizeof(rela), sizeof(rela));
+    return rela;
+  }
+  Elf32_Rel rel;
+  memcpy(&rel, buffer + rel_hdr->sh_offset + i * sizeof(rel), sizeof(rel));
+  rela.r_offset = rel.r_offset;
+  rela.r_info =
+    ((uint64_t) ELF32_R_SYM(rel.r_info) << 32) | ELF32_R_TYPE(rel.r_info);
+  rela.r_addend = 0;
+  return rela;
+}
+
+uint32_t elf_entry_count(Elf64_Shdr *hdr, uint32_t size32, uint32_t size64)
+{
+  return hdr->sh_size / (target64 ? size64 : size32);
+}
+
+relocation_type_t elf_relocation_type(uint32_t type)
+{
+  if (!target64) return type == R_386_32 ? rIMM : rOFFSET;
+  switch (type) {
+  case R_X86_64_PC32: case R_X86_64_PLT32: return rOFFSET;
+  case R_X86_64_32: case R_X86_64_32S: return rIMM;
+  case R_X86_64_64: return rIMM64;
+  }
+  printf("Unsupported relocation type %u\n", type);
+  exit(1);
+}
+
+// the sections of an object file that the linker reads, by index. 0, the
+// null section, means that the section is missing
+typedef struct {
+  Elf64_Header hdr;
+  uint32_t symtab, rel_text, strtab;
+  uint32_t text, data, bss, rodata;
+} elf_object_t;
+
+// returns 0 if `buffer` is not an object file of the target's class
+uint8_t open_elf(elf_object_t *obj, uint8_t *buffer, uint32_t len)
+{
+  char elfmag[7] = { ELFMAG0, ELFMAG1, ELFMAG2, ELFMAG3, 1, 1, 1 };
+  if (target64) elfmag[4] = 2;
+  if (len < 5 || strncmp((char *)buffer, elfmag, 7) != 0)
+    return 0;
+
+  memset(obj, 0, sizeof(*obj));
+  if (target64) memcpy(&obj->hdr, buffer, sizeof(obj->hdr));
+  else {
+    Elf32_Header hdr32;
+    memcpy(&hdr32, buffer, sizeof(hdr32));
+    obj->hdr.e_shoff = hdr32.e_shoff;
+    obj->hdr.e_shentsize = hdr32.e_shentsize;
+    obj->hdr.e_shnum = hdr32.e_shnum;
+    obj->hdr.e_shstrndx = hdr32.e_shstrndx;
+  }
+
+  Elf64_Shdr shstrtab_hdr = elf_section(buffer, &obj->hdr, obj->hdr.e_shstrndx);
+  char *shstrtab = (char *)(buffer + shstrtab_hdr.sh_offset);
+  char *rel_text = target64 ? ".rela.text" : ".rel.text";
+  for (uint32_t i = 0; i < obj->hdr.e_shnum; ++i) {
+    char *name = shstrtab + elf_section(buffer, &obj->hdr, i).sh_name;
+    if (strcmp(name, ".symtab") == 0) obj->symtab = i;
+    if (strcmp(name, rel_text) == 0) obj->rel_text = i;
+    if (strcmp(name, ".strtab") == 0) obj->strtab = i;
+    if (strcmp(name, ".text") == 0) obj->text = i;
+    if (strcmp(name, ".data") == 0) obj->data = i;
+    if (strcmp(name, ".bss") == 0) obj->bss = i;
+    if (strcmp(name, ".rodata") == 0) obj->rodata = i;
+  }
+  return 1;
+}
+
+// the sections of an object file that the linker copies, in the order it
+// copies them
+typedef enum {
+  sTEXT, sDATA, sRODATA, sBSS, sEND
+} object_section_t;
+
+// a symbol that an object file defines in one of the sections it copies
+typedef struct {
+  char *name;
+  object_section_t section;
+  uint32_t value;
+  uint8_t global_func; // names the object file when ordering functions
+} object_symbol_t;
+
+// a relocation of the .text of an object file
+typedef struct {
+  uint32_t offset;
+  char *name;
+  relocation_type_t type;
+  int32_t addend;
+} object_relocation_t;
+
+// an object file of the archive, parsed once when the archive is loaded.
+// sections and names point into the archive. .bss has a size but no bytes
+typedef struct {
+  uint8_t *section[sEND];
+  uint32_t size[sEND];
+  object_symbol_t *syms;
+  uint32_t sym_count;
+  object_relocation_t *rels;
+  uint32_t rel_count;
+} object_t;
+
+object_t *archive_objects = NULL;
+uint32_t archive_object_count = 0;
+
+// adds the object file in `buffer` to archive_objects
+void index_elf(uint8_t *buffer, uint32_t len)
+{
+  elf_object_t obj;
+  if (!open_elf(&obj, buffer, len)) return;
+
+  archive_objects = realloc(
+    archive_objects, (archive_object_count + 1) * sizeof(object_t)
+    );
+  object_t *object = &archive_objects[archive_object_count++];
+  memset(object, 0, sizeof(*object));
+
+  // an object file without .text has its code copied from the null
+  // section, which is empty
+  uint32_t sections[sEND] = { obj.text, obj.data, obj.rodata, obj.bss };
+  for (object_section_t s = sTEXT; s < sEND; ++s) {
+    if (s != sTEXT && !sections[s]) continue;
+    Elf64_Shdr hdr = elf_section(buffer, &obj.hdr, sections[s]);
+    if (s != sBSS) object->section[s] = buffer + hdr.sh_offset;
+    object->size[s] = hdr.sh_size;
+  }
+
+  Elf64_Shdr strtab_hdr = elf_section(buffer, &obj.hdr, obj.strtab);
+  Elf64_Shdr symtab_hdr = elf_section(buffer, &obj.hdr, obj.symtab);
+  char *strtab = (char *)(buffer + strtab_hdr.sh_offset);
+  uint32_t sym_count =
+    elf_entry_count(&symtab_hdr, sizeof(Elf32_Sym), sizeof(Elf64_Sym));
+  object->syms = malloc(sym_count * sizeof(object_symbol_t));
+  for (uint32_t i = 0; i < sym_count; ++i) {
+    Elf64_Sym current = elf_symbol(buffer, &symtab_hdr, i);
+    object_section_t s = sTEXT;
+    while (s < sEND && !(sections[s] && current.st_shndx == sections[s])) ++s;
+    if (s == sEND) continue;
+    object->syms[object->sym_count++] = (object_symbol_t) {
+      .name = strtab + current.st_name, .section = s,
+      .value = current.st_value,
+      .global_func = ELF64_ST_TYPE(current.st_info) == STT_FUNC
+        && ELF64_ST_BIND(current.st_info) == STB_GLOBAL
+    };
+  }
+
+  if (!obj.rel_text) return;
+  Elf64_Shdr rel_hdr = elf_section(buffer, &obj.hdr, obj.rel_text);
+  uint32_t rel_count =
+    elf_entry_count(&rel_hdr, sizeof(Elf32_Rel), sizeof(Elf64_Rela));
+  object->rels = malloc(rel_count * sizeof(object_relocation_t));
+  for (uint32_t i = 0; i < rel_count; ++i) {
+    Elf64_Rela rel = elf_relocation(buffer, &rel_hdr, i);
+    Elf64_Sym sym = elf_symbol(buffer, &symtab_hdr, ELF64_R_SYM(rel.r_info));
+    object->rels[object->rel_count++] = (object_relocation_t) {
+      .offset = rel.r_offset, .name = strtab + sym.st_name,
+      .type = elf_relocation_type(ELF64_R_TYPE(rel.r_info)),
+      .addend = rel.r_addend
+    };
+  }
+}
+
+// links an object file of the archive into the executable
+void read_elf(object_t *object)
+{
+  // TODO data section stuff
+  uint32_t offsets[sEND];
+  offsets[sTEXT] = text_loc;
+  write_text(object->section[sTEXT], object->size[sTEXT]);
+  // the object file is named after its first global function
+  uint32_t unit = order_unit_count;
+  order_add_unit(offsets[sTEXT], NULL);
+
+  offsets[sDATA] = data_loc;
+  if (object->section[sDATA])
+    write_data(object->section[sDATA], object->size[sDATA]);
+  offsets[sRODATA] = data_loc;
+  if (object->section[sRODATA])
+    write_data(object->section[sRODATA], object->size[sRODATA]);
+  offsets[sBSS] = data_loc;
+  if (data_loc + object->size[sBSS] > DATA_CAP) {
+    printf("Too much data.\n");
+    exit(1);
+  }
+  memset(data + data_loc, 0, object->size[sBSS]);
+  data_loc += object->size[sBSS];
+
+  for (uint32_t i = 0; i < object->sym_count; ++i) {
+    object_symbol_t *current = &object->syms[i];
+    symbol_t sym; memset(&sym, 0, sizeof(sym));
+    sym.name = current->name;
+    sym.type = tINT;
+    sym.loc = offsets[current->section] + current->value;
+    sym.loc_type = current->section == sTEXT ? lTEXT : lDATA;
+    symtab_insert(root_symtab, sym);
+    if (
+      current->section == sTEXT && current->global_func
+      && unit < order_unit_count && order_units[unit].name == NULL
+      ) {
+      order_units[unit].name = current->name;
+    }
+  }
+
+  for (uint32_t i = 0; i < object->rel_count; ++i) {
+    object_relocation_t *rel = &object->rels[i];
+    add_relocation(
+      offsets[sTEXT] + rel->offset, rel->name, root_symtab, rel->type
+      );
+    if (target64) relocs->addend = rel->addend;
+  }
+}
+
+// the symbols that code in the archive refers to
+char **archive_refs = NULL;
+uint32_t archive_ref_count = 0;
+
+// records the symbols that the relocations of an object file refer to
+void scan_elf(object_t *object)
+{
+  for (uint32_t i = 0; i < object->rel_count; ++i) {
+    archive_refs = realloc(
+      archive_refs, (archive_ref_count + 1) * sizeof(char *)
+      );
+    archive_refs[archive_ref_count++] = object->rels[i].name;
+  }
+}
+
+// the archive is only read and parsed once and stays in memory, since the
+// symbols read from it point into it. --run-batch loads it before compiling
+// any of the programs it links with it, so that they all start from its
+// objects and only copy them into their executables
+char *archive_name = NULL;
+uint8_t *archive_buffer = NULL;
+uint32_t archive_len = 0;
+
+void load_archive(char *name)
+{
+  if (archive_name != NULL && strcmp(archive_name, name) == 0) return;
+  FILE *archive = fopen(name, "r");
+  if (archive == NULL) {
+    printf("Could not read archive %s\n", name);
+    exit(1);
+  }
+  fseek(archive, 0, SEEK_END);
+  archive_len = ftell(archive);
+  fseek(archive, 0, SEEK_SET);
+  archive_buffer = malloc(archive_len);
+  fread(archive_buffer, 1, archive_len, archive);
+  fclose(archive);
+  archive_name = name;
+
+  archive_object_count = 0;
+  if (
+    archive_len < 8 || strncmp((char *)archive_buffer, "!<arch>\n", 8) != 0
+    )
+    return;
+
+  uint32_t idx = 8;
+  while (idx < archive_len) {
+    archive_header_t *header = (archive_header_t *)(archive_buffer + idx);
+    uint32_t file_len = atoi(header->file_len);
+    index_elf(archive_buffer + idx + sizeof(archive_header_t), file_len);
+    idx += file_len + sizeof(archive_header_t);
+  }
+}
+
+// calls `read` on every object file in the archive
+void read_archive(char *name, void (*read)(object_t *object))
+{
+  load_archive(name);
+  for (uint32_t i = 0; i < archive_object_count; ++i)
+    read(&archive_objects[i]);
+}
+
+// removes the functions that `node`, its children or the nodes after it
+// name other than to call them from regparm_funcs
+void find_address_taken(ast_node_t *node)
+{
+  for (; node != NULL; node = node->next) {
+    ast_node_t *children = node->children;
+    if (node->type == nEXPR && node->variant == vIDENT) {
+      for (uint32_t i = 0; i < regparm_func_count; ++i)
+        if (strcmp(regparm_funcs[i].name, node->s) == 0)
+          regparm_funcs[i--] = regparm_funcs[--regparm_func_count];
+    }
+    if (
+      node->type == nEXPR && node->variant == vCALL
+      && children->variant == vIDENT
+      )
+      children = children->next;
+    find_address_taken(children);
+  }
+}
+
+// finds the functions that can take their first parameters in registers:
+// see regparm_of()
+void find_regparm_funcs(ast_node_t *ast)
+{
+  for (ast_node_t *current = ast; current != NULL; current = current->next) {
+    if (current->type != nFUNCTION) continue;
+    if (strcmp(current->s, "_start") == 0) continue;
+    uint32_t params = 0;
+    ast_node_t *child = current->children->next;
+    for (; child->type == nARGUMENT; child = child->next) ++params;
+    if (params == 0 || child->variant != vBLOCK) continue;
+
+    uint8_t referenced = 0;
+    for (uint32_t i = 0; i < archive_ref_count; ++i)
+      if (strcmp(archive_refs[i], current->s) == 0) referenced = 1;
+    if (referenced) continue;
+
+    regparm_funcs = realloc(
+      regparm_funcs, (regparm_func_count + 1) * sizeof(regparm_func_t)
+      );
+    regparm_funcs[regparm_func_count++] = (regparm_func_t) {
+      .name = current->s,
+      .regparm = params < IR_REGPARM ? params : IR_REGPARM
+    };
+  }
+  find_address_taken(ast);
+}
+
+// interprocedural constant propagation, run over the whole program at -O2
+// between simplify() and codegen(). calls to pure functions whose arguments
+// are all constants are evaluated at compile time and replaced with their
+// result, and a parameter that is given the same constant at every call site
+// becomes a local variable set to it, with the argument dropped from the
+// calls. the second is only done for functions that are called by name from
+// this file alone, like passing parameters in registers.
+//
+// a function is pure if its result only depends on its arguments: it reads
+// and writes nothing but its own variables, uses no pointers or strings and
+// only calls pure functions. evaluation interprets the AST with the same
+// typing as codegen, and gives up after IPA_EVAL_STEPS steps or on anything
+// that would trap or read an unset variable at runtime
+#define IPA_EVAL_STEPS 20000
+
+typedef struct ipa_func_s {
+  ast_node_t *node;
+  symbol_type_t type; // the return type
+  uint8_t pure;
+  uint8_t internal; // only ever called by name from this file
+} ipa_func_t;
+
+ipa_func_t *ipa_funcs = NULL;
+uint32_t ipa_func_count = 0;
+
+// the calls by name to functions defined in this file, innermost first
+ast_node_t **ipa_calls = NULL;
+uint32_t ipa_call_count = 0;
+
+ipa_func_t *ipa_func(char *name)
+{
+  for (uint32_t i = 0; i < ipa_func_count; ++i)
+    if (strcmp(ipa_funcs[i].node->s, name) == 0) return ipa_funcs + i;
+  return NULL;
+}
+
+scope_t *scope_find(scope_t *scope, char *name)
+{
+  for (; scope != NULL; scope = scope->next)
+    if (strcmp(scope->name, name) == 0) return scope;
+  return NULL;
+}
+
+ast_node_t *new_node(ast_node_type_t type, ast_node_variant_t variant)
+{
+  ast_node_t *node = malloc(sizeof(ast_node_t));
+  memset(node, 0, sizeof(ast_node_t));
+  node->type = type;
+  node->variant = variant;
+  return node;
+}
+
+// the function defined in this file that `call` calls by name, if any.
+// `scope` holds the local variables, which hide functions
+ipa_func_t *ipa_callee(ast_node_t *call, scope_t *scope)
+{
+  ast_node_t *callee = call->children;
+  if (callee->variant != vIDENT || scope_find(scope, callee->s)) return NULL;
+  return ipa_func(callee->s);
+}
+
+// records the calls in `expr`, and the functions it names other than to
+// call them
+void ipa_collect_expr(ast_node_t *expr, scope_t *scope)
+{
+  ast_node_t *c = expr->children;
+  if (expr->variant == vCALL && c->variant == vIDENT) c = c->next;
+  for (; c != NULL; c = c->next) ipa_collect_expr(c, scope);
+
+  ipa_func_t *f;
+  if (expr->variant == vIDENT && !scope_find(scope, expr->s)) {
+    f = ipa_func(expr->s);
+    if (f != NULL) f->internal = 0;
+  }
+  if (expr->variant == vCALL && (f = ipa_callee(expr, scope)) != NULL) {
+    ipa_calls = realloc(ipa_calls, (ipa_call_count + 1) * sizeof(ast_node_t *));
+    ipa_calls[ipa_call_count++] = expr;
+  }
+}
+
+scope_t *ipa_collect_stmt(ast_node_t *stmt, scope_t *scope)
+{
+  if (stmt->variant == vDECL)
+    return scope_push(scope, stmt->s, symbol_type_of_node_type(stmt->children), 0);
+  if (stmt->type == nEXPR) {
+    ipa_collect_expr(stmt, scope);
+    return scope;
+  }
+  scope_t *inner = scope;
+  for (ast_node_t *c = stmt->children; c != NULL; c = c->next)
+    inner = ipa_collect_stmt(c, stmt->variant == vBLOCK ? inner : scope);
+  return scope;
+}
+
+// the local scope of a function: its parameters
+scope_t *ipa_params(ast_node_t *fn)
+{
+  scope_t *scope = NULL;
+  ast_node_t *arg = fn->children->next;
+  for (; arg->type == nARGUMENT; arg = arg->next)
+    scope = scope_push(
+      scope, arg->s, symbol_type_of_node_type(arg->children), 0
+      );
+  return scope;
+}
+
+ast_node_t *ipa_body(ast_node_t *fn)
+{
+  ast_node_t *body = fn->children->next;
+  while (body->type == nARGUMENT) body = body->next;
+  return body;
+}
+
+void ipa_collect(ast_node_t *ast)
+{
+  ipa_call_count = 0;
+  for (ast_node_t *current = ast; current != NULL; current = current->next)
+    if (current->type == nFUNCTION)
+      ipa_collect_stmt(ipa_body(current), ipa_params(current));
+}
+
+// whether `node` only uses the variables in `scope` and calls pure functions
+uint8_t ipa_pure_expr(ast_node_t *expr, scope_t *scope)
+{
+  switch (expr->variant) {
+  case vSTRING_LITERAL: case vDEREF: case vADDRESSOF: return 0;
+  case vIDENT: return scope_find(scope, expr->s) != NULL;
+  default: ;
+  }
+
+  ast_node_t *c = expr->children;
+  if (expr->variant == vCALL) {
+    ipa_func_t *f = ipa_callee(expr, scope);
+    if (f == NULL || !f->pure) return 0;
+    c = c->next;
+  }
+  for (; c != NULL; c = c->next)
+    if (!ipa_pure_expr(c, scope)) return 0;
+  return 1;
+}
+
+uint8_t ipa_pure_stmt(ast_node_t *stmt, scope_t **scope)
+{
+  if (stmt->variant == vDECL) {
+    symbol_type_t type = symbol_type_of_node_type(stmt->children);
+    *scope = scope_push(*scope, stmt->s, type, 0);
+    return 1;
+  }
+  if (stmt->type == nEXPR) return ipa_pure_expr(stmt, *scope);
+  scope_t *inner = *scope;
+  for (ast_node_t *c = stmt->children; c != NULL; c = c->next) {
+    scope_t *s = *scope;
+    if (!ipa_pure_stmt(c, stmt->variant == vBLOCK ? &inner : &s)) return 0;
+  }
+  return 1;
+}
+
+// the variables of the functions being evaluated. those of the innermost
+// call start at `ipa_frame`
+typedef struct ipa_var_s {
+  char *name;
+  symbol_type_t type;
+  int32_t v;
+  uint8_t set;
+} ipa_var_t;
+
+ipa_var_t *ipa_vars = NULL;
+uint32_t ipa_var_count = 0;
+uint32_t ipa_frame = 0;
+uint32_t ipa_steps = 0; // left until evaluation gives up
 
-    // cmpl $0, %eax
-    // je else_start
-    // <if block>
-    // jmp else_end
-    // else_start:
-    // <else block>
-    // else_end:
+typedef enum {
+  eNEXT, eBREAK, eCONTINUE, eRETURN, eFAIL
+} ipa_flow_t;
 
-    uint8_t tmp[3] = { 0x83, 0xf8, 0x00 };
-    write_text(tmp, 3);
+// a value stored into a variable of type `type`
+int32_t ipa_narrow(symbol_type_t type, int32_t v)
+{
+  return type == tCHAR ? (int8_t) v : v;
+}
 
-    uint32_t je_addr = text_loc;
-    text_loc += 6;
-    uint32_t if_start = text_loc;
-    codegen_stmt(stmt->children->next, symtab, block_id, continues, breaks);
+void ipa_declare(char *name, symbol_type_t type, int32_t v, uint8_t set)
+{
+  ipa_vars = realloc(ipa_vars, (ipa_var_count + 1) * sizeof(ipa_var_t));
+  ipa_vars[ipa_var_count++] = (ipa_var_t) {
+    .name = name, .type = type, .v = ipa_narrow(type, v), .set = set
+  };
+}
 
-    uint32_t jmp_addr = text_loc;
-    text_loc += 5;
+ipa_var_t *ipa_var(char *name)
+{
+  for (uint32_t i = ipa_var_count; i > ipa_frame; --i)
+    if (strcmp(ipa_vars[i - 1].name, name) == 0) return ipa_vars + i - 1;
+  return NULL;
+}
 
-    uint32_t else_start = text_loc;
-    codegen_stmt(stmt->children->next->next, symtab, block_id, continues, breaks);
-    uint32_t else_end = text_loc;
+uint8_t ipa_eval_call(ipa_func_t *f, ast_node_t *call, int32_t *out);
 
-    uint32_t je_offset = else_start - if_start;
-    if ((je_offset + 4) < 256) {
-      uint8_t tmp1[6] = { 0x74, (je_offset + 4) & 0xff, 0x90, 0x90, 0x90, 0x90 };
-      memcpy(text + je_addr, tmp1, 6);
-    } else {
-      uint8_t tmp1[6] = { 0x0f, 0x84, 0x00, 0x00, 0x00, 0x00 };
-      for (uint32_t i = 2; i < 6; ++i) {
-        tmp1[i] = je_offset & 0xff;
-        je_offset >>= 8;
-      }
-      memcpy(text + je_addr, tmp1, 6);
-    }
+// evaluates `expr`, returns 0 if it cannot be done at compile time
+uint8_t ipa_eval(ast_node_t *expr, int32_t *out, symbol_type_t *type)
+{
+  if (ipa_steps == 0) return 0;
+  --ipa_steps;
+
+  ast_node_t *left = expr->children;
+  ipa_var_t *var;
+  int32_t l, r;
+  symbol_type_t lt, rt;
+  switch (expr->variant) {
+  case vINT_LITERAL: case vCHAR_LITERAL:
+    *type = expr->variant == vINT_LITERAL ? tINT : tCHAR;
+    *out = ipa_narrow(*type, expr->i);
+    return 1;
 
-    uint32_t jmp_offset = else_end - else_start;
-    if ((jmp_offset + 3) < 256) {
-      uint8_t tmp2[5] = { 0xeb, (jmp_offset + 3) & 0xff, 0x90, 0x90, 0x90 };
-      memcpy(text + jmp_addr, tmp2, 5);
-    } else {
-      uint8_t tmp2[5] = { 0xe9, 0x00, 0x00, 0x00, 0x00 };
-      for (uint32_t i = 1; i < 5; ++i) {
-        tmp2[i] = jmp_offset & 0xff;
-        jmp_offset >>= 8;
-      }
-      memcpy(text + jmp_addr, tmp2, 5);
-    }
-  }
+  case vIDENT:
+    var = ipa_var(expr->s);
+    if (var == NULL || !var->set) return 0;
+    *out = var->v;
+    *type = var->type;
+    return 1;
 
-  if (stmt->variant == vWHILE) {
-    uint32_t cond_start = text_loc;
-    codegen_expr(stmt->children, symtab);
-    uint8_t tmp[3] = { 0x83, 0xf8, 0x00 };
-    write_text(tmp, 3);
-
-    uint32_t je_addr = text_loc;
-    text_loc += 6;
-    uint32_t while_start = text_loc;
-
-    uint32_t cs[256]; memset(cs, 0, sizeof(cs));
-    uint32_t bs[256]; memset(bs, 0, sizeof(bs));
-    codegen_stmt(stmt->children->next, symtab, block_id, cs, bs);
-
-    uint32_t jmp_addr = text_loc;
-    text_loc += 5;
-    uint32_t while_end = text_loc;
-
-    uint32_t je_offset = while_end - while_start;
-    if ((je_offset + 4) < 256) {
-      uint8_t tmp1[6] = { 0x74, (je_offset + 4) & 0xff, 0x90, 0x90, 0x90, 0x90 };
-      memcpy(text + je_addr, tmp1, 6);
-    } else {
-      uint8_t tmp1[6] = { 0x0f, 0x84, 0x00, 0x00, 0x00, 0x00 };
-      for (uint32_t i = 2; i < 6; ++i) {
-        tmp1[i] = je_offset & 0xff;
-        je_offset >>= 8;
-      }
-      memcpy(text + je_addr, tmp1, 6);
-    }
+  case vASSIGN:
+    // the value of an assignment is that of its right side. calls in it
+    // may move the variables
+    if (!ipa_eval(left->next, out, type)) return 0;
+    var = ipa_var(left->s);
+    if (var == NULL) return 0;
+    var->v = ipa_narrow(var->type, *out);
+    var->set = 1;
+    *type = tINT;
+    return 1;
 
-    uint32_t jmp_offset = while_end - cond_start;
-    if (jmp_offset - 3 < 256) {
-      uint8_t tmp2[5] = { 0xeb, (256 - (jmp_offset - 3)) & 0xff, 0x90, 0x90, 0x90 };
-      memcpy(text + jmp_addr, tmp2, 5);
-    } else {
-      uint8_t tmp2[5] = { 0xe9, 0x00, 0x00, 0x00, 0x00 };
-      jmp_offset = -jmp_offset;
-      for (uint32_t i = 1; i < 5; ++i) {
-        tmp2[i] = jmp_offset & 0xff;
-        jmp_offset >>= 8;
-      }
-      memcpy(text + jmp_addr, tmp2, 5);
-    }
+  case vINCREMENT: case vDECREMENT:
+    var = ipa_var(left->s);
+    if (var == NULL || !var->set) return 0;
+    var->v = ipa_narrow(
+      var->type, (uint32_t) var->v + (expr->variant == vINCREMENT ? 1 : -1)
+      );
+    *out = var->v;
+    *type = var->type;
+    return 1;
 
-    // fill in continue statements
-    uint32_t ci = 0;
-    while (cs[ci]) {
-      uint32_t offset = cs[ci] - cond_start;
-      if (offset + 2 < 256) {
-        uint8_t tmp2[5] = { 0xeb, (256 - (offset + 2)) & 0xff, 0x90, 0x90, 0x90 };
-        memcpy(text + cs[ci], tmp2, 5);
-      } else {
-        uint8_t tmp2[5] = { 0xe9, 0x00, 0x00, 0x00, 0x00 };
-        offset = -(offset + 5);
-        for (uint32_t i = 1; i < 5; ++i) {
-          tmp2[i] = offset & 0xff;
-          offset >>= 8;
-        }
-        memcpy(text + cs[ci], tmp2, 5);
-      }
-      ++ci;
-    }
+  case vNOT: case vBIT_NOT:
+    if (!ipa_eval(left, &l, type)) return 0;
+    *out = expr->variant == vNOT ? !l : ~l;
+    if (expr->variant == vNOT) *type = tCHAR;
+    return 1;
 
-    // fill in break statements
-    uint32_t bi = 0;
-    while (bs[bi]) {
-      uint32_t offset = while_end - (bs[bi] + 5);
-      if ((offset + 3) < 256) {
-        uint8_t tmp2[5] = { 0xeb, (offset + 3) & 0xff, 0x90, 0x90, 0x90 };
-        memcpy(text + bs[bi], tmp2, 5);
-      } else {
-        uint8_t tmp2[5] = { 0xe9, 0x00, 0x00, 0x00, 0x00 };
-        for (uint32_t i = 1; i < 5; ++i) {
-          tmp2[i] = offset & 0xff;
-          offset >>= 8;
-        }
-        memcpy(text + bs[bi], tmp2, 5);
-      }
-      ++bi;
-    }
+  case vCALL: {
+    ipa_func_t *f = ipa_func(left->s);
+    *type = f->type;
+    return ipa_eval_call(f, expr, out);
   }
-}
 
-void codegen(ast_node_t *ast)
-{
-  ast_node_t *current = ast;
-  while (current != NULL) {
-    uint32_t size = construct_symtab(current, root_symtab, NULL, 0, 0);
+  default: ;
+  }
 
-    if (current->type == nSTMT) {
-      if (data_loc + size > DATA_CAP) {
-        printf("Too much data.\n");
-        exit(1);
-      }
-      data_loc += size;
-      current = current->next;
-      continue;
-    }
+  if (!ipa_eval(left, &l, &lt) || !ipa_eval(left->next, &r, &rt)) return 0;
+  if (!fold_binary(expr->variant, l, r, out)) return 0;
+  switch (expr->variant) {
+  case vLT: case vGT: case vEQUAL: case vAND: case vOR:
+    *type = tINT;
+    return 1;
+  default: ;
+  }
 
-    ast_node_t *current_child = current->children;
-    while (current_child->type != nSTMT) current_child = current_child->next;
-    if (current_child->variant != vBLOCK) {
-      current = current->next; continue;
-    }
+  // an operator on two chars produces a char. codegen does not wrap the
+  // quotient of -128 / -1, so that is left to runtime
+  *type = lt == tCHAR ? rt : lt;
+  if (lt != tCHAR || rt != tCHAR) return 1;
+  if (expr->variant == vDIVIDE && *out != (int8_t) *out) return 0;
+  *out = (int8_t) *out;
+  return 1;
+}
 
-    // function preamble:
-    //   pushl %ebp
-    //   movl %esp, %ebp
-    uint8_t tmp[3] = { 0x55, 0x89, 0xe5 };
-    write_text(tmp, 3);
+ipa_flow_t ipa_exec(ast_node_t *stmt, int32_t *ret)
+{
+  if (ipa_steps == 0) return eFAIL;
+  --ipa_steps;
+
+  int32_t v;
+  symbol_type_t t;
+  ipa_flow_t flow = eNEXT;
+  switch (stmt->variant) {
+  case vDECL:
+    ipa_declare(stmt->s, symbol_type_of_node_type(stmt->children), 0, 0);
+    return eNEXT;
+  case vEXPR: return ipa_eval(stmt->children, &v, &t) ? eNEXT : eFAIL;
+  case vRETURN:
+    if (stmt->children == NULL || !ipa_eval(stmt->children, ret, &t))
+      return eFAIL;
+    return eRETURN;
+  case vBREAK: return eBREAK;
+  case vCONTINUE: return eCONTINUE;
+
+  case vBLOCK: {
+    uint32_t count = ipa_var_count;
+    for (ast_node_t *c = stmt->children; c != NULL && flow == eNEXT; c = c->next)
+      flow = ipa_exec(c, ret);
+    ipa_var_count = count;
+    return flow;
+  }
 
-    // subl <stacksize>, %esp
-    tmp[0] = 0x81; tmp[1] = 0xec;
-    write_text(tmp, 2);
-    for (uint32_t i = 0; i < 4; ++i) {
-      uint8_t tmp0 = size;
-      write_text(&tmp0, 1);
-      size >>= 8;
+  case vIF:
+    if (!ipa_eval(stmt->children, &v, &t)) return eFAIL;
+    return ipa_exec(v ? stmt->children->next : stmt->children->next->next, ret);
+
+  case vWHILE:
+    while (1) {
+      if (!ipa_eval(stmt->children, &v, &t)) return eFAIL;
+      if (!v) return eNEXT;
+      flow = ipa_exec(stmt->children->next, ret);
+      if (flow == eBREAK) return eNEXT;
+      if (flow == eRETURN || flow == eFAIL) return flow;
     }
 
-    symbol_t *symtab = symtab_get(root_symtab, current->s)->child;
-    uint32_t block_id = 0;
-    codegen_stmt(current_child, symtab, &block_id, NULL, NULL);
+  default: return eNEXT;
+  }
+}
 
-    // function epilogue:
-    //   leave
-    //   retl
-    tmp[0] = 0xc9; tmp[1] = 0xc3;
-    write_text(tmp, 2);
+// evaluates the call `call` to the pure function `f`. parameters take their
+// arguments like variables of their type, and the result is returned like a
+// value of the return type
+uint8_t ipa_eval_call(ipa_func_t *f, ast_node_t *call, int32_t *out)
+{
+  uint32_t n = 0;
+  ast_node_t *arg, *param;
+  for (arg = call->children->next; arg != NULL; arg = arg->next) ++n;
+  int32_t *args = malloc((n + 1) * sizeof(int32_t));
+  symbol_type_t t;
+  uint8_t ok = 1;
+  n = 0;
+  for (arg = call->children->next; arg != NULL && ok; arg = arg->next)
+    ok = ipa_eval(arg, args + n++, &t);
+
+  uint32_t count = ipa_var_count, frame = ipa_frame;
+  uint32_t i = 0;
+  param = f->node->children->next;
+  for (; param->type == nARGUMENT; param = param->next, ++i) {
+    if (i >= n) ok = 0;
+    t = symbol_type_of_node_type(param->children);
+    ipa_declare(param->s, t, ok ? args[i] : 0, 1);
+  }
+  free(args);
+
+  ipa_frame = count;
+  ok = ok && ipa_exec(param, out) == eRETURN;
+  *out = ipa_narrow(f->type, *out);
+  ipa_var_count = count;
+  ipa_frame = frame;
+  return ok;
+}
 
-    current = current->next;
+// replaces the calls to pure functions whose arguments are all constants
+// with their results. returns whether it replaced any
+uint8_t ipa_fold_calls(ast_node_t *ast)
+{
+  uint8_t changed = 0;
+  ipa_collect(ast);
+  for (uint32_t i = 0; i < ipa_call_count; ++i) {
+    ast_node_t *call = ipa_calls[i];
+    ipa_func_t *f = ipa_func(call->children->s);
+    if (!f->pure || (f->type != tINT && f->type != tCHAR)) continue;
+    uint8_t constant = 1;
+    for (ast_node_t *arg = call->children->next; arg != NULL; arg = arg->next)
+      if (!is_literal(arg)) constant = 0;
+    if (!constant) continue;
+
+    int32_t v;
+    ipa_steps = IPA_EVAL_STEPS;
+    ipa_var_count = ipa_frame = 0;
+    if (!ipa_eval_call(f, call, &v)) continue;
+    make_literal(call, f->type, v);
+    changed = 1;
   }
+  return changed;
 }
 
-void relocate()
+// turns the parameters of `f` that every call passes the same constant into
+// local variables set to it, and drops them from the calls. returns whether
+// there were any
+uint8_t ipa_propagate_args(ipa_func_t *f)
 {
-  relocation_t *current = relocs;
-  while (current != NULL) {
-    symbol_t *sym = symtab_get(current->symtab, current->name);
-    if (sym == NULL || sym->loc == (uint32_t) -1) {
-      printf("Undefined symbol %s\n", current->name);
-      exit(1);
+  ast_node_t *fn = f->node, *body = ipa_body(fn);
+  uint32_t calls = 0;
+  for (uint32_t i = 0; i < ipa_call_count; ++i)
+    if (ipa_calls[i]->variant == vCALL && ipa_func(ipa_calls[i]->children->s) == f)
+      ++calls;
+  if (calls == 0 || !f->internal) return 0;
+
+  uint8_t changed = 0;
+  ast_node_t **param = &(fn->children->next);
+  uint32_t index = 0;
+  while ((*param)->type == nARGUMENT) {
+    ast_node_t *p = *param;
+    symbol_type_t type = symbol_type_of_node_type(p->children);
+    uint8_t constant = 1, seen = 0;
+    int32_t value = 0;
+    for (uint32_t i = 0; i < ipa_call_count && constant; ++i) {
+      ast_node_t *call = ipa_calls[i];
+      if (call->variant != vCALL || ipa_func(call->children->s) != f) continue;
+      ast_node_t *arg = call->children->next;
+      for (uint32_t j = 0; j < index && arg != NULL; ++j) arg = arg->next;
+      if (arg == NULL || !is_literal(arg)) constant = 0;
+      else if (seen && ipa_narrow(type, arg->i) != value) constant = 0;
+      else value = ipa_narrow(type, arg->i);
+      seen = 1;
+    }
+    // a variable of the same name declared in the body would clash
+    for (ast_node_t *c = body->children; c != NULL && constant; c = c->next)
+      if (c->variant == vDECL && strcmp(c->s, p->s) == 0) constant = 0;
+    if (!constant) {
+      param = &(p->next);
+      ++index;
+      continue;
     }
 
-    uint32_t addr = DATA_START + sym->loc;
-    if (sym->loc_type == lTEXT) addr = TEXT_START + sym->loc;
-
-    if (current->type == rMOV_EAX) {
-      uint8_t tmp[5];
-      tmp[0] = 0xb8;
-      for (uint32_t i = 1; i < 5; ++i) {
-        tmp[i] = addr & 0xff;
-        addr >>= 8;
-      }
-      memcpy(text + current->addr, tmp, sizeof(tmp));
+    // <type> <param>;
+    // <param> = <value>;
+    ast_node_t *decl = new_node(nSTMT, vDECL);
+    decl->s = p->s;
+    decl->children = p->children;
+    ast_node_t *stmt = new_node(nSTMT, vEXPR);
+    ast_node_t *assign = new_node(nEXPR, vASSIGN);
+    assign->children = new_node(nEXPR, vIDENT);
+    assign->children->s = p->s;
+    assign->children->next = new_node(nEXPR, vINT_LITERAL);
+    make_literal(assign->children->next, type == tCHAR ? tCHAR : tINT, value);
+    stmt->children = assign;
+    decl->next = stmt;
+    stmt->next = body->children;
+    body->children = decl;
+
+    for (uint32_t i = 0; i < ipa_call_count; ++i) {
+      ast_node_t *call = ipa_calls[i];
+      if (call->variant != vCALL || ipa_func(call->children->s) != f) continue;
+      ast_node_t **arg = &(call->children->next);
+      for (uint32_t j = 0; j < index; ++j) arg = &((*arg)->next);
+      *arg = (*arg)->next;
     }
+    *param = p->next;
+    changed = 1;
+  }
+  return changed;
+}
 
-    if (current->type == rOFFSET || current->type == rIMM) {
-      uint32_t offset = addr;
-      if (current->type == rOFFSET)
-        offset = addr - (current->addr + TEXT_START) - 4;
-      uint8_t tmp[4];
-      for (uint32_t i = 0; i < 4; ++i) {
-        tmp[i] = offset & 0xff;
-        offset >>= 8;
+void ipcp(ast_node_t *ast)
+{
+  for (ast_node_t *current = ast; current != NULL; current = current->next) {
+    if (current->type != nFUNCTION || ipa_body(current)->variant != vBLOCK)
+      continue;
+    uint8_t referenced = strcmp(current->s, "_start") == 0;
+    for (uint32_t i = 0; i < archive_ref_count; ++i)
+      if (strcmp(archive_refs[i], current->s) == 0) referenced = 1;
+    ipa_funcs = realloc(ipa_funcs, (ipa_func_count + 1) * sizeof(ipa_func_t));
+    ipa_funcs[ipa_func_count++] = (ipa_func_t) {
+      .node = current,
+      .type = symbol_type_of_node_type(current->children),
+      .pure = 1,
+      .internal = !referenced
+    };
+  }
+  ipa_collect(ast);
+
+  // a function is impure if it does anything else than calling pure
+  // functions, so purity is found by removing those from the set of all
+  // functions until nothing changes
+  uint8_t changed = 1;
+  while (changed) {
+    changed = 0;
+    for (uint32_t i = 0; i < ipa_func_count; ++i) {
+      ipa_func_t *f = ipa_funcs + i;
+      scope_t *scope = ipa_params(f->node);
+      if (f->pure && !ipa_pure_stmt(ipa_body(f->node), &scope)) {
+        f->pure = 0;
+        changed = 1;
       }
-      memcpy(text + current->addr, tmp, sizeof(tmp));
     }
+  }
 
-    current = current->next;
+  // folding calls gives other calls constant arguments, and parameters
+  // that become variables can let calls be folded
+  changed = 1;
+  for (uint32_t round = 0; round < 4 && changed; ++round) {
+    changed = ipa_fold_calls(ast);
+    if (changed) simplify(ast);
+    ipa_collect(ast);
+    for (uint32_t i = 0; i < ipa_func_count; ++i)
+      changed |= ipa_propagate_args(ipa_funcs + i);
   }
 }
 
-void write_elf(FILE *out)
+// profile-guided optimization: -fprofile-generate counts how often every
+// function is called, each branch of every if is taken and every while
+// loop is entered and goes around, and writes the counts to the profile
+// when the program calls exit. -fprofile-use reads them back and attaches
+// them to the same statements, and lowering gives them to the IR blocks
+// for layout, inlining and unrolling. the counters of a function are
+// numbered in the order of its statements: its entry, then two for every
+// if (then, else) and two for every while (entries, iterations).
+//
+// the profile is the start of the data section, written out as it is:
+//   "nprf", <function count>
+//   for every function: <hash>, <counter count>, <name, padded to a word>,
+//                       <counters>
+// a function is matched by name and by a hash of its syntax tree, so that
+// the counts of a function that has changed since are not used
+#define PROFILE_MAGIC 0x6672706e
+
+uint32_t profile_start = 0, profile_size = 0, profile_file = 0;
+uint8_t profile_exits = 0; // some call to exit goes through profile.exit
+
+typedef struct profile_func_s {
+  uint32_t next; // the next counter
+  uint32_t addr; // -fprofile-generate: the address of the counters
+  uint32_t *counts; // -fprofile-use: their values
+} profile_func_t;
+
+uint32_t profile_counters(ast_node_t *stmt)
 {
-  uint32_t entry = TEXT_START;
-  symbol_t *start = symtab_get(root_symtab, "_start");
-  if (start != NULL) entry = TEXT_START + start->loc;
-  else printf("Cannot find entry symbol _start; defaulting to %#x\n", entry);
-
-  Elf32_Header ehdr;
-  memset(&ehdr, 0, sizeof(ehdr));
-  ehdr.e_ident[0] = ELFMAG0; ehdr.e_ident[1] = ELFMAG1;
-  ehdr.e_ident[2] = ELFMAG2; ehdr.e_ident[3] = ELFMAG3;
-  ehdr.e_ident[4] = 1; ehdr.e_ident[5] = 1; ehdr.e_ident[6] = 1;
-  ehdr.e_type = ET_EXEC;
-  ehdr.e_machine = 3;
-  ehdr.e_version = 1;
-  ehdr.e_phnum = 2;
-  ehdr.e_phentsize = sizeof(Elf32_Phdr);
-  ehdr.e_phoff = sizeof(ehdr);
-  ehdr.e_ehsize = sizeof(ehdr);
-  ehdr.e_entry = entry;
-
-  Elf32_Phdr text_hdr;
-  memset(&text_hdr, 0, sizeof(text_hdr));
-  text_hdr.p_type = PT_LOAD;
-  text_hdr.p_offset = sizeof(ehdr) + (2*sizeof(Elf32_Phdr)) + data_loc;
-  text_hdr.p_vaddr = TEXT_START;
-  text_hdr.p_memsz = text_loc;
-  text_hdr.p_filesz = text_loc;
-  text_hdr.p_flags |= PF_X;
-
-  Elf32_Phdr data_hdr;
-  memset(&data_hdr, 0, sizeof(data_hdr));
-  data_hdr.p_type = PT_LOAD;
-  data_hdr.p_offset = sizeof(ehdr) + (2*sizeof(Elf32_Phdr));
-  data_hdr.p_vaddr = DATA_START;
-  data_hdr.p_memsz = data_loc;
-  data_hdr.p_filesz = data_loc;
+  uint32_t n = 0;
+  switch (stmt->variant) {
+  case vBLOCK:
+    for (ast_node_t *c = stmt->children; c != NULL; c = c->next)
+      n += profile_counters(c);
+    return n;
+  case vIF:
+    return 2 + profile_counters(stmt->children->next)
+      + profile_counters(stmt->children->next->next);
+  case vWHILE:
+    return 2 + profile_counters(stmt->children->next);
+  default: return 0;
+  }
+}
 
-  fwrite(&ehdr, sizeof(ehdr), 1, out);
-  fwrite(&data_hdr, sizeof(data_hdr), 1, out);
-  fwrite(&text_hdr, sizeof(text_hdr), 1, out);
-  fwrite(data, data_loc, 1, out);
-  fwrite(text, text_loc, 1, out);
+// a hash of the kinds of the nodes in `node` and its siblings, and how they
+// nest
+uint32_t profile_hash(ast_node_t *node, uint32_t h)
+{
+  for (; node != NULL; node = node->next) {
+    h = (h << 5) + h + 64 * node->type + node->variant;
+    h = profile_hash(node->children, h);
+    h = (h << 5) + h;
+  }
+  return h;
+}
 
-#ifdef NANOC_DEBUG
-  printf("text offset for objdumping: %#x\n", text_hdr.p_offset);
-#endif
+// ++(*<counter i>);
+ast_node_t *profile_increment(profile_func_t *pf, uint32_t i)
+{
+  ast_node_t *stmt = new_node(nSTMT, vEXPR);
+  stmt->children = new_node(nEXPR, vINCREMENT);
+  stmt->children->children = new_node(nEXPR, vDEREF);
+  stmt->children->children->children = new_node(nEXPR, vINT_LITERAL);
+  stmt->children->children->children->i = pf->addr + 4 * i;
+  return stmt;
 }
 
-struct archive_header_s {
-  char ident[16];
-  char mod_time[12];
-  char owner_id[6];
-  char group_id[6];
-  char file_mode[8];
-  char file_len[10];
-  char end[2];
-} __attribute__((packed));
-typedef struct archive_header_s archive_header_t;
+// starts the statement at `link` with an increment of counter i, making it
+// a block if it is not one
+void profile_count_at(ast_node_t **link, profile_func_t *pf, uint32_t i)
+{
+  ast_node_t *stmt = *link;
+  if (stmt->variant != vBLOCK) {
+    ast_node_t *block = new_node(nSTMT, vBLOCK);
+    block->children = stmt;
+    block->next = stmt->next;
+    stmt->next = NULL;
+    *link = stmt = block;
+  }
+  ast_node_t *inc = profile_increment(pf, i);
+  inc->next = stmt->children;
+  stmt->children = inc;
+}
 
-void read_elf(uint8_t *buffer, uint32_t len)
+// counts the statement at `link` and the ones in it. returns the link that
+// points to it, which changes when an increment goes in front of it
+ast_node_t **profile_stmt(ast_node_t **link, profile_func_t *pf)
 {
-  // TODO data section stuff
-  char elfmag[7] = { ELFMAG0, ELFMAG1, ELFMAG2, ELFMAG3, 1, 1, 1 };
-  if (len < 5 || strncmp((char *)buffer, elfmag, 7) != 0)
-    return;
+  ast_node_t *stmt = *link;
+  uint32_t i = pf->next;
+  switch (stmt->variant) {
+  case vBLOCK:
+    for (ast_node_t **c = &stmt->children; *c != NULL; c = &(*c)->next)
+      c = profile_stmt(c, pf);
+    return link;
+
+  case vIF:
+    pf->next += 2;
+    if (profile_use != NULL) stmt->counts = pf->counts + i;
+    else {
+      profile_count_at(&stmt->children->next, pf, i);
+      profile_count_at(&stmt->children->next->next, pf, i + 1);
+    }
+    profile_stmt(&stmt->children->next, pf);
+    profile_stmt(&stmt->children->next->next, pf);
+    return link;
 
-  Elf32_Header *hdr = (Elf32_Header *)buffer;
-  Elf32_Shdr *shstrtab_hdr =
-    (Elf32_Shdr *)(buffer + hdr->e_shoff + (hdr->e_shstrndx * hdr->e_shentsize));
-  char *shstrtab = (char *)(buffer + shstrtab_hdr->sh_offset);
-
-  Elf32_Shdr *symtab_hdr = NULL, *rel_text_hdr = NULL, *strtab_hdr = NULL;
-  Elf32_Shdr *text_hdr = NULL, *data_hdr = NULL, *bss_hdr = NULL, *rodata_hdr = NULL;
-  uint32_t text_idx = 0, data_idx = 0, bss_idx = 0, rodata_idx = 0, unused_idx = 0;
-
-  for (uint32_t i = 0; i < hdr->e_shnum; ++i) {
-    Elf32_Shdr *current =
-      (Elf32_Shdr *)(buffer + hdr->e_shoff + (hdr->e_shentsize * i));
-
-#define FIND_SECTION(name, hdr, idx)                        \
-    if (strcmp(shstrtab + current->sh_name, (name)) == 0) { \
-      (idx) = i;                                            \
-      (hdr) = current; continue;                            \
-    }
-
-    FIND_SECTION(".symtab", symtab_hdr, unused_idx);
-    FIND_SECTION(".rel.text", rel_text_hdr, unused_idx);
-    FIND_SECTION(".strtab", strtab_hdr, unused_idx);
-    FIND_SECTION(".text", text_hdr, text_idx);
-    FIND_SECTION(".data", data_hdr, data_idx);
-    FIND_SECTION(".bss", bss_hdr, bss_idx);
-    FIND_SECTION(".rodata", rodata_hdr, rodata_idx);
-  }
-
-  uint32_t text_offset = text_loc;
-  write_text(buffer + text_hdr->sh_offset, text_hdr->sh_size);
-
-  uint32_t data_offset = data_loc;
-  if (data_hdr != NULL)
-    write_data(buffer + data_hdr->sh_offset, data_hdr->sh_size);
-  uint32_t rodata_offset = data_loc;
-  if (rodata_hdr != NULL)
-    write_data(buffer + rodata_hdr->sh_offset, rodata_hdr->sh_size);
-  uint32_t bss_offset = data_loc;
-  if (bss_hdr != NULL) {
-    if (data_loc + bss_hdr->sh_size > DATA_CAP) {
-      printf("Too much data.\n");
-      exit(1);
+  case vWHILE:
+    pf->next += 2;
+    if (profile_use != NULL) stmt->counts = pf->counts + i;
+    else {
+      profile_count_at(&stmt->children->next, pf, i + 1);
+      ast_node_t *inc = profile_increment(pf, i);
+      inc->next = stmt;
+      *link = inc;
+      link = &inc->next;
     }
-    memset(data + data_loc, 0, bss_hdr->sh_size);
-    data_loc += bss_hdr->sh_size;
+    profile_stmt(&stmt->children->next, pf);
+    return link;
+
+  default:
+    return link;
   }
+}
 
-  char *strtab = (char *)(buffer + strtab_hdr->sh_offset);
-  Elf32_Sym *symtab = (Elf32_Sym *)(buffer + symtab_hdr->sh_offset);
-  Elf32_Sym *current = symtab;
-  while ((uintptr_t)current - (uintptr_t)symtab < symtab_hdr->sh_size) {
-    int32_t offset = -1;
-    loc_type_t loc_type = lDATA;
-    if (current->st_shndx == text_idx && text_hdr != NULL) {
-      offset = text_offset; loc_type = lTEXT;
+// makes calls to exit in `node` and its siblings call profile.exit, which
+// writes the profile first
+void profile_exit_calls(ast_node_t *node)
+{
+  for (; node != NULL; node = node->next) {
+    profile_exit_calls(node->children);
+    if (node->variant != vCALL || node->type != nEXPR) continue;
+    ast_node_t *callee = node->children;
+    if (callee->variant == vIDENT && strcmp(callee->s, "exit") == 0) {
+      callee->s = "profile.exit";
+      profile_exits = 1;
     }
-    if (current->st_shndx == data_idx && data_hdr != NULL) offset = data_offset;
-    if (current->st_shndx == rodata_idx && rodata_hdr != NULL) offset = rodata_offset;
-    if (current->st_shndx == bss_idx && bss_hdr != NULL) offset = bss_offset;
-    if (offset == -1) { ++current; continue; }
-    char *name = strtab + current->st_name;
-    symbol_t sym; memset(&sym, 0, sizeof(sym));
-    sym.name = name;
-    sym.type = tINT;
-    sym.loc = offset + current->st_value;
-    sym.loc_type = loc_type;
-    symtab_insert(root_symtab, sym);
-    ++current;
   }
+}
 
-  Elf32_Rel *rel = (Elf32_Rel *)(buffer + rel_text_hdr->sh_offset);
-  Elf32_Rel *current_rel = rel;
-  while ((uintptr_t)current_rel - (uintptr_t)rel < rel_text_hdr->sh_size) {
-    Elf32_Sym *sym = symtab + ELF32_R_SYM(current_rel->r_info);
-    relocation_type_t type = rOFFSET;
-    if (ELF32_R_TYPE(current_rel->r_info) == R_386_32) type = rIMM;
-    add_relocation(
-      text_offset + current_rel->r_offset,
-      strtab + sym->st_name,
-      root_symtab, type
-      );
-    ++current_rel;
-  }
+void write_word(uint32_t w)
+{
+  write_data((uint8_t *) &w, 4);
 }
 
-void read_archive(char *name)
+// -fprofile-generate: lays out the profile and adds the increments
+void profile_instrument(ast_node_t *ast)
 {
-  FILE *archive = fopen(name, "r");
-  fseek(archive, 0, SEEK_END);
-  uint32_t len = ftell(archive);
-  fseek(archive, 0, SEEK_SET);
-  uint8_t *buffer = malloc(len);
-  fread(buffer, 1, len, archive);
+  uint32_t funcs = 0;
+  for (ast_node_t *fn = ast; fn != NULL; fn = fn->next)
+    if (fn->type == nFUNCTION && ipa_body(fn)->variant == vBLOCK) ++funcs;
+
+  profile_start = DATA_START + data_loc;
+  write_word(PROFILE_MAGIC);
+  write_word(funcs);
+  for (ast_node_t *fn = ast; fn != NULL; fn = fn->next) {
+    if (fn->type != nFUNCTION || ipa_body(fn)->variant != vBLOCK) continue;
+    ast_node_t **link = &fn->children;
+    while ((*link)->type != nSTMT) link = &(*link)->next;
+    uint32_t n = 1 + profile_counters(*link);
+    write_word(profile_hash(fn->children, 5381));
+    write_word(n);
+    uint32_t len = strlen(fn->s) + 1;
+    write_data((uint8_t *) fn->s, len);
+    for (; len % 4; ++len) write_data((uint8_t *) "", 1);
+
+    profile_func_t pf = { .next = 1, .addr = DATA_START + data_loc };
+    for (uint32_t i = 0; i < n; ++i) write_word(0);
+    profile_count_at(link, &pf, 0);
+    profile_stmt(link, &pf);
+    profile_exit_calls(*link);
+  }
+  profile_size = DATA_START + data_loc - profile_start;
+  profile_file = DATA_START + data_loc;
+  write_data((uint8_t *) profile_generate, strlen(profile_generate) + 1);
+
+  if (!profile_exits) return;
+  symbol_t sym;
+  memset(&sym, 0, sizeof(symbol_t));
+  sym.name = "profile.exit";
+  sym.type = tVOID;
+  sym.loc = -1;
+  sym.loc_type = lTEXT;
+  symtab_insert(root_symtab, sym);
+}
 
-  if (len < 8 || strncmp((char *)buffer, "!<arch>\n", 8) != 0)
-    return;
+// the system calls of profile.exit in 64-bit code, with the code in %rdi:
+//   pushq %rdi
+//   movl $2, %eax              open(<file>, O_WRONLY | O_CREAT | O_TRUNC,
+//   movl $<file>, %edi              0644)
+//   movl $0x241, %esi
+//   movl $0644, %edx
+//   syscall
+//   testq %rax, %rax
+//   js 1f
+//   movq %rax, %rdi            write(fd, <profile>, <size>)
+//   movl $1, %eax
+//   movl $<profile>, %esi
+//   movl $<size>, %edx
+//   syscall
+//   movl $3, %eax              close(fd)
+//   syscall
+// 1:
+//   popq %rdi
+void profile_emit_exit64()
+{
+  uint8_t syscall[2] = { 0x0f, 0x05 };
+  emit_push((operand_t) { .type = oREG, .reg = EDI });
+  emit_load(EAX, (operand_t) { .type = oIMM, .val = 2 }, 0);
+  emit_load(EDI, (operand_t) { .type = oIMM, .val = profile_file }, 0);
+  emit_load(ESI, (operand_t) { .type = oIMM, .val = 0x241 }, 0);
+  emit_load(EDX, (operand_t) { .type = oIMM, .val = 0644 }, 0);
+  write_text(syscall, 2);
+  emit_test(EAX, EAX, 0);
+  uint8_t js[2] = { 0x78, 0 };
+  uint32_t at = text_loc;
+  write_text(js, 2);
+  emit_load(EDI, (operand_t) { .type = oREG, .reg = EAX }, 0);
+  emit_load(EAX, (operand_t) { .type = oIMM, .val = 1 }, 0);
+  emit_load(ESI, (operand_t) { .type = oIMM, .val = profile_start }, 0);
+  emit_load(EDX, (operand_t) { .type = oIMM, .val = profile_size }, 0);
+  write_text(syscall, 2);
+  emit_load(EAX, (operand_t) { .type = oIMM, .val = 3 }, 0);
+  write_text(syscall, 2);
+  text[at + 1] = text_loc - (at + 2);
+  emit_pop(EDI);
+}
 
-  uint32_t idx = 8;
-  while (idx < len) {
-    archive_header_t *header = (archive_header_t *)(buffer + idx);
-    uint32_t file_len = atoi(header->file_len);
-    read_elf(buffer + idx + sizeof(archive_header_t), file_len);
-    idx += file_len + sizeof(archive_header_t);
+// profile.exit(code):
+//   movl $5, %eax              open(<file>, O_WRONLY | O_CREAT | O_TRUNC,
+//   movl $<file>, %ebx              0644)
+//   movl $0x241, %ecx
+//   movl $0644, %edx
+//   int $0x80
+//   testl %eax, %eax
+//   js 1f
+//   movl %eax, %ebx            write(fd, <profile>, <size>)
+//   movl $4, %eax
+//   movl $<profile>, %ecx
+//   movl $<size>, %edx
+//   int $0x80
+//   movl $6, %eax              close(fd)
+//   int $0x80
+// 1:
+//   jmp exit                   with the return address and code in place
+void profile_emit_exit()
+{
+  if (!profile_exits) return;
+  uint32_t start = text_loc;
+  symtab_get(root_symtab, "profile.exit")->loc = text_loc;
+  if (target64) profile_emit_exit64();
+  else {
+    uint8_t syscall[2] = { 0xcd, 0x80 };
+    emit_load(EAX, (operand_t) { .type = oIMM, .val = 5 }, 0);
+    emit_load(EBX, (operand_t) { .type = oIMM, .val = profile_file }, 0);
+    emit_load(ECX, (operand_t) { .type = oIMM, .val = 0x241 }, 0);
+    emit_load(EDX, (operand_t) { .type = oIMM, .val = 0644 }, 0);
+    write_text(syscall, 2);
+    emit_test(EAX, EAX, 0);
+    uint8_t js[2] = { 0x78, 0 };
+    uint32_t at = text_loc;
+    write_text(js, 2);
+    emit_load(EBX, (operand_t) { .type = oREG, .reg = EAX }, 0);
+    emit_load(EAX, (operand_t) { .type = oIMM, .val = 4 }, 0);
+    emit_load(ECX, (operand_t) { .type = oIMM, .val = profile_start }, 0);
+    emit_load(EDX, (operand_t) { .type = oIMM, .val = profile_size }, 0);
+    write_text(syscall, 2);
+    emit_load(EAX, (operand_t) { .type = oIMM, .val = 6 }, 0);
+    write_text(syscall, 2);
+    text[at + 1] = text_loc - (at + 2);
   }
+  uint8_t jmp[5] = { 0xe9, 0, 0, 0, 0 };
+  add_relocation(text_loc + 1, "exit", root_symtab, rOFFSET);
+  write_text(jmp, 5);
+  order_add_unit(start, "profile.exit");
 }
 
-int main(int argc, char *argv[])
+// -fprofile-use: reads the profile and attaches the counts of the
+// functions that have not changed
+void profile_read(ast_node_t *ast)
 {
-  if (argc < 2) {
-    printf("Usage: nanoc <filename> [<archive>]\n");
-    return 1;
+  FILE *in = fopen(profile_use, "r");
+  if (in == NULL) {
+    printf("Could not read profile %s\n", profile_use);
+    exit(1);
+  }
+  uint32_t cap = 4096, size = 0, n;
+  uint8_t *buf = malloc(cap);
+  while ((n = fread(buf + size, 1, cap - size, in)) > 0) {
+    size += n;
+    if (size == cap) buf = realloc(buf, cap *= 2);
+  }
+  fclose(in);
+
+  uint32_t *words = (uint32_t *) buf;
+  if (size < 8 || words[0] != PROFILE_MAGIC) {
+    printf("Malformed profile %s\n", profile_use);
+    exit(1);
+  }
+  uint32_t at = 8;
+  for (uint32_t i = 0; i < words[1]; ++i) {
+    if (at + 8 > size) break;
+    uint32_t hash = *(uint32_t *) (buf + at);
+    uint32_t count = *(uint32_t *) (buf + at + 4);
+    char *name = (char *) buf + at + 8;
+    uint32_t len = strnlen(name, size - at - 8) + 1;
+    uint32_t *counts = (uint32_t *) (buf + at + 8 + ((len + 3) & ~3));
+    at += 8 + ((len + 3) & ~3) + 4 * count;
+    if (at > size) break;
+
+    for (ast_node_t *fn = ast; fn != NULL; fn = fn->next) {
+      if (fn->type != nFUNCTION || strcmp(fn->s, name) != 0) continue;
+      ast_node_t **link = &fn->children;
+      while ((*link)->type != nSTMT) link = &(*link)->next;
+      if ((*link)->variant != vBLOCK) continue;
+      if (
+        profile_hash(fn->children, 5381) != hash
+        || 1 + profile_counters(*link) != count
+        ) {
+        printf("Ignoring the profile of %s, which has changed\n", fn->s);
+        continue;
+      }
+      profile_func_t pf = { .next = 1, .counts = counts };
+      (*link)->counts = counts;
+      profile_stmt(link, &pf);
+    }
   }
+}
 
-  char *filename = argv[1];
+// compiles `filename` and links it with `archive`, if there is one. the
+// executable is left in text and data
+void compile(char *filename, char *archive)
+{
   input = fopen(filename, "r");
+  if (input == NULL) {
+    printf("Could not read %s\n", filename);
+    exit(1);
+  }
 
   root_symtab = malloc(sizeof(symbol_t) * SYMTAB_SIZE);
   memset(root_symtab, 0, sizeof(symbol_t) * SYMTAB_SIZE);
 
   ast_node_t *root = parse();
+  simplify(root);
+  if (profile_generate != NULL) profile_instrument(root);
+  else if (profile_use != NULL) profile_read(root);
+  if (opt_level >= 1) {
+    if (archive != NULL) read_archive(archive, scan_elf);
+    if (opt_level >= 2) ipcp(root);
+    find_regparm_funcs(root);
+  }
   codegen(root);
+  if (profile_generate != NULL) profile_emit_exit();
 
-  if (argc > 2) read_archive(argv[2]);
+  if (archive != NULL)
+    read_archive(archive, read_elf);
 
+  if (opt_level >= 2 && reorder_functions) order_functions();
   relocate();
 
   // temporary thing to have a non-empty data section
@@ -1895,9 +10518,200 @@ int main(int argc, char *argv[])
     memcpy(data, "asdf", 4);
     data_loc += 4;
   }
+}
+
+void print_stats()
+{
+  if (peephole_stats) {
+    for (uint32_t i = 0; i < PEEPHOLE_RULE_COUNT; ++i)
+      printf("%-14s %u\n", peephole_rules[i].name, peephole_rules[i].hits);
+  }
+
+  if (time_passes) {
+    for (uint32_t i = 0; i < pEND; ++i) {
+      if (passes[i].runs == 0) continue;
+      printf(
+        "%-14s %6u runs %10.3f ms\n", passes[i].name, passes[i].runs,
+        1000.0 * passes[i].time / CLOCKS_PER_SEC
+        );
+    }
+  }
+}
+
+// --run and --run-batch: the executable is written to a file that only
+// exists in memory and executed from there, without going through a.out
+#ifdef __linux__
+extern char **environ;
+
+// replaces nanoc with the compiled program, whose arguments are `args`
+void run_executable(char **args)
+{
+  int fd = memfd_create("a.out", MFD_CLOEXEC);
+  if (fd < 0) {
+    printf("Could not create an executable in memory\n");
+    exit(1);
+  }
+  FILE *out = fdopen(fd, "w");
+  write_elf(out);
+  fflush(out);
+  fflush(stdout);
+  fexecve(fd, args, environ);
+  printf("Could not run %s\n", args[0]);
+  exit(1);
+}
+
+// --run-batch: compiles and runs the programs named on standard input, one
+// per line, and prints how each of them exited. every program is compiled
+// by a child of nanoc, which starts from the state nanoc was in before any
+// of them, so that the archive is only read once, and becomes the program
+// once it is compiled. the child tells nanoc that it compiled the program
+// through a pipe that closes when it runs it
+int run_programs(char *archive)
+{
+  if (archive != NULL) load_archive(archive);
+  char line[4096];
+  while (fgets(line, sizeof(line), stdin) != NULL) {
+    line[strcspn(line, "\n")] = 0;
+    if (line[0] == 0) continue;
+
+    int ready[2];
+    if (pipe2(ready, O_CLOEXEC) < 0) {
+      printf("Could not create a pipe\n");
+      return 1;
+    }
+    fflush(stdout);
+    pid_t pid = fork();
+    if (pid < 0) {
+      printf("Could not start %s\n", line);
+      return 1;
+    }
+    if (pid == 0) {
+      // the programs do not read the list of programs. stdin is not closed,
+      // which would move the offset in the list that nanoc shares with it
+      close(ready[0]);
+      dup2(open("/dev/null", O_RDONLY), 0);
+      compile(line, archive);
+      char *args[2] = { line, NULL };
+      write(ready[1], "", 1);
+      run_executable(args);
+    }
+
+    close(ready[1]);
+    char c;
+    uint8_t compiled = read(ready[0], &c, 1) == 1;
+    close(ready[0]);
+    int status;
+    waitpid(pid, &status, 0);
+    if (!compiled) printf("%s: compile error\n", line);
+    else if (WIFSIGNALED(status))
+      printf("%s: signal %d\n", line, WTERMSIG(status));
+    else printf("%s: exit %d\n", line, WEXITSTATUS(status));
+  }
+  return 0;
+}
+#else
+void run_executable(char **args)
+{
+  printf("--run is only supported on Linux\n");
+  exit(1);
+}
+
+int run_programs(char *archive)
+{
+  printf("--run-batch is only supported on Linux\n");
+  return 1;
+}
+#endif
+
+int main(int argc, char *argv[])
+{
+  char *filename = NULL;
+  char *archive = NULL;
+  int program_args = argc; // the arguments after -- are the program's
+  for (int i = 1; i < argc; ++i) {
+    if (strcmp(argv[i], "--") == 0) {
+      program_args = i + 1;
+      break;
+    }
+    if (strcmp(argv[i], "-fshort-circuit") == 0) short_circuit = 1;
+    else if (strcmp(argv[i], "-fno-short-circuit") == 0) short_circuit = 0;
+    else if (strcmp(argv[i], "-fpeephole") == 0) peephole_enabled = 1;
+    else if (strcmp(argv[i], "-fno-peephole") == 0) peephole_enabled = 0;
+    else if (strcmp(argv[i], "--peephole-stats") == 0) peephole_stats = 1;
+    else if (strcmp(argv[i], "-O0") == 0) opt_level = 0;
+    else if (strcmp(argv[i], "-O1") == 0) opt_level = 1;
+    else if (strcmp(argv[i], "-O2") == 0) opt_level = 2;
+    else if (strcmp(argv[i], "--emit-ir") == 0) emit_ir = 1;
+    else if (strcmp(argv[i], "--time-passes") == 0) time_passes = 1;
+    else if (strcmp(argv[i], "-funroll-loops") == 0) unroll_loops = 1;
+    else if (strcmp(argv[i], "-fno-unroll-loops") == 0) unroll_loops = 0;
+    else if (strcmp(argv[i], "--unroll-report") == 0) unroll_report = 1;
+    else if (strcmp(argv[i], "--frame-report") == 0) frame_report = 1;
+    else if (strcmp(argv[i], "-freorder-functions") == 0)
+      reorder_functions = 1;
+    else if (strcmp(argv[i], "-fno-reorder-functions") == 0)
+      reorder_functions = 0;
+    else if (strcmp(argv[i], "--function-order-report") == 0)
+      function_order_report = 1;
+    else if (strncmp(argv[i], "-finline-limit=", 15) == 0)
+      inline_limit = atoi(argv[i] + 15);
+    else if (strcmp(argv[i], "-fschedule-insns") == 0) schedule_insns = 1;
+    else if (strcmp(argv[i], "-fno-schedule-insns") == 0) schedule_insns = 0;
+    else if (strcmp(argv[i], "-fprofile-generate") == 0)
+      profile_generate = "nanoc.prof";
+    else if (strncmp(argv[i], "-fprofile-generate=", 19) == 0)
+      profile_generate = argv[i] + 19;
+    else if (strcmp(argv[i], "-fprofile-use") == 0) profile_use = "nanoc.prof";
+    else if (strncmp(argv[i], "-fprofile-use=", 14) == 0)
+      profile_use = argv[i] + 14;
+    else if (strcmp(argv[i], "--run") == 0) run = 1;
+    else if (strcmp(argv[i], "--run-batch") == 0) run = run_batch = 1;
+    else if (strcmp(argv[i], "-m32") == 0) target64 = 0;
+    else if (strcmp(argv[i], "-m64") == 0) target64 = 1;
+    else if (strncmp(argv[i], "-mtune=", 7) == 0) {
+      for (mtune = 0; mtune < TUNE_COUNT; ++mtune)
+        if (strcmp(argv[i] + 7, tunes[mtune].name) == 0) break;
+      if (mtune == TUNE_COUNT) {
+        printf("Unknown CPU '%s'\n", argv[i] + 7);
+        return 1;
+      }
+    }
+    else if (argv[i][0] == '-') {
+      printf("Unknown option '%s'\n", argv[i]);
+      return 1;
+    } else if (filename == NULL) filename = argv[i];
+    else if (archive == NULL) archive = argv[i];
+  }
+
+  if (filename == NULL && !run_batch) {
+    printf("Usage: nanoc [<options>] <filename> [<archive>] [-- <args>]\n");
+    printf("       nanoc [<options>] --run-batch [<archive>]\n");
+    return 1;
+  }
+
+  // the IR passes and the peephole optimizer only know 32-bit code
+  if (target64 && opt_level > 0) {
+    printf("-m64 only supports -O0, not -O%u\n", opt_level);
+    return 1;
+  }
+  if (target64) peephole_enabled = 0;
+
+  // the only file named with --run-batch is the archive
+  if (run_batch) return run_programs(filename);
+  compile(filename, archive);
+  if (run) {
+    print_stats();
+    char **args = malloc((argc - program_args + 2) * sizeof(char *));
+    uint32_t n = 0;
+    args[n++] = filename;
+    for (int i = program_args; i < argc; ++i) args[n++] = argv[i];
+    args[n] = NULL;
+    run_executable(args);
+  }
 
   FILE *out = fopen("a.out", "w");
   write_elf(out);
+  print_stats();
 
   return 0;
 }
@@ -0,0 +1,106 @@
+void exit(int code);
+
+int failures;
+
+int check_div(int x, int d, int q, int r)
+{
+  if (q != (x / d)) { failures = (failures + 1); }
+  if (r != (x % d)) { failures = (failures + 1); }
+  return 0;
+}
+
+int check_mul(int x, int c, int p)
+{
+  if (p != (x * c)) { failures = (failures + 1); }
+  return 0;
+}
+
+int sweep(int x)
+{
+  check_div(x, 1, x / 1, x % 1);
+  check_div(x, 2, x / 2, x % 2);
+  check_div(x, 3, x / 3, x % 3);
+  check_div(x, 4, x / 4, x % 4);
+  check_div(x, 5, x / 5, x % 5);
+  check_div(x, 6, x / 6, x % 6);
+  check_div(x, 7, x / 7, x % 7);
+  check_div(x, 8, x / 8, x % 8);
+  check_div(x, 9, x / 9, x % 9);
+  check_div(x, 10, x / 10, x % 10);
+  check_div(x, 11, x / 11, x % 11);
+  check_div(x, 12, x / 12, x % 12);
+  check_div(x, 13, x / 13, x % 13);
+  check_div(x, 16, x / 16, x % 16);
+  check_div(x, 25, x / 25, x % 25);
+  check_div(x, 60, x / 60, x % 60);
+  check_div(x, 64, x / 64, x % 64);
+  check_div(x, 100, x / 100, x % 100);
+  check_div(x, 125, x / 125, x % 125);
+  check_div(x, 641, x / 641, x % 641);
+  check_div(x, 1000, x / 1000, x % 1000);
+  check_div(x, 1024, x / 1024, x % 1024);
+  check_div(x, 7919, x / 7919, x % 7919);
+  check_div(x, 65536, x / 65536, x % 65536);
+  check_div(x, 1000000, x / 1000000, x % 1000000);
+  check_div(x, 2147483647, x / 2147483647, x % 2147483647);
+  check_div(x, (0 - 1), x / (0 - 1), x % (0 - 1));
+  check_div(x, (0 - 2), x / (0 - 2), x % (0 - 2));
+  check_div(x, (0 - 3), x / (0 - 3), x % (0 - 3));
+  check_div(x, (0 - 7), x / (0 - 7), x % (0 - 7));
+  check_div(x, (0 - 8), x / (0 - 8), x % (0 - 8));
+  check_div(x, (0 - 10), x / (0 - 10), x % (0 - 10));
+  check_div(x, (0 - 1000), x / (0 - 1000), x % (0 - 1000));
+  check_div(x, (0 - 65536), x / (0 - 65536), x % (0 - 65536));
+  check_div(x, (0 - 2147483647), x / (0 - 2147483647), x % (0 - 2147483647));
+  check_mul(x, 0, x * 0);
+  check_mul(x, 1, x * 1);
+  check_mul(x, 2, x * 2);
+  check_mul(x, 3, x * 3);
+  check_mul(x, 5, x * 5);
+  check_mul(x, 6, x * 6);
+  check_mul(x, 7, x * 7);
+  check_mul(x, 9, x * 9);
+  check_mul(x, 10, x * 10);
+  check_mul(x, 12, x * 12);
+  check_mul(x, 15, x * 15);
+  check_mul(x, 18, x * 18);
+  check_mul(x, 24, x * 24);
+  check_mul(x, 25, x * 25);
+  check_mul(x, 27, x * 27);
+  check_mul(x, 40, x * 40);
+  check_mul(x, 45, x * 45);
+  check_mul(x, 72, x * 72);
+  check_mul(x, 81, x * 81);
+  check_mul(x, 100, x * 100);
+  check_mul(x, 1024, x * 1024);
+  check_mul(x, (0 - 1), x * (0 - 1));
+  check_mul(x, (0 - 2), x * (0 - 2));
+  check_mul(x, (0 - 3), x * (0 - 3));
+  check_mul(x, (0 - 4), x * (0 - 4));
+  check_mul(x, (0 - 9), x * (0 - 9));
+  check_mul(x, (0 - 10), x * (0 - 10));
+  check_mul(x, (0 - 15), x * (0 - 15));
+  check_mul(x, (0 - 24), x * (0 - 24));
+  return 0;
+}
+
+void _start()
+{
+  int i;
+  i = (0 - 5000);
+  while (i < 5000) {
+    sweep(i);
+    i = (i + 1);
+  }
+
+  i = 0;
+  while (i < 1000) {
+    sweep(2147483647 - i);
+    sweep((0 - 2147483647) + i);
+    sweep(i * 65521);
+    sweep(0 - (i * 65521));
+    i = (i + 1);
+  }
+
+  exit(failures);
+}
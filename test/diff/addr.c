@@ -0,0 +1,42 @@
+void exit(int code);
+
+void bump(int *p, int by)
+{
+  *p = (*p + by);
+}
+
+int through(int n)
+{
+  int kept; int promoted;
+  kept = n;
+  promoted = n;
+  bump(&kept, 3);
+  promoted = (promoted + 3);
+  bump(&kept, promoted);
+  return (kept - promoted);
+}
+
+int nested(int n)
+{
+  int i; int j; int s;
+  i = 0; s = 0;
+  while (i < n) {
+    j = 0;
+    while (j < i) {
+      if ((j % 3) == 0) {
+        j = (j + 1);
+        continue;
+      }
+      s = (s + (i * j));
+      if (s > 5000) { break; }
+      j = (j + 1);
+    }
+    i = (i + 1);
+  }
+  return s;
+}
+
+void _start()
+{
+  exit(((through(4) + nested(12)) % 256));
+}
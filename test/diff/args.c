@@ -0,0 +1,38 @@
+void exit(int code);
+
+int *slot;
+
+int spread(int a, int b, char c, int d, int e, int f, int g, char h)
+{
+  return ((((a - b) + (c * d)) + ((e - f) * g)) + h);
+}
+
+void point(int **pp, int *p)
+{
+  *pp = p;
+}
+
+int follow(int **pp)
+{
+  return (*(*pp));
+}
+
+int wrap(int x)
+{
+  return ((x * 65536) * 65536);
+}
+
+void _start()
+{
+  int v;
+  int *p;
+  int **pp;
+  v = 7;
+  p = (&v);
+  pp = (&p);
+  *(*pp) = (v + 5);
+  point((&slot), (&v));
+  v = (follow((&slot)) + spread(1, 2, 3, 4, 50, 6, 2, (0 - 9)));
+  v = (v + spread(v, follow(pp), 100, 3, 9, 4, v, 27));
+  exit(((v + wrap(v)) & 127));
+}
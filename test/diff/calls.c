@@ -0,0 +1,43 @@
+void exit(int code);
+
+int ack(int m, int n)
+{
+  if (m == 0) { return (n + 1); }
+  if (n == 0) { return ack((m - 1), 1); }
+  return ack((m - 1), ack(m, (n - 1)));
+}
+
+int collatz(int n)
+{
+  int steps;
+  steps = 0;
+  while (n != 1) {
+    if ((n % 2) == 0) {
+      n = (n / 2);
+    } else {
+      n = ((n * 3) + 1);
+    }
+    steps = (steps + 1);
+  }
+  return steps;
+}
+
+int divs(int x)
+{
+  int q; int r;
+  q = (x / 7);
+  r = (x % 7);
+  if ((((q * 7) + r) != x)) { return 1; }
+  q = ((0 - x) / 7);
+  r = ((0 - x) % 7);
+  if ((((q * 7) + r) != (0 - x))) { return 2; }
+  return 0;
+}
+
+void _start()
+{
+  int sum;
+  sum = (ack(2, 3) + collatz(27));
+  sum = (sum + (divs(100) + divs(12345)));
+  exit((sum % 256));
+}
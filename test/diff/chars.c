@@ -0,0 +1,57 @@
+void exit(int code);
+
+char wrap(char c, int n)
+{
+  while (n > 0) {
+    c = (c + 37);
+    n = (n - 1);
+  }
+  return c;
+}
+
+char square(char c)
+{
+  return (c * c);
+}
+
+int count(char *s, char c)
+{
+  int n;
+  n = 0;
+  while ((*s) != 0) {
+    if ((*s) == c) {
+      n = (n + 1);
+    }
+    s = (s + 1);
+  }
+  return n;
+}
+
+int mixed(char a, int b)
+{
+  int d;
+  char c;
+  c = (a * 3);
+  d = (c - b);
+  if (c < b) {
+    return (d * 2);
+  }
+  return (c + d);
+}
+
+void _start()
+{
+  int sum;
+  char ch;
+  char *p;
+  ch = 100;
+  ch = (ch + 100);
+  sum = (ch + wrap(5, 9));
+  sum = (sum + square(ch));
+  sum = (sum + count("a banana bread", 'a'));
+  sum = (sum + mixed(ch, (0 - 200)));
+  p = (&ch);
+  *p = (ch * ch);
+  sum = (sum + (ch * 7));
+  exit((sum & 127));
+}
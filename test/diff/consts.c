@@ -0,0 +1,42 @@
+void exit(int code);
+
+int flag;
+
+int pick(int n)
+{
+  int k; int r;
+  k = 4;
+  r = 0;
+  if ((k * 2) == 8) {
+    r = (n + k);
+  } else {
+    r = (n - k);
+  }
+  while (k < 4) {
+    r = (r + 1000);
+    k = (k + 1);
+  }
+  if (flag) {
+    r = (r * 3);
+  }
+  return r;
+}
+
+int unused(int n)
+{
+  int dead; int live;
+  dead = (n * 7);
+  live = (n + 1);
+  dead = (dead + live);
+  return live;
+}
+
+void _start()
+{
+  int sum;
+  sum = pick(5);
+  flag = 1;
+  sum = (sum + pick(2));
+  sum = (sum + unused(10));
+  exit(sum);
+}
@@ -0,0 +1,41 @@
+void exit(int code);
+
+int g;
+
+int same(int a, int b)
+{
+  int x; int y; int z;
+  x = ((a * b) + (a - b));
+  y = ((b * a) + (a - b));
+  z = 0;
+  if ((a * b) > 10) {
+    z = ((a * b) - 10);
+  }
+  if (a == b) { z = (z + 1); }
+  if (a == b) { z = (z + 2); }
+  if (a != b) {
+    if (a == b) { z = (z + 100); }
+  }
+  return ((x - y) + z);
+}
+
+int loads(int *p)
+{
+  int s;
+  s = ((*p) + (*p));
+  *p = 5;
+  s = (s + (*p));
+  g = 3;
+  s = (s + (g + g));
+  return s;
+}
+
+void _start()
+{
+  int v; int sum;
+  v = 7;
+  sum = (same(3, 4) + same(5, 5));
+  sum = (sum + loads(&v));
+  sum = (sum + v);
+  exit((sum % 256));
+}
@@ -0,0 +1,59 @@
+void exit(int code);
+
+int g;
+int h;
+
+int setg(int v)
+{
+  g = v;
+  return 1;
+}
+
+int seth(int v)
+{
+  h = v;
+  return 2;
+}
+
+int binary()
+{
+  int t; int s;
+  g = 5;
+  t = (g + setg(100));
+  g = 5;
+  s = (g - setg(7));
+  g = 5;
+  s = (s + (setg(9) - g));
+  g = 5;
+  if (g < setg(3)) { s = (s + 1); }
+  g = 5; h = 4;
+  s = (s + ((g * h) - ((setg(1) + seth(2)) * (g + h))));
+  g = 2;
+  s = (s + (((g * 3) + (g * 5)) - (((setg(6) * 2) + (g * 7)) + (g * 11))));
+  g = 5; h = 4;
+  s = (s + ((g * h) - ((g * h) - ((g * h) - (setg(3) - (g * h))))));
+  return (t + s);
+}
+
+int compound()
+{
+  int *p; int s;
+  g = 5;
+  g -= setg(100);
+  s = g;
+  g = 5;
+  g += setg(20);
+  s = (s + g);
+  h = 10;
+  p = (&h);
+  *p -= seth(30);
+  s = (s + h);
+  h = 3;
+  *p *= (seth(4) + h);
+  return (s + h);
+}
+
+void _start()
+{
+  exit((((binary() + compound()) + 128) % 128));
+}
@@ -0,0 +1,32 @@
+void exit(int code);
+
+char twice(char c)
+{
+  return (c + c);
+}
+
+char shout()
+{
+  char c;
+  char *p;
+  c = 'a';
+  p = (&c);
+  *p = ((*p) - 32);
+  return c;
+}
+
+int count(int n)
+{
+  char seen;
+  seen = 0;
+  while (n > 0) {
+    seen = (seen + 3);
+    n = (n - 1);
+  }
+  return seen;
+}
+
+void _start()
+{
+  exit((((twice(21) + shout()) + count(40)) & 127));
+}
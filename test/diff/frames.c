@@ -0,0 +1,36 @@
+void exit(int code);
+
+int pick(int n, int *out)
+{
+  int r;
+  if (n > 3) {
+    int a;
+    char c;
+    int b;
+    a = (n * 2);
+    c = 5;
+    b = (a + c);
+    r = b;
+  } else {
+    int d;
+    d = (n + 1);
+    r = d;
+  }
+  *out = r;
+  return r;
+}
+
+int user(int n)
+{
+  int kept;
+  int x;
+  char t;
+  x = pick(n, (&kept));
+  t = 3;
+  return ((kept + x) + t);
+}
+
+void _start()
+{
+  exit(user(7));
+}
@@ -0,0 +1,58 @@
+void exit(int code);
+int total;
+int square(int val)
+{
+  return (val * val);
+}
+int clamp(int val, int hi)
+{
+  if (val > hi) {
+    return hi;
+  }
+  return val;
+}
+int bump(int val)
+{
+  val = (val + 1);
+  total = (total + val);
+  return val;
+}
+int via(int val)
+{
+  int *ptr;
+  ptr = (&val);
+  *ptr = (val * 2);
+  return val;
+}
+int fact(int num)
+{
+  if (num < 2) {
+    return 1;
+  }
+  return (num * fact((num - 1)));
+}
+void noop(int val)
+{
+  total = (total + val);
+}
+int twice(int val)
+{
+  return (square(val) + clamp(val, 5));
+}
+void _start()
+{
+  int res;
+  int idx;
+  res = 0;
+  idx = 0;
+  total = 0;
+  while (idx < 10) {
+    res = (res + twice(idx));
+    res = (res + bump(idx));
+    idx = (idx + 1);
+  }
+  noop(3);
+  res = (res + via(7));
+  res = (res + fact(5));
+  exit(((res + total) & 255));
+}
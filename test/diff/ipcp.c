@@ -0,0 +1,62 @@
+void exit(int code);
+int gsum;
+
+int square(int n)
+{
+  return (n * n);
+}
+
+int fib(int n)
+{
+  if (n < 2) {
+    return n;
+  }
+  return (fib((n - 1)) + fib((n - 2)));
+}
+
+char wrap(char c, int k)
+{
+  int i;
+  i = 0;
+  while (i < k) {
+    c = (c + 50);
+    ++i;
+  }
+  return c;
+}
+
+int scaled(int x, int scale)
+{
+  gsum = (gsum + x);
+  return (x * scale);
+}
+
+int table_size(int entries, int width)
+{
+  return (entries * width);
+}
+
+int loop(int n)
+{
+  int s;
+  int i;
+  s = 0;
+  i = 0;
+  while (i < n) {
+    s = (s + scaled(i, 3));
+    s = (s + table_size(4, 8));
+    i = (i + 1);
+  }
+  return s;
+}
+
+void _start()
+{
+  int r;
+  gsum = 0;
+  r = (square(7) + fib(10));
+  r = (r + wrap(3, 4));
+  r = (r + loop(10));
+  r = (r + scaled(5, 3));
+  exit(((r + gsum) & 255));
+}
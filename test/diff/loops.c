@@ -0,0 +1,90 @@
+void exit(int code);
+
+int hits;
+char seen;
+
+int sum_words(int *buf, int n)
+{
+  int i; int acc;
+  i = 0; acc = 0;
+  while (i < n) {
+    acc = (acc + (*(buf + (i * 4))));
+    i = (i + 1);
+  }
+  return acc;
+}
+
+void fill_words(int *buf, int n, int scale)
+{
+  int i;
+  i = 0;
+  while (i < n) {
+    *(buf + (i * 4)) = ((i * scale) + (scale * 7));
+    i = (i + 1);
+  }
+}
+
+void copy_bytes(char *dst, char *src, int n)
+{
+  int k;
+  k = 0;
+  while (n > 0) {
+    *(dst + k) = (*(src + k));
+    k = (k + 1);
+    n = (n - 1);
+  }
+}
+
+int scan(char *str)
+{
+  int len;
+  len = 0;
+  while (*(str + len)) len = (len + 1);
+  return len;
+}
+
+int count_up(int n, int limit)
+{
+  int i;
+  i = 0;
+  while (i < n) {
+    if ((i % 3) == 0) { hits = (hits + i); }
+    seen = i;
+    if (hits > limit) { return i; }
+    i = (i + 1);
+  }
+  return (0 - 1);
+}
+
+int nested(int n)
+{
+  int i; int j; int s;
+  i = 0; s = 0;
+  while (i < n) {
+    j = 0;
+    while (j < n) {
+      s = (s + ((i * n) + j));
+      j = (j + 1);
+    }
+    hits = (hits + 1);
+    i = (i + 1);
+  }
+  return s;
+}
+
+void _start()
+{
+  int *words; char *text; char *copy; int s;
+  words = "................................";
+  text = "loops!!";
+  copy = "........";
+  fill_words(words, 8, 3);
+  s = sum_words(words, 8);
+  copy_bytes(copy, text, 8);
+  s = (s + scan(copy));
+  s = (s + count_up(40, 100));
+  s = (s + (hits + seen));
+  s = (s + nested(6));
+  s = (s + count_up(0, 0));
+  exit((s % 256));
+}
@@ -0,0 +1,48 @@
+void exit(int code);
+int later(int x);
+
+int twice(int x)
+{
+  return (x + x);
+}
+
+int apply(void *f, int x)
+{
+  return f(x);
+}
+
+int pick(int n)
+{
+  void *f;
+  f = twice;
+  if (n > 3) {
+    f = later;
+  }
+  return apply(f, n);
+}
+
+int later(int x)
+{
+  return ((x * 3) + 1);
+}
+
+void _start()
+{
+  int sum;
+  void *p;
+  void *q;
+  p = twice;
+  q = (&later);
+  sum = 0;
+  while (sum < 20) {
+    sum = (sum + pick(2));
+  }
+  sum = (sum + pick(5));
+  if (p == twice) {
+    sum = (sum + 1);
+  }
+  if (q != p) {
+    sum = (sum + q(4));
+  }
+  exit(sum);
+}
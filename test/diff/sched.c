@@ -0,0 +1,53 @@
+void exit(int code);
+
+int g;
+int h;
+char c;
+
+int mix(int *p, int *q, int a)
+{
+  int x;
+  int y;
+  x = (*p);
+  *q = (x + a);
+  y = (*p);
+  x = (x * a);
+  y = (y * (*q));
+  g = (x + y);
+  h = (g - x);
+  return ((x * y) + h);
+}
+
+int bytes(char *s, int n)
+{
+  int sum;
+  char b;
+  sum = 0;
+  while (n > 0) {
+    b = (*s);
+    *s = (b + 1);
+    sum = ((sum * 3) + (*s));
+    c = ((*s) < b);
+    sum = (sum + c);
+    s = (s + 1);
+    n = (n - 1);
+  }
+  return sum;
+}
+
+void _start()
+{
+  int a;
+  int b;
+  int r;
+  a = 3;
+  b = 4;
+  g = 7;
+  r = mix((&a), (&b), 5);
+  r = (r + mix((&a), (&a), 2));
+  r = (r + (b * a));
+  a = 1684234849;
+  r = (r + bytes((&a), 4));
+  r = (r + a);
+  exit((r & 255));
+}
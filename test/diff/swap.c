@@ -0,0 +1,36 @@
+void exit(int code);
+
+int fib(int n)
+{
+  int a; int b; int t;
+  a = 0; b = 1;
+  while (n > 0) {
+    t = a;
+    a = b;
+    b = (t + b);
+    n = (n - 1);
+  }
+  return a;
+}
+
+int rotate(int n)
+{
+  int x; int y; int z; int t;
+  x = 1; y = 2; z = 3;
+  while (n > 0) {
+    t = x;
+    x = y;
+    y = z;
+    z = t;
+    n = (n - 1);
+  }
+  return ((x * 100) + ((y * 10) + z));
+}
+
+void _start()
+{
+  int sum;
+  sum = (fib(20) + rotate(7));
+  sum = (sum + (fib(1) + rotate(0)));
+  exit((sum % 251));
+}
@@ -0,0 +1,53 @@
+void exit(int code);
+int total;
+int sum_to(int num, int acc)
+{
+  if (num == 0) {
+    return acc;
+  }
+  return sum_to((num - 1), (acc + num));
+}
+int gcd(int aa, int bb)
+{
+  if (bb == 0) {
+    return aa;
+  }
+  return gcd(bb, (aa % bb));
+}
+int odd(int num);
+int even(int num)
+{
+  if (num == 0) {
+    return 1;
+  }
+  return odd((num - 1));
+}
+int odd(int num)
+{
+  if (num == 0) {
+    return 0;
+  }
+  return even((num - 1));
+}
+void count(int num)
+{
+  if (num > 0) {
+    total = (total + num);
+    count((num - 1));
+  }
+}
+int swap_args(int aa, int bb, int cc)
+{
+  return gcd(cc, aa);
+}
+void _start()
+{
+  int res;
+  total = 0;
+  res = sum_to(5000, 0);
+  res = (res + gcd(1071, 462));
+  res = (res + even(5001));
+  count(3000);
+  res = (res + swap_args(12, 5, 18));
+  exit(((res + total) & 127));
+}
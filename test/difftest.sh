@@ -0,0 +1,95 @@
+#!/bin/sh
+# differential test: every program in test/diff is compiled at -O0, -O1 and
+# -O2 and must print the same output and exit with the same status at every
+# level. the programs report what they computed through their exit status.
+# every program in test/check checks its own results and must exit with
+# status 0 at every level.
+#
+# usage: test/difftest.sh <archive> [<runner>]
+#
+# <runner> is a command that runs the executable it is given, for testing on
+# a machine that cannot run nanoc's output directly (an emulator, or a script
+# that copies it to the target). by default the programs are run with
+# nanoc --run. a program that exits with status 126, 127 or 128 and above did
+# not run or was killed by a signal, so the test programs exit below 128.
+
+archive=$1
+runner=$2
+nanoc=${NANOC:-$(pwd)/nanoc}
+dir=$(cd "$(dirname "$0")" && pwd)
+tmp=$(mktemp -d)
+failed=0
+
+if [ -z "$archive" ]; then
+  echo "usage: $0 <archive> [<runner>]"
+  exit 2
+fi
+case $archive in
+  /*) ;;
+  *) archive=$(pwd)/$archive ;;
+esac
+
+# compiles and runs $1 at $2 in $tmp/<name>$2, leaving its output and exit
+# status there. fails if the program does not compile or does not run
+run() {
+  out=$tmp/$(basename "$1" .c)$2
+  mkdir -p "$out"
+  if ! (cd "$out" && "$nanoc" $2 "$1" "$archive" > /dev/null); then
+    echo "FAIL $(basename "$1" .c) $2: does not compile"
+    failed=1
+    return 1
+  fi
+  if [ -z "$runner" ]; then
+    (cd "$out" && "$nanoc" $2 --run "$1" "$archive" > stdout 2>&1
+     echo $? > status)
+  else
+    chmod +x "$out/a.out"
+    (cd "$out" && $runner ./a.out > stdout 2>&1; echo $? > status)
+  fi
+  status=$(cat "$out/status")
+  if [ "$status" -ge 128 ] || [ "$status" = 126 ] || [ "$status" = 127 ]
+  then
+    echo "FAIL $(basename "$1" .c) $2: does not run (exit status $status)"
+    failed=1
+    rm "$out/status"
+    return 1
+  fi
+}
+
+for src in "$dir"/diff/*.c; do
+  name=$(basename "$src" .c)
+  for level in -O0 -O1 -O2; do
+    run "$src" $level
+  done
+
+  for level in -O1 -O2; do
+    [ -f "$tmp/$name-O0/status" ] && [ -f "$tmp/$name$level/status" ] ||
+      continue
+    if
+      cmp -s "$tmp/$name-O0/stdout" "$tmp/$name$level/stdout" &&
+      cmp -s "$tmp/$name-O0/status" "$tmp/$name$level/status"
+    then
+      echo "ok   $name $level"
+    else
+      echo "FAIL $name $level: exit status $(cat "$tmp/$name$level/status"), \
+-O0 exits with $(cat "$tmp/$name-O0/status")"
+      failed=1
+    fi
+  done
+done
+
+for src in "$dir"/check/*.c; do
+  name=$(basename "$src" .c)
+  for level in -O0 -O1 -O2; do
+    run "$src" $level || continue
+    if [ "$(cat "$tmp/$name$level/status")" = 0 ]; then
+      echo "ok   $name $level"
+    else
+      echo "FAIL $name $level: exit status $(cat "$tmp/$name$level/status")"
+      failed=1
+    fi
+  done
+done
+
+rm -rf "$tmp"
+exit $failed